@@ -0,0 +1,79 @@
+#ifndef ADAPTIVE_SPHERE_H
+#define ADAPTIVE_SPHERE_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <vector>
+#include <cmath>
+
+#include "Figures.h"
+#include "MeshLibrary.h"
+
+// Coarse cube-sphere of quad patches, refined on the GPU by the tessellation shaders in ShaderData/Planets
+class TessellatedSphere
+{
+public:
+	static bool isSupported()
+	{
+		return GLVersion.major >= 4;
+	}
+
+	// Every body shares the same patches from the MeshLibrary and scales them with its model matrix
+	TessellatedSphere(int patchesPerEdge = 16)
+		: patches(MeshLibrary::instance().cubeSphere(patchesPerEdge))
+	{
+	}
+
+	void render()
+	{
+		MeshLibrary::instance().draw(patches);
+	}
+
+private:
+	MeshHandle patches;
+};
+
+// Fallback without tessellation shaders: a few static resolutions picked by projected size
+class SphereLODSet
+{
+public:
+	SphereLODSet()
+	{
+		static const int sectorCounts[] = { 18, 36, 72, 144, 288 };
+
+		for (int sectors : sectorCounts)
+		{
+			levels.push_back(MeshLibrary::instance().sphere(sectors, sectors / 2));
+			levelSectors.push_back(sectors);
+		}
+	}
+
+	// Smallest level whose chord sag, r * pi^2 / (2 * sectors^2), stays under a pixel
+	void select(float projectedRadiusPixels)
+	{
+		current = levels.size() - 1;
+		for (size_t i = 0; i < levels.size(); i++)
+		{
+			float s = (float)levelSectors[i];
+			if (projectedRadiusPixels * PI * PI / (2.0f * s * s) <= 1.0f)
+			{
+				current = i;
+				break;
+			}
+		}
+	}
+
+	// Unit spheres drawn with the regular planet shader and model matrix
+	void render()
+	{
+		MeshLibrary::instance().draw(levels[current]);
+	}
+
+private:
+	std::vector<MeshHandle> levels;
+	std::vector<int> levelSectors;
+	size_t current = 1;
+};
+
+#endif
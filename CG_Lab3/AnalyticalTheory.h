@@ -0,0 +1,311 @@
+#ifndef ANALYTICAL_THEORY_H
+#define ANALYTICAL_THEORY_H
+
+#include <glm/glm.hpp>
+
+#include <vector>
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+#include "SimdMath.h"
+#include "Kepler.h"
+
+// Positions as VSOP-style periodic series: each rectangular coordinate is
+//   sum over a of T^a * sum A cos(B + C T), T in Julian millennia from J2000,
+// with the a = 0 and a = 1 series. Terms come from expanding an elliptic orbit in multiples of its
+// mean anomaly. Turning the ellipse by its argument of periapsis and node makes every argument a
+// combination k M + j w + l N, so their steady precession is exact, and the slow drift of a, e and i
+// gives the a = 1 terms.
+// The full series is kept, and truncate() picks the terms that meet an accuracy, smallest first.
+class AnalyticalTheory
+{
+public:
+	// The a = 1 terms grow with T, truncation weighs them at the edge of the rates' span (1800-2050)
+	static constexpr double validMillennia = 0.2;
+
+	// Elements at J2000 and their drift per Julian century, the mean anomaly rate being the mean motion
+	size_t addBody(const OrbitalElements& elements, const OrbitalElements& ratesPerCentury)
+	{
+		Body body;
+		body.scale = elements.semiMajorAxis;
+
+		// Elements one century either side give the drift of the amplitudes
+		const double h = 1.0;
+		OrbitalElements before = shift(elements, ratesPerCentury, -h), after = shift(elements, ratesPerCentury, h);
+
+		std::vector<double> now, earlier, later;
+		expand(elements, now);
+		expand(before, earlier);
+		expand(after, later);
+
+		// Angles and their rates per millennium
+		double M = elements.meanAnomaly, w = elements.argumentOfPeriapsis, N = elements.ascendingNode;
+		double dM = ratesPerCentury.meanAnomaly * 10.0, dw = ratesPerCentury.argumentOfPeriapsis * 10.0, dN = ratesPerCentury.ascendingNode * 10.0;
+
+		for (int m = -(int)harmonics; m <= (int)harmonics; m++)
+		{
+			size_t index = (size_t)(m + (int)harmonics);
+
+			// In the node's frame the orbit is w = sum d_m e^(i (m M + w)). Inclining it and turning by N,
+			// X + iY = e^(iN) ((1 + cos i) / 2 w + (1 - cos i) / 2 conj(w)) and Z = sin i Im(w)
+			for (int family = 0; family < 5; family++)
+			{
+				int sign = family == 1 || family == 3 ? -1 : 1;
+				int coordinate = family < 2 ? 0 : family < 4 ? 1 : 2;
+				double node = coordinate == 2 ? 0.0 : 1.0;
+				double shiftPhase = coordinate == 0 ? 0.0 : -0.5 * pi;
+
+				double phase = sign * (m * M + w) + node * N + shiftPhase;
+				double frequency = sign * (m * dM + dw) + node * dN;
+
+				double constant = amplitude(elements, now[index], family);
+				double drift = (amplitude(after, later[index], family) - amplitude(before, earlier[index], family)) * (10.0 / (2.0 * h));
+
+				addTerm(body.full[coordinate][0], constant, phase, frequency, body.scale);
+				addTerm(body.full[coordinate][1], drift, phase, frequency, body.scale);
+			}
+		}
+
+		bodies.push_back(body);
+		truncateBody(bodies.back(), 0.0);
+		return bodies.size() - 1;
+	}
+
+	size_t size() const
+	{
+		return bodies.size();
+	}
+
+	// Drops terms while the sum of their largest contributions stays under the given angle, seen
+	// from the parent at the body's mean distance. Zero keeps the whole series.
+	void truncate(double arcseconds)
+	{
+		for (Body& body : bodies)
+			truncateBody(body, arcseconds);
+	}
+
+	size_t termCount() const
+	{
+		size_t count = 0;
+		for (const Body& body : bodies)
+			count += body.terms;
+		return count;
+	}
+
+	size_t fullTermCount() const
+	{
+		size_t count = 0;
+		for (const Body& body : bodies)
+			for (int coordinate = 0; coordinate < 3; coordinate++)
+				count += body.full[coordinate][0].amplitude.size() + body.full[coordinate][1].amplitude.size();
+		return count;
+	}
+
+	// Position relative to the parent, in the ecliptic frame of the elements
+	glm::dvec3 position(size_t index, double day) const
+	{
+		const Body& body = bodies[index];
+		double t = day / 365250.0;
+
+		glm::dvec3 result;
+		for (int coordinate = 0; coordinate < 3; coordinate++)
+			result[coordinate] = sum(body.active[coordinate][0], t) + t * sum(body.active[coordinate][1], t);
+		return result;
+	}
+
+private:
+	// Multiples of the mean anomaly kept, enough for e = 0.25 to reach double precision
+	static constexpr size_t harmonics = 32;
+	static constexpr size_t samples = 128;
+	static constexpr double pi = 3.14159265358979323846;
+
+	struct Series
+	{
+		std::vector<double> amplitude, phase, frequency;
+	};
+
+	struct Body
+	{
+		double scale;
+
+		// Per coordinate, the a = 0 and a = 1 series
+		Series full[3][2];
+		Series active[3][2];
+		size_t terms = 0;
+	};
+
+	std::vector<Body> bodies;
+
+	// Only the shape and tilt matter, the angles are in the arguments
+	static OrbitalElements shift(const OrbitalElements& elements, const OrbitalElements& rates, double centuries)
+	{
+		OrbitalElements shifted = elements;
+		shifted.semiMajorAxis += rates.semiMajorAxis * centuries;
+		shifted.eccentricity += rates.eccentricity * centuries;
+		shifted.inclination += rates.inclination * centuries;
+		return shifted;
+	}
+
+	// d_m of the orbit in its own plane, x + iy = sum d_m e^(imM) for m in [-harmonics, harmonics],
+	// from a discrete Fourier transform over one period of the mean anomaly
+	static void expand(const OrbitalElements& elements, std::vector<double>& coefficients)
+	{
+		double a = elements.semiMajorAxis, e = elements.eccentricity, b = a * std::sqrt(1.0 - e * e);
+
+		// x = a (cos E - e) only has cosines and y = b sin E only sines
+		std::vector<double> cosines(harmonics + 1, 0.0), sines(harmonics + 1, 0.0);
+		for (size_t j = 0; j < samples; j++)
+		{
+			double M = 2.0 * pi * j / samples;
+			double E = M + e * std::sin(M);
+			for (int i = 0; i < 50; i++)
+			{
+				double dE = (E - e * std::sin(E) - M) / (1.0 - e * std::cos(E));
+				E -= dE;
+				if (std::fabs(dE) < 1e-15)
+					break;
+			}
+
+			double x = a * (std::cos(E) - e), y = b * std::sin(E);
+			for (size_t k = 0; k <= harmonics; k++)
+			{
+				cosines[k] += x * std::cos(k * M);
+				sines[k] += y * std::sin(k * M);
+			}
+		}
+
+		// x_k cos kM + i y_k sin kM = (x_k + y_k) / 2 e^(ikM) + (x_k - y_k) / 2 e^(-ikM)
+		coefficients.assign(2 * harmonics + 1, 0.0);
+		coefficients[harmonics] = cosines[0] / samples;
+		for (size_t k = 1; k <= harmonics; k++)
+		{
+			coefficients[harmonics + k] = (cosines[k] + sines[k]) / samples;
+			coefficients[harmonics - k] = (cosines[k] - sines[k]) / samples;
+		}
+	}
+
+	// Amplitude of one of the five term families: X and Y from w and from conj(w), then Z
+	static double amplitude(const OrbitalElements& elements, double d, int family)
+	{
+		double cosI = std::cos(elements.inclination);
+		if (family == 4)
+			return std::sin(elements.inclination) * d;
+
+		return (family % 2 == 0 ? 0.5 * (1.0 + cosI) : 0.5 * (1.0 - cosI)) * d;
+	}
+
+	static void addTerm(Series& series, double amplitude, double phase, double frequency, double scale)
+	{
+		// Below double precision of the orbit, noise from the transform
+		if (std::fabs(amplitude) < 1e-14 * scale)
+			return;
+
+		series.amplitude.push_back(std::fabs(amplitude));
+		series.phase.push_back(amplitude < 0.0 ? phase + pi : phase);
+		series.frequency.push_back(frequency);
+	}
+
+	void truncateBody(Body& body, double arcseconds)
+	{
+		struct Candidate
+		{
+			double weight;
+			int coordinate, power;
+			size_t index;
+		};
+
+		std::vector<Candidate> candidates;
+		for (int coordinate = 0; coordinate < 3; coordinate++)
+		{
+			for (int power = 0; power < 2; power++)
+			{
+				const Series& series = body.full[coordinate][power];
+				for (size_t i = 0; i < series.amplitude.size(); i++)
+				{
+					double weight = series.amplitude[i] * (power == 0 ? 1.0 : validMillennia);
+					candidates.push_back({ weight, coordinate, power, i });
+				}
+			}
+		}
+
+		// Dropped terms can't add up to more than the tolerance, largest terms first in each series
+		std::sort(candidates.begin(), candidates.end(), [](const Candidate& a, const Candidate& b) { return a.weight < b.weight; });
+
+		double tolerance = arcseconds * pi / (180.0 * 3600.0) * body.scale, dropped = 0.0;
+		size_t first = 0;
+		while (first < candidates.size() && dropped + candidates[first].weight <= tolerance)
+			dropped += candidates[first++].weight;
+
+		for (int coordinate = 0; coordinate < 3; coordinate++)
+			for (int power = 0; power < 2; power++)
+				body.active[coordinate][power] = Series();
+
+		body.terms = candidates.size() - first;
+		for (size_t i = candidates.size(); i > first; i--)
+		{
+			const Candidate& candidate = candidates[i - 1];
+			const Series& from = body.full[candidate.coordinate][candidate.power];
+			Series& to = body.active[candidate.coordinate][candidate.power];
+
+			to.amplitude.push_back(from.amplitude[candidate.index]);
+			to.phase.push_back(from.phase[candidate.index]);
+			to.frequency.push_back(from.frequency[candidate.index]);
+		}
+
+		// Whole blocks of 8, padding terms have no amplitude
+		for (int coordinate = 0; coordinate < 3; coordinate++)
+		{
+			for (int power = 0; power < 2; power++)
+			{
+				Series& series = body.active[coordinate][power];
+				size_t padded = (series.amplitude.size() + 7) / 8 * 8;
+				series.amplitude.resize(padded, 0.0);
+				series.phase.resize(padded, 0.0);
+				series.frequency.resize(padded, 0.0);
+			}
+		}
+	}
+
+	static double sum(const Series& series, double t)
+	{
+		size_t count = series.amplitude.size();
+		double total = 0.0;
+
+#if defined(__AVX2__)
+		// Arguments in double, reduced to [-pi, pi] before dropping to float for the sine/cosine
+		const __m256d twoPi = _mm256_set1_pd(2.0 * pi), invTwoPi = _mm256_set1_pd(1.0 / (2.0 * pi));
+		__m256d time = _mm256_set1_pd(t);
+		__m256d sum0 = _mm256_setzero_pd(), sum1 = _mm256_setzero_pd();
+
+		for (size_t i = 0; i < count; i += 8)
+		{
+			__m256d a0 = _mm256_add_pd(_mm256_mul_pd(_mm256_loadu_pd(&series.frequency[i]), time), _mm256_loadu_pd(&series.phase[i]));
+			__m256d a1 = _mm256_add_pd(_mm256_mul_pd(_mm256_loadu_pd(&series.frequency[i + 4]), time), _mm256_loadu_pd(&series.phase[i + 4]));
+			a0 = _mm256_sub_pd(a0, _mm256_mul_pd(twoPi, _mm256_round_pd(_mm256_mul_pd(a0, invTwoPi), _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC)));
+			a1 = _mm256_sub_pd(a1, _mm256_mul_pd(twoPi, _mm256_round_pd(_mm256_mul_pd(a1, invTwoPi), _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC)));
+
+			__m256 sine, cosine;
+			SimdMath::sincos8(_mm256_set_m128(_mm256_cvtpd_ps(a1), _mm256_cvtpd_ps(a0)), sine, cosine);
+
+			sum0 = _mm256_add_pd(sum0, _mm256_mul_pd(_mm256_loadu_pd(&series.amplitude[i]), _mm256_cvtps_pd(_mm256_castps256_ps128(cosine))));
+			sum1 = _mm256_add_pd(sum1, _mm256_mul_pd(_mm256_loadu_pd(&series.amplitude[i + 4]), _mm256_cvtps_pd(_mm256_extractf128_ps(cosine, 1))));
+		}
+
+		double lanes[4];
+		_mm256_storeu_pd(lanes, _mm256_add_pd(sum0, sum1));
+		total = (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+#else
+		for (size_t i = 0; i < count; i++)
+			total += series.amplitude[i] * std::cos(series.frequency[i] * t + series.phase[i]);
+#endif
+
+		return total;
+	}
+};
+
+#endif
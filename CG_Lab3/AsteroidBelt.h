@@ -0,0 +1,600 @@
+#ifndef ASTEROID_BELT_H
+#define ASTEROID_BELT_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <vector>
+#include <map>
+#include <utility>
+#include <chrono>
+#include <random>
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstddef>
+
+#include "Shader.h"
+#include "JobSystem.h"
+#include "Kepler.h"
+
+struct BeltStats
+{
+	size_t asteroids = 0;
+	size_t instanceBytes = 0;
+	double generationMs = 0.0;
+	int drawCalls = 0;
+	size_t bandInstances[3] = {};		// asteroids drawn as points, coarse and detailed rocks last frame
+	size_t skippedUpdates = 0;			// frames whose passes waited for the GPU to finish the previous ones
+	double gpuMs = 0.0;					// newest frame whose timer has come back, passes and draws
+};
+
+// GPU time of the belt drawn with its first asteroids only, from one view
+struct BeltDensity
+{
+	size_t asteroids = 0;
+	double gpuMs = 0.0;
+	double submitMs = 0.0;
+};
+
+// Asteroids between two orbits, generated once into a static buffer. Each frame a transform feedback
+// pass solves Kepler's equation once per asteroid into a position buffer, then one pass per band of
+// sizes on screen compacts the indices of the asteroids in that band into a list per shape. Points,
+// coarse and detailed rocks are drawn from their lists, and every vertex only looks its asteroid up.
+// GL 4.1 can't draw a captured count instanced, so the counts come back through queries. There are
+// two sets of positions and lists: update() fills one before the bodies are drawn, and render() draws
+// the newest set whose counts have come back, never waiting for one. When the GPU is still on the
+// previous set, the frame skips its passes and the belt keeps the older positions a frame longer.
+// Orbits are in the scene's units around the origin, rates per day.
+class AsteroidBelt
+{
+public:
+	static constexpr int shapes = 4;
+
+	// Diameters in pixels where the coarse rock takes over from the point and the detailed one from the coarse
+	static constexpr float coarsePixels = 1.5f, detailPixels = 8.0f;
+
+	// Mean motions and spins are whole turns over this many days, so the day can be wrapped to it
+	// and still be a float
+	static constexpr double cycleDays = 1048576.0;
+
+	// Edges as (AU, scene distance), semi-major axes spread evenly between them apart from the
+	// Kirkwood gaps; gm in AU^3/day^2 sets the periods. At most a third of what a texture buffer can
+	// address, as the orbits take three texels each.
+	AsteroidBelt(size_t count, double gm, glm::dvec2 innerEdge, glm::dvec2 outerEdge, const char* vertexShaderPath, const char* fragmentShaderPath)
+		: shader(vertexShaderPath, fragmentShaderPath),
+		propagateShader("ShaderData/Asteroids/propagate_vertex_shader.txt", nullptr, "Position"),
+		bandShader("ShaderData/Asteroids/band_vertex_shader.txt", "ShaderData/Asteroids/band_geometry_shader.txt", "Index")
+	{
+		GLint limit = 0;
+		glGetIntegerv(GL_MAX_TEXTURE_BUFFER_SIZE, &limit);
+		if (limit > 0)
+			count = std::min(count, (size_t)limit / 3);
+
+		auto begin = std::chrono::high_resolution_clock::now();
+		std::vector<float> data(count * floatsPerAsteroid);
+		size_t blockCount = (count + blockSize - 1) / blockSize;
+		JobSystem::instance().parallelFor(blockCount, 1, [&](size_t first, size_t last)
+			{
+				for (size_t block = first; block < last; block++)
+					generate(block * blockSize, std::min((block + 1) * blockSize, count), gm, innerEdge, outerEdge, data.data());
+			});
+		stats.generationMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - begin).count();
+
+		// Asteroids are independent, so each shape simply takes the next quarter
+		asteroids = count;
+		for (int shape = 0; shape <= shapes; shape++)
+			shapeStarts[shape] = count * shape / shapes;
+
+		orbitTexture = textureBuffer(orbitBuffer, GL_RGBA32F, count * floatsPerAsteroid * sizeof(float), data.data());
+		for (ListSet& set : sets)
+		{
+			set.positionTexture = textureBuffer(set.positionBuffer, GL_RGBA32F, count * sizeof(glm::vec4), nullptr);
+			set.listTexture = textureBuffer(set.listBuffer, GL_R32I, bands * count * sizeof(GLint), nullptr);
+			glGenQueries(bands * shapes, set.counters);
+		}
+
+		buildRocks();
+		glGenVertexArrays(1, &passVao);
+		glGenQueries(timerCount * 2, timers);
+
+		stats.asteroids = count;
+		stats.instanceBytes = count * (floatsPerAsteroid * sizeof(float) + listSets * (sizeof(glm::vec4) + bands * sizeof(GLint)));
+	}
+
+	~AsteroidBelt()
+	{
+		glDeleteQueries(timerCount * 2, timers);
+		for (ListSet& set : sets)
+		{
+			glDeleteQueries(bands * shapes, set.counters);
+			glDeleteTextures(1, &set.positionTexture);
+			glDeleteTextures(1, &set.listTexture);
+			const GLuint buffers[] = { set.positionBuffer, set.listBuffer };
+			glDeleteBuffers(2, buffers);
+		}
+		glDeleteVertexArrays(1, &passVao);
+		glDeleteVertexArrays(1, &rockVao);
+		glDeleteTextures(1, &orbitTexture);
+		const GLuint buffers[] = { orbitBuffer, vertexBuffer, indexBuffer };
+		glDeleteBuffers(3, buffers);
+	}
+
+	size_t size() const
+	{
+		return asteroids;
+	}
+
+	// Positions and band lists for the frame, issued before the bodies so they are usually done by render()
+	void update(const glm::mat4& view, const glm::mat4& projection, float viewportHeight, double day)
+	{
+		// The frame's two timers come back together, one still in flight is skipped rather than waited for
+		GLint available = 0;
+		GLuint* frameTimers = timers + 2 * timerIndex;
+		if (timersStarted[timerIndex])
+		{
+			glGetQueryObjectiv(frameTimers[1], GL_QUERY_RESULT_AVAILABLE, &available);
+			if (available)
+			{
+				GLuint64 updateNanoseconds = 0, renderNanoseconds = 0;
+				glGetQueryObjectui64v(frameTimers[0], GL_QUERY_RESULT, &updateNanoseconds);
+				glGetQueryObjectui64v(frameTimers[1], GL_QUERY_RESULT, &renderNanoseconds);
+				stats.gpuMs = (updateNanoseconds + renderNanoseconds) * 1e-6;
+			}
+		}
+
+		// A set that is neither drawn nor waiting for its counts, there is none while the GPU is behind
+		int target = -1;
+		for (int set = 0; set < listSets && target < 0; set++)
+			if (set != drawnSet && !sets[set].pending)
+				target = set;
+		if (target < 0)
+			stats.skippedUpdates++;
+
+		frameTimed = !timersStarted[timerIndex] || available;
+		if (frameTimed)
+			glBeginQuery(GL_TIME_ELAPSED, frameTimers[0]);
+		if (target >= 0)
+		{
+			compact(sets[target], view, projection, viewportHeight, day, size());
+			sets[target].pending = true;
+		}
+		if (frameTimed)
+			glEndQuery(GL_TIME_ELAPSED);
+	}
+
+	// With the bodies, before the skybox. The frame's GPU time is read a few frames later.
+	void render(const glm::mat4& view, const glm::mat4& projection)
+	{
+		for (int set = 0; set < listSets; set++)
+			if (sets[set].pending && readCounts(sets[set], false))
+				drawnSet = set;
+
+		GLuint* frameTimers = timers + 2 * timerIndex;
+		if (frameTimed)
+			glBeginQuery(GL_TIME_ELAPSED, frameTimers[1]);
+		if (drawnSet >= 0)
+			draw(sets[drawnSet], view, projection);
+		if (frameTimed)
+		{
+			glEndQuery(GL_TIME_ELAPSED);
+			timersStarted[timerIndex] = true;
+		}
+		timerIndex = (timerIndex + 1) % timerCount;
+	}
+
+	const BeltStats& getStats() const
+	{
+		return stats;
+	}
+
+	// GPU time for the first 1000, 10000, ... asteroids up to all of them, drawn from the given view
+	// into whatever is bound, through the set that isn't being drawn. Waits for the GPU, needs a GL context.
+	std::vector<BeltDensity> measureDensity(const glm::mat4& view, const glm::mat4& projection, float viewportHeight, double day, int runs = 10)
+	{
+		std::vector<BeltDensity> results;
+		GLuint timer;
+		glGenQueries(1, &timer);
+		ListSet& set = sets[drawnSet == 0 ? 1 : 0];
+
+		for (size_t count = std::min<size_t>(1000, size()); ; count = std::min(count * 10, size()))
+		{
+			BeltDensity density;
+			density.asteroids = count;
+
+			glFinish();
+			for (int run = 0; run < runs; run++)
+			{
+				auto begin = std::chrono::high_resolution_clock::now();
+				glBeginQuery(GL_TIME_ELAPSED, timer);
+				compact(set, view, projection, viewportHeight, day, count);
+				readCounts(set, true);
+				draw(set, view, projection);
+				glEndQuery(GL_TIME_ELAPSED);
+				density.submitMs += std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - begin).count() / runs;
+
+				GLuint64 nanoseconds = 0;
+				glGetQueryObjectui64v(timer, GL_QUERY_RESULT, &nanoseconds);
+				density.gpuMs += nanoseconds * 1e-6 / runs;
+			}
+			results.push_back(density);
+
+			if (count >= size())
+				break;
+		}
+
+		glDeleteQueries(1, &timer);
+		return results;
+	}
+
+private:
+	// Periapsis direction times a and mean anomaly at day 0, the direction a quarter turn on times b
+	// and mean motion, spin axis times radius and spin rate
+	static constexpr size_t floatsPerAsteroid = 12;
+	static constexpr size_t blockSize = 4096;
+
+	// Points, coarse and detailed rocks
+	static constexpr int bands = 3;
+
+	static constexpr int timerCount = 4;
+
+	// Per rock: the subdivided icosahedron's vertices, and the triangles of each level
+	static constexpr int rockVertices = 42, detailTriangles = 80, coarseTriangles = 20;
+
+	Shader shader, propagateShader, bandShader;
+	size_t asteroids = 0;
+	size_t shapeStarts[shapes + 1] = {};
+
+	// Orbits, 3 texels per asteroid
+	GLuint orbitBuffer = 0, orbitTexture = 0;
+
+	// Centre and spin angle per asteroid, and each band's list of the indices it keeps with every
+	// shape's starting where the shape's asteroids do. The queries count the indices written for
+	// each band and shape, kept once they have come back.
+	struct ListSet
+	{
+		GLuint positionBuffer = 0, listBuffer = 0;
+		GLuint positionTexture = 0, listTexture = 0;
+		GLuint counters[bands * shapes] = {};
+		GLuint kept[bands * shapes] = {};
+		size_t compacted[shapes] = {};		// asteroids of each shape the passes saw
+		bool pending = false;				// passes issued, counts not read yet
+	};
+
+	static constexpr int listSets = 2;
+	ListSet sets[listSets];
+	int drawnSet = -1;
+
+	// The feedback passes read nothing but textures and gl_VertexID
+	GLuint passVao = 0;
+
+	// All rocks, then one vertex at the origin for the points
+	GLuint vertexBuffer = 0, indexBuffer = 0;
+	GLuint rockVao = 0;
+
+	// Compaction and draws of each frame
+	GLuint timers[timerCount * 2] = {};
+	bool timersStarted[timerCount] = {};
+	int timerIndex = 0;
+	bool frameTimed = false;
+
+	BeltStats stats;
+
+	// Every block has its own generator, so the belt doesn't depend on the thread count
+	static void generate(size_t first, size_t last, double gm, glm::dvec2 innerEdge, glm::dvec2 outerEdge, float* out)
+	{
+		const double twoPi = 6.283185307179586;
+		const double turn = twoPi / cycleDays;
+
+		// 3:1, 5:2, 7:3 and 2:1 resonances with Jupiter
+		const double gaps[] = { 2.502, 2.825, 2.958, 3.279 };
+		const double gapHalfWidth = 0.015;
+
+		std::mt19937 random((unsigned int)(first / blockSize) + 1);
+		std::uniform_real_distribution<double> uniform(0.0, 1.0);
+		std::normal_distribution<double> gaussian;
+
+		for (size_t i = first; i < last; i++)
+		{
+			double a;
+			bool inGap;
+			do
+			{
+				a = innerEdge.x + (outerEdge.x - innerEdge.x) * uniform(random);
+				inGap = false;
+				for (double gap : gaps)
+					inGap |= std::fabs(a - gap) < gapHalfWidth;
+			} while (inGap);
+
+			OrbitalElements elements;
+			elements.semiMajorAxis = a;
+			elements.eccentricity = std::min(std::fabs(0.08 * gaussian(random)), 0.25);
+			elements.inclination = std::min(std::fabs(0.12 * gaussian(random)), 0.4);
+			elements.ascendingNode = twoPi * uniform(random);
+			elements.argumentOfPeriapsis = twoPi * uniform(random);
+			elements.meanAnomaly = twoPi * uniform(random);
+
+			// Shaped like the real orbit at the scene's distance, as the bodies' orbits are
+			double e = elements.eccentricity;
+			double sceneA = innerEdge.y + (a - innerEdge.x) * (outerEdge.y - innerEdge.y) / (outerEdge.x - innerEdge.x);
+			double meanMotion = std::round(std::sqrt(gm / (a * a * a)) / turn) * turn;
+
+			glm::dvec3 p, q;
+			KeplerPropagator::perifocalAxes(elements, p, q);
+			p = glm::dvec3(p.x, p.z, -p.y) * sceneA;
+			q = glm::dvec3(q.x, q.z, -q.y) * (sceneA * std::sqrt(1.0 - e * e));
+
+			// Many small ones and few large, N(>r) falling as r^-1.5
+			double radius = std::min(0.004 * std::pow(1.0 - uniform(random), -1.0 / 1.5), 0.04);
+			glm::dvec3 axis = glm::normalize(glm::dvec3(gaussian(random), gaussian(random), gaussian(random))) * radius;
+			double spin = std::round((0.2 + uniform(random)) / turn) * turn * (uniform(random) < 0.5 ? -1.0 : 1.0);
+
+			float* asteroid = out + i * floatsPerAsteroid;
+			asteroid[0] = (float)p.x; asteroid[1] = (float)p.y; asteroid[2] = (float)p.z; asteroid[3] = (float)elements.meanAnomaly;
+			asteroid[4] = (float)q.x; asteroid[5] = (float)q.y; asteroid[6] = (float)q.z; asteroid[7] = (float)meanMotion;
+			asteroid[8] = (float)axis.x; asteroid[9] = (float)axis.y; asteroid[10] = (float)axis.z; asteroid[11] = (float)spin;
+		}
+	}
+
+	// An icosahedron subdivided once, pushed in and out by a few smooth bumps and stretched along
+	// random axes. The first 12 vertices are the icosahedron's own, so the coarse level reuses them.
+	static void buildRock(int shape, std::vector<glm::vec3>& vertices, std::vector<uint16_t>& detail, std::vector<uint16_t>& coarse)
+	{
+		const float t = 1.6180340f;
+		std::vector<glm::vec3> directions = {
+			{ -1, t, 0 }, { 1, t, 0 }, { -1, -t, 0 }, { 1, -t, 0 }, { 0, -1, t }, { 0, 1, t },
+			{ 0, -1, -t }, { 0, 1, -t }, { t, 0, -1 }, { t, 0, 1 }, { -t, 0, -1 }, { -t, 0, 1 } };
+		const uint16_t faces[coarseTriangles][3] = {
+			{ 0, 11, 5 }, { 0, 5, 1 }, { 0, 1, 7 }, { 0, 7, 10 }, { 0, 10, 11 }, { 1, 5, 9 }, { 5, 11, 4 }, { 11, 10, 2 }, { 10, 7, 6 }, { 7, 1, 8 },
+			{ 3, 9, 4 }, { 3, 4, 2 }, { 3, 2, 6 }, { 3, 6, 8 }, { 3, 8, 9 }, { 4, 9, 5 }, { 2, 4, 11 }, { 6, 2, 10 }, { 8, 6, 7 }, { 9, 8, 1 } };
+
+		// A new vertex on every edge, shared by the two faces on it
+		std::map<std::pair<uint16_t, uint16_t>, uint16_t> midpoints;
+		auto midpoint = [&](uint16_t a, uint16_t b)
+		{
+			std::pair<uint16_t, uint16_t> edge(std::min(a, b), std::max(a, b));
+			auto found = midpoints.find(edge);
+			if (found != midpoints.end())
+				return found->second;
+
+			directions.push_back(directions[a] + directions[b]);
+			uint16_t index = (uint16_t)(directions.size() - 1);
+			midpoints[edge] = index;
+			return index;
+		};
+
+		uint16_t base = (uint16_t)vertices.size();
+		for (const auto& face : faces)
+		{
+			uint16_t ab = midpoint(face[0], face[1]), bc = midpoint(face[1], face[2]), ca = midpoint(face[2], face[0]);
+			const uint16_t triangles[4][3] = { { face[0], ab, ca }, { face[1], bc, ab }, { face[2], ca, bc }, { ab, bc, ca } };
+			for (const auto& triangle : triangles)
+				for (uint16_t corner : triangle)
+					detail.push_back(base + corner);
+			for (uint16_t corner : face)
+				coarse.push_back(base + corner);
+		}
+
+		std::mt19937 random(101 + shape);
+		std::uniform_real_distribution<float> uniform(-1.0f, 1.0f);
+		glm::vec3 bumps[6];
+		float heights[6];
+		for (int k = 0; k < 6; k++)
+		{
+			bumps[k] = glm::normalize(glm::vec3(uniform(random), uniform(random), uniform(random)));
+			heights[k] = 0.35f * uniform(random);
+		}
+		glm::vec3 stretch(1.0f, 0.75f + 0.2f * uniform(random), 0.6f + 0.15f * uniform(random));
+
+		float extent = 0.0f;
+		std::vector<glm::vec3> shaped;
+		for (glm::vec3 direction : directions)
+		{
+			direction = glm::normalize(direction);
+			float radius = 1.0f;
+			for (int k = 0; k < 6; k++)
+			{
+				float facing = std::max(glm::dot(direction, bumps[k]), 0.0f);
+				radius += heights[k] * facing * facing * facing;
+			}
+
+			shaped.push_back(direction * radius * stretch);
+			extent = std::max(extent, glm::length(shaped.back()));
+		}
+
+		// Radius 1 at the furthest point
+		for (const glm::vec3& vertex : shaped)
+			vertices.push_back(vertex / extent);
+	}
+
+	static GLuint textureBuffer(GLuint& buffer, GLenum format, size_t bytes, const void* data)
+	{
+		glGenBuffers(1, &buffer);
+		glBindBuffer(GL_TEXTURE_BUFFER, buffer);
+		glBufferData(GL_TEXTURE_BUFFER, (GLsizeiptr)bytes, data, data ? GL_STATIC_DRAW : GL_DYNAMIC_COPY);
+
+		GLuint texture;
+		glGenTextures(1, &texture);
+		glBindTexture(GL_TEXTURE_BUFFER, texture);
+		glTexBuffer(GL_TEXTURE_BUFFER, format, buffer);
+		glBindTexture(GL_TEXTURE_BUFFER, 0);
+		glBindBuffer(GL_TEXTURE_BUFFER, 0);
+		return texture;
+	}
+
+	void buildRocks()
+	{
+		std::vector<glm::vec3> vertices;
+		std::vector<uint16_t> detail, coarse;
+		for (int shape = 0; shape < shapes; shape++)
+			buildRock(shape, vertices, detail, coarse);
+		vertices.push_back(glm::vec3(0.0f));
+
+		std::vector<uint16_t> indices(detail);
+		indices.insert(indices.end(), coarse.begin(), coarse.end());
+
+		glGenVertexArrays(1, &rockVao);
+		glBindVertexArray(rockVao);
+
+		glGenBuffers(1, &vertexBuffer);
+		glBindBuffer(GL_ARRAY_BUFFER, vertexBuffer);
+		glBufferData(GL_ARRAY_BUFFER, (GLsizeiptr)(vertices.size() * sizeof(glm::vec3)), vertices.data(), GL_STATIC_DRAW);
+		glEnableVertexAttribArray(0);
+		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(glm::vec3), (void*)0);
+
+		glGenBuffers(1, &indexBuffer);
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexBuffer);
+		glBufferData(GL_ELEMENT_ARRAY_BUFFER, (GLsizeiptr)(indices.size() * sizeof(uint16_t)), indices.data(), GL_STATIC_DRAW);
+
+		glBindVertexArray(0);
+	}
+
+	// Feedback passes over the first count asteroids spread over the shapes: their positions, then
+	// each band's indices, with a query counting what every band and shape kept
+	void compact(ListSet& set, const glm::mat4& view, const glm::mat4& projection, float viewportHeight, double day, size_t count)
+	{
+		double wrapped = std::fmod(day, cycleDays);
+		if (wrapped < 0.0)
+			wrapped += cycleDays;
+
+		for (int shape = 0; shape < shapes; shape++)
+			set.compacted[shape] = std::min(shapeStarts[shape + 1] - shapeStarts[shape], (count + shapes - 1) / shapes);
+
+		glEnable(GL_RASTERIZER_DISCARD);
+		glBindVertexArray(passVao);
+		glActiveTexture(GL_TEXTURE0);
+		glBindTexture(GL_TEXTURE_BUFFER, orbitTexture);
+		glActiveTexture(GL_TEXTURE1);
+		glBindTexture(GL_TEXTURE_BUFFER, set.positionTexture);
+
+		propagateShader.use();
+		propagateShader.setUniformI("orbits", 0);
+		propagateShader.setUniformF("day", (float)wrapped);
+		for (int shape = 0; shape < shapes; shape++)
+		{
+			if (set.compacted[shape] == 0)
+				continue;
+
+			glBindBufferRange(GL_TRANSFORM_FEEDBACK_BUFFER, 0, set.positionBuffer, (GLintptr)(shapeStarts[shape] * sizeof(glm::vec4)),
+				(GLsizeiptr)(set.compacted[shape] * sizeof(glm::vec4)));
+			glBeginTransformFeedback(GL_POINTS);
+			glDrawArrays(GL_POINTS, (GLint)shapeStarts[shape], (GLsizei)set.compacted[shape]);
+			glEndTransformFeedback();
+		}
+
+		// Points, coarse and detailed rocks, each keeping the sizes in its band
+		const glm::vec2 pixelRanges[bands] = { { 0.0f, coarsePixels }, { coarsePixels, detailPixels }, { detailPixels, 1e30f } };
+
+		bandShader.use();
+		bandShader.setUniformMat4("view", view);
+		bandShader.setUniformI("orbits", 0);
+		bandShader.setUniformI("positions", 1);
+		bandShader.setUniformF("pixelScale", 0.5f * viewportHeight * projection[1][1]);
+		for (int band = 0; band < bands; band++)
+		{
+			bandShader.setUniformVec2("pixelRange", pixelRanges[band]);
+			for (int shape = 0; shape < shapes; shape++)
+			{
+				if (set.compacted[shape] == 0)
+					continue;
+
+				glBindBufferRange(GL_TRANSFORM_FEEDBACK_BUFFER, 0, set.listBuffer, (GLintptr)((band * size() + shapeStarts[shape]) * sizeof(GLint)),
+					(GLsizeiptr)(set.compacted[shape] * sizeof(GLint)));
+				glBeginQuery(GL_TRANSFORM_FEEDBACK_PRIMITIVES_WRITTEN, set.counters[band * shapes + shape]);
+				glBeginTransformFeedback(GL_POINTS);
+				glDrawArrays(GL_POINTS, (GLint)shapeStarts[shape], (GLsizei)set.compacted[shape]);
+				glEndTransformFeedback();
+				glEndQuery(GL_TRANSFORM_FEEDBACK_PRIMITIVES_WRITTEN);
+			}
+		}
+
+		glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0, 0);
+		glBindTexture(GL_TEXTURE_BUFFER, 0);
+		glActiveTexture(GL_TEXTURE0);
+		glBindTexture(GL_TEXTURE_BUFFER, 0);
+		glBindVertexArray(0);
+		glDisable(GL_RASTERIZER_DISCARD);
+	}
+
+	// Whether the set's counts have come back, and keeps them. Waiting only for the benchmarks.
+	bool readCounts(ListSet& set, bool wait)
+	{
+		for (int band = 0; band < bands; band++)
+			for (int shape = 0; shape < shapes; shape++)
+			{
+				GLint available = 1;
+				if (!wait && set.compacted[shape] > 0)
+					glGetQueryObjectiv(set.counters[band * shapes + shape], GL_QUERY_RESULT_AVAILABLE, &available);
+				if (!available)
+					return false;
+			}
+
+		for (int band = 0; band < bands; band++)
+			for (int shape = 0; shape < shapes; shape++)
+			{
+				GLuint& kept = set.kept[band * shapes + shape];
+				kept = 0;
+				if (set.compacted[shape] > 0)
+					glGetQueryObjectuiv(set.counters[band * shapes + shape], GL_QUERY_RESULT, &kept);
+			}
+
+		set.pending = false;
+		return true;
+	}
+
+	// Every band's list of each shape, at most 12 draws
+	void draw(const ListSet& set, const glm::mat4& view, const glm::mat4& projection)
+	{
+		shader.use();
+		shader.setUniformMat4("view", view);
+		shader.setUniformMat4("projection", projection);
+		shader.setUniformI("orbits", 0);
+		shader.setUniformI("positions", 1);
+		shader.setUniformI("list", 2);
+
+		const GLuint textures[] = { orbitTexture, set.positionTexture, set.listTexture };
+		for (int unit = 0; unit < 3; unit++)
+		{
+			glActiveTexture(GL_TEXTURE0 + unit);
+			glBindTexture(GL_TEXTURE_BUFFER, textures[unit]);
+		}
+
+		const size_t detailBytes = shapes * detailTriangles * 3 * sizeof(uint16_t);
+
+		glBindVertexArray(rockVao);
+		stats.drawCalls = 0;
+		for (int band = 0; band < bands; band++)
+		{
+			shader.setUniformB("points", band == 0);
+			stats.bandInstances[band] = 0;
+
+			for (int shape = 0; shape < shapes; shape++)
+			{
+				GLuint kept = set.kept[band * shapes + shape];
+				stats.bandInstances[band] += kept;
+				if (kept == 0)
+					continue;
+
+				shader.setUniformI("listStart", (int)(band * size() + shapeStarts[shape]));
+				if (band == 0)
+					glDrawArraysInstanced(GL_POINTS, shapes * rockVertices, 1, (GLsizei)kept);
+				else if (band == 1)
+					glDrawElementsInstanced(GL_TRIANGLES, coarseTriangles * 3, GL_UNSIGNED_SHORT,
+						(void*)(detailBytes + shape * coarseTriangles * 3 * sizeof(uint16_t)), (GLsizei)kept);
+				else
+					glDrawElementsInstanced(GL_TRIANGLES, detailTriangles * 3, GL_UNSIGNED_SHORT,
+						(void*)(shape * detailTriangles * 3 * sizeof(uint16_t)), (GLsizei)kept);
+				stats.drawCalls++;
+			}
+		}
+		glBindVertexArray(0);
+
+		for (int unit = 2; unit >= 0; unit--)
+		{
+			glActiveTexture(GL_TEXTURE0 + unit);
+			glBindTexture(GL_TEXTURE_BUFFER, 0);
+		}
+	}
+};
+
+#endif
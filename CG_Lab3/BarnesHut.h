@@ -0,0 +1,718 @@
+#ifndef BARNES_HUT_H
+#define BARNES_HUT_H
+
+#include <vector>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstddef>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+#include "JobSystem.h"
+
+struct BarnesHutStats
+{
+	double buildMs = 0.0;			// bounds, Morton sort, octree and multipoles
+	double forceMs = 0.0;
+	size_t nodes = 0;
+	int depth = 0;
+	double interactionsPerParticle = 0.0;
+
+	// Against direct summation on a sample of particles, filled by measureAccuracy
+	double rmsRelativeError = 0.0;
+	double maxRelativeError = 0.0;
+};
+
+// Tree code for large particle counts. Particles are sorted along a Morton curve, so every octree
+// cell is a contiguous range of them, and cells far enough away are replaced by their monopole
+// and, optionally, traceless quadrupole. Units follow NBodySystem (masses are G * m).
+class BarnesHut
+{
+public:
+	BarnesHut(double openingAngle = 0.5, bool quadrupole = true, double softening = 0.0)
+		: theta(openingAngle), useQuadrupole(quadrupole), softening2(softening * softening)
+	{
+	}
+
+	void setOpeningAngle(double openingAngle)
+	{
+		theta = openingAngle;
+	}
+
+	void setQuadrupole(bool enabled)
+	{
+		useQuadrupole = enabled;
+	}
+
+	// Accelerations of all n particles, in the order they were given
+	void computeAccelerations(const double* x, const double* y, const double* z, const double* mass, size_t n,
+		double* ax, double* ay, double* az)
+	{
+		auto begin = std::chrono::high_resolution_clock::now();
+		build(x, y, z, mass, n);
+		auto built = std::chrono::high_resolution_clock::now();
+
+		// One walk per group of nearby particles
+		std::vector<size_t> interactions(groups.size());
+		JobSystem::instance().parallelFor(groups.size(), 4, [&](size_t first, size_t last)
+		{
+			InteractionList list;
+			for (size_t g = first; g < last; g++)
+				interactions[g] = evaluateGroup(nodes[groups[g]], list, ax, ay, az);
+		});
+
+		auto done = std::chrono::high_resolution_clock::now();
+
+		size_t total = 0;
+		for (size_t count : interactions)
+			total += count;
+
+		stats.buildMs = std::chrono::duration<double, std::milli>(built - begin).count();
+		stats.forceMs = std::chrono::duration<double, std::milli>(done - built).count();
+		stats.nodes = nodes.size();
+		stats.interactionsPerParticle = n > 0 ? (double)total / n : 0.0;
+	}
+
+	// Compares the last accelerations with direct summation on up to sampleCount particles
+	void measureAccuracy(const double* x, const double* y, const double* z, const double* mass, size_t n,
+		const double* ax, const double* ay, const double* az, size_t sampleCount)
+	{
+		sampleCount = std::min(sampleCount, n);
+		if (sampleCount == 0)
+			return;
+
+		size_t stride = n / sampleCount;
+		std::vector<double> errors(sampleCount);
+
+		JobSystem::instance().parallelFor(sampleCount, 8, [&](size_t first, size_t last)
+		{
+			for (size_t s = first; s < last; s++)
+			{
+				size_t i = s * stride;
+				double exact[3] = { 0.0, 0.0, 0.0 };
+
+				for (size_t j = 0; j < n; j++)
+				{
+					if (j == i)
+						continue;
+					addPoint(x[j] - x[i], y[j] - y[i], z[j] - z[i], mass[j], exact);
+				}
+
+				double dx = ax[i] - exact[0], dy = ay[i] - exact[1], dz = az[i] - exact[2];
+				double magnitude = std::sqrt(exact[0] * exact[0] + exact[1] * exact[1] + exact[2] * exact[2]);
+				errors[s] = magnitude > 0.0 ? std::sqrt(dx * dx + dy * dy + dz * dz) / magnitude : 0.0;
+			}
+		});
+
+		double sum = 0.0, worst = 0.0;
+		for (double error : errors)
+		{
+			sum += error * error;
+			worst = std::max(worst, error);
+		}
+
+		stats.rmsRelativeError = std::sqrt(sum / sampleCount);
+		stats.maxRelativeError = worst;
+	}
+
+	const BarnesHutStats& getStats() const
+	{
+		return stats;
+	}
+
+private:
+	struct Node
+	{
+		double center[3];		// geometric center of the cell
+		double halfSize;
+		double com[3];
+		double mass;
+		double quadrupole[6];	// xx, xy, xz, yy, yz, zz around com
+		double openingRadius;	// cell size / theta plus the offset of com from the center
+		uint32_t begin, end;	// particle range
+		uint32_t firstChild;	// children are stored next to each other
+		uint32_t childCount;
+	};
+
+	static const int MortonBits = 21;
+	static const uint32_t LeafSize = 16;
+	static const uint32_t GroupSize = 64;
+
+	double theta;
+	bool useQuadrupole;
+	double softening2;
+
+	// Particles in Morton order
+	std::vector<double> px, py, pz, pm;
+	std::vector<uint64_t> codes;
+	std::vector<size_t> order;
+
+	std::vector<Node> nodes;
+	std::vector<uint32_t> groups;
+	BarnesHutStats stats;
+
+	static uint64_t spreadBits(uint64_t v)
+	{
+		v &= 0x1fffff;
+		v = (v | v << 32) & 0x1f00000000ffffull;
+		v = (v | v << 16) & 0x1f0000ff0000ffull;
+		v = (v | v << 8) & 0x100f00f00f00f00full;
+		v = (v | v << 4) & 0x10c30c30c30c30c3ull;
+		v = (v | v << 2) & 0x1249249249249249ull;
+		return v;
+	}
+
+	void build(const double* x, const double* y, const double* z, const double* mass, size_t n)
+	{
+		JobSystem& jobs = JobSystem::instance();
+
+		// Bounding cube
+		size_t blockCount = std::max<size_t>(1, std::min<size_t>(n / 4096, 256));
+		std::vector<double> blockBounds(blockCount * 6);
+		jobs.parallelFor(blockCount, 1, [&](size_t first, size_t last)
+		{
+			for (size_t b = first; b < last; b++)
+			{
+				double* bounds = &blockBounds[b * 6];
+				bounds[0] = bounds[1] = bounds[2] = HUGE_VAL;
+				bounds[3] = bounds[4] = bounds[5] = -HUGE_VAL;
+
+				for (size_t i = n * b / blockCount; i < n * (b + 1) / blockCount; i++)
+				{
+					bounds[0] = std::min(bounds[0], x[i]); bounds[3] = std::max(bounds[3], x[i]);
+					bounds[1] = std::min(bounds[1], y[i]); bounds[4] = std::max(bounds[4], y[i]);
+					bounds[2] = std::min(bounds[2], z[i]); bounds[5] = std::max(bounds[5], z[i]);
+				}
+			}
+		});
+
+		double low[3] = { HUGE_VAL, HUGE_VAL, HUGE_VAL }, high[3] = { -HUGE_VAL, -HUGE_VAL, -HUGE_VAL };
+		for (size_t b = 0; b < blockCount; b++)
+		{
+			for (int k = 0; k < 3; k++)
+			{
+				low[k] = std::min(low[k], blockBounds[b * 6 + k]);
+				high[k] = std::max(high[k], blockBounds[b * 6 + 3 + k]);
+			}
+		}
+
+		double size = std::max(high[0] - low[0], std::max(high[1] - low[1], high[2] - low[2])) * 1.0001 + 1e-12;
+		double scale = (double)(1 << MortonBits) / size;
+
+		// Morton keys, then a parallel sort of (key, index) pairs
+		std::vector<std::pair<uint64_t, size_t>> keys(n);
+		jobs.parallelFor(n, 4096, [&](size_t first, size_t last)
+		{
+			for (size_t i = first; i < last; i++)
+			{
+				uint64_t cx = std::min<uint64_t>((uint64_t)((x[i] - low[0]) * scale), (1 << MortonBits) - 1);
+				uint64_t cy = std::min<uint64_t>((uint64_t)((y[i] - low[1]) * scale), (1 << MortonBits) - 1);
+				uint64_t cz = std::min<uint64_t>((uint64_t)((z[i] - low[2]) * scale), (1 << MortonBits) - 1);
+				keys[i] = std::make_pair(spreadBits(cx) | spreadBits(cy) << 1 | spreadBits(cz) << 2, i);
+			}
+		});
+
+		parallelSort(keys);
+
+		px.resize(n); py.resize(n); pz.resize(n); pm.resize(n);
+		codes.resize(n); order.resize(n);
+		jobs.parallelFor(n, 4096, [&](size_t first, size_t last)
+		{
+			for (size_t i = first; i < last; i++)
+			{
+				size_t source = keys[i].second;
+				codes[i] = keys[i].first;
+				order[i] = source;
+				px[i] = x[source]; py[i] = y[source]; pz[i] = z[source]; pm[i] = mass[source];
+			}
+		});
+
+		// Top of the tree built here, subtrees below splitLevel in parallel
+		nodes.clear();
+		groups.clear();
+		stats.depth = 0;
+		if (n == 0)
+			return;
+
+		Node root = makeNode(0, (uint32_t)n, low[0] + size * 0.5, low[1] + size * 0.5, low[2] + size * 0.5, size * 0.5);
+		nodes.push_back(root);
+
+		std::vector<uint32_t> frontier;
+		std::vector<int> frontierLevels;
+		const int splitLevel = 3;
+		buildTop(0, 0, splitLevel, frontier, frontierLevels);
+
+		std::vector<std::vector<Node>> subtrees(frontier.size());
+		std::vector<int> subtreeDepths(frontier.size(), 0);
+		jobs.parallelFor(frontier.size(), 1, [&](size_t first, size_t last)
+		{
+			for (size_t f = first; f < last; f++)
+			{
+				subtrees[f].push_back(nodes[frontier[f]]);
+				subtreeDepths[f] = buildSubtree(subtrees[f], 0, frontierLevels[f]);
+			}
+		});
+
+		// Append subtrees, their roots replace the frontier nodes
+		std::vector<size_t> offsets(frontier.size());
+		size_t total = nodes.size();
+		for (size_t f = 0; f < frontier.size(); f++)
+		{
+			offsets[f] = total - 1;
+			total += subtrees[f].size() - 1;
+			stats.depth = std::max(stats.depth, subtreeDepths[f]);
+		}
+		nodes.resize(total);
+
+		jobs.parallelFor(frontier.size(), 1, [&](size_t first, size_t last)
+		{
+			for (size_t f = first; f < last; f++)
+			{
+				std::vector<Node>& subtree = subtrees[f];
+				for (size_t k = 0; k < subtree.size(); k++)
+				{
+					Node node = subtree[k];
+					if (node.childCount > 0)
+						node.firstChild += (uint32_t)offsets[f];
+					nodes[k == 0 ? frontier[f] : offsets[f] + k] = node;
+				}
+			}
+		});
+
+		// Multipoles of the top levels from their children
+		finishTop(0, splitLevel);
+
+		// Walks are shared by the particles of the highest cells holding at most GroupSize of them
+		groups.clear();
+		collectGroups(0);
+	}
+
+	Node makeNode(uint32_t begin, uint32_t end, double cx, double cy, double cz, double halfSize) const
+	{
+		Node node;
+		node.center[0] = cx; node.center[1] = cy; node.center[2] = cz;
+		node.halfSize = halfSize;
+		node.begin = begin;
+		node.end = end;
+		node.firstChild = 0;
+		node.childCount = 0;
+		node.mass = 0.0;
+		return node;
+	}
+
+	// Splits a node's particles into its non-empty octants, which are consecutive ranges
+	void splitNode(std::vector<Node>& tree, uint32_t index, int level)
+	{
+		Node node = tree[index];
+		int shift = 3 * (MortonBits - 1 - level);
+
+		uint32_t firstChild = (uint32_t)tree.size();
+		uint32_t childCount = 0;
+		uint32_t begin = node.begin;
+
+		while (begin < node.end)
+		{
+			uint64_t octant = (codes[begin] >> shift) & 7;
+			uint32_t end = (uint32_t)(std::upper_bound(codes.begin() + begin, codes.begin() + node.end, codes[begin] | ((1ull << shift) - 1)) - codes.begin());
+
+			double quarter = node.halfSize * 0.5;
+			tree.push_back(makeNode(begin, end,
+				node.center[0] + ((octant & 1) ? quarter : -quarter),
+				node.center[1] + ((octant & 2) ? quarter : -quarter),
+				node.center[2] + ((octant & 4) ? quarter : -quarter), quarter));
+
+			childCount++;
+			begin = end;
+		}
+
+		tree[index].firstChild = firstChild;
+		tree[index].childCount = childCount;
+	}
+
+	bool isLeaf(const Node& node, int level) const
+	{
+		return node.end - node.begin <= LeafSize || level >= MortonBits;
+	}
+
+	void buildTop(uint32_t index, int level, int splitLevel, std::vector<uint32_t>& frontier, std::vector<int>& frontierLevels)
+	{
+		if (level == splitLevel || isLeaf(nodes[index], level))
+		{
+			frontier.push_back(index);
+			frontierLevels.push_back(level);
+			return;
+		}
+
+		splitNode(nodes, index, level);
+
+		for (uint32_t c = 0; c < nodes[index].childCount; c++)
+			buildTop(nodes[index].firstChild + c, level + 1, splitLevel, frontier, frontierLevels);
+	}
+
+	// Builds the tree below tree[index] and fills in its multipoles, returns the depth reached
+	int buildSubtree(std::vector<Node>& tree, uint32_t index, int level)
+	{
+		int depth = level;
+
+		if (isLeaf(tree[index], level))
+		{
+			leafMultipoles(tree[index]);
+			return depth;
+		}
+
+		splitNode(tree, index, level);
+
+		uint32_t firstChild = tree[index].firstChild, childCount = tree[index].childCount;
+		for (uint32_t c = 0; c < childCount; c++)
+			depth = std::max(depth, buildSubtree(tree, firstChild + c, level + 1));
+
+		combineMultipoles(tree[index], &tree[firstChild], childCount);
+		return depth;
+	}
+
+	void finishTop(uint32_t index, int splitLevel, int level = 0)
+	{
+		Node& node = nodes[index];
+		if (level == splitLevel || node.childCount == 0)
+			return;
+
+		for (uint32_t c = 0; c < node.childCount; c++)
+			finishTop(node.firstChild + c, splitLevel, level + 1);
+
+		combineMultipoles(nodes[index], &nodes[nodes[index].firstChild], nodes[index].childCount);
+	}
+
+	void leafMultipoles(Node& node) const
+	{
+		double mass = 0.0, com[3] = { 0.0, 0.0, 0.0 };
+		for (uint32_t i = node.begin; i < node.end; i++)
+		{
+			mass += pm[i];
+			com[0] += pm[i] * px[i]; com[1] += pm[i] * py[i]; com[2] += pm[i] * pz[i];
+		}
+		setCom(node, mass, com);
+
+		std::fill(node.quadrupole, node.quadrupole + 6, 0.0);
+		for (uint32_t i = node.begin; i < node.end; i++)
+			addQuadrupole(node.quadrupole, px[i] - node.com[0], py[i] - node.com[1], pz[i] - node.com[2], pm[i]);
+	}
+
+	void combineMultipoles(Node& node, const Node* children, uint32_t childCount) const
+	{
+		double mass = 0.0, com[3] = { 0.0, 0.0, 0.0 };
+		for (uint32_t c = 0; c < childCount; c++)
+		{
+			mass += children[c].mass;
+			for (int k = 0; k < 3; k++)
+				com[k] += children[c].mass * children[c].com[k];
+		}
+		setCom(node, mass, com);
+
+		// Parallel axis theorem for the children's quadrupoles
+		std::fill(node.quadrupole, node.quadrupole + 6, 0.0);
+		for (uint32_t c = 0; c < childCount; c++)
+		{
+			for (int k = 0; k < 6; k++)
+				node.quadrupole[k] += children[c].quadrupole[k];
+			addQuadrupole(node.quadrupole, children[c].com[0] - node.com[0], children[c].com[1] - node.com[1], children[c].com[2] - node.com[2], children[c].mass);
+		}
+	}
+
+	void setCom(Node& node, double mass, const double* weighted) const
+	{
+		node.mass = mass;
+		for (int k = 0; k < 3; k++)
+			node.com[k] = mass > 0.0 ? weighted[k] / mass : node.center[k];
+
+		// Opened when closer than size / theta, pushed out by how far com sits from the center
+		double dx = node.com[0] - node.center[0], dy = node.com[1] - node.center[1], dz = node.com[2] - node.center[2];
+		node.openingRadius = 2.0 * node.halfSize / theta + std::sqrt(dx * dx + dy * dy + dz * dz);
+	}
+
+	static void addQuadrupole(double* q, double dx, double dy, double dz, double mass)
+	{
+		double r2 = dx * dx + dy * dy + dz * dz;
+		q[0] += mass * (3.0 * dx * dx - r2);
+		q[1] += mass * 3.0 * dx * dy;
+		q[2] += mass * 3.0 * dx * dz;
+		q[3] += mass * (3.0 * dy * dy - r2);
+		q[4] += mass * 3.0 * dy * dz;
+		q[5] += mass * (3.0 * dz * dz - r2);
+	}
+
+	// Acceleration at p from a point mass at p + d
+	void addPoint(double dx, double dy, double dz, double mass, double* acc) const
+	{
+		double r2 = dx * dx + dy * dy + dz * dz + softening2;
+		double invR = 1.0 / std::sqrt(r2);
+		double scale = mass * invR * invR * invR;
+		acc[0] += dx * scale; acc[1] += dy * scale; acc[2] += dz * scale;
+	}
+
+	void collectGroups(uint32_t index)
+	{
+		const Node& node = nodes[index];
+		if (node.end - node.begin <= GroupSize || node.childCount == 0)
+		{
+			groups.push_back(index);
+			return;
+		}
+
+		for (uint32_t c = 0; c < node.childCount; c++)
+			collectGroups(node.firstChild + c);
+	}
+
+	// Far cells and near particles of a whole group, gathered into arrays for the kernels
+	struct InteractionList
+	{
+		std::vector<double> cellX, cellY, cellZ, cellMass;
+		std::vector<double> cellQ[6];
+		std::vector<double> bodyX, bodyY, bodyZ, bodyMass;
+
+		void clear()
+		{
+			cellX.clear(); cellY.clear(); cellZ.clear(); cellMass.clear();
+			for (std::vector<double>& q : cellQ)
+				q.clear();
+			bodyX.clear(); bodyY.clear(); bodyZ.clear(); bodyMass.clear();
+		}
+	};
+
+	// Walks the tree once for a group, with the opening test widened by the radius of its particles,
+	// then sums the lists for every particle in it. Returns the number of interactions.
+	size_t evaluateGroup(const Node& group, InteractionList& list, double* ax, double* ay, double* az) const
+	{
+		double low[3] = { HUGE_VAL, HUGE_VAL, HUGE_VAL }, high[3] = { -HUGE_VAL, -HUGE_VAL, -HUGE_VAL };
+		for (uint32_t i = group.begin; i < group.end; i++)
+		{
+			low[0] = std::min(low[0], px[i]); high[0] = std::max(high[0], px[i]);
+			low[1] = std::min(low[1], py[i]); high[1] = std::max(high[1], py[i]);
+			low[2] = std::min(low[2], pz[i]); high[2] = std::max(high[2], pz[i]);
+		}
+
+		double center[3], radius2 = 0.0;
+		for (int k = 0; k < 3; k++)
+		{
+			center[k] = 0.5 * (low[k] + high[k]);
+			radius2 += 0.25 * (high[k] - low[k]) * (high[k] - low[k]);
+		}
+		double radius = std::sqrt(radius2);
+
+		list.clear();
+
+		uint32_t stack[64 * 8];
+		int top = 0;
+		stack[top++] = 0;
+
+		while (top > 0)
+		{
+			const Node& node = nodes[stack[--top]];
+
+			double dx = node.com[0] - center[0], dy = node.com[1] - center[1], dz = node.com[2] - center[2];
+			double reach = node.openingRadius + radius;
+
+			if (dx * dx + dy * dy + dz * dz > reach * reach)
+			{
+				list.cellX.push_back(node.com[0]);
+				list.cellY.push_back(node.com[1]);
+				list.cellZ.push_back(node.com[2]);
+				list.cellMass.push_back(node.mass);
+				for (int k = 0; k < 6; k++)
+					list.cellQ[k].push_back(node.quadrupole[k]);
+			}
+			else if (node.childCount == 0)
+			{
+				list.bodyX.insert(list.bodyX.end(), px.begin() + node.begin, px.begin() + node.end);
+				list.bodyY.insert(list.bodyY.end(), py.begin() + node.begin, py.begin() + node.end);
+				list.bodyZ.insert(list.bodyZ.end(), pz.begin() + node.begin, pz.begin() + node.end);
+				list.bodyMass.insert(list.bodyMass.end(), pm.begin() + node.begin, pm.begin() + node.end);
+			}
+			else
+			{
+				for (uint32_t c = 0; c < node.childCount; c++)
+					stack[top++] = node.firstChild + c;
+			}
+		}
+
+		for (uint32_t i = group.begin; i < group.end; i++)
+		{
+			double acc[3] = { 0.0, 0.0, 0.0 };
+
+			// The particle itself is in the body list, at zero distance
+			addBodies(list, px[i], py[i], pz[i], acc);
+			addCells(list, px[i], py[i], pz[i], acc);
+
+			size_t original = order[i];
+			ax[original] = acc[0];
+			ay[original] = acc[1];
+			az[original] = acc[2];
+		}
+
+		return (group.end - group.begin) * (list.cellMass.size() + list.bodyMass.size() - 1);
+	}
+
+	void addBodies(const InteractionList& list, double x, double y, double z, double* acc) const
+	{
+		size_t n = list.bodyMass.size(), j = 0;
+
+#if defined(__AVX2__)
+		__m256d xi = _mm256_set1_pd(x), yi = _mm256_set1_pd(y), zi = _mm256_set1_pd(z);
+		__m256d eps2 = _mm256_set1_pd(softening2), zero = _mm256_setzero_pd(), one = _mm256_set1_pd(1.0);
+		__m256d accX = zero, accY = zero, accZ = zero;
+
+		for (; j + 4 <= n; j += 4)
+		{
+			__m256d dx = _mm256_sub_pd(_mm256_loadu_pd(&list.bodyX[j]), xi);
+			__m256d dy = _mm256_sub_pd(_mm256_loadu_pd(&list.bodyY[j]), yi);
+			__m256d dz = _mm256_sub_pd(_mm256_loadu_pd(&list.bodyZ[j]), zi);
+			__m256d d2 = _mm256_add_pd(_mm256_add_pd(_mm256_mul_pd(dx, dx), _mm256_mul_pd(dy, dy)), _mm256_mul_pd(dz, dz));
+
+			// m / r^3, zero for the particle itself
+			__m256d invR = _mm256_div_pd(one, _mm256_sqrt_pd(_mm256_add_pd(d2, eps2)));
+			__m256d scale = _mm256_mul_pd(_mm256_mul_pd(invR, invR), _mm256_mul_pd(invR, _mm256_loadu_pd(&list.bodyMass[j])));
+			scale = _mm256_and_pd(scale, _mm256_cmp_pd(d2, zero, _CMP_GT_OQ));
+
+			accX = _mm256_add_pd(accX, _mm256_mul_pd(dx, scale));
+			accY = _mm256_add_pd(accY, _mm256_mul_pd(dy, scale));
+			accZ = _mm256_add_pd(accZ, _mm256_mul_pd(dz, scale));
+		}
+
+		acc[0] += horizontalSum(accX);
+		acc[1] += horizontalSum(accY);
+		acc[2] += horizontalSum(accZ);
+#endif
+
+		for (; j < n; j++)
+		{
+			double dx = list.bodyX[j] - x, dy = list.bodyY[j] - y, dz = list.bodyZ[j] - z;
+			if (dx * dx + dy * dy + dz * dz > 0.0)
+				addPoint(dx, dy, dz, list.bodyMass[j], acc);
+		}
+	}
+
+	// Monopole and, if enabled, quadrupole of the far cells
+	void addCells(const InteractionList& list, double x, double y, double z, double* acc) const
+	{
+		size_t n = list.cellMass.size(), j = 0;
+		const std::vector<double>* q = list.cellQ;
+
+#if defined(__AVX2__)
+		__m256d xi = _mm256_set1_pd(x), yi = _mm256_set1_pd(y), zi = _mm256_set1_pd(z);
+		__m256d eps2 = _mm256_set1_pd(softening2), one = _mm256_set1_pd(1.0), fiveHalves = _mm256_set1_pd(2.5);
+		__m256d accX = _mm256_setzero_pd(), accY = _mm256_setzero_pd(), accZ = _mm256_setzero_pd();
+
+		for (; j + 4 <= n; j += 4)
+		{
+			__m256d dx = _mm256_sub_pd(_mm256_loadu_pd(&list.cellX[j]), xi);
+			__m256d dy = _mm256_sub_pd(_mm256_loadu_pd(&list.cellY[j]), yi);
+			__m256d dz = _mm256_sub_pd(_mm256_loadu_pd(&list.cellZ[j]), zi);
+			__m256d r2 = _mm256_add_pd(_mm256_add_pd(_mm256_mul_pd(dx, dx), _mm256_mul_pd(dy, dy)), _mm256_add_pd(_mm256_mul_pd(dz, dz), eps2));
+
+			__m256d invR = _mm256_div_pd(one, _mm256_sqrt_pd(r2));
+			__m256d invR2 = _mm256_mul_pd(invR, invR);
+			__m256d invR3 = _mm256_mul_pd(invR, invR2);
+
+			__m256d scale = _mm256_mul_pd(invR3, _mm256_loadu_pd(&list.cellMass[j]));
+			__m256d sumX = _mm256_mul_pd(dx, scale), sumY = _mm256_mul_pd(dy, scale), sumZ = _mm256_mul_pd(dz, scale);
+
+			if (useQuadrupole)
+			{
+				__m256d q0 = _mm256_loadu_pd(&q[0][j]), q1 = _mm256_loadu_pd(&q[1][j]), q2 = _mm256_loadu_pd(&q[2][j]);
+				__m256d q3 = _mm256_loadu_pd(&q[3][j]), q4 = _mm256_loadu_pd(&q[4][j]), q5 = _mm256_loadu_pd(&q[5][j]);
+
+				__m256d qx = _mm256_add_pd(_mm256_add_pd(_mm256_mul_pd(q0, dx), _mm256_mul_pd(q1, dy)), _mm256_mul_pd(q2, dz));
+				__m256d qy = _mm256_add_pd(_mm256_add_pd(_mm256_mul_pd(q1, dx), _mm256_mul_pd(q3, dy)), _mm256_mul_pd(q4, dz));
+				__m256d qz = _mm256_add_pd(_mm256_add_pd(_mm256_mul_pd(q2, dx), _mm256_mul_pd(q4, dy)), _mm256_mul_pd(q5, dz));
+				__m256d sQs = _mm256_add_pd(_mm256_add_pd(_mm256_mul_pd(dx, qx), _mm256_mul_pd(dy, qy)), _mm256_mul_pd(dz, qz));
+
+				__m256d invR5 = _mm256_mul_pd(invR3, invR2);
+				__m256d radial = _mm256_mul_pd(_mm256_mul_pd(fiveHalves, sQs), _mm256_mul_pd(invR5, invR2));
+
+				sumX = _mm256_add_pd(sumX, _mm256_sub_pd(_mm256_mul_pd(radial, dx), _mm256_mul_pd(qx, invR5)));
+				sumY = _mm256_add_pd(sumY, _mm256_sub_pd(_mm256_mul_pd(radial, dy), _mm256_mul_pd(qy, invR5)));
+				sumZ = _mm256_add_pd(sumZ, _mm256_sub_pd(_mm256_mul_pd(radial, dz), _mm256_mul_pd(qz, invR5)));
+			}
+
+			accX = _mm256_add_pd(accX, sumX);
+			accY = _mm256_add_pd(accY, sumY);
+			accZ = _mm256_add_pd(accZ, sumZ);
+		}
+
+		acc[0] += horizontalSum(accX);
+		acc[1] += horizontalSum(accY);
+		acc[2] += horizontalSum(accZ);
+#endif
+
+		for (; j < n; j++)
+		{
+			// d points from the particle to com
+			double dx = list.cellX[j] - x, dy = list.cellY[j] - y, dz = list.cellZ[j] - z;
+			double invR = 1.0 / std::sqrt(dx * dx + dy * dy + dz * dz + softening2);
+			double invR2 = invR * invR;
+			double invR3 = invR * invR2;
+
+			double scale = list.cellMass[j] * invR3;
+			acc[0] += dx * scale; acc[1] += dy * scale; acc[2] += dz * scale;
+
+			if (useQuadrupole)
+			{
+				// With s = particle - com = -d: a = Q s / r^5 - 5/2 (s.Q.s) s / r^7
+				double qx = q[0][j] * dx + q[1][j] * dy + q[2][j] * dz;
+				double qy = q[1][j] * dx + q[3][j] * dy + q[4][j] * dz;
+				double qz = q[2][j] * dx + q[4][j] * dy + q[5][j] * dz;
+				double sQs = dx * qx + dy * qy + dz * qz;
+
+				double invR5 = invR3 * invR2;
+				double radial = 2.5 * sQs * invR5 * invR2;
+				acc[0] += -qx * invR5 + radial * dx;
+				acc[1] += -qy * invR5 + radial * dy;
+				acc[2] += -qz * invR5 + radial * dz;
+			}
+		}
+	}
+
+#if defined(__AVX2__)
+	static double horizontalSum(__m256d v)
+	{
+		__m128d sum = _mm_add_pd(_mm256_castpd256_pd128(v), _mm256_extractf128_pd(v, 1));
+		return _mm_cvtsd_f64(_mm_add_sd(sum, _mm_unpackhi_pd(sum, sum)));
+	}
+#endif
+
+	// Sorted blocks merged pairwise
+	static void parallelSort(std::vector<std::pair<uint64_t, size_t>>& keys)
+	{
+		JobSystem& jobs = JobSystem::instance();
+
+		size_t blockCount = 1;
+		while (blockCount < jobs.threadCount() * 2 && keys.size() / (blockCount * 2) >= 16384)
+			blockCount *= 2;
+
+		size_t n = keys.size();
+		jobs.parallelFor(blockCount, 1, [&](size_t first, size_t last)
+		{
+			for (size_t b = first; b < last; b++)
+				std::sort(keys.begin() + n * b / blockCount, keys.begin() + n * (b + 1) / blockCount);
+		});
+
+		for (size_t width = 1; width < blockCount; width *= 2)
+		{
+			size_t merges = blockCount / (width * 2);
+			jobs.parallelFor(merges, 1, [&](size_t first, size_t last)
+			{
+				for (size_t m = first; m < last; m++)
+				{
+					size_t b = m * width * 2;
+					std::inplace_merge(keys.begin() + n * b / blockCount, keys.begin() + n * (b + width) / blockCount,
+						keys.begin() + n * (b + width * 2) / blockCount);
+				}
+			});
+		}
+	}
+};
+
+#endif
@@ -0,0 +1,400 @@
+#ifndef BODY_ENTITIES_H
+#define BODY_ENTITIES_H
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <vector>
+#include <string>
+#include <memory>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstddef>
+
+#include "Planet.h"
+#include "SimulationThread.h"
+#include "TransformHierarchy.h"
+#include "Frustum.h"
+#include "CacheCounters.h"
+#include "UpdateScheduler.h"
+
+typedef uint32_t Entity;
+static constexpr Entity noEntity = UINT32_MAX;
+
+// Components of one type packed together in the order they were added. A sparse index maps an
+// entity to its slot, removal moves the last component into the hole.
+template<typename T>
+class ComponentArray
+{
+public:
+	T& add(Entity entity, const T& component)
+	{
+		if (entity >= slots.size())
+			slots.resize(entity + 1, noSlot);
+
+		slots[entity] = (uint32_t)components.size();
+		components.push_back(component);
+		owners.push_back(entity);
+		return components.back();
+	}
+
+	void remove(Entity entity)
+	{
+		uint32_t slot = slots[entity];
+		components[slot] = components.back();
+		owners[slot] = owners.back();
+		slots[owners[slot]] = slot;
+		slots[entity] = noSlot;
+
+		components.pop_back();
+		owners.pop_back();
+	}
+
+	bool has(Entity entity) const
+	{
+		return entity < slots.size() && slots[entity] != noSlot;
+	}
+
+	T& get(Entity entity)
+	{
+		return components[slots[entity]];
+	}
+
+	const T& get(Entity entity) const
+	{
+		return components[slots[entity]];
+	}
+
+	// By slot
+	T& operator[](size_t slot)
+	{
+		return components[slot];
+	}
+
+	const T& operator[](size_t slot) const
+	{
+		return components[slot];
+	}
+
+	Entity owner(size_t slot) const
+	{
+		return owners[slot];
+	}
+
+	size_t size() const
+	{
+		return components.size();
+	}
+
+private:
+	static constexpr uint32_t noSlot = UINT32_MAX;
+
+	std::vector<T> components;
+	std::vector<Entity> owners;
+	std::vector<uint32_t> slots;
+};
+
+// Which simulated body an entity follows, how its orbit maps onto the scene and how fast it spins
+struct OrbitComponent
+{
+	SolarSystem::Body source;
+	float sceneDistance;
+	float spinSpeed;
+};
+
+// Scene nodes and their world matrices as of the last hierarchy update
+struct TransformComponent
+{
+	TransformHierarchy::NodeId orbitNode, spinNode, ringNode;
+	glm::mat4 body, rings;
+};
+
+// Sphere around the body and its rings, and whether it was in view
+struct BoundsComponent
+{
+	float radius;
+	bool visible;
+};
+
+// The GL side, meshes, materials, rings and terrain, only touched when drawing
+struct RenderComponent
+{
+	Planet* planet;
+	bool drawOrbit;
+};
+
+struct LightComponent
+{
+	glm::vec3 color;
+};
+
+struct LayoutStats
+{
+	size_t bodies = 0;
+	double legacyMs = 0.0, packedMs = 0.0;
+
+	bool countersAvailable = false;
+	uint64_t legacyL1Misses = 0, packedL1Misses = 0;
+	uint64_t legacyLastLevelMisses = 0, packedLastLevelMisses = 0;
+};
+
+// Bodies as entities with their state in packed component arrays, and the systems that run over
+// them each frame. Every system reads only the arrays it needs, so placing and culling bodies
+// streams through a few small arrays instead of whole Planet objects.
+class BodyEntities
+{
+public:
+	ComponentArray<OrbitComponent> orbits;
+	ComponentArray<TransformComponent> transforms;
+	ComponentArray<ScheduleComponent> schedules;
+	ComponentArray<BoundsComponent> bounds;
+	ComponentArray<RenderComponent> renders;
+	ComponentArray<LightComponent> lights;
+
+	Entity create()
+	{
+		return nextEntity++;
+	}
+
+	// A simulated body with a spin and ring node under its parent's orbit node. Parents are
+	// created before their children.
+	Entity addBody(TransformHierarchy& scene, TransformHierarchy::NodeId parentNode, SolarSystem::Body source, float sceneDistance, Planet* planet, bool drawOrbit)
+	{
+		Entity entity = create();
+		orbits.add(entity, { source, sceneDistance, planet->getRotationSpeed() });
+
+		TransformComponent transform;
+		transform.orbitNode = scene.add(parentNode);
+		transform.spinNode = scene.add(transform.orbitNode);
+		transform.ringNode = scene.add(transform.orbitNode);
+		transform.body = transform.rings = glm::mat4(1.0f);
+		transforms.add(entity, transform);
+		schedules.add(entity, ScheduleComponent());
+
+		bounds.add(entity, { planet->getBoundingRadius(), true });
+		renders.add(entity, { planet, drawOrbit });
+		return entity;
+	}
+
+	// Evaluated at the next update whatever the scheduler says: the body the camera looks at, or
+	// all of them when positions jump
+	void focus(Entity entity)
+	{
+		schedules.get(entity).forced = true;
+	}
+
+	void forceUpdates()
+	{
+		for (size_t i = 0; i < schedules.size(); i++)
+			schedules[i].forced = true;
+	}
+
+	// Orbit, schedule and transform: positions relative to the parents, evaluated when the scheduler
+	// says they're due and extrapolated otherwise, and spins into the hierarchy. Returns how many
+	// positions were evaluated.
+	size_t placeBodies(TransformHierarchy& scene, const SimulationState& state, float alpha, float time, const glm::vec3& cameraPos, float pixelsPerRadian)
+	{
+		size_t evaluated = 0;
+		for (size_t i = 0; i < orbits.size(); i++)
+		{
+			const OrbitComponent& orbit = orbits[i];
+			Entity entity = orbits.owner(i);
+			const TransformComponent& transform = transforms.get(entity);
+			ScheduleComponent& schedule = schedules.get(entity);
+
+			glm::vec3 position;
+			if (UpdateScheduler::due(schedule, time))
+			{
+				position = state.scenePosition(orbit.source, orbit.sceneDistance, alpha);
+				UpdateScheduler::sample(schedule, position, time, glm::length(glm::vec3(transform.body[3]) - cameraPos), pixelsPerRadian);
+				evaluated++;
+			}
+			else
+				position = UpdateScheduler::position(schedule, time);
+
+			scene.setLocal(transform.orbitNode, glm::translate(glm::mat4(1.0f), position));
+			scene.setLocal(transform.spinNode, glm::rotate(glm::mat4(1.0f), orbit.spinSpeed * time, glm::vec3(0.0f, 0.0f, 1.0f)));
+		}
+
+		scene.update();
+		for (size_t i = 0; i < transforms.size(); i++)
+		{
+			TransformComponent& transform = transforms[i];
+			transform.body = scene.getWorld(transform.spinNode);
+			transform.rings = scene.getWorld(transform.ringNode);
+		}
+
+		return evaluated;
+	}
+
+	// The nearest body whose bounding sphere the ray hits, noEntity if none
+	Entity pick(const glm::vec3& origin, const glm::vec3& direction) const
+	{
+		Entity nearest = noEntity;
+		float nearestDistance = INFINITY;
+		glm::vec3 unit = glm::normalize(direction);
+
+		for (size_t i = 0; i < bounds.size(); i++)
+		{
+			glm::vec3 toCenter = glm::vec3(transforms.get(bounds.owner(i)).body[3]) - origin;
+			float along = glm::dot(toCenter, unit), radius = bounds[i].radius;
+			if (along < 0.0f || glm::dot(toCenter, toCenter) - along * along > radius * radius)
+				continue;
+
+			if (along < nearestDistance)
+			{
+				nearestDistance = along;
+				nearest = bounds.owner(i);
+			}
+		}
+
+		return nearest;
+	}
+
+	// Transform and bounds: which bodies are in view
+	void cull(const Frustum& frustum)
+	{
+		spheres.resize(bounds.size());
+		visible.resize(bounds.size());
+
+		for (size_t i = 0; i < bounds.size(); i++)
+			spheres[i] = glm::vec4(glm::vec3(transforms.get(bounds.owner(i)).body[3]), bounds[i].radius);
+
+		frustum.cull(spheres.data(), spheres.size(), visible.data());
+		for (size_t i = 0; i < bounds.size(); i++)
+			bounds[i].visible = visible[i] != 0;
+	}
+
+	// Hands the planets their matrices and picks their level of detail
+	void updateDetail(const glm::vec3& cameraPos, float viewportHeight, float fovY, bool adaptive)
+	{
+		for (size_t i = 0; i < renders.size(); i++)
+		{
+			Entity entity = renders.owner(i);
+			const TransformComponent& transform = transforms.get(entity);
+
+			Planet* planet = renders[i].planet;
+			planet->setTransforms(transform.body, transform.rings);
+			planet->setAdaptiveMesh(adaptive);
+			planet->updateDetail(cameraPos, viewportHeight, fovY);
+		}
+	}
+
+	// Lit by the first light, bodies out of view only draw their orbit
+	void render(const glm::mat4& view, const glm::mat4& projection, const glm::vec3& viewPos, bool visibleOrbits)
+	{
+		glm::vec3 lightPos(0.0f), lightColor(1.0f);
+		if (lights.size() > 0)
+		{
+			lightPos = glm::vec3(transforms.get(lights.owner(0)).body[3]);
+			lightColor = lights[0].color;
+		}
+
+		for (size_t i = 0; i < renders.size(); i++)
+		{
+			const RenderComponent& render = renders[i];
+			render.planet->setVisible(bounds.get(renders.owner(i)).visible);
+			render.planet->render(view, projection, lightPos, lightColor, viewPos, render.drawOrbit && visibleOrbits);
+		}
+	}
+
+	// The orbit-to-matrix update over count bodies, once with the state inside Planet-sized objects
+	// allocated one by one, as before, and once with the packed orbit and transform arrays
+	static LayoutStats measureLayouts(size_t count)
+	{
+		// Planet's members in Planet's order, with shaders, meshes and GL objects as the handles they hold
+		struct LegacyBody
+		{
+			unsigned int shaderProgram, sunOrbitShaderProgram;
+			MeshHandle bodyMesh, ringMesh, sunOrbitMesh;
+			std::vector<glm::vec2> ringRadii;
+			float sunOrbitThickness;
+			glm::mat4 orbitShape;
+			unsigned int textureID, orbitTextureID, cloudTextureID;
+			bool isLight, hasClouds;
+			glm::mat4 modelMatrix, ringMatrix;
+			bool visible;
+			float distanceFromSun, rotationAroundSelfSpeed;
+			std::vector<glm::vec4> orbitColors;
+			float bodyRadius;
+			std::string bodyTexturePath, bodyFragmentShaderPath;
+			std::unique_ptr<int> terrain, terrainShaderProgram;
+			bool drawTerrain;
+			float terrainRange, surfaceHeightScale;
+			std::unique_ptr<int> tessBody, tessShaderProgram, lodBody;
+			bool adaptiveMesh;
+			float viewportHeight;
+		};
+
+		glm::mat4 ecliptic = glm::rotate(glm::mat4(1.0f), glm::radians(-90.0f), glm::vec3(1.0f, 0.0f, 0.0f));
+		auto modelMatrix = [&ecliptic](float distance, float spin, float time)
+			{
+				glm::vec3 position(distance * cosf(time / distance), distance * sinf(time / distance), 0.0f);
+				return glm::rotate(glm::translate(ecliptic, position), spin * time, glm::vec3(0.0f, 0.0f, 1.0f));
+			};
+
+		std::vector<std::unique_ptr<LegacyBody>> legacy;
+		BodyEntities packed;
+		for (size_t i = 0; i < count; i++)
+		{
+			float distance = 5.0f + (float)(i % 1000) * 0.05f, spin = 0.01f * (float)(i % 7);
+
+			// Strings and vectors allocated in between, like the real objects
+			legacy.push_back(std::make_unique<LegacyBody>());
+			legacy.back()->distanceFromSun = distance;
+			legacy.back()->rotationAroundSelfSpeed = spin;
+			legacy.back()->bodyTexturePath = "Textures/Planets/planet_surface.jpg";
+			legacy.back()->bodyFragmentShaderPath = "ShaderData/Planets/fragment_shader.txt";
+			legacy.back()->orbitColors.resize(4);
+
+			Entity entity = packed.create();
+			packed.orbits.add(entity, { SolarSystem::Mercury, distance, spin });
+			packed.transforms.add(entity, { 0, 0, 0, glm::mat4(1.0f), glm::mat4(1.0f) });
+		}
+
+		LayoutStats stats;
+		stats.bodies = count;
+		const int runs = 10;
+		CacheCounters counters;
+		stats.countersAvailable = counters.available();
+
+		counters.start();
+		auto begin = std::chrono::high_resolution_clock::now();
+		for (int run = 0; run < runs; run++)
+		{
+			for (const std::unique_ptr<LegacyBody>& body : legacy)
+				body->modelMatrix = modelMatrix(body->distanceFromSun, body->rotationAroundSelfSpeed, (float)run);
+		}
+		stats.legacyMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - begin).count() / runs;
+		counters.stop();
+		stats.legacyL1Misses = counters.l1Misses / runs;
+		stats.legacyLastLevelMisses = counters.lastLevelMisses / runs;
+
+		counters.start();
+		begin = std::chrono::high_resolution_clock::now();
+		for (int run = 0; run < runs; run++)
+		{
+			for (size_t i = 0; i < packed.orbits.size(); i++)
+			{
+				const OrbitComponent& orbit = packed.orbits[i];
+				packed.transforms[i].body = modelMatrix(orbit.sceneDistance, orbit.spinSpeed, (float)run);
+			}
+		}
+		stats.packedMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - begin).count() / runs;
+		counters.stop();
+		stats.packedL1Misses = counters.l1Misses / runs;
+		stats.packedLastLevelMisses = counters.lastLevelMisses / runs;
+
+		return stats;
+	}
+
+private:
+	Entity nextEntity = 0;
+
+	// Scratch for culling
+	std::vector<glm::vec4> spheres;
+	std::vector<unsigned char> visible;
+};
+
+#endif
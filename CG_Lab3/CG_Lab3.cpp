@@ -6,29 +6,80 @@
 
 #include <iostream>
 #include <vector>
+#include <string>
+#include <memory>
+#include <algorithm>
+#include <cstdlib>
+#include <chrono>
 #include <cmath>
+#include <random>
 
 #include "Shader.h"
 #include "Camera.h"
 #include "Figures.h"
 #include "Planet.h"
 #include "Skybox.h"
+#include "SolarSystem.h"
+#include "SimulationThread.h"
+#include "Frustum.h"
+#include "TransformHierarchy.h"
+#include "BodyEntities.h"
+#include "ModelMatrices.h"
+#include "TestParticles.h"
+#include "PointSprites.h"
+#include "RingParticles.h"
+#include "AsteroidBelt.h"
+#include "SmallBodyCatalogue.h"
+#include "OrbitTrails.h"
 
 #define PI 3.14159265358979323846
 
 void processInput(GLFWwindow* window, glm::mat4* projection, float& deltaTime, float currentFrame);
 void framebuffer_size_callback(GLFWwindow* window, int width, int height);
 void mouse_callback(GLFWwindow* window, double xpos, double ypos);
-
-bool spaceKeyPressed = false, pKeyPressed = false;
+void printStats(const std::vector<std::pair<const char*, Planet*>>& bodies, const SimulationState& simulation, const ThreadTiming& renderTiming, double overlapMsPerSecond, const ParticleStats& probes, RingParticles* ring, const BeltStats& belt, const CatalogueStats& catalogue, const TrailStats& trails);
+void printBenchmarks();
+void heliocentricSources(const SimulationState& state, float alpha, glm::dvec3* sources);
+void launchProbes(TestParticles& probes, const SimulationState& state, float alpha, size_t count);
+
+bool spaceKeyPressed = false, pKeyPressed = false, iKeyPressed = false, lKeyPressed = false, bKeyPressed = false, eKeyPressed = false;
+bool plusKeyPressed = false, minusKeyPressed = false, jKeyPressed = false, gKeyPressed = false, oKeyPressed = false;
+bool statsRequested = false, benchmarkRequested = false, launchRequested = false;
+int screenWidth = 800, screenHeight = 600;
 float lastMouseX = 400, lastMouseY = 300;
 bool firstMouseMovement = true;
 bool visibleOrbits = true;
+bool adaptiveBodies = true;
+
+// G swaps Saturn's tori for this many colliding particles
+bool simulatedRing = false;
+const size_t ringParticleCount = 1000000;
+
+// Where positions come from, the ephemeris and the series can be scrubbed a decade per second
+// with the arrow keys
+SolarSystem::Source positionSource = SolarSystem::Simulation;
+int scrubDirection = 0;
 
-bool pause = false;
+bool paused = false;
 float pausedTime = 0.0f;
 float pauseStartTime = 0.0f;
 
+// Scene seconds per wall second, + and - change it tenfold
+double timeWarp = 1.0;
+
+// J launches a swarm of this many probes from the Earth, up to maxProbes in all
+const size_t probesPerLaunch = 100000, maxProbes = 1000000;
+
+// Asteroids between 2.1 and 3.3 AU
+const size_t asteroidCount = 1000000;
+
+// O swaps the orbit tori for trails of where the bodies have been, this many samples over the
+// last orbit or trailDays, whichever is shorter, cut by up to half where the trails round their
+// intervals to share a class
+bool orbitTrails = false;
+const size_t trailSamples = 256;
+const double trailDays = 730.0;
+
 // Creating a camera
 Camera camera(
     5.0f,                              // speed
@@ -39,8 +90,25 @@ Camera camera(
     glm::vec3(0.0f, 1.0f, 0.0f),        // up
     glm::perspective(glm::radians(45.0f), 800.0f / 600.0f, 0.1f, 100.0f));    // projection   
 
-int main(void)
+int main(int argc, char* argv[])
 {
+    // "--ephemeris 1900 2100" refits the ephemeris file over those years and exits
+    if (argc == 4 && std::string(argv[1]) == "--ephemeris")
+    {
+        double startDay = (std::atof(argv[2]) - 2000.0) * 365.25, endDay = (std::atof(argv[3]) - 2000.0) * 365.25;
+        bool written = endDay > startDay && SolarSystem::writeEphemeris(SolarSystem::ephemerisFile, startDay, endDay);
+        std::cout << (written ? "Wrote " : "Failed to write ") << SolarSystem::ephemerisFile << std::endl;
+        return written ? 0 : -1;
+    }
+
+    // "--catalogue MPCORB.DAT" converts the Minor Planet Center's orbits for mapping at startup and exits
+    if (argc == 3 && std::string(argv[1]) == "--catalogue")
+    {
+        size_t objects = SmallBodyCatalogue::import(argv[2], SmallBodyCatalogue::file, SolarSystem::gmSun);
+        std::cout << (objects > 0 ? "Wrote " + std::to_string(objects) + " orbits to " : std::string("Failed to write ")) << SmallBodyCatalogue::file << std::endl;
+        return objects > 0 ? 0 : -1;
+    }
+
     GLFWwindow* window;
 
     // Initializing the library
@@ -49,13 +117,20 @@ int main(void)
         std::cout << "Failed to initialise GLFW" << std::endl;
         return -1;
     }
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+    // 4.1 enables tessellated bodies, 3.3 falls back to static levels of detail
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 1);
     glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
 
     // Creating a windowed mode window and its OpenGL context
     window = glfwCreateWindow(800, 600, "Lab 3", NULL, NULL);
     if (!window)
+    {
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+        window = glfwCreateWindow(800, 600, "Lab 3", NULL, NULL);
+    }
+    if (!window)
     {
         std::cout << "Failed to create GLFW window" << std::endl;
         glfwTerminate();
@@ -75,6 +150,15 @@ int main(void)
     glViewport(0, 0, 800, 600);
     glfwSetFramebufferSizeCallback(window, framebuffer_size_callback);
 
+    // Every texture starts decoding on the job system while shaders and meshes are set up
+    Texture::prefetch({
+        "Textures/Skybox/right.jpg", "Textures/Skybox/left.jpg", "Textures/Skybox/top.jpg",
+        "Textures/Skybox/bottom.jpg", "Textures/Skybox/front.jpg", "Textures/Skybox/back.jpg",
+        "Textures/Sun/sun.jpg", "Textures/Mercury/mercury.jpg", "Textures/Venus/venus_surface.jpg", "Textures/Venus/venus_atmosphere.jpg",
+        "Textures/Earth/earth_surface.jpg", "Textures/Earth/earth_clouds.jpg", "Textures/Earth/moon.jpg", "Textures/Mars/mars.jpg",
+        "Textures/Jupiter/jupiter.jpg", "Textures/Saturn/saturn.jpg", "Textures/Saturn/saturn_ring.png", "Textures/Uranus/uranus.jpg",
+        "Textures/Neptune/neptune.jpg", "Textures/Pluto/pluto.jpg" });
+
     //Skybox
     Skybox skybox(std::vector<std::string>{
         "Textures/Skybox/right.jpg",
@@ -87,23 +171,136 @@ int main(void)
         "ShaderData/Skybox/skybox_fragment.txt");
 
     // Creating planets
-    Planet sun(5.0f, 36, 18, 0.0f, 0.0f, glm::radians(10.0f), "ShaderData/Planets/vertex_shader.txt", "ShaderData/Planets/fragment_shader.txt", "Textures/Sun/sun.jpg", nullptr, nullptr, 0, true);
-    Planet mercury(0.19f, 36, 18, 7.2f, 1.05f, 0.00071f, "ShaderData/Planets/vertex_shader.txt", "ShaderData/Planets/fragment_shader.txt", "Textures/Mercury/mercury.jpg");
-    Planet venus(0.48f, 36, 18, 9.5f, 0.62f, 0.00017f, "ShaderData/Planets/vertex_shader.txt", "ShaderData/Planets/fragment_shader.txt", "Textures/Venus/venus_surface.jpg", "Textures/Venus/venus_atmosphere.jpg");
-    Planet earth(0.50f, 36, 18, 12.0f, 0.2f, 0.04167f, "ShaderData/Planets/vertex_shader.txt", "ShaderData/Planets/fragment_shader.txt", "Textures/Earth/earth_surface.jpg", "Textures/Earth/earth_clouds.jpg");
-    Planet mars(0.27f, 36, 18, 14.2f, 0.43f, 0.04060f, "ShaderData/Planets/vertex_shader.txt", "ShaderData/Planets/fragment_shader.txt", "Textures/Mars/mars.jpg");
-    Planet jupiter(3.0f, 36, 18, 19.5f, 0.08f, 0.1f, "ShaderData/Planets/vertex_shader.txt", "ShaderData/Planets/fragment_shader.txt", "Textures/Jupiter/jupiter.jpg");
-    Planet saturn(2.5f, 36, 18, 27.5f, 0.03f, 0.209260f, "ShaderData/Planets/vertex_shader.txt", "ShaderData/Planets/fragment_shader.txt", "Textures/Saturn/saturn.jpg", nullptr, "Textures/Saturn/saturn_ring.png", 20);
-    Planet uranus(1.5f, 36, 18, 35.0f, 0.1f, 0.05818f, "ShaderData/Planets/vertex_shader.txt", "ShaderData/Planets/fragment_shader.txt", "Textures/Uranus/uranus.jpg");
-    Planet neptune(1.4f, 36, 18, 39.0f, 0.006f, 0.06192f, "ShaderData/Planets/vertex_shader.txt", "ShaderData/Planets/fragment_shader.txt", "Textures/Neptune/neptune.jpg");
+    Planet sun(5.0f, 36, 18, 0.0f, glm::radians(10.0f), "ShaderData/Planets/vertex_shader.txt", "ShaderData/Planets/fragment_shader.txt", "Textures/Sun/sun.jpg", nullptr, nullptr, 0, true);
+    Planet mercury(0.19f, 36, 18, 7.2f, 0.00071f, "ShaderData/Planets/vertex_shader.txt", "ShaderData/Planets/fragment_shader.txt", "Textures/Mercury/mercury.jpg");
+    Planet venus(0.48f, 36, 18, 9.5f, 0.00017f, "ShaderData/Planets/vertex_shader.txt", "ShaderData/Planets/fragment_shader.txt", "Textures/Venus/venus_surface.jpg", "Textures/Venus/venus_atmosphere.jpg");
+    Planet earth(0.50f, 36, 18, 12.0f, 0.04167f, "ShaderData/Planets/vertex_shader.txt", "ShaderData/Planets/fragment_shader.txt", "Textures/Earth/earth_surface.jpg", "Textures/Earth/earth_clouds.jpg");
+    Planet mars(0.27f, 36, 18, 14.2f, 0.04060f, "ShaderData/Planets/vertex_shader.txt", "ShaderData/Planets/fragment_shader.txt", "Textures/Mars/mars.jpg");
+    Planet jupiter(3.0f, 36, 18, 19.5f, 0.1f, "ShaderData/Planets/vertex_shader.txt", "ShaderData/Planets/fragment_shader.txt", "Textures/Jupiter/jupiter.jpg");
+    Planet saturn(2.5f, 36, 18, 27.5f, 0.209260f, "ShaderData/Planets/vertex_shader.txt", "ShaderData/Planets/fragment_shader.txt", "Textures/Saturn/saturn.jpg", nullptr, "Textures/Saturn/saturn_ring.png", 20);
+    Planet uranus(1.5f, 36, 18, 35.0f, 0.05818f, "ShaderData/Planets/vertex_shader.txt", "ShaderData/Planets/fragment_shader.txt", "Textures/Uranus/uranus.jpg");
+    Planet neptune(1.4f, 36, 18, 39.0f, 0.06192f, "ShaderData/Planets/vertex_shader.txt", "ShaderData/Planets/fragment_shader.txt", "Textures/Neptune/neptune.jpg");
     // Yeah yeah it's not a planet
-    Planet pluto(0.1f, 36, 18, 41.5f, 0.004f, 0.00063f, "ShaderData/Planets/vertex_shader.txt", "ShaderData/Planets/fragment_shader.txt", "Textures/Pluto/pluto.jpg");
+    Planet pluto(0.1f, 36, 18, 41.5f, 0.00063f, "ShaderData/Planets/vertex_shader.txt", "ShaderData/Planets/fragment_shader.txt", "Textures/Pluto/pluto.jpg");
     // Earth moon
-    Planet moon(0.19f, 36, 18, 12.0f, 0.2f, 0.00071f, "ShaderData/Planets/vertex_shader.txt", "ShaderData/Planets/fragment_shader.txt", "Textures/Earth/moon.jpg");
+    Planet moon(0.19f, 36, 18, 12.0f, 0.00071f, "ShaderData/Planets/vertex_shader.txt", "ShaderData/Planets/fragment_shader.txt", "Textures/Earth/moon.jpg");
+
+    // All body and orbit geometry is built by now
+    MeshLibrary::instance().upload();
+
+    // Close approaches switch rocky bodies to terrain
+    mercury.enableTerrain(0.02f);
+    venus.enableTerrain(0.01f);
+    earth.enableTerrain(0.01f);
+    mars.enableTerrain(0.02f);
+    moon.enableTerrain(0.02f);
+    pluto.enableTerrain(0.02f);
+
+    // Same order as SolarSystem::Body
+    std::vector<std::pair<const char*, Planet*>> bodies = {
+        { "Sun", &sun }, { "Mercury", &mercury }, { "Venus", &venus }, { "Earth", &earth }, { "Moon", &moon }, { "Mars", &mars },
+        { "Jupiter", &jupiter }, { "Saturn", &saturn }, { "Uranus", &uranus }, { "Neptune", &neptune }, { "Pluto", &pluto } };
+
+    // Each body's position relative to its parent with its spin and rings below it, so the Moon
+    // follows wherever the Earth actually is
+    TransformHierarchy scene;
+    TransformHierarchy::NodeId ecliptic = scene.add(TransformHierarchy::none, glm::rotate(glm::mat4(1.0f), glm::radians(-90.0f), glm::vec3(1.0f, 0.0f, 0.0f)));
+
+    BodyEntities entities;
+    std::vector<Entity> bodyEntities(bodies.size());
+    for (int i = 0; i < SolarSystem::BodyCount; i++)
+    {
+        TransformHierarchy::NodeId parentNode = i == SolarSystem::Sun ? ecliptic : entities.transforms.get(bodyEntities[SolarSystem::parentOf((SolarSystem::Body)i)]).orbitNode;
+        float sceneDistance = i == SolarSystem::Moon ? 1.0f : bodies[i].second->getDistanceFromSun();
+        bodyEntities[i] = entities.addBody(scene, parentNode, (SolarSystem::Body)i, sceneDistance, bodies[i].second, i != SolarSystem::Sun);
+    }
+
+    // The Sun lights everything
+    entities.lights.add(bodyEntities[SolarSystem::Sun], { glm::vec3(1.0f, 1.0f, 0.8f) });
+
+    // Gravity drives the orbits, the Moon is kept 1 unit from the Earth as before
+    SolarSystem solarSystem;
+
+    // Fitted to the simulation over 1900-2100 on the first run
+    if (!solarSystem.openEphemeris(SolarSystem::ephemerisFile))
+    {
+        std::cout << "Building " << SolarSystem::ephemerisFile << std::endl;
+        SolarSystem::writeEphemeris(SolarSystem::ephemerisFile, -100.0 * 365.25, 100.0 * 365.25);
+        solarSystem.openEphemeris(SolarSystem::ephemerisFile);
+    }
+
+    // Only the simulation thread touches solarSystem from here on
+    SimulationThread simulation(solarSystem);
+
+    // Render thread busy time per second, and how much simulation work ran meanwhile
+    ThreadTiming renderTiming;
+    double renderBusyMs = 0.0, overlapMs = 0.0, overlapMsPerSecond = 0.0;
+    auto timingSecond = std::chrono::steady_clock::now();
+
+    // Orbit tori follow the real ellipses, the Moon keeps the Earth's
+    for (int i = SolarSystem::Mercury; i < SolarSystem::BodyCount; i++)
+    {
+        Planet* body = bodies[i].second;
+        SolarSystem::Body simulated = i == SolarSystem::Moon ? SolarSystem::Earth : (SolarSystem::Body)i;
+        body->setOrbitShape(SolarSystem::orbitEllipse(simulated, body->getDistanceFromSun()));
+    }
+
+    // Probes feel the Sun and every other body, and spread over the scene like the orbits do
+    TestParticles probes(SolarSystem::gmSun);
+    std::vector<glm::dvec2> probeRadii;
+    for (int i = SolarSystem::Mercury; i < SolarSystem::BodyCount; i++)
+    {
+        probes.addSource(SolarSystem::gmOf((SolarSystem::Body)i));
+        if (i != SolarSystem::Moon)
+            probeRadii.push_back(glm::dvec2(SolarSystem::getElements((SolarSystem::Body)i).semiMajorAxis, bodies[i].second->getDistanceFromSun()));
+    }
+    probes.setSceneRadii(probeRadii);
+    PointSprites probeSprites("ShaderData/Particles/vertex_shader.txt", "ShaderData/Particles/fragment_shader.txt");
+
+    // Built the first time it's shown, the inner edge goes round in 30 s
+    std::unique_ptr<RingParticles> saturnRing;
+    PointSprites ringSprites("ShaderData/Particles/vertex_shader.txt", "ShaderData/Particles/fragment_shader.txt");
 
-    // Lights
-    glm::vec3 lightPos(0.0f, 0.0f, 0.0f);
-    glm::vec3 lightColor(1.0f, 1.0f, 0.8f);
+    // The main belt, placed between Mars and Jupiter on the same scale as their orbits
+    double marsAu = SolarSystem::getElements(SolarSystem::Mars).semiMajorAxis, jupiterAu = SolarSystem::getElements(SolarSystem::Jupiter).semiMajorAxis;
+    auto beltEdge = [&](double au)
+    {
+        double t = (au - marsAu) / (jupiterAu - marsAu);
+        return glm::dvec2(au, mars.getDistanceFromSun() + t * (jupiter.getDistanceFromSun() - mars.getDistanceFromSun()));
+    };
+    AsteroidBelt belt(asteroidCount, SolarSystem::gmSun, beltEdge(2.1), beltEdge(3.3), "ShaderData/Asteroids/vertex_shader.txt", "ShaderData/Asteroids/fragment_shader.txt");
+
+    // Real asteroids and comets when a catalogue has been converted, placed like the probes
+    SmallBodyCatalogue catalogue;
+    if (catalogue.open(SmallBodyCatalogue::file))
+        std::cout << "Mapped " << catalogue.size() << " small bodies in " << catalogue.getStats().openMs << " ms" << std::endl;
+    SceneScale catalogueScale;
+    catalogueScale.setRadii(probeRadii);
+    PointSprites catalogueSprites("ShaderData/Particles/vertex_shader.txt", "ShaderData/Particles/fragment_shader.txt");
+
+    // Propagated again when the day changes, culled again when that or the view does
+    double catalogueDay = NAN;
+    glm::mat4 catalogueView(0.0f);
+
+    // The Moon's trail is sampled with the Earth's, so it shows the loops about the Earth's path
+    OrbitTrails trails((size_t)1 << 20, "ShaderData/Trails/vertex_shader.txt", "ShaderData/Trails/fragment_shader.txt");
+    std::vector<OrbitTrails::TrailId> bodyTrails(SolarSystem::BodyCount, OrbitTrails::noTrail);
+    std::vector<glm::vec3> trailPositions(SolarSystem::BodyCount);
+    for (int i = SolarSystem::Mercury; i < SolarSystem::BodyCount; i++)
+    {
+        SolarSystem::Body sampled = i == SolarSystem::Moon ? SolarSystem::Earth : (SolarSystem::Body)i;
+        double a = SolarSystem::getElements(sampled).semiMajorAxis;
+        double period = 2.0 * PI * std::sqrt(a * a * a / SolarSystem::gmSun);
+        bodyTrails[i] = trails.add(trailSamples, std::min(period, trailDays) / trailSamples, glm::vec4(0.7f, 0.85f, 1.0f, 0.8f));
+    }
+
+    // Day and source positions the probes were last advanced to
+    double probeDay = 0.0;
+    glm::dvec3 probeSources[SolarSystem::BodyCount - 1];
+    bool probesStarted = false;
+
+    // Source the body positions were last evaluated from
+    SolarSystem::Source placedSource = SolarSystem::Simulation;
 
     // Some additional stuff before render starts
     float deltaTime = 0.0f, lastFrame = 0.0f;
@@ -116,9 +313,11 @@ int main(void)
     // Render loop
     while (!glfwWindowShouldClose(window))
     {
+        auto frameBegin = std::chrono::steady_clock::now();
+
         // Keeping track of deltaTime
         float currentFrame = glfwGetTime();
-        if (!pause)
+        if (!paused)
         {
             deltaTime = currentFrame - lastFrame - pausedTime;
             lastFrame = currentFrame - pausedTime;
@@ -130,20 +329,144 @@ int main(void)
         // Update camera
         camera.updateView();
 
-        // Update planets
-        if (!pause)
+        // The simulation steps on its own thread, this one sends settings and reads its newest state
+        std::chrono::nanoseconds simulationBusy = simulation.busyTime();
+
+        simulation.setWarp(timeWarp);
+        simulation.setPaused(paused);
+        simulation.setSource(positionSource);
+        simulation.setScrub(scrubDirection);
+        const SimulationState& state = simulation.latest();
+
+        // Update planets, between the last two steps
+        float alpha = state.alphaAt(frameBegin);
+        float time = (float)state.renderSeconds(alpha);
+
+        // Positions are evaluated as often as they move on screen, always for the body in front of the
+        // camera, and for all of them when scrubbing or switching sources makes them jump
+        if (scrubDirection != 0 || state.source != placedSource)
+            entities.forceUpdates();
+        if (state.source != placedSource)
+            trails.clear();
+        placedSource = state.source;
+
+        Entity focused = entities.pick(camera.cameraPos, camera.cameraFront);
+        if (focused != noEntity)
+            entities.focus(focused);
+
+        entities.placeBodies(scene, state, alpha, time, camera.cameraPos, UpdateScheduler::pixelsPerRadian((float)screenHeight, glm::radians(45.0f)));
+
+        // Update level of detail, fov matches the camera projection
+        entities.updateDetail(camera.cameraPos, (float)screenHeight, glm::radians(45.0f), adaptiveBodies);
+
+        // Bodies outside the view only draw their orbit
+        entities.cull(Frustum(camera.projection * camera.view));
+
+        // Probes move on with the bodies' day, backwards too when scrubbing, as far as their step budget goes
+        double stepDays = SimulationClock::seconds(SimulationClock::stepTicks) * SolarSystem::daysPerSecond;
+        double day = state.day - stepDays * (1.0 - alpha);
+        glm::dvec3 sources[SolarSystem::BodyCount - 1];
+        heliocentricSources(state, alpha, sources);
+
+        if (probesStarted && probes.size() > 0)
+        {
+            // Past the step budget the swarm stops short and catches up on later frames, from where
+            // the sources were on the day it reached
+            double asked = day - probeDay;
+            double moved = probes.advance(asked, probeSources, sources);
+            if (moved == asked)
+            {
+                probeDay = day;
+                std::copy(sources, sources + SolarSystem::BodyCount - 1, probeSources);
+            }
+            else
+            {
+                for (int k = 0; k < SolarSystem::BodyCount - 1; k++)
+                    probeSources[k] += (sources[k] - probeSources[k]) * (moved / asked);
+                probeDay += moved;
+            }
+        }
+        else
+        {
+            probeDay = day;
+            std::copy(sources, sources + SolarSystem::BodyCount - 1, probeSources);
+        }
+        probesStarted = true;
+
+        // New probes start on the swarm's day, so they wait while it catches up
+        if (launchRequested && probeDay == day)
+        {
+            if (probes.size() < maxProbes)
+                launchProbes(probes, state, alpha, std::min(probesPerLaunch, maxProbes - probes.size()));
+            launchRequested = false;
+        }
+
+        if (probes.size() > 0)
+        {
+            probes.writeScene(probeSprites.map(probes.size()));
+            probeSprites.unmap();
+        }
+
+        // Trails sample where the bodies are drawn
+        for (int i = SolarSystem::Mercury; i < SolarSystem::BodyCount; i++)
+            if (bodyTrails[i] != OrbitTrails::noTrail)
+                trailPositions[bodyTrails[i]] = glm::vec3(entities.transforms.get(bodyEntities[i]).body[3]);
+        trails.append(day, trailPositions.data());
+
+        if (catalogue.isOpen())
+        {
+            glm::mat4 viewProjection = camera.projection * camera.view;
+            bool moved = day != catalogueDay;
+            if (moved)
+            {
+                catalogue.propagate(day);
+                catalogueDay = day;
+            }
+
+            if (moved || viewProjection != catalogueView)
+            {
+                size_t visible = catalogue.gatherVisible(catalogueScale, Frustum(viewProjection));
+                float* positions = catalogueSprites.map(visible);
+                if (visible > 0)
+                    catalogue.writeVisible(positions);
+                catalogueSprites.unmap();
+                catalogueView = viewProjection;
+            }
+        }
+
+        if (simulatedRing && !saturnRing)
+        {
+            glm::vec2 span = saturn.getRingSpan();
+            saturnRing = std::make_unique<RingParticles>(ringParticleCount, span.x, span.y, 30.0f);
+        }
+        saturn.setRingsVisible(!simulatedRing);
+
+        if (simulatedRing)
+        {
+            if (!paused)
+                saturnRing->step(std::min(deltaTime, 1.0f / 30.0f));
+            saturnRing->writePositions(ringSprites.map(saturnRing->size()));
+            ringSprites.unmap();
+        }
+
+        if (statsRequested)
         {
-            sun.updatePos(currentFrame - pausedTime);
-            mercury.updatePos(currentFrame - pausedTime);
-            venus.updatePos(currentFrame - pausedTime);
-            earth.updatePos(currentFrame - pausedTime);
-            moon.updatePos(currentFrame - pausedTime, earth.getDistanceFromSun());
-            mars.updatePos(currentFrame - pausedTime);
-            jupiter.updatePos(currentFrame - pausedTime);
-            saturn.updatePos(currentFrame - pausedTime);
-            uranus.updatePos(currentFrame - pausedTime);
-            neptune.updatePos(currentFrame - pausedTime);
-            pluto.updatePos(currentFrame - pausedTime);
+            printStats(bodies, state, renderTiming, overlapMsPerSecond, probes.getStats(), saturnRing.get(), belt.getStats(), catalogue.getStats(), trails.getStats());
+            statsRequested = false;
+        }
+
+        if (benchmarkRequested)
+        {
+            printBenchmarks();
+
+            // Drawn from the current view, so look at the belt first
+            for (const BeltDensity& density : belt.measureDensity(camera.view, camera.projection, (float)screenHeight, day))
+                std::cout << "Asteroid belt, " << density.asteroids << ": " << density.gpuMs << " ms GPU, " << density.submitMs << " ms to submit" << std::endl;
+            for (const TrailBenchmark& trail : OrbitTrails::measure("ShaderData/Trails/vertex_shader.txt", "ShaderData/Trails/fragment_shader.txt",
+                camera.view, camera.projection, glm::vec2(screenWidth, screenHeight)))
+                std::cout << "Orbit trails, " << trail.trails << " of " << trail.samples << " samples: " << trail.appendMs << " ms per append in "
+                    << trail.uploadsPerAppend << " uploads, " << trail.gpuMs << " ms GPU, " << trail.submitMs << " ms to submit" << std::endl;
+            benchmarkRequested = false;
         }
 
         // Render here 
@@ -151,22 +474,38 @@ int main(void)
         glClearColor(1.0f, 0.68f, 0.79f, 1.0f);
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-        // Render planets
-        sun.render(camera.view, camera.projection, lightPos, lightColor, camera.cameraPos, false);
-        mercury.render(camera.view, camera.projection, lightPos, lightColor, camera.cameraPos, visibleOrbits);
-        venus.render(camera.view, camera.projection, lightPos, lightColor, camera.cameraPos, visibleOrbits);
-        earth.render(camera.view, camera.projection, lightPos, lightColor, camera.cameraPos, visibleOrbits);
-        moon.render(camera.view, camera.projection, lightPos, lightColor, camera.cameraPos, visibleOrbits);
-        mars.render(camera.view, camera.projection, lightPos, lightColor, camera.cameraPos, visibleOrbits);
-        jupiter.render(camera.view, camera.projection, lightPos, lightColor, camera.cameraPos, visibleOrbits);
-        saturn.render(camera.view, camera.projection, lightPos, lightColor, camera.cameraPos, visibleOrbits);
-        uranus.render(camera.view, camera.projection, lightPos, lightColor, camera.cameraPos, visibleOrbits);
-        neptune.render(camera.view, camera.projection, lightPos, lightColor, camera.cameraPos, visibleOrbits);
-        pluto.render(camera.view, camera.projection, lightPos, lightColor, camera.cameraPos, visibleOrbits);
+        // Render planets, the belt's positions and band lists are worked out on the GPU meanwhile
+        belt.update(camera.view, camera.projection, (float)screenHeight, day);
+        entities.render(camera.view, camera.projection, camera.cameraPos, visibleOrbits && !orbitTrails);
+        belt.render(camera.view, camera.projection);
 
         // Skybox
         skybox.render(camera.view, camera.projection);
 
+        // Trails, probes and ring particles, additive over everything
+        if (visibleOrbits && orbitTrails)
+            trails.render(camera.view, camera.projection, glm::vec2(screenWidth, screenHeight), 2.0f);
+        probeSprites.render(glm::mat4(1.0f), camera.view, camera.projection, glm::vec4(0.6f, 0.9f, 1.0f, 0.6f), 0.05f * screenHeight);
+        catalogueSprites.render(glm::mat4(1.0f), camera.view, camera.projection, glm::vec4(1.0f, 0.85f, 0.6f, 0.35f), 0.02f * screenHeight);
+        if (simulatedRing)
+            ringSprites.render(entities.transforms.get(bodyEntities[SolarSystem::Saturn]).rings, camera.view, camera.projection,
+                glm::vec4(0.85f, 0.75f, 0.6f, 0.2f), 0.02f * screenHeight);
+
+        // Waiting for the swap isn't work
+        auto frameEnd = std::chrono::steady_clock::now();
+        renderBusyMs += std::chrono::duration<double, std::milli>(frameEnd - frameBegin).count();
+        overlapMs += std::chrono::duration<double, std::milli>(simulation.busyTime() - simulationBusy).count();
+        renderTiming.core = SimulationThread::currentCore();
+
+        if (frameEnd - timingSecond >= std::chrono::seconds(1))
+        {
+            double seconds = std::chrono::duration<double>(frameEnd - timingSecond).count();
+            renderTiming.busyMsPerSecond = renderBusyMs / seconds;
+            overlapMsPerSecond = overlapMs / seconds;
+            renderBusyMs = overlapMs = 0.0;
+            timingSecond = frameEnd;
+        }
+
         // Swap front and back buffers
         glfwSwapBuffers(window);
 
@@ -213,9 +552,9 @@ void processInput(GLFWwindow* window, glm::mat4* projection, float& deltaTime, f
     if (glfwGetKey(window, GLFW_KEY_P) == GLFW_PRESS && !pKeyPressed)
     {
         pKeyPressed = true;
-        pause = !pause;
+        paused = !paused;
 
-        if (pause)
+        if (paused)
         {
             pauseStartTime = currentFrame;
         }
@@ -236,6 +575,378 @@ void processInput(GLFWwindow* window, glm::mat4* projection, float& deltaTime, f
     }
     if (glfwGetKey(window, GLFW_KEY_SPACE) == GLFW_RELEASE)
         spaceKeyPressed = false;
+
+
+    // Enable/Disable adaptive body meshes
+    if (glfwGetKey(window, GLFW_KEY_L) == GLFW_PRESS && !lKeyPressed)
+    {
+        adaptiveBodies = !adaptiveBodies;
+        lKeyPressed = true;
+    }
+    if (glfwGetKey(window, GLFW_KEY_L) == GLFW_RELEASE)
+        lKeyPressed = false;
+
+
+    // Print statistics
+    if (glfwGetKey(window, GLFW_KEY_I) == GLFW_PRESS && !iKeyPressed)
+    {
+        statsRequested = true;
+        iKeyPressed = true;
+    }
+    if (glfwGetKey(window, GLFW_KEY_I) == GLFW_RELEASE)
+        iKeyPressed = false;
+
+
+    // Measure the simulation kernels
+    if (glfwGetKey(window, GLFW_KEY_B) == GLFW_PRESS && !bKeyPressed)
+    {
+        benchmarkRequested = true;
+        bKeyPressed = true;
+    }
+    if (glfwGetKey(window, GLFW_KEY_B) == GLFW_RELEASE)
+        bKeyPressed = false;
+
+
+    // Cycle through the simulation, the ephemeris and the series, and scrub the last two
+    if (glfwGetKey(window, GLFW_KEY_E) == GLFW_PRESS && !eKeyPressed)
+    {
+        positionSource = (SolarSystem::Source)((positionSource + 1) % SolarSystem::SourceCount);
+        eKeyPressed = true;
+    }
+    if (glfwGetKey(window, GLFW_KEY_E) == GLFW_RELEASE)
+        eKeyPressed = false;
+
+    // Enable/Disable the simulated Saturn ring
+    if (glfwGetKey(window, GLFW_KEY_G) == GLFW_PRESS && !gKeyPressed)
+    {
+        simulatedRing = !simulatedRing;
+        gKeyPressed = true;
+    }
+    if (glfwGetKey(window, GLFW_KEY_G) == GLFW_RELEASE)
+        gKeyPressed = false;
+
+    // Swap the orbit tori for trails
+    if (glfwGetKey(window, GLFW_KEY_O) == GLFW_PRESS && !oKeyPressed)
+    {
+        orbitTrails = !orbitTrails;
+        oKeyPressed = true;
+    }
+    if (glfwGetKey(window, GLFW_KEY_O) == GLFW_RELEASE)
+        oKeyPressed = false;
+
+    // Launch probes
+    if (glfwGetKey(window, GLFW_KEY_J) == GLFW_PRESS && !jKeyPressed)
+    {
+        launchRequested = true;
+        jKeyPressed = true;
+    }
+    if (glfwGetKey(window, GLFW_KEY_J) == GLFW_RELEASE)
+        jKeyPressed = false;
+
+    // Time warp, 1x to 10^7x
+    if (glfwGetKey(window, GLFW_KEY_EQUAL) == GLFW_PRESS && !plusKeyPressed)
+    {
+        timeWarp = std::min(timeWarp * 10.0, SimulationClock::maxWarp);
+        plusKeyPressed = true;
+    }
+    if (glfwGetKey(window, GLFW_KEY_EQUAL) == GLFW_RELEASE)
+        plusKeyPressed = false;
+
+    if (glfwGetKey(window, GLFW_KEY_MINUS) == GLFW_PRESS && !minusKeyPressed)
+    {
+        timeWarp = std::max(timeWarp / 10.0, 1.0);
+        minusKeyPressed = true;
+    }
+    if (glfwGetKey(window, GLFW_KEY_MINUS) == GLFW_RELEASE)
+        minusKeyPressed = false;
+
+    scrubDirection = 0;
+    if (glfwGetKey(window, GLFW_KEY_RIGHT) == GLFW_PRESS)
+        scrubDirection++;
+    if (glfwGetKey(window, GLFW_KEY_LEFT) == GLFW_PRESS)
+        scrubDirection--;
+}
+
+// Heliocentric positions (AU) of every body but the Sun between the last two steps, in Body order
+void heliocentricSources(const SimulationState& state, float alpha, glm::dvec3* sources)
+{
+    for (int i = SolarSystem::Mercury; i < SolarSystem::BodyCount; i++)
+    {
+        sources[i - 1] = state.previous[i] + (state.current[i] - state.previous[i]) * (double)alpha;
+        if (i == SolarSystem::Moon)
+            sources[i - 1] += sources[SolarSystem::Earth - 1];
+    }
+}
+
+// A cloud 0.02 AU around the Earth, flying apart at up to 3 km/s on top of the Earth's own velocity
+void launchProbes(TestParticles& probes, const SimulationState& state, float alpha, size_t count)
+{
+    static std::mt19937 random(7);
+    std::normal_distribution<double> gaussian;
+    std::uniform_real_distribution<double> uniform(0.0, 1.0);
+
+    double stepDays = SimulationClock::seconds(SimulationClock::stepTicks) * SolarSystem::daysPerSecond;
+    glm::dvec3 sources[SolarSystem::BodyCount - 1];
+    heliocentricSources(state, alpha, sources);
+    glm::dvec3 earth = sources[SolarSystem::Earth - 1];
+    glm::dvec3 earthVelocity = (state.current[SolarSystem::Earth] - state.previous[SolarSystem::Earth]) / stepDays;
+
+    const double kilometresPerSecond = 86400.0 / 1.495978707e8;
+    for (size_t i = 0; i < count; i++)
+    {
+        glm::dvec3 direction = glm::normalize(glm::dvec3(gaussian(random), gaussian(random), gaussian(random)));
+        probes.add(earth + direction * 0.02, earthVelocity + direction * (3.0 * kilometresPerSecond * uniform(random)));
+    }
+}
+
+void printStats(const std::vector<std::pair<const char*, Planet*>>& bodies, const SimulationState& simulation, const ThreadTiming& renderTiming, double overlapMsPerSecond, const ParticleStats& probes, RingParticles* ring, const BeltStats& belt, const CatalogueStats& catalogue, const TrailStats& trails)
+{
+    std::cout << "---- Statistics ----" << std::endl;
+
+    const MeshStatistics& meshes = MeshOptimizer::statistics();
+    std::cout << "Meshes: " << meshes.meshes << ", " << meshes.triangles << " triangles, "
+        << meshes.originalBytes / 1024 << " KB unpacked -> " << meshes.packedBytes / 1024 << " KB packed, ACMR "
+        << meshes.transformsBefore / meshes.triangles << " -> " << meshes.transformsAfter / meshes.triangles << std::endl;
+
+    const MeshLibraryStats& library = MeshLibrary::instance().getStats();
+    std::cout << "Mesh library: " << library.meshes << " unique meshes for " << library.requests << " requests, "
+        << library.vertexBytes / 1024 << " KB vertices + " << library.indexBytes / 1024 << " KB indices on the GPU" << std::endl;
+
+    const NBodyStats& gravity = simulation.gravity;
+    std::cout << "Gravity: " << gravity.steps << " steps over " << gravity.simulatedTime << " days, energy drift " << gravity.relativeEnergyDrift
+        << ", momentum drift " << gravity.momentumDrift << ", angular momentum drift " << gravity.angularMomentumDrift << ", "
+        << gravity.pairInteractions / gravity.kernelSeconds << " pair interactions/s" << std::endl;
+
+    std::cout << "Threads: simulation " << simulation.timing.busyMsPerSecond << " ms/s on core " << simulation.timing.core << ", render "
+        << renderTiming.busyMsPerSecond << " ms/s on core " << renderTiming.core << ", " << overlapMsPerSecond
+        << " ms/s of simulation while rendering" << std::endl;
+
+    const ClockStats& clock = simulation.clock;
+    std::cout << "Clock: warp " << clock.requestedWarp << "x requested, " << clock.achievedWarp << "x achieved, " << clock.stepsLastFrame
+        << " steps in " << clock.stepMs << " ms last frame, " << clock.droppedSeconds << " s dropped" << std::endl;
+
+    const char* sources[] = { "simulation", "ephemeris", "series" };
+    std::cout << "Positions: " << sources[simulation.source] << ", year " << 2000.0 + simulation.day / 365.25
+        << ", series " << simulation.theoryTerms << " terms" << std::endl;
+
+    if (simulation.ephemerisBytes > 0)
+    {
+        const EphemerisStats& tabulated = simulation.ephemeris;
+        std::cout << "Ephemeris: " << (simulation.source == SolarSystem::Tabulated ? "in use" : "idle") << ", "
+            << tabulated.evaluations << " evaluations, " << tabulated.segmentLoads
+            << " segments read (" << tabulated.bytesLoaded / 1024 << " KB of " << simulation.ephemerisBytes / 1024 << " KB mapped)" << std::endl;
+    }
+
+    std::cout << "Probes: " << probes.particles << ", " << probes.steps << " steps, last frame " << probes.lastSubsteps
+        << " substeps in " << probes.lastAdvanceMs << " ms, " << probes.lagDays << " days behind the clock" << std::endl;
+
+    std::cout << "Asteroid belt: " << belt.asteroids << " asteroids, " << belt.instanceBytes / (1024 * 1024) << " MB of orbits, positions and lists, generated in "
+        << belt.generationMs << " ms, " << belt.bandInstances[0] << " points, " << belt.bandInstances[1] << " coarse and " << belt.bandInstances[2]
+        << " detailed rocks in " << belt.drawCalls << " draws, " << belt.gpuMs << " ms GPU last frame, " << belt.skippedUpdates
+        << " updates skipped waiting for the GPU" << std::endl;
+
+    if (catalogue.objects > 0)
+        std::cout << "Catalogue: " << catalogue.objects << " objects in " << catalogue.fileBytes / (1024 * 1024) << " MB mapped in " << catalogue.openMs
+            << " ms, " << catalogue.propagations << " propagations, last " << catalogue.propagateMs << " ms, culling " << catalogue.cullMs << " ms, "
+            << catalogue.visible << " visible" << std::endl;
+
+    std::cout << "Orbit trails: " << trails.trails << " in " << trails.classes << " classes, " << trails.chunks << " chunks of "
+        << trails.allocatedSamples << " / " << trails.capacitySamples << " samples, " << trails.appends << " appends, last "
+        << trails.uploadBytes << " bytes in " << trails.appendMs << " ms" << std::endl;
+
+    if (ring)
+    {
+        const RingStats& particles = ring->getStats();
+        std::cout << "Saturn ring: " << particles.particles << " particles, per step hash " << particles.hashMs << " ms, collisions "
+            << particles.collisionMs << " ms, integration " << particles.integrateMs << " ms, " << particles.collisionsPerStep << " collisions" << std::endl;
+    }
+
+    for (const auto& body : bodies)
+    {
+        const TerrainStats* terrain = body.second->getTerrainStats();
+        if (terrain == nullptr)
+            continue;
+
+        std::cout << body.first << " terrain: " << terrain->visibleChunks << " visible, "
+            << terrain->loadedChunks << " loaded, " << terrain->pendingChunks << " pending, "
+            << "generation " << terrain->avgGenerationMs << " ms, latency avg " << terrain->avgLatencyMs
+            << " ms / max " << terrain->maxLatencyMs << " ms" << std::endl;
+    }
+}
+
+void printBenchmarks()
+{
+    std::cout << "---- Simulation kernels, " << JobSystem::instance().threadCount() << " threads ----" << std::endl;
+
+    for (size_t bodyCount = 10; bodyCount <= 10000; bodyCount *= 10)
+        std::cout << bodyCount << " bodies: " << NBodySystem::measureThroughput(bodyCount) << " pair interactions/s" << std::endl;
+
+    // Barnes-Hut at the default opening angle, monopole only and with quadrupoles
+    for (size_t bodyCount = 10000; bodyCount <= 1000000; bodyCount *= 10)
+    {
+        for (int quadrupole = 0; quadrupole < 2; quadrupole++)
+        {
+            BarnesHutStats tree = NBodySystem::measureTree(bodyCount, 0.5, quadrupole != 0);
+            std::cout << bodyCount << " bodies, tree" << (quadrupole ? " + quadrupole" : "") << ": build " << tree.buildMs << " ms, force "
+                << tree.forceMs << " ms, " << tree.interactionsPerParticle << " interactions per body, error rms "
+                << tree.rmsRelativeError << " / max " << tree.maxRelativeError << std::endl;
+        }
+    }
+
+    // Sphere and torus generation take their sines and cosines from here
+    SinCosStats trig = SimdMath::measure(1000000);
+    std::cout << "sincos, " << trig.angles << " angles over [-" << trig.range << ", " << trig.range << "]: " << trig.vectorPerMs << "/ms vectorised, "
+        << trig.scalarPerMs << "/ms scalar, " << trig.standardPerMs << "/ms std::sin + std::cos, max error " << trig.vectorMaxError << " vectorised, "
+        << trig.scalarMaxError << " scalar" << std::endl;
+
+    // Generators against the scalar ones they replaced, the torus with as many rings and sides
+    for (int sectors = 36; sectors <= 2048; sectors = sectors == 36 ? 64 : sectors * 2)
+    {
+        FigureBenchmark figures = FigureBenchmarks::measure(sectors, sectors / 2);
+        std::cout << "Sphere / torus " << sectors << "x" << sectors / 2 << ": " << figures.sphereMs << " / " << figures.torusMs << " ms, scalar "
+            << figures.referenceSphereMs << " / " << figures.referenceTorusMs << " ms, max error position " << figures.maxPositionError << ", normal "
+            << figures.maxNormalError << (figures.sameIndices ? ", same indices" : ", INDICES DIFFER") << std::endl;
+    }
+
+    std::cout << "Kepler, 1000000 orbits: " << KeplerPropagator::measureThroughput(1000000, 0.3) << " positions/ms up to e = 0.3, "
+        << KeplerPropagator::measureThroughput(1000000, 0.9) << " positions/ms up to e = 0.9" << std::endl;
+
+    std::cout << "Ephemeris: " << Ephemeris::measureThroughput(SolarSystem::ephemerisFile, 100000, false) << " evaluations/ms at random dates, "
+        << Ephemeris::measureThroughput(SolarSystem::ephemerisFile, 100000, true) << " evaluations/ms scrubbing" << std::endl;
+
+    // Truncated series, 0 keeps every term
+    const double accuracies[] = { 60.0, 1.0, 0.1, 0.0 };
+    for (double arcseconds : accuracies)
+    {
+        size_t terms;
+        double error;
+        double rate = SolarSystem::measureTheory(arcseconds, 20000, terms, error);
+        std::cout << "Series to " << arcseconds << "\": " << terms << " terms, " << rate * 1000.0 << " evaluations/s of all bodies, "
+            << error << "\" from the full series" << std::endl;
+    }
+
+    // A comet diving to 0.05 AU, fixed leapfrog steps against Hermite block steps
+    EncounterStats encounters = SolarSystem::measureEncounters(10.0);
+    std::cout << "Close encounters, " << encounters.years << " years: leapfrog " << encounters.leapfrogMs << " ms for " << encounters.leapfrogSteps
+        << " steps, energy drift " << encounters.leapfrogEnergyDrift << ", comet off by " << encounters.leapfrogCometError << " AU; Hermite "
+        << encounters.hermiteMs << " ms for " << encounters.hermite.blockSteps << " block steps, energy drift " << encounters.hermiteEnergyDrift
+        << ", comet off by " << encounters.hermiteCometError << " AU" << std::endl;
+
+    for (const HermiteLevel& level : encounters.hermite.levels)
+    {
+        if (level.bodySteps > 0)
+            std::cout << "  step " << level.step << " days: " << level.bodies << " bodies at the end, " << level.bodySteps << " body steps, "
+                << level.pairInteractions << " pair interactions, " << level.seconds * 1000.0 << " ms" << std::endl;
+    }
+
+    // Ten millennia of the planets at 4 day steps
+    LongRunStats longRun = SolarSystem::measureLongRun(10000.0, 4.0);
+    std::cout << "Wisdom-Holman, " << longRun.years << " years at " << longRun.stepDays << " day steps: " << longRun.wisdomHolmanSeconds << " s for "
+        << longRun.steps << " steps, energy error up to " << longRun.maxEnergyError << ", leapfrog at the simulation step would take about "
+        << longRun.leapfrogSeconds << " s" << std::endl;
+
+    // Massless probes among ten sources, a leapfrog step of all of them
+    for (size_t particleCount = 10000; particleCount <= 1000000; particleCount *= 10)
+    {
+        ParticleStats particles = TestParticles::measure(particleCount);
+        std::cout << "Test particles, " << particleCount << ": " << particles.stepMs << " ms per step, " << particles.particleStepsPerSecond
+            << " particle steps/s, " << particles.sceneMs << " ms to scene positions, " << particles.maxOrbitError
+            << " AU off Kepler after a year" << std::endl;
+    }
+
+    // A million ring particles, where a step goes
+    RingStats ring = RingParticles::measure(1000000, 10);
+    std::cout << "Ring particles, " << ring.particles << ": hash " << ring.hashMs << " ms, collisions " << ring.collisionMs << " ms, integration "
+        << ring.integrateMs << " ms per step, " << ring.collisionsPerStep << " collisions per step" << std::endl;
+
+    // A catalogue the size of MPCORB from text to the screen
+    CatalogueBenchmark catalogue = SmallBodyCatalogue::measure(1300000, SolarSystem::gmSun);
+    std::cout << "Small body catalogue, " << catalogue.objects << ": " << catalogue.textBytes / (1024 * 1024) << " MB of text imported in "
+        << catalogue.importMs << " ms to " << catalogue.fileBytes / (1024 * 1024) << " MB, mapped in " << catalogue.openMs << " ms, first propagation "
+        << catalogue.firstPropagateMs << " ms, then " << catalogue.propagateMs << " ms (" << catalogue.positionsPerMs << " positions/ms), culling "
+        << catalogue.cullMs << " ms" << std::endl;
+
+    // Moons of moons with spacecraft, the update is all that's timed
+    HierarchyStats hierarchy = TransformHierarchy::measureUpdate(100000);
+    std::cout << "Transform hierarchy, " << hierarchy.nodes << " nodes: " << hierarchy.allDirtyMs << " ms all moved, "
+        << hierarchy.oneSubtreeMs << " ms one planet in a hundred moved, " << hierarchy.cleanMs << " ms nothing moved" << std::endl;
+
+    // Evaluating positions every frame against when they'd move 2 pixels on screen
+    for (size_t bodyCount = 1000; bodyCount <= 10000; bodyCount *= 10)
+    {
+        ScheduleStats schedule = UpdateScheduler::measure(bodyCount);
+        std::cout << "Update scheduling, " << bodyCount << " bodies: " << schedule.everyFrameMs << " ms per frame every frame, "
+            << schedule.scheduledMs << " ms scheduled with " << schedule.evaluationsPerFrame << " evaluations per frame, "
+            << schedule.maxErrorPixels << " px max error" << std::endl;
+    }
+
+    // Closed-form model matrices against the glm chain per body
+    InstanceBuffer instances(16);
+    for (size_t bodyCount : { (size_t)10, (size_t)1000, (size_t)1000000 })
+    {
+        ModelMatrixStats matrices = ModelMatrices::measure(bodyCount, &instances);
+        std::cout << "Model matrices, " << bodyCount << " bodies: " << matrices.perObjectMs << " ms per object, " << matrices.batchedMs
+            << " ms batched, " << matrices.mappedMs << " ms batched into an instance buffer, max difference " << matrices.maxError << std::endl;
+    }
+
+    // Planet objects allocated one by one against packed orbit and transform components
+    LayoutStats layouts = BodyEntities::measureLayouts(100000);
+    std::cout << "Body layout, " << layouts.bodies << " bodies: " << layouts.legacyMs << " ms in objects, " << layouts.packedMs << " ms in components";
+    if (layouts.countersAvailable)
+        std::cout << ", L1 misses " << layouts.legacyL1Misses << " / " << layouts.packedL1Misses << ", last level misses "
+            << layouts.legacyLastLevelMisses << " / " << layouts.packedLastLevelMisses;
+    else
+        std::cout << ", cache counters unavailable";
+    std::cout << std::endl;
+
+    // The same kernels on 1 to 16 threads, past the hardware ones they only show the overhead
+    JobSystem& jobs = JobSystem::instance();
+    unsigned int defaultThreads = jobs.threadCount();
+    std::cout << "---- Job system scaling, " << std::thread::hardware_concurrency() << " hardware threads ----" << std::endl;
+
+    const std::vector<std::string> textures = { "Textures/Sun/sun.jpg", "Textures/Earth/earth_surface.jpg", "Textures/Earth/earth_clouds.jpg",
+        "Textures/Jupiter/jupiter.jpg", "Textures/Saturn/saturn.jpg", "Textures/Mars/mars.jpg", "Textures/Earth/moon.jpg", "Textures/Neptune/neptune.jpg" };
+
+    for (unsigned int threads = 1; threads <= 16; threads *= 2)
+    {
+        jobs.setThreadLimit(threads);
+
+        // Propagating asteroids and culling them as a continuation, the shape of a frame
+        KeplerPropagator propagator(2.9591220828559115e-4);
+        for (size_t i = 0; i < 1000000; i++)
+            propagator.add({ 2.1 + 1.2 * (i % 1000) / 1000.0, 0.3 * (i % 997) / 997.0, 0.1, 0.01 * i, 0.02 * i, 0.03 * i });
+
+        std::vector<float> x(propagator.size()), y(propagator.size()), z(propagator.size());
+        std::vector<glm::vec4> spheres(propagator.size());
+        std::vector<unsigned char> visible(propagator.size());
+        Frustum frustum(camera.projection * camera.view);
+        propagator.propagate(0.0, x.data(), y.data(), z.data());
+
+        auto begin = std::chrono::high_resolution_clock::now();
+        JobHandle propagated = jobs.run([&]() { propagator.propagate(100.0, x.data(), y.data(), z.data()); });
+        JobHandle culled = jobs.then(propagated, [&]()
+            {
+                jobs.parallelFor(spheres.size(), [&](size_t first, size_t last)
+                    {
+                        for (size_t i = first; i < last; i++)
+                            spheres[i] = glm::vec4(x[i] * 10.0f, z[i] * 10.0f, -y[i] * 10.0f, 0.01f);
+                    });
+                frustum.cull(spheres.data(), spheres.size(), visible.data());
+            });
+        jobs.wait(culled);
+        double frameMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - begin).count();
+
+        RingStats ringStep = RingParticles::measure(1000000, 3);
+
+        std::cout << threads << " threads: direct 4096 bodies " << NBodySystem::measureThroughput(4096) << " pairs/s, tree 100000 bodies "
+            << NBodySystem::measureTree(100000, 0.5, false).forceMs << " ms, Kepler " << KeplerPropagator::measureThroughput(1000000, 0.3)
+            << " positions/ms, culling " << Frustum::measureThroughput(1000000) << " spheres/ms, 96 terrain chunks "
+            << Terrain::measureGeneration("Textures/Earth/earth_surface.jpg", 96) << " ms, " << textures.size() << " textures decoded in "
+            << Texture::measureDecode(textures) << " ms, propagate + cull 1000000 asteroids " << frameMs << " ms, ring step 1000000 particles "
+            << ringStep.hashMs + ringStep.collisionMs + ringStep.integrateMs << " ms (hash " << ringStep.hashMs << ", collisions " << ringStep.collisionMs << ")" << std::endl;
+    }
+
+    jobs.setThreadLimit(defaultThreads);
 }
 
 void mouse_callback(GLFWwindow* window, double xpos, double ypos) 
@@ -262,4 +973,6 @@ void mouse_callback(GLFWwindow* window, double xpos, double ypos)
 void framebuffer_size_callback(GLFWwindow* window, int width, int height)
 {
     glViewport(0, 0, width, height);
+    screenWidth = width;
+    screenHeight = height;
 }
\ No newline at end of file
@@ -0,0 +1,103 @@
+#ifndef CACHE_COUNTERS_H
+#define CACHE_COUNTERS_H
+
+#include <cstdint>
+#include <initializer_list>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+#endif
+
+// L1 data and last-level cache misses of the calling thread between start() and stop(), from the
+// hardware counters where the OS hands them out (perf events on Linux). Elsewhere, or when they're
+// not permitted, available() is false and the counts stay 0.
+class CacheCounters
+{
+public:
+	CacheCounters()
+	{
+#ifdef __linux__
+		l1Counter = open(PERF_TYPE_HW_CACHE,
+			PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16));
+		lastLevelCounter = open(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES);
+#endif
+	}
+
+	CacheCounters(const CacheCounters&) = delete;
+	CacheCounters& operator=(const CacheCounters&) = delete;
+
+	~CacheCounters()
+	{
+#ifdef __linux__
+		if (l1Counter >= 0)
+			::close(l1Counter);
+		if (lastLevelCounter >= 0)
+			::close(lastLevelCounter);
+#endif
+	}
+
+	bool available() const
+	{
+		return l1Counter >= 0 && lastLevelCounter >= 0;
+	}
+
+	void start()
+	{
+#ifdef __linux__
+		for (int counter : { l1Counter, lastLevelCounter })
+		{
+			if (counter < 0)
+				continue;
+			ioctl(counter, PERF_EVENT_IOC_RESET, 0);
+			ioctl(counter, PERF_EVENT_IOC_ENABLE, 0);
+		}
+#endif
+	}
+
+	void stop()
+	{
+#ifdef __linux__
+		l1Misses = finish(l1Counter);
+		lastLevelMisses = finish(lastLevelCounter);
+#endif
+	}
+
+	uint64_t l1Misses = 0;
+	uint64_t lastLevelMisses = 0;
+
+private:
+	int l1Counter = -1;
+	int lastLevelCounter = -1;
+
+#ifdef __linux__
+	static int open(uint32_t type, uint64_t config)
+	{
+		perf_event_attr attributes = {};
+		attributes.type = type;
+		attributes.size = sizeof(attributes);
+		attributes.config = config;
+		attributes.disabled = 1;
+		attributes.exclude_kernel = 1;
+		attributes.exclude_hv = 1;
+
+		return (int)syscall(__NR_perf_event_open, &attributes, 0, -1, -1, 0);
+	}
+
+	static uint64_t finish(int counter)
+	{
+		uint64_t count = 0;
+		if (counter < 0)
+			return 0;
+
+		ioctl(counter, PERF_EVENT_IOC_DISABLE, 0);
+		if (::read(counter, &count, sizeof(count)) != (ssize_t)sizeof(count))
+			return 0;
+		return count;
+	}
+#endif
+};
+
+#endif
@@ -0,0 +1,362 @@
+#ifndef EPHEMERIS_H
+#define EPHEMERIS_H
+
+#include <glm/glm.hpp>
+
+#include <vector>
+#include <functional>
+#include <fstream>
+#include <algorithm>
+#include <chrono>
+#include <random>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <cstddef>
+
+#include "MappedFile.h"
+
+struct EphemerisStats
+{
+	size_t evaluations = 0;
+
+	// Segments a body moved into since the last evaluation, and their bytes
+	size_t segmentLoads = 0;
+	size_t bytesLoaded = 0;
+};
+
+// How one body is tabulated: positions relative to the parent (-1 for none), in segments of
+// segmentDays each fitted with coefficientCount Chebyshev polynomials per coordinate
+struct EphemerisLayout
+{
+	int parent;
+	double segmentDays;
+	unsigned int coefficientCount;
+};
+
+// Positions from a binary file of Chebyshev segments, mapped into memory.
+// File: a header, one entry per body, then each body's segments back to back, every segment holding
+// the x, y and z coefficients. A date's segment is found by division, so moving anywhere in the
+// span only reads the few segments around it.
+class Ephemeris
+{
+public:
+	bool open(const char* path)
+	{
+		close();
+		if (!file.open(path))
+			return false;
+
+		if (file.size() < sizeof(Header))
+		{
+			close();
+			return false;
+		}
+
+		std::memcpy(&header, file.data(), sizeof(Header));
+		if (std::memcmp(header.magic, fileMagic, sizeof(header.magic)) != 0 || header.version != fileVersion ||
+			!std::isfinite(header.startDay) || !(header.endDay >= header.startDay) || std::isinf(header.endDay) ||
+			header.bodyCount > (file.size() - sizeof(Header)) / sizeof(BodyEntry))
+		{
+			close();
+			return false;
+		}
+
+		bodies.resize(header.bodyCount);
+		std::memcpy(bodies.data(), file.data() + sizeof(Header), header.bodyCount * sizeof(BodyEntry));
+
+		for (const BodyEntry& body : bodies)
+		{
+			if (!validBody(body))
+			{
+				close();
+				return false;
+			}
+		}
+
+		lastSegment.assign(header.bodyCount, UINT64_MAX);
+		return true;
+	}
+
+	void close()
+	{
+		file.close();
+		bodies.clear();
+		lastSegment.clear();
+		header = Header();
+	}
+
+	bool isOpen() const
+	{
+		return file.isOpen();
+	}
+
+	size_t bodyCount() const
+	{
+		return bodies.size();
+	}
+
+	double startDay() const
+	{
+		return header.startDay;
+	}
+
+	double endDay() const
+	{
+		return header.endDay;
+	}
+
+	size_t fileBytes() const
+	{
+		return file.size();
+	}
+
+	// Position relative to the parent at the given day, and the velocity per day if asked for.
+	// Days outside the span are clamped to it.
+	void evaluate(size_t body, double day, glm::dvec3& position, glm::dvec3* velocity = nullptr)
+	{
+		const BodyEntry& entry = bodies[body];
+
+		double t = (std::min(std::max(day, header.startDay), header.endDay) - header.startDay) / entry.segmentDays;
+		uint64_t segment = std::min((uint64_t)t, entry.segmentCount - 1);
+
+		stats.evaluations++;
+		if (segment != lastSegment[body])
+		{
+			lastSegment[body] = segment;
+			stats.segmentLoads++;
+			stats.bytesLoaded += segmentBytes(entry);
+		}
+
+		// Chebyshev polynomials are defined on [-1, 1] over the segment
+		double x = 2.0 * (t - (double)segment) - 1.0;
+		unsigned int n = entry.coefficientCount;
+		const double* coefficients = (const double*)(file.data() + entry.offset + segment * segmentBytes(entry));
+
+		position = clenshaw(coefficients, n, x);
+		if (velocity != nullptr)
+			*velocity = clenshawDerivative(coefficients, n, x) * (2.0 / entry.segmentDays);
+	}
+
+	const EphemerisStats& getStats() const
+	{
+		return stats;
+	}
+
+	// Fits every body over [startDay, endDay] and writes the file. sample(day, positions) fills
+	// each body's position relative to its parent and is called with days in increasing order,
+	// so it can be a forward integration.
+	static bool write(const char* path, double startDay, double endDay, const std::vector<EphemerisLayout>& layout,
+		const std::function<void(double, glm::dvec3*)>& sample)
+	{
+		// Every body's nodes in one timeline
+		struct Node
+		{
+			double day;
+			uint32_t body;
+			uint32_t slot;
+		};
+
+		std::vector<BodyEntry> entries(layout.size());
+		std::vector<std::vector<glm::dvec3>> values(layout.size());
+		std::vector<Node> nodes;
+
+		uint64_t offset = sizeof(Header) + layout.size() * sizeof(BodyEntry);
+		for (size_t i = 0; i < layout.size(); i++)
+		{
+			BodyEntry& entry = entries[i];
+			entry.parent = layout[i].parent;
+			entry.coefficientCount = layout[i].coefficientCount;
+			entry.segmentDays = layout[i].segmentDays;
+			entry.segmentCount = (uint64_t)std::max(1.0, std::ceil((endDay - startDay) / entry.segmentDays));
+			entry.offset = offset;
+			offset += entry.segmentCount * segmentBytes(entry);
+
+			// Chebyshev nodes, the roots of T_n, keep the interpolation close to the best fit
+			unsigned int n = entry.coefficientCount;
+			values[i].resize(entry.segmentCount * n);
+			for (uint64_t segment = 0; segment < entry.segmentCount; segment++)
+			{
+				for (unsigned int k = 0; k < n; k++)
+				{
+					double x = std::cos(pi * (k + 0.5) / n);
+					double day = startDay + (segment + 0.5 * (x + 1.0)) * entry.segmentDays;
+					nodes.push_back({ day, (uint32_t)i, (uint32_t)(segment * n + k) });
+				}
+			}
+		}
+
+		std::sort(nodes.begin(), nodes.end(), [](const Node& a, const Node& b) { return a.day < b.day; });
+
+		std::vector<glm::dvec3> positions(layout.size());
+		double sampledDay = 0.0;
+		for (size_t i = 0; i < nodes.size(); i++)
+		{
+			if (i == 0 || nodes[i].day != sampledDay)
+			{
+				sampledDay = nodes[i].day;
+				sample(sampledDay, positions.data());
+			}
+
+			values[nodes[i].body][nodes[i].slot] = positions[nodes[i].body];
+		}
+
+		std::ofstream out(path, std::ios::binary);
+		if (!out)
+			return false;
+
+		Header header;
+		std::memcpy(header.magic, fileMagic, sizeof(header.magic));
+		header.version = fileVersion;
+		header.bodyCount = (uint32_t)layout.size();
+		header.startDay = startDay;
+		header.endDay = endDay;
+
+		out.write((const char*)&header, sizeof(Header));
+		out.write((const char*)entries.data(), entries.size() * sizeof(BodyEntry));
+
+		for (size_t i = 0; i < layout.size(); i++)
+		{
+			unsigned int n = entries[i].coefficientCount;
+			std::vector<double> coefficients(3 * n);
+
+			for (uint64_t segment = 0; segment < entries[i].segmentCount; segment++)
+			{
+				const glm::dvec3* f = &values[i][segment * n];
+
+				// c_j = 2/n sum f_k T_j(x_k), with c_0 halved
+				for (unsigned int j = 0; j < n; j++)
+				{
+					glm::dvec3 sum(0.0);
+					for (unsigned int k = 0; k < n; k++)
+						sum += f[k] * std::cos(pi * j * (k + 0.5) / n);
+					sum *= (j == 0 ? 1.0 : 2.0) / n;
+
+					coefficients[j] = sum.x;
+					coefficients[n + j] = sum.y;
+					coefficients[2 * n + j] = sum.z;
+				}
+
+				out.write((const char*)coefficients.data(), coefficients.size() * sizeof(double));
+			}
+		}
+
+		return (bool)out;
+	}
+
+	// Evaluations per millisecond for every body at random days across the span, and when
+	// scrubbing forward a decade per second at 60 frames per second
+	static double measureThroughput(const char* path, size_t count, bool scrubbing)
+	{
+		Ephemeris ephemeris;
+		if (!ephemeris.open(path))
+			return 0.0;
+
+		const Header& header = ephemeris.header;
+		std::mt19937 random(7);
+		std::uniform_real_distribution<double> uniform(header.startDay, header.endDay);
+
+		std::vector<double> days(count);
+		for (size_t i = 0; i < count; i++)
+			days[i] = scrubbing ? header.startDay + std::fmod(i * 3652.5 / 60.0, header.endDay - header.startDay) : uniform(random);
+
+		glm::dvec3 position, velocity, sum(0.0);
+		auto begin = std::chrono::high_resolution_clock::now();
+		for (double day : days)
+		{
+			for (size_t body = 0; body < ephemeris.bodyCount(); body++)
+			{
+				ephemeris.evaluate(body, day, position, &velocity);
+				sum += position + velocity;
+			}
+		}
+		double ms = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - begin).count();
+
+		// Keeps the loop from being optimised away
+		volatile double sink = sum.x + sum.y + sum.z;
+		(void)sink;
+
+		return count * ephemeris.bodyCount() / ms;
+	}
+
+private:
+	static constexpr double pi = 3.14159265358979323846;
+	static constexpr char fileMagic[8] = { 'C', 'H', 'E', 'B', 'E', 'P', 'H', 0 };
+	static constexpr uint32_t fileVersion = 1;
+
+	struct Header
+	{
+		char magic[8] = {};
+		uint32_t version = 0;
+		uint32_t bodyCount = 0;
+		double startDay = 0.0;
+		double endDay = 0.0;
+	};
+
+	struct BodyEntry
+	{
+		int32_t parent;
+		uint32_t coefficientCount;
+		double segmentDays;
+		uint64_t segmentCount;
+		uint64_t offset;
+	};
+
+	MappedFile file;
+	Header header;
+	std::vector<BodyEntry> bodies;
+	std::vector<uint64_t> lastSegment;
+	EphemerisStats stats;
+
+	static size_t segmentBytes(const BodyEntry& body)
+	{
+		return 3 * (size_t)body.coefficientCount * sizeof(double);
+	}
+
+	// A corrupt entry must not reach evaluate: clenshaw needs at least one coefficient, the segment
+	// index divides by segmentDays, and every segment has to lie inside the mapping. The size test
+	// is done by division so a huge segmentCount can't wrap around and pass.
+	bool validBody(const BodyEntry& body) const
+	{
+		if (body.coefficientCount == 0 || body.segmentCount == 0 ||
+			!std::isfinite(body.segmentDays) || body.segmentDays <= 0.0 ||
+			body.parent < -1 || body.parent >= (int64_t)header.bodyCount)
+			return false;
+
+		size_t size = file.size();
+		if (body.offset > size || body.offset % alignof(double) != 0)
+			return false;
+
+		return body.segmentCount <= (size - body.offset) / segmentBytes(body);
+	}
+
+	// sum c_j T_j(x) for the three coordinates, which are n apart
+	static glm::dvec3 clenshaw(const double* c, unsigned int n, double x)
+	{
+		glm::dvec3 b1(0.0), b2(0.0);
+		for (unsigned int j = n - 1; j >= 1; j--)
+		{
+			glm::dvec3 b0 = glm::dvec3(c[j], c[n + j], c[2 * n + j]) + 2.0 * x * b1 - b2;
+			b2 = b1;
+			b1 = b0;
+		}
+
+		return glm::dvec3(c[0], c[n], c[2 * n]) + x * b1 - b2;
+	}
+
+	// T_j' = j U_(j-1), so the derivative is a series in U with the same recurrence
+	static glm::dvec3 clenshawDerivative(const double* c, unsigned int n, double x)
+	{
+		glm::dvec3 b1(0.0), b2(0.0);
+		for (unsigned int j = n - 1; j >= 1; j--)
+		{
+			glm::dvec3 b0 = (double)j * glm::dvec3(c[j], c[n + j], c[2 * n + j]) + 2.0 * x * b1 - b2;
+			b2 = b1;
+			b1 = b0;
+		}
+
+		return b1;
+	}
+};
+
+#endif
@@ -2,8 +2,12 @@
 #define FIGURES_H
 
 #include <vector>
+#include <chrono>
+#include <algorithm>
 #include <cmath>
 
+#include "SimdMath.h"
+
 #define PI 3.14159265358979323846
 
 class Sphere
@@ -14,71 +18,72 @@ public:
 
     Sphere(float radius, int sectorCount, int stackCount)
     {
-        float x, y, z, xy;
-        float nx, ny, nz;
-        float s, t;
-
         float sectorStep = 2 * PI / sectorCount;
         float stackStep = PI / stackCount;
-        float sectorAngle, stackAngle;
+
+        // sin/cos of every sector and stack angle, shared by all rows and columns
+        std::vector<float> sectorSin(sectorCount + 1), sectorCos(sectorCount + 1);
+        std::vector<float> stackSin(stackCount + 1), stackCos(stackCount + 1);
+        SimdMath::sincosRange(0.0f, sectorStep, &sectorSin[0], &sectorCos[0], sectorCount + 1);
+        SimdMath::sincosRange(PI / 2, -stackStep, &stackSin[0], &stackCos[0], stackCount + 1); // starting from pi/2 to -pi/2
 
         // Vertices
+        vertices.resize((size_t)(stackCount + 1) * (sectorCount + 1) * 8);
+        float* out = &vertices[0];
+
         for (int i = 0; i <= stackCount; ++i)
         {
-            stackAngle = PI / 2 - i * stackStep; // starting from pi/2 to -pi/2
-            xy = radius * cosf(stackAngle); // r * cos(u)
-            z = radius * sinf(stackAngle);  // r * sin(u)
+            float nxy = stackCos[i];    // cos(u)
+            float nz = stackSin[i];     // sin(u)
+            float t = (float)i / stackCount;
 
             // add (sectorCount+1) vertices per stack
             for (int j = 0; j <= sectorCount; ++j)
             {
-                sectorAngle = j * sectorStep; // starting from 0 to 2pi
+                float nx = nxy * sectorCos[j]; // cos(u) * cos(v)
+                float ny = nxy * sectorSin[j]; // cos(u) * sin(v)
 
                 // vertex position (x, y, z)
-                x = xy * cosf(sectorAngle); // r * cos(u) * cos(v)
-                y = xy * sinf(sectorAngle); // r * cos(u) * sin(v)
-                vertices.push_back(x);
-                vertices.push_back(y);
-                vertices.push_back(z);
+                out[0] = radius * nx;
+                out[1] = radius * ny;
+                out[2] = radius * nz;
 
                 // normal vector (nx, ny, nz)
-                nx = x / radius;
-                ny = y / radius;
-                nz = z / radius;
-                vertices.push_back(nx);
-                vertices.push_back(ny);
-                vertices.push_back(nz);
+                out[3] = nx;
+                out[4] = ny;
+                out[5] = nz;
 
                 // vertex tex coord (s, t) range between [0, 1]
-                s = (float)j / sectorCount;
-                t = (float)i / stackCount;
-                vertices.push_back(s);
-                vertices.push_back(t);
+                out[6] = (float)j / sectorCount;
+                out[7] = t;
+
+                out += 8;
             }
         }
 
-        // Indices
-        int k1, k2;
+        // Indices, 2 triangles per sector excluding the first and last stacks
+        indices.resize(stackCount > 1 ? (size_t)sectorCount * (2 * stackCount - 2) * 3 : 0);
+        unsigned int* index = indices.empty() ? nullptr : &indices[0];
+
         for (int i = 0; i < stackCount; ++i)
         {
-            k1 = i * (sectorCount + 1); // beginning of current stack
-            k2 = k1 + sectorCount + 1; // beginning of next stack
+            unsigned int k1 = i * (sectorCount + 1); // beginning of current stack
+            unsigned int k2 = k1 + sectorCount + 1; // beginning of next stack
 
             for (int j = 0; j < sectorCount; ++j, ++k1, ++k2)
             {
-                // 2 triangles per sector excluding the first and last stacks
                 if (i != 0)
                 {
-                    indices.push_back(k1);
-                    indices.push_back(k2);
-                    indices.push_back(k1 + 1);
+                    *index++ = k1;
+                    *index++ = k2;
+                    *index++ = k1 + 1;
                 }
 
                 if (i != (stackCount - 1))
                 {
-                    indices.push_back(k1 + 1);
-                    indices.push_back(k2);
-                    indices.push_back(k2 + 1);
+                    *index++ = k1 + 1;
+                    *index++ = k2;
+                    *index++ = k2 + 1;
                 }
             }
         }
@@ -90,15 +95,262 @@ class Torus
 public:
     std::vector<float> vertices;
     std::vector<unsigned int> indices;
+    float outerRadius, innerRadius;
 
     Torus(float outerRadius, float innerRadius, int numSides, int numRings)
+        : outerRadius(outerRadius), innerRadius(innerRadius)
     {
         float ringFactor = 2.0f * PI / numRings;
         float sideFactor = 2.0f * PI / numSides;
-        float x, y, z;
-        float nx, ny, nz;
+
+        std::vector<float> ringSin(numRings + 1), ringCos(numRings + 1);
+        std::vector<float> sideSin(numSides + 1), sideCos(numSides + 1);
+        SimdMath::sincosRange(0.0f, ringFactor, &ringSin[0], &ringCos[0], numRings + 1);
+        SimdMath::sincosRange(0.0f, sideFactor, &sideSin[0], &sideCos[0], numSides + 1);
 
         // Vertices
+        vertices.resize((size_t)(numRings + 1) * (numSides + 1) * 6);
+        float* out = &vertices[0];
+
+        for (int ring = 0; ring <= numRings; ++ring)
+        {
+            float cosU = ringCos[ring];
+            float sinU = ringSin[ring];
+
+            for (int side = 0; side <= numSides; ++side)
+            {
+                float cosV = sideCos[side];
+                float sinV = sideSin[side];
+
+                float x = (outerRadius + innerRadius * cosV) * cosU;
+                float y = (outerRadius + innerRadius * cosV) * sinU;
+                float z = innerRadius * sinV;
+
+                // Position
+                out[0] = x;
+                out[1] = y;
+                out[2] = z;
+
+                // Normals
+                out[3] = x / innerRadius;
+                out[4] = y / innerRadius;
+                out[5] = z / innerRadius;
+
+                out += 6;
+            }
+        }
+
+        // Indices
+        indices.resize((size_t)numRings * numSides * 6);
+        unsigned int* index = &indices[0];
+
+        for (int ring = 0; ring < numRings; ++ring)
+        {
+            unsigned int ringStart = ring * (numSides + 1);
+            unsigned int nextRingStart = (ring + 1) * (numSides + 1);
+
+            for (int side = 0; side < numSides; ++side)
+            {
+                *index++ = ringStart + side;
+                *index++ = nextRingStart + side;
+                *index++ = ringStart + side + 1;
+
+                *index++ = ringStart + side + 1;
+                *index++ = nextRingStart + side;
+                *index++ = nextRingStart + side + 1;
+            }
+        }
+    }
+};
+
+// Control points of a unit cube, patchesPerEdge quads across each face, for the tessellation
+// shaders to warp onto the sphere. 3 floats per vertex, 4 indices per patch.
+class CubeSpherePatches
+{
+public:
+    std::vector<float> vertices;
+    std::vector<unsigned int> indices;
+
+    CubeSpherePatches(int patchesPerEdge)
+    {
+        static const float normals[6][3] = { {1, 0, 0}, {-1, 0, 0}, {0, 1, 0}, {0, -1, 0}, {0, 0, 1}, {0, 0, -1} };
+        static const float uAxes[6][3] = { {0, 1, 0}, {0, -1, 0}, {-1, 0, 0}, {1, 0, 0}, {1, 0, 0}, {-1, 0, 0} };
+        static const float vAxes[6][3] = { {0, 0, 1}, {0, 0, 1}, {0, 0, 1}, {0, 0, 1}, {0, 1, 0}, {0, 1, 0} };
+
+        int side = patchesPerEdge + 1;
+
+        for (int face = 0; face < 6; face++)
+        {
+            unsigned int faceStart = (unsigned int)(vertices.size() / 3);
+
+            for (int j = 0; j < side; j++)
+            {
+                for (int i = 0; i < side; i++)
+                {
+                    float u = 2.0f * i / patchesPerEdge - 1.0f;
+                    float v = 2.0f * j / patchesPerEdge - 1.0f;
+
+                    for (int axis = 0; axis < 3; axis++)
+                        vertices.push_back(normals[face][axis] + u * uAxes[face][axis] + v * vAxes[face][axis]);
+                }
+            }
+
+            // One patch per quad: (0,0), (1,0), (1,1), (0,1)
+            for (int j = 0; j < patchesPerEdge; j++)
+            {
+                for (int i = 0; i < patchesPerEdge; i++)
+                {
+                    unsigned int k = faceStart + j * side + i;
+                    indices.push_back(k);
+                    indices.push_back(k + 1);
+                    indices.push_back(k + side + 1);
+                    indices.push_back(k + side);
+                }
+            }
+        }
+    }
+};
+
+// Sphere and Torus at one resolution against the scalar cosf/sinf generators they replaced: the
+// fastest of a few runs, and the largest difference in any position or normal component
+struct FigureBenchmark
+{
+    int sectors = 0, stacks = 0;        // the torus gets as many rings and sides
+    double sphereMs = 0.0, referenceSphereMs = 0.0;
+    double torusMs = 0.0, referenceTorusMs = 0.0;
+    float maxPositionError = 0.0f, maxNormalError = 0.0f;
+    bool sameIndices = true;
+};
+
+class FigureBenchmarks
+{
+public:
+    static FigureBenchmark measure(int sectors, int stacks, int runs = 5)
+    {
+        FigureBenchmark result;
+        result.sectors = sectors;
+        result.stacks = stacks;
+
+        std::vector<float> referenceVertices;
+        std::vector<unsigned int> referenceIndices;
+
+        result.sphereMs = time(runs, [&]() { Sphere sphere(1.0f, sectors, stacks); return sphere.vertices.size(); });
+        result.referenceSphereMs = time(runs, [&]() { referenceSphere(1.0f, sectors, stacks, referenceVertices, referenceIndices); return referenceVertices.size(); });
+
+        Sphere sphere(1.0f, sectors, stacks);
+        compare(sphere.vertices, sphere.indices, referenceVertices, referenceIndices, 8, result);
+
+        result.torusMs = time(runs, [&]() { Torus torus(1.0f, 0.25f, stacks, sectors); return torus.vertices.size(); });
+        result.referenceTorusMs = time(runs, [&]() { referenceTorus(1.0f, 0.25f, stacks, sectors, referenceVertices, referenceIndices); return referenceVertices.size(); });
+
+        Torus torus(1.0f, 0.25f, stacks, sectors);
+        compare(torus.vertices, torus.indices, referenceVertices, referenceIndices, 6, result);
+
+        return result;
+    }
+
+private:
+    template<typename Body>
+    static double time(int runs, Body body)
+    {
+        double best = INFINITY;
+        for (int run = 0; run < runs; run++)
+        {
+            auto begin = std::chrono::high_resolution_clock::now();
+            volatile size_t sink = body();
+            (void)sink;
+            best = std::min(best, std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - begin).count());
+        }
+        return best;
+    }
+
+    // Positions then normals in every vertex of stride floats
+    static void compare(const std::vector<float>& vertices, const std::vector<unsigned int>& indices,
+        const std::vector<float>& referenceVertices, const std::vector<unsigned int>& referenceIndices, size_t stride, FigureBenchmark& result)
+    {
+        result.sameIndices = result.sameIndices && indices == referenceIndices;
+        if (vertices.size() != referenceVertices.size())
+        {
+            result.maxPositionError = result.maxNormalError = INFINITY;
+            return;
+        }
+
+        for (size_t v = 0; v < vertices.size(); v += stride)
+        {
+            for (size_t axis = 0; axis < 3; axis++)
+            {
+                result.maxPositionError = std::max(result.maxPositionError, std::fabs(vertices[v + axis] - referenceVertices[v + axis]));
+                result.maxNormalError = std::max(result.maxNormalError, std::fabs(vertices[v + 3 + axis] - referenceVertices[v + 3 + axis]));
+            }
+        }
+    }
+
+    // The Sphere constructor as it was, cosf/sinf per vertex and one push_back per float
+    static void referenceSphere(float radius, int sectorCount, int stackCount, std::vector<float>& vertices, std::vector<unsigned int>& indices)
+    {
+        vertices.clear();
+        indices.clear();
+
+        float sectorStep = 2 * PI / sectorCount;
+        float stackStep = PI / stackCount;
+
+        for (int i = 0; i <= stackCount; ++i)
+        {
+            float stackAngle = PI / 2 - i * stackStep;
+            float xy = radius * cosf(stackAngle);
+            float z = radius * sinf(stackAngle);
+
+            for (int j = 0; j <= sectorCount; ++j)
+            {
+                float sectorAngle = j * sectorStep;
+                float x = xy * cosf(sectorAngle);
+                float y = xy * sinf(sectorAngle);
+                vertices.push_back(x);
+                vertices.push_back(y);
+                vertices.push_back(z);
+
+                vertices.push_back(x / radius);
+                vertices.push_back(y / radius);
+                vertices.push_back(z / radius);
+
+                vertices.push_back((float)j / sectorCount);
+                vertices.push_back((float)i / stackCount);
+            }
+        }
+
+        for (int i = 0; i < stackCount; ++i)
+        {
+            int k1 = i * (sectorCount + 1);
+            int k2 = k1 + sectorCount + 1;
+
+            for (int j = 0; j < sectorCount; ++j, ++k1, ++k2)
+            {
+                if (i != 0)
+                {
+                    indices.push_back(k1);
+                    indices.push_back(k2);
+                    indices.push_back(k1 + 1);
+                }
+
+                if (i != (stackCount - 1))
+                {
+                    indices.push_back(k1 + 1);
+                    indices.push_back(k2);
+                    indices.push_back(k2 + 1);
+                }
+            }
+        }
+    }
+
+    // The Torus constructor as it was
+    static void referenceTorus(float outerRadius, float innerRadius, int numSides, int numRings, std::vector<float>& vertices, std::vector<unsigned int>& indices)
+    {
+        vertices.clear();
+        indices.clear();
+
+        float ringFactor = 2.0f * PI / numRings;
+        float sideFactor = 2.0f * PI / numSides;
+
         for (int ring = 0; ring <= numRings; ++ring)
         {
             float u = ring * ringFactor;
@@ -111,27 +363,20 @@ public:
                 float cosV = cos(v);
                 float sinV = sin(v);
 
-                x = (outerRadius + innerRadius * cosV) * cosU;
-                y = (outerRadius + innerRadius * cosV) * sinU;
-                z = innerRadius * sinV;
-
-                nx = x / innerRadius;
-                ny = y / innerRadius;
-                nz = z / innerRadius;
+                float x = (outerRadius + innerRadius * cosV) * cosU;
+                float y = (outerRadius + innerRadius * cosV) * sinU;
+                float z = innerRadius * sinV;
 
-                // Push back vertex position
                 vertices.push_back(x);
                 vertices.push_back(y);
                 vertices.push_back(z);
 
-                // Normals
-                vertices.push_back(nx);
-                vertices.push_back(ny);
-                vertices.push_back(nz);
+                vertices.push_back(x / innerRadius);
+                vertices.push_back(y / innerRadius);
+                vertices.push_back(z / innerRadius);
             }
         }
 
-        // Indices
         for (int ring = 0; ring < numRings; ++ring)
         {
             int ringStart = ring * (numSides + 1);
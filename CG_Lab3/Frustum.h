@@ -0,0 +1,101 @@
+#ifndef FRUSTUM_H
+#define FRUSTUM_H
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <vector>
+#include <chrono>
+#include <random>
+#include <cstddef>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+#include "SimdMath.h"
+#include "JobSystem.h"
+
+// The six planes of a view-projection matrix, normals pointing inwards, for culling bounding spheres
+class Frustum
+{
+public:
+	// Each plane is the last row of the matrix plus or minus one of the others
+	Frustum(const glm::mat4& viewProjection)
+	{
+		glm::vec4 rows[4];
+		for (int i = 0; i < 4; i++)
+			rows[i] = glm::vec4(viewProjection[0][i], viewProjection[1][i], viewProjection[2][i], viewProjection[3][i]);
+
+		for (int i = 0; i < 3; i++)
+		{
+			planes[2 * i] = rows[3] + rows[i];
+			planes[2 * i + 1] = rows[3] - rows[i];
+		}
+
+		for (glm::vec4& plane : planes)
+			plane /= glm::length(glm::vec3(plane));
+	}
+
+	bool intersects(const glm::vec3& center, float radius) const
+	{
+		for (const glm::vec4& plane : planes)
+		{
+			if (glm::dot(glm::vec3(plane), center) + plane.w < -radius)
+				return false;
+		}
+		return true;
+	}
+
+#if defined(__AVX2__)
+	// All ones in the lanes of 8 points that are inside
+	__m256 containsPoints(__m256 x, __m256 y, __m256 z) const
+	{
+		__m256 inside = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+		for (const glm::vec4& plane : planes)
+		{
+			__m256 distance = SimdMath::fmadd8(_mm256_set1_ps(plane.x), x, SimdMath::fmadd8(_mm256_set1_ps(plane.y), y,
+				SimdMath::fmadd8(_mm256_set1_ps(plane.z), z, _mm256_set1_ps(plane.w))));
+			inside = _mm256_and_ps(inside, _mm256_cmp_ps(distance, _mm256_setzero_ps(), _CMP_GE_OQ));
+		}
+		return inside;
+	}
+#endif
+
+	// visible[i] for the spheres (center, radius in w), split over the job system when there are many
+	void cull(const glm::vec4* spheres, size_t count, unsigned char* visible) const
+	{
+		JobSystem::instance().parallelFor(count, [&](size_t first, size_t last)
+			{
+				for (size_t i = first; i < last; i++)
+					visible[i] = intersects(glm::vec3(spheres[i]), spheres[i].w) ? 1 : 0;
+			});
+	}
+
+	// Spheres culled per millisecond, count of them scattered around a camera at the origin
+	static double measureThroughput(size_t count)
+	{
+		std::mt19937 random(5);
+		std::uniform_real_distribution<float> uniform(-50.0f, 50.0f);
+
+		std::vector<glm::vec4> spheres(count);
+		for (glm::vec4& sphere : spheres)
+			sphere = glm::vec4(uniform(random), uniform(random), uniform(random), 0.5f);
+		std::vector<unsigned char> visible(count);
+
+		glm::mat4 projection = glm::perspective(glm::radians(45.0f), 800.0f / 600.0f, 0.1f, 100.0f);
+		Frustum frustum(projection * glm::lookAt(glm::vec3(0.0f), glm::vec3(0.0f, 0.0f, -1.0f), glm::vec3(0.0f, 1.0f, 0.0f)));
+
+		auto begin = std::chrono::high_resolution_clock::now();
+		for (int run = 0; run < 10; run++)
+			frustum.cull(spheres.data(), count, visible.data());
+		double ms = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - begin).count();
+
+		return 10.0 * count / ms;
+	}
+
+private:
+	glm::vec4 planes[6];
+};
+
+#endif
@@ -0,0 +1,295 @@
+#ifndef HERMITE_H
+#define HERMITE_H
+
+#include <glm/glm.hpp>
+
+#include <vector>
+#include <chrono>
+#include <cmath>
+#include <algorithm>
+#include <cstddef>
+
+#include "JobSystem.h"
+
+// Work at one block step size, maxStep / 2^level
+struct HermiteLevel
+{
+	double step = 0.0;
+	size_t bodies = 0;					// currently on this level
+	long long bodySteps = 0;
+	double pairInteractions = 0.0;
+	double seconds = 0.0;
+};
+
+struct HermiteStats
+{
+	long long blockSteps = 0;
+	std::vector<HermiteLevel> levels;
+};
+
+// Fourth-order Hermite integration with individual block timesteps (Makino & Aarseth 1992). Every
+// body has a power-of-two step from its own acceleration and its derivatives, and a block step
+// only evaluates the bodies whose steps end then, against positions of all the others predicted
+// from their last state. A moon or a comet at perihelion takes short steps while the outer
+// planets take long ones.
+// Units as NBodySystem's, masses as G * m. Integrates forwards only.
+class HermiteIntegrator
+{
+public:
+	// maxStep should be a power of two (in days for the solar system), accuracy is Aarseth's eta
+	HermiteIntegrator(double maxStep, double accuracy = 0.02, double softening = 0.0)
+		: maxStep(maxStep), accuracy(accuracy), softening2(softening * softening)
+	{
+	}
+
+	size_t addBody(double gm, glm::dvec3 position, glm::dvec3 velocity)
+	{
+		mass.push_back(gm);
+		positions.push_back(position);
+		velocities.push_back(velocity);
+
+		started = false;
+		return mass.size() - 1;
+	}
+
+	size_t size() const
+	{
+		return mass.size();
+	}
+
+	double getTime() const
+	{
+		return time;
+	}
+
+	// Predicted to the current time, bodies are only synchronized at the ends of their own steps
+	glm::dvec3 getPosition(size_t i) const
+	{
+		if (!started)
+			return positions[i];
+
+		double dt = time - bodyTimes[i];
+		return positions[i] + (velocities[i] + (accelerations[i] * 0.5 + jerks[i] * (dt / 6.0)) * dt) * dt;
+	}
+
+	glm::dvec3 getVelocity(size_t i) const
+	{
+		if (!started)
+			return velocities[i];
+
+		double dt = time - bodyTimes[i];
+		return velocities[i] + (accelerations[i] + jerks[i] * (0.5 * dt)) * dt;
+	}
+
+	// Block steps up to targetTime, where the bodies are left mid-step
+	void advanceTo(double targetTime)
+	{
+		if (!started)
+			start();
+
+		while (true)
+		{
+			double next = INFINITY;
+			for (size_t i = 0; i < size(); i++)
+				next = std::min(next, bodyTimes[i] + steps[i]);
+
+			if (next > targetTime)
+				break;
+			blockStep(next);
+		}
+
+		time = std::max(time, targetTime);
+	}
+
+	double totalEnergy() const
+	{
+		size_t n = size();
+		double kinetic = 0.0, potential = 0.0;
+
+		for (size_t i = 0; i < n; i++)
+		{
+			glm::dvec3 position = getPosition(i), velocity = getVelocity(i);
+			kinetic += 0.5 * mass[i] * glm::dot(velocity, velocity);
+
+			for (size_t j = i + 1; j < n; j++)
+			{
+				glm::dvec3 d = getPosition(j) - position;
+				potential -= mass[i] * mass[j] / std::sqrt(glm::dot(d, d) + softening2);
+			}
+		}
+
+		return kinetic + potential;
+	}
+
+	// Body counts per level as of now
+	const HermiteStats& getStats()
+	{
+		for (HermiteLevel& level : stats.levels)
+			level.bodies = 0;
+		for (size_t i = 0; i < size(); i++)
+			stats.levels[levelOf(steps[i])].bodies++;
+
+		return stats;
+	}
+
+private:
+	static constexpr int maxLevels = 40;
+
+	double maxStep, accuracy, softening2;
+	double time = 0.0, startTime = 0.0;
+	bool started = false;
+
+	std::vector<double> mass;
+
+	// State at each body's own time, and its current step
+	std::vector<glm::dvec3> positions, velocities, accelerations, jerks;
+	std::vector<double> bodyTimes, steps;
+
+	// Scratch of a block step
+	std::vector<glm::dvec3> predictedPositions, predictedVelocities, newAccelerations, newJerks;
+	std::vector<size_t> active;
+
+	HermiteStats stats;
+
+	int levelOf(double step) const
+	{
+		return std::min((int)std::lround(std::log2(maxStep / step)), maxLevels - 1);
+	}
+
+	// Initial steps from acceleration over jerk, rounded down to a power of two
+	void start()
+	{
+		size_t n = size();
+		accelerations.assign(n, glm::dvec3(0.0));
+		jerks.assign(n, glm::dvec3(0.0));
+		bodyTimes.assign(n, time);
+		steps.assign(n, maxStep);
+		startTime = time;
+		predictedPositions = positions;
+		predictedVelocities = velocities;
+
+		active.resize(n);
+		for (size_t i = 0; i < n; i++)
+			active[i] = i;
+		evaluate();
+
+		for (size_t i = 0; i < n; i++)
+		{
+			accelerations[i] = newAccelerations[i];
+			jerks[i] = newJerks[i];
+
+			double jerk = glm::length(jerks[i]);
+			double step = jerk > 0.0 ? 0.01 * glm::length(accelerations[i]) / jerk : maxStep;
+			while (steps[i] > step && levelOf(steps[i]) < maxLevels - 1)
+				steps[i] *= 0.5;
+		}
+
+		stats.levels.assign(maxLevels, HermiteLevel());
+		for (int level = 0; level < maxLevels; level++)
+			stats.levels[level].step = std::ldexp(maxStep, -level);
+
+		started = true;
+	}
+
+	// Acceleration and jerk of the active bodies from the predicted state of all of them
+	void evaluate()
+	{
+		size_t n = size();
+		newAccelerations.resize(n);
+		newJerks.resize(n);
+
+		JobSystem::instance().parallelFor(active.size(), [&](size_t first, size_t last)
+			{
+				for (size_t k = first; k < last; k++)
+				{
+					size_t i = active[k];
+					glm::dvec3 acceleration(0.0), jerk(0.0);
+
+					for (size_t j = 0; j < n; j++)
+					{
+						if (j == i)
+							continue;
+
+						glm::dvec3 d = predictedPositions[j] - predictedPositions[i];
+						glm::dvec3 dv = predictedVelocities[j] - predictedVelocities[i];
+						double invR2 = 1.0 / (glm::dot(d, d) + softening2);
+						double massInvR3 = mass[j] * invR2 * std::sqrt(invR2);
+
+						acceleration += d * massInvR3;
+						jerk += (dv - d * (3.0 * glm::dot(d, dv) * invR2)) * massInvR3;
+					}
+
+					newAccelerations[i] = acceleration;
+					newJerks[i] = jerk;
+				}
+			});
+	}
+
+	void blockStep(double next)
+	{
+		auto begin = std::chrono::high_resolution_clock::now();
+		size_t n = size();
+
+		active.clear();
+		for (size_t i = 0; i < n; i++)
+		{
+			if (bodyTimes[i] + steps[i] == next)
+				active.push_back(i);
+		}
+
+		// Everyone predicted to the end of the block
+		predictedPositions.resize(n);
+		predictedVelocities.resize(n);
+		time = next;
+		for (size_t i = 0; i < n; i++)
+		{
+			predictedPositions[i] = getPosition(i);
+			predictedVelocities[i] = getVelocity(i);
+		}
+
+		evaluate();
+
+		// Time split between the levels by their share of the active bodies
+		double seconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - begin).count();
+		for (size_t i : active)
+		{
+			HermiteLevel& level = stats.levels[levelOf(steps[i])];
+			level.bodySteps++;
+			level.pairInteractions += (double)(n - 1);
+			level.seconds += seconds / active.size();
+
+			correct(i, next);
+		}
+		stats.blockSteps++;
+	}
+
+	// Hermite corrector, then the next step from Aarseth's criterion
+	void correct(size_t i, double next)
+	{
+		double dt = steps[i], dt2 = dt * dt;
+		glm::dvec3 a0 = accelerations[i], j0 = jerks[i], a1 = newAccelerations[i], j1 = newJerks[i];
+
+		// Second and third derivatives at the start of the step
+		glm::dvec3 snap = (-6.0 * (a0 - a1) - dt * (4.0 * j0 + 2.0 * j1)) / dt2;
+		glm::dvec3 crackle = (12.0 * (a0 - a1) + 6.0 * dt * (j0 + j1)) / (dt2 * dt);
+
+		positions[i] = predictedPositions[i] + (snap * (1.0 / 24.0) + crackle * (dt / 120.0)) * (dt2 * dt2);
+		velocities[i] = predictedVelocities[i] + (snap * (1.0 / 6.0) + crackle * (dt / 24.0)) * (dt2 * dt);
+		accelerations[i] = a1;
+		jerks[i] = j1;
+		bodyTimes[i] = next;
+
+		glm::dvec3 snapEnd = snap + crackle * dt;
+		double a = glm::length(a1), j = glm::length(j1), s = glm::length(snapEnd), c = glm::length(crackle);
+		double denominator = j * c + s * s;
+		double ideal = denominator > 0.0 ? std::sqrt(accuracy * (a * s + j * j) / denominator) : maxStep;
+
+		// Halved as often as needed, doubled at most once and only where the doubled step lines up
+		while (steps[i] > ideal && levelOf(steps[i]) < maxLevels - 1)
+			steps[i] *= 0.5;
+		if (ideal >= 2.0 * steps[i] && 2.0 * steps[i] <= maxStep && std::fmod(next - startTime, 2.0 * steps[i]) == 0.0)
+			steps[i] *= 2.0;
+	}
+};
+
+#endif
@@ -0,0 +1,88 @@
+#ifndef INSTANCE_BUFFER_H
+#define INSTANCE_BUFFER_H
+
+#include <glad/glad.h>
+
+#include <cstddef>
+
+// Per-instance vertex data of a fixed number of floats per instance, written by the CPU through a
+// mapping and read by instanced draws. Every map orphans the old storage, so a frame never waits
+// for the GPU to finish drawing the previous one.
+class InstanceBuffer
+{
+public:
+	explicit InstanceBuffer(size_t floatsPerInstance) : floatsPerInstance(floatsPerInstance)
+	{
+	}
+
+	InstanceBuffer(const InstanceBuffer&) = delete;
+	InstanceBuffer& operator=(const InstanceBuffer&) = delete;
+
+	~InstanceBuffer()
+	{
+		if (buffer != 0)
+			glDeleteBuffers(1, &buffer);
+	}
+
+	// Write-only, possibly uncached memory: fill it in order and never read it back
+	float* map(size_t instances)
+	{
+		if (buffer == 0)
+			glGenBuffers(1, &buffer);
+
+		count = instances;
+		GLsizeiptr bytes = (GLsizeiptr)(instances * floatsPerInstance * sizeof(float));
+
+		glBindBuffer(GL_ARRAY_BUFFER, buffer);
+		glBufferData(GL_ARRAY_BUFFER, bytes, nullptr, GL_STREAM_DRAW);
+		return bytes == 0 ? nullptr : (float*)glMapBufferRange(GL_ARRAY_BUFFER, 0, bytes, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+	}
+
+	void unmap()
+	{
+		glBindBuffer(GL_ARRAY_BUFFER, buffer);
+		if (count > 0)
+			glUnmapBuffer(GL_ARRAY_BUFFER);
+	}
+
+	// Instances that never change, copied once for the GPU to keep
+	void upload(const float* data, size_t instances)
+	{
+		if (buffer == 0)
+			glGenBuffers(1, &buffer);
+
+		count = instances;
+		glBindBuffer(GL_ARRAY_BUFFER, buffer);
+		glBufferData(GL_ARRAY_BUFFER, (GLsizeiptr)(instances * floatsPerInstance * sizeof(float)), data, GL_STATIC_DRAW);
+	}
+
+	// Points an attribute of the bound vertex array at components floats, offset floats into each
+	// instance. Instance 0 of a draw is firstInstance here, GL 4.1 has no base instance.
+	void attribute(GLuint location, GLint components, size_t offset, size_t firstInstance = 0)
+	{
+		size_t start = (firstInstance * floatsPerInstance + offset) * sizeof(float);
+		glBindBuffer(GL_ARRAY_BUFFER, buffer);
+		glEnableVertexAttribArray(location);
+		glVertexAttribPointer(location, components, GL_FLOAT, GL_FALSE, (GLsizei)(floatsPerInstance * sizeof(float)), (void*)start);
+		glVertexAttribDivisor(location, 1);
+	}
+
+	// A mat4 takes four locations, one per column
+	void matrixAttribute(GLuint location, size_t offset)
+	{
+		for (GLuint column = 0; column < 4; column++)
+			attribute(location + column, 4, offset + 4 * column);
+	}
+
+	size_t size() const
+	{
+		return count;
+	}
+
+private:
+	size_t floatsPerInstance;
+	size_t count = 0;
+	GLuint buffer = 0;
+};
+
+#endif
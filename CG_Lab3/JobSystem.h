@@ -0,0 +1,341 @@
+#ifndef JOB_SYSTEM_H
+#define JOB_SYSTEM_H
+
+#include <vector>
+#include <deque>
+#include <memory>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <algorithm>
+#include <cstddef>
+
+// A job other jobs can depend on. It's queued once every dependency has finished, and finishing
+// queues the continuations that were waiting for it.
+struct JobState
+{
+	std::function<void()> work;
+
+	// Unfinished dependencies, plus one until run() has registered them all
+	std::atomic<int> blockers{ 1 };
+	std::atomic<bool> done{ false };
+
+	std::mutex mutex;
+	std::vector<std::shared_ptr<JobState>> continuations;
+};
+
+typedef std::shared_ptr<JobState> JobHandle;
+
+// Worker threads with one job deque each. Owners push and pop at the back, idle threads steal
+// the oldest (largest) jobs from the front of the others, so recursively split work spreads out.
+// Threads that call parallelFor or wait run jobs too until what they wait for is done.
+// Background jobs (terrain chunks) sit in a queue of their own that only workers take from, so a
+// thread helping with a loop never gets stuck in one.
+class JobSystem
+{
+public:
+	static JobSystem& instance()
+	{
+		static JobSystem jobs;
+		return jobs;
+	}
+
+	// Active workers plus the calling thread
+	unsigned int threadCount() const
+	{
+		return activeWorkers.load(std::memory_order_acquire) + 1;
+	}
+
+	// Caps the threads used, the caller included, for measuring scaling. Workers are started
+	// when first needed and parked above the limit, at 1 background jobs wait until it's raised.
+	// Called from the main thread only.
+	void setThreadLimit(unsigned int limit)
+	{
+		unsigned int workers = std::min(std::max(limit, 1u), maxThreads) - 1;
+		while (threads.size() < workers)
+		{
+			int index = (int)threads.size() + 1;
+			threads.emplace_back([this, index]() { workerLoop(index); });
+			startedWorkers.fetch_add(1, std::memory_order_release);
+		}
+
+		{
+			std::lock_guard<std::mutex> lock(sleepMutex);
+			activeWorkers.store(workers, std::memory_order_release);
+		}
+		wakeUp.notify_all();
+		unparked.notify_all();
+	}
+
+	// Calls body(begin, end) over [0, count) in ranges of at most grain elements. Each range is split
+	// in halves, one half pushed for thieves and the other kept, until it's small enough to run.
+	void parallelFor(size_t count, size_t grain, const std::function<void(size_t, size_t)>& body)
+	{
+		if (count == 0)
+			return;
+
+		grain = std::max<size_t>(grain, 1);
+		if (activeWorkers.load(std::memory_order_acquire) == 0 || count <= grain)
+		{
+			body(0, count);
+			return;
+		}
+
+		std::atomic<size_t> remaining(count);
+		runRange(0, count, grain, body, remaining);
+
+		while (remaining.load(std::memory_order_acquire) > 0)
+		{
+			if (!runOne(false))
+				std::this_thread::yield();
+		}
+	}
+
+	// Same, with about four ranges per thread so there's something left to steal when threads
+	// run unevenly, but never fewer than minimumGrain elements in one
+	void parallelFor(size_t count, const std::function<void(size_t, size_t)>& body)
+	{
+		parallelFor(count, std::max(count / (4 * threadCount()), minimumGrain), body);
+	}
+
+	// Queues work to run after every job in dependencies has finished
+	JobHandle run(std::function<void()> work, const std::vector<JobHandle>& dependencies = {})
+	{
+		JobHandle job = std::make_shared<JobState>();
+		job->work = std::move(work);
+
+		for (const JobHandle& dependency : dependencies)
+		{
+			if (!dependency)
+				continue;
+
+			std::lock_guard<std::mutex> lock(dependency->mutex);
+			if (dependency->done.load(std::memory_order_acquire))
+				continue;
+
+			job->blockers.fetch_add(1, std::memory_order_relaxed);
+			dependency->continuations.push_back(job);
+		}
+
+		release(job);
+		return job;
+	}
+
+	JobHandle then(const JobHandle& job, std::function<void()> work)
+	{
+		return run(std::move(work), { job });
+	}
+
+	// Runs other jobs until this one is done
+	void wait(const JobHandle& job)
+	{
+		while (job && !job->done.load(std::memory_order_acquire))
+		{
+			if (!runOne(false))
+				std::this_thread::yield();
+		}
+	}
+
+	// Fire and forget, for work that may take longer than a frame
+	void submit(std::function<void()> work)
+	{
+		{
+			std::lock_guard<std::mutex> lock(background.mutex);
+			background.jobs.push_back(std::move(work));
+		}
+		background.size.fetch_add(1, std::memory_order_release);
+		notify();
+	}
+
+	~JobSystem()
+	{
+		{
+			std::lock_guard<std::mutex> lock(sleepMutex);
+			stop = true;
+		}
+		wakeUp.notify_all();
+		unparked.notify_all();
+
+		for (std::thread& thread : threads)
+			thread.join();
+	}
+
+private:
+	static constexpr unsigned int maxThreads = 16;
+	static constexpr size_t minimumGrain = 64;
+
+	struct Queue
+	{
+		std::deque<std::function<void()>> jobs;
+		std::mutex mutex;
+
+		// Lets thieves skip empty queues without locking them
+		std::atomic<int> size{ 0 };
+	};
+
+	// Queue 0 is shared by threads that aren't workers, worker i owns queue i
+	std::vector<std::unique_ptr<Queue>> queues;
+	Queue background;
+	std::vector<std::thread> threads;
+	std::atomic<unsigned int> startedWorkers{ 0 };
+	std::atomic<unsigned int> activeWorkers{ 0 };
+
+	std::atomic<int> queued{ 0 };
+	std::mutex sleepMutex;
+	std::condition_variable wakeUp, unparked;
+	bool stop = false;
+
+	JobSystem()
+	{
+		unsigned int hardware = std::thread::hardware_concurrency();
+		unsigned int limit = std::max(std::min(hardware, maxThreads), 2u);
+
+		// Queues for every worker there could be, so thieves never see the list change
+		for (unsigned int i = 0; i < maxThreads; i++)
+			queues.push_back(std::make_unique<Queue>());
+
+		setThreadLimit(limit);
+	}
+
+	static int& currentQueue()
+	{
+		static thread_local int index = 0;
+		return index;
+	}
+
+	void push(std::function<void()> job)
+	{
+		Queue& queue = *queues[currentQueue()];
+		{
+			std::lock_guard<std::mutex> lock(queue.mutex);
+			queue.jobs.push_back(std::move(job));
+		}
+		queue.size.fetch_add(1, std::memory_order_release);
+		notify();
+	}
+
+	void notify()
+	{
+		queued.fetch_add(1, std::memory_order_release);
+
+		// Taking the lock orders this with a worker that's about to sleep
+		{
+			std::lock_guard<std::mutex> lock(sleepMutex);
+		}
+		wakeUp.notify_one();
+	}
+
+	static bool take(Queue& queue, bool newest, std::function<void()>& job)
+	{
+		if (queue.size.load(std::memory_order_acquire) == 0)
+			return false;
+
+		std::lock_guard<std::mutex> lock(queue.mutex);
+		if (queue.jobs.empty())
+			return false;
+
+		if (newest)
+		{
+			job = std::move(queue.jobs.back());
+			queue.jobs.pop_back();
+		}
+		else
+		{
+			job = std::move(queue.jobs.front());
+			queue.jobs.pop_front();
+		}
+		queue.size.fetch_sub(1, std::memory_order_relaxed);
+		return true;
+	}
+
+	// Own jobs newest first, then the oldest job of any other queue, then background work
+	bool runOne(bool withBackground)
+	{
+		std::function<void()> job;
+		size_t own = (size_t)currentQueue();
+		size_t count = startedWorkers.load(std::memory_order_acquire) + 1;
+
+		for (size_t i = 0; i < count && !job; i++)
+			take(*queues[(own + i) % count], i == 0, job);
+
+		if (!job && withBackground)
+			take(background, false, job);
+
+		if (!job)
+			return false;
+
+		queued.fetch_sub(1, std::memory_order_relaxed);
+		job();
+		return true;
+	}
+
+	void release(const JobHandle& job)
+	{
+		if (job->blockers.fetch_sub(1, std::memory_order_acq_rel) == 1)
+			push([this, job]() { execute(job); });
+	}
+
+	void execute(const JobHandle& job)
+	{
+		job->work();
+		job->work = nullptr;
+
+		std::vector<JobHandle> continuations;
+		{
+			std::lock_guard<std::mutex> lock(job->mutex);
+			job->done.store(true, std::memory_order_release);
+			continuations.swap(job->continuations);
+		}
+
+		for (const JobHandle& continuation : continuations)
+			release(continuation);
+	}
+
+	void runRange(size_t begin, size_t end, size_t grain, const std::function<void(size_t, size_t)>& body, std::atomic<size_t>& remaining)
+	{
+		while (end - begin > grain)
+		{
+			size_t middle = begin + (end - begin) / 2;
+			size_t upperEnd = end;
+			push([this, middle, upperEnd, grain, &body, &remaining]() { runRange(middle, upperEnd, grain, body, remaining); });
+			end = middle;
+		}
+
+		body(begin, end);
+		remaining.fetch_sub(end - begin, std::memory_order_acq_rel);
+	}
+
+	void workerLoop(int index)
+	{
+		currentQueue() = index;
+		unsigned int worker = (unsigned int)index;
+
+		while (true)
+		{
+			if (worker <= activeWorkers.load(std::memory_order_acquire))
+			{
+				if (runOne(true))
+					continue;
+
+				std::unique_lock<std::mutex> lock(sleepMutex);
+				wakeUp.wait(lock, [this, worker]()
+					{
+						return stop || worker > activeWorkers.load(std::memory_order_acquire) || queued.load(std::memory_order_acquire) > 0;
+					});
+			}
+			else
+			{
+				// Parked by setThreadLimit, its queue is empty or left to thieves
+				std::unique_lock<std::mutex> lock(sleepMutex);
+				unparked.wait(lock, [this, worker]() { return stop || worker <= activeWorkers.load(std::memory_order_acquire); });
+			}
+
+			if (stop)
+				return;
+		}
+	}
+};
+
+#endif
@@ -0,0 +1,327 @@
+#ifndef KEPLER_H
+#define KEPLER_H
+
+#include <glm/glm.hpp>
+
+#include <vector>
+#include <algorithm>
+#include <numeric>
+#include <chrono>
+#include <random>
+#include <cmath>
+#include <cstdint>
+#include <cstddef>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+#include "SimdMath.h"
+#include "JobSystem.h"
+
+// Classical elements of an orbit around a central body. Angles in radians, time in days,
+// the mean anomaly is the one at epoch.
+struct OrbitalElements
+{
+	double semiMajorAxis;
+	double eccentricity;
+	double inclination;
+	double ascendingNode;
+	double argumentOfPeriapsis;
+	double meanAnomaly;
+	double epoch = 0.0;
+};
+
+// Orbits laid out for propagation, one entry per body in eccentricity order, padded to whole blocks
+// of 8, with the Halley iterations each block needs. Owned by a KeplerPropagator or mapped from a file.
+struct KeplerArrays
+{
+	size_t count = 0;
+	const double* meanMotion = nullptr;		// M(t) = meanMotion * t + phase
+	const double* phase = nullptr;
+	const float* eccentricity = nullptr;
+	const float* semiMajor = nullptr;
+	const float* semiMinor = nullptr;
+	const float* px = nullptr;				// periapsis direction and the one 90 degrees ahead
+	const float* py = nullptr;
+	const float* pz = nullptr;
+	const float* qx = nullptr;
+	const float* qy = nullptr;
+	const float* qz = nullptr;
+	const int32_t* blockIterations = nullptr;
+};
+
+// Elliptic orbits evaluated in batches: Kepler's equation is solved with Halley's method for 8 bodies
+// per AVX2 register. Bodies are kept sorted by eccentricity and every block of 8 runs the fixed
+// number of iterations its most eccentric body needs, so there are no branches per lane.
+class KeplerPropagator
+{
+public:
+	KeplerPropagator(double gm) : gm(gm)
+	{
+	}
+
+	// Returns the id of the body, positions come out sorted by eccentricity, see getId
+	size_t add(const OrbitalElements& elements)
+	{
+		orbits.push_back(elements);
+		sorted = false;
+		return orbits.size() - 1;
+	}
+
+	size_t size() const
+	{
+		return orbits.size();
+	}
+
+	// Id of the body whose position is written at index i
+	size_t getId(size_t i)
+	{
+		prepare();
+		return ids[i];
+	}
+
+	// Positions at time (days) relative to the central body, in the orbit's frame (AU for the solar system)
+	void propagate(double time, float* x, float* y, float* z)
+	{
+		propagate(getArrays(), time, x, y, z);
+	}
+
+	static void propagate(const KeplerArrays& orbits, double time, float* x, float* y, float* z)
+	{
+		size_t blockCount = (orbits.count + 7) / 8;
+		JobSystem::instance().parallelFor(blockCount, [&](size_t first, size_t last)
+		{
+			for (size_t block = first; block < last; block++)
+				propagateBlock(orbits, block, time, x, y, z);
+		});
+	}
+
+	// The sorted layout, valid until the next add
+	KeplerArrays getArrays()
+	{
+		prepare();
+
+		KeplerArrays arrays;
+		arrays.count = size();
+		arrays.meanMotion = meanMotion.data(); arrays.phase = phase.data();
+		arrays.eccentricity = eccentricity.data(); arrays.semiMajor = semiMajor.data(); arrays.semiMinor = semiMinor.data();
+		arrays.px = px.data(); arrays.py = py.data(); arrays.pz = pz.data();
+		arrays.qx = qx.data(); arrays.qy = qy.data(); arrays.qz = qz.data();
+		arrays.blockIterations = blockIterations.data();
+		return arrays;
+	}
+
+	// Halley iterations that bring E to float precision from the starter used below
+	static int iterationsFor(double eccentricity)
+	{
+		if (eccentricity < 0.05) return 1;
+		if (eccentricity < 0.3) return 2;
+		if (eccentricity < 0.8) return 3;
+		if (eccentricity < 0.95) return 4;
+		return 6;
+	}
+
+	// Position and velocity in double precision, for setting up a simulation
+	static void stateVector(const OrbitalElements& elements, double gm, double time, glm::dvec3& position, glm::dvec3& velocity)
+	{
+		double e = elements.eccentricity, a = elements.semiMajorAxis;
+		double n = std::sqrt(gm / (a * a * a));
+		double M = std::remainder(elements.meanAnomaly + n * (time - elements.epoch), 2.0 * 3.14159265358979323846);
+
+		double E = M + e * std::sin(M);
+		for (int i = 0; i < 50; i++)
+		{
+			double dE = (E - e * std::sin(E) - M) / (1.0 - e * std::cos(E));
+			E -= dE;
+			if (std::fabs(dE) < 1e-15)
+				break;
+		}
+
+		glm::dvec3 p, q;
+		perifocalAxes(elements, p, q);
+
+		double b = a * std::sqrt(1.0 - e * e);
+		double cosE = std::cos(E), sinE = std::sin(E);
+		double r = a * (1.0 - e * cosE);
+
+		position = p * (a * (cosE - e)) + q * (b * sinE);
+		velocity = (p * (-a * sinE) + q * (b * cosE)) * (std::sqrt(gm * a) / (r * a));
+	}
+
+	// Unit vectors towards periapsis and 90 degrees ahead of it, in the reference frame
+	static void perifocalAxes(const OrbitalElements& elements, glm::dvec3& p, glm::dvec3& q)
+	{
+		double cosO = std::cos(elements.ascendingNode), sinO = std::sin(elements.ascendingNode);
+		double cosI = std::cos(elements.inclination), sinI = std::sin(elements.inclination);
+		double cosW = std::cos(elements.argumentOfPeriapsis), sinW = std::sin(elements.argumentOfPeriapsis);
+
+		p = glm::dvec3(cosO * cosW - sinO * sinW * cosI, sinO * cosW + cosO * sinW * cosI, sinW * sinI);
+		q = glm::dvec3(-cosO * sinW - sinO * cosW * cosI, -sinO * sinW + cosO * cosW * cosI, cosW * sinI);
+	}
+
+	// Evaluations per millisecond for count bodies with eccentricities up to maxEccentricity
+	static double measureThroughput(size_t count, double maxEccentricity)
+	{
+		KeplerPropagator propagator(2.9591220828559115e-4);
+		std::mt19937 random(99);
+		std::uniform_real_distribution<double> uniform(0.0, 1.0);
+
+		for (size_t i = 0; i < count; i++)
+		{
+			OrbitalElements elements;
+			elements.semiMajorAxis = 2.1 + 1.2 * uniform(random);
+			elements.eccentricity = maxEccentricity * uniform(random);
+			elements.inclination = 0.5 * uniform(random);
+			elements.ascendingNode = 6.28 * uniform(random);
+			elements.argumentOfPeriapsis = 6.28 * uniform(random);
+			elements.meanAnomaly = 6.28 * uniform(random);
+			propagator.add(elements);
+		}
+
+		std::vector<float> x(count), y(count), z(count);
+		propagator.propagate(0.0, x.data(), y.data(), z.data());
+
+		int runs = 10;
+		auto begin = std::chrono::high_resolution_clock::now();
+		for (int i = 0; i < runs; i++)
+			propagator.propagate(100.0 * i, x.data(), y.data(), z.data());
+		double ms = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - begin).count();
+
+		return count * runs / ms;
+	}
+
+private:
+	double gm;
+	std::vector<OrbitalElements> orbits;
+	bool sorted = true;
+
+	// Per body, in eccentricity order, padded to whole blocks
+	std::vector<size_t> ids;
+	std::vector<double> meanMotion, phase;	// M(t) = meanMotion * t + phase
+	std::vector<float> eccentricity, semiMajor, semiMinor;
+	std::vector<float> px, py, pz, qx, qy, qz;	// periapsis direction and the one 90 degrees ahead
+	std::vector<int32_t> blockIterations;
+
+	void prepare()
+	{
+		if (sorted)
+			return;
+
+		ids.resize(orbits.size());
+		std::iota(ids.begin(), ids.end(), (size_t)0);
+		std::stable_sort(ids.begin(), ids.end(), [this](size_t a, size_t b) { return orbits[a].eccentricity < orbits[b].eccentricity; });
+
+		size_t padded = (orbits.size() + 7) / 8 * 8;
+		meanMotion.assign(padded, 0.0); phase.assign(padded, 0.0);
+		eccentricity.assign(padded, 0.0f); semiMajor.assign(padded, 0.0f); semiMinor.assign(padded, 0.0f);
+		px.assign(padded, 0.0f); py.assign(padded, 0.0f); pz.assign(padded, 0.0f);
+		qx.assign(padded, 0.0f); qy.assign(padded, 0.0f); qz.assign(padded, 0.0f);
+		blockIterations.assign(padded / 8, 1);
+
+		for (size_t i = 0; i < orbits.size(); i++)
+		{
+			const OrbitalElements& elements = orbits[ids[i]];
+			double a = elements.semiMajorAxis, e = elements.eccentricity;
+
+			meanMotion[i] = std::sqrt(gm / (a * a * a));
+			phase[i] = elements.meanAnomaly - meanMotion[i] * elements.epoch;
+
+			eccentricity[i] = (float)e;
+			semiMajor[i] = (float)a;
+			semiMinor[i] = (float)(a * std::sqrt(1.0 - e * e));
+
+			glm::dvec3 p, q;
+			perifocalAxes(elements, p, q);
+			px[i] = (float)p.x; py[i] = (float)p.y; pz[i] = (float)p.z;
+			qx[i] = (float)q.x; qy[i] = (float)q.y; qz[i] = (float)q.z;
+
+			blockIterations[i / 8] = std::max<int32_t>(blockIterations[i / 8], iterationsFor(e));
+		}
+
+		sorted = true;
+	}
+
+	static void propagateBlock(const KeplerArrays& orbits, size_t block, double time, float* x, float* y, float* z)
+	{
+		size_t begin = block * 8;
+		size_t count = std::min<size_t>(8, orbits.count - begin);
+		int iterations = orbits.blockIterations[block];
+
+		const double* meanMotion = orbits.meanMotion;
+		const double* phase = orbits.phase;
+		const float* eccentricity = orbits.eccentricity;
+		const float* semiMajor = orbits.semiMajor;
+		const float* semiMinor = orbits.semiMinor;
+		const float* px = orbits.px; const float* py = orbits.py; const float* pz = orbits.pz;
+		const float* qx = orbits.qx; const float* qy = orbits.qy; const float* qz = orbits.qz;
+
+#if defined(__AVX2__)
+		// Mean anomaly in double, reduced to [-pi, pi] before dropping to float
+		const __m256d twoPi = _mm256_set1_pd(2.0 * 3.14159265358979323846), invTwoPi = _mm256_set1_pd(1.0 / (2.0 * 3.14159265358979323846));
+		__m256d t = _mm256_set1_pd(time);
+		__m256d m0 = _mm256_add_pd(_mm256_mul_pd(_mm256_loadu_pd(&meanMotion[begin]), t), _mm256_loadu_pd(&phase[begin]));
+		__m256d m1 = _mm256_add_pd(_mm256_mul_pd(_mm256_loadu_pd(&meanMotion[begin + 4]), t), _mm256_loadu_pd(&phase[begin + 4]));
+		m0 = _mm256_sub_pd(m0, _mm256_mul_pd(twoPi, _mm256_round_pd(_mm256_mul_pd(m0, invTwoPi), _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC)));
+		m1 = _mm256_sub_pd(m1, _mm256_mul_pd(twoPi, _mm256_round_pd(_mm256_mul_pd(m1, invTwoPi), _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC)));
+		__m256 M = _mm256_set_m128(_mm256_cvtpd_ps(m1), _mm256_cvtpd_ps(m0));
+
+		__m256 e = _mm256_loadu_ps(&eccentricity[begin]);
+		__m256 one = _mm256_set1_ps(1.0f), half = _mm256_set1_ps(0.5f);
+
+		// Starter E = M + e sin M (1 + e cos M), then Halley steps
+		__m256 sinE, cosE;
+		SimdMath::sincos8(M, sinE, cosE);
+		__m256 E = _mm256_add_ps(M, _mm256_mul_ps(_mm256_mul_ps(e, sinE), _mm256_add_ps(one, _mm256_mul_ps(e, cosE))));
+
+		for (int i = 0; i < iterations; i++)
+		{
+			SimdMath::sincos8(E, sinE, cosE);
+			__m256 esin = _mm256_mul_ps(e, sinE);
+			__m256 f = _mm256_sub_ps(_mm256_sub_ps(E, esin), M);
+			__m256 df = _mm256_sub_ps(one, _mm256_mul_ps(e, cosE));
+			__m256 denominator = _mm256_sub_ps(df, _mm256_div_ps(_mm256_mul_ps(_mm256_mul_ps(half, f), esin), df));
+			E = _mm256_sub_ps(E, _mm256_div_ps(f, denominator));
+		}
+
+		SimdMath::sincos8(E, sinE, cosE);
+		__m256 u = _mm256_mul_ps(_mm256_loadu_ps(&semiMajor[begin]), _mm256_sub_ps(cosE, e));
+		__m256 v = _mm256_mul_ps(_mm256_loadu_ps(&semiMinor[begin]), sinE);
+
+		float outX[8], outY[8], outZ[8];
+		_mm256_storeu_ps(outX, _mm256_add_ps(_mm256_mul_ps(u, _mm256_loadu_ps(&px[begin])), _mm256_mul_ps(v, _mm256_loadu_ps(&qx[begin]))));
+		_mm256_storeu_ps(outY, _mm256_add_ps(_mm256_mul_ps(u, _mm256_loadu_ps(&py[begin])), _mm256_mul_ps(v, _mm256_loadu_ps(&qy[begin]))));
+		_mm256_storeu_ps(outZ, _mm256_add_ps(_mm256_mul_ps(u, _mm256_loadu_ps(&pz[begin])), _mm256_mul_ps(v, _mm256_loadu_ps(&qz[begin]))));
+
+		std::copy(outX, outX + count, x + begin);
+		std::copy(outY, outY + count, y + begin);
+		std::copy(outZ, outZ + count, z + begin);
+#else
+		for (size_t k = begin; k < begin + count; k++)
+		{
+			float M = (float)std::remainder(meanMotion[k] * time + phase[k], 2.0 * 3.14159265358979323846);
+			float e = eccentricity[k];
+
+			float sinE, cosE;
+			SimdMath::sincos(M, sinE, cosE);
+			float E = M + e * sinE * (1.0f + e * cosE);
+
+			for (int i = 0; i < iterations; i++)
+			{
+				SimdMath::sincos(E, sinE, cosE);
+				float f = E - e * sinE - M;
+				float df = 1.0f - e * cosE;
+				E -= f / (df - 0.5f * f * e * sinE / df);
+			}
+
+			SimdMath::sincos(E, sinE, cosE);
+			float u = semiMajor[k] * (cosE - e), v = semiMinor[k] * sinE;
+			x[k] = u * px[k] + v * qx[k];
+			y[k] = u * py[k] + v * qy[k];
+			z[k] = u * pz[k] + v * qz[k];
+		}
+#endif
+	}
+};
+
+#endif
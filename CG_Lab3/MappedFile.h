@@ -0,0 +1,143 @@
+#ifndef MAPPED_FILE_H
+#define MAPPED_FILE_H
+
+#include <cstddef>
+
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+// Read-only view of a whole file. Nothing is read up front, the OS pages in what gets touched,
+// and it's told the accesses are random so it doesn't read ahead either, unless the file is
+// opened for reading through from start to end.
+class MappedFile
+{
+public:
+	MappedFile() = default;
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+
+	~MappedFile()
+	{
+		close();
+	}
+
+	bool open(const char* path, bool sequential = false)
+	{
+		close();
+
+#ifdef _WIN32
+		file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | (sequential ? FILE_FLAG_SEQUENTIAL_SCAN : FILE_FLAG_RANDOM_ACCESS), nullptr);
+		if (file == INVALID_HANDLE_VALUE)
+			return false;
+
+		LARGE_INTEGER fileSize;
+		if (!GetFileSizeEx(file, &fileSize) || fileSize.QuadPart == 0)
+		{
+			close();
+			return false;
+		}
+
+		mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+		if (mapping == nullptr)
+		{
+			close();
+			return false;
+		}
+
+		bytes = (const unsigned char*)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+		length = (size_t)fileSize.QuadPart;
+#else
+		file = ::open(path, O_RDONLY);
+		if (file < 0)
+			return false;
+
+		struct stat status;
+		if (fstat(file, &status) != 0 || status.st_size == 0)
+		{
+			close();
+			return false;
+		}
+
+		void* view = mmap(nullptr, (size_t)status.st_size, PROT_READ, MAP_PRIVATE, file, 0);
+		if (view != MAP_FAILED)
+		{
+			madvise(view, (size_t)status.st_size, sequential ? MADV_SEQUENTIAL : MADV_RANDOM);
+			bytes = (const unsigned char*)view;
+		}
+		length = (size_t)status.st_size;
+#endif
+
+		if (bytes == nullptr)
+		{
+			close();
+			return false;
+		}
+
+		return true;
+	}
+
+	void close()
+	{
+#ifdef _WIN32
+		if (bytes != nullptr)
+			UnmapViewOfFile(bytes);
+		if (mapping != nullptr)
+			CloseHandle(mapping);
+		if (file != INVALID_HANDLE_VALUE)
+			CloseHandle(file);
+
+		mapping = nullptr;
+		file = INVALID_HANDLE_VALUE;
+#else
+		if (bytes != nullptr)
+			munmap((void*)bytes, length);
+		if (file >= 0)
+			::close(file);
+
+		file = -1;
+#endif
+
+		bytes = nullptr;
+		length = 0;
+	}
+
+	bool isOpen() const
+	{
+		return bytes != nullptr;
+	}
+
+	const unsigned char* data() const
+	{
+		return bytes;
+	}
+
+	size_t size() const
+	{
+		return length;
+	}
+
+private:
+	const unsigned char* bytes = nullptr;
+	size_t length = 0;
+
+#ifdef _WIN32
+	HANDLE file = INVALID_HANDLE_VALUE;
+	HANDLE mapping = nullptr;
+#else
+	int file = -1;
+#endif
+};
+
+#endif
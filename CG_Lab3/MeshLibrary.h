@@ -0,0 +1,416 @@
+#ifndef MESH_LIBRARY_H
+#define MESH_LIBRARY_H
+
+#include <glad/glad.h>
+
+#include <vector>
+#include <algorithm>
+#include <utility>
+#include <map>
+#include <tuple>
+#include <cstdint>
+#include <cstddef>
+
+#include "Figures.h"
+#include "MeshOptimizer.h"
+#include "StaticFigures.h"
+
+// Lightweight reference to a mesh stored in one of the library's shared buffers
+struct MeshHandle
+{
+	int pool = -1;
+	GLsizei indexCount = 0;
+	size_t indexOffset = 0;		// bytes into the pool's element buffer
+	GLint baseVertex = 0;
+	GLenum indexType = GL_UNSIGNED_SHORT;
+};
+
+struct MeshLibraryStats
+{
+	int meshes = 0;
+	int requests = 0;
+	size_t vertexBytes = 0;
+	size_t indexBytes = 0;
+};
+
+// Unit spheres and tori keyed by their generator parameters. Every mesh is built, packed and optimised once,
+// then lives in a shared vertex/element buffer per vertex format and is drawn with a base vertex offset.
+// Indices are 16-bit, meshes with more vertices than that can address go to a 32-bit pool of their format.
+// Bodies scale the unit meshes with their model matrix. The cube-sphere patches for the tessellation
+// shaders are shared the same way, in a pool of their own.
+class MeshLibrary
+{
+public:
+	static MeshLibrary& instance()
+	{
+		static MeshLibrary library;
+		return library;
+	}
+
+	// Sphere of radius 1. The bodies' and SphereLODSet's resolutions come from compile-time tables,
+	// others are generated
+	MeshHandle sphere(int sectorCount, int stackCount)
+	{
+		if (stackCount * 2 == sectorCount)
+		{
+			switch (sectorCount)
+			{
+			case 18: return sphere<18, 9>();
+			case 36: return sphere<36, 18>();
+			case 72: return sphere<72, 36>();
+			case 144: return sphere<144, 72>();
+			case 288: return sphere<288, 144>();
+			}
+		}
+
+		stats.requests++;
+
+		MeshKey key(SpherePool, sectorCount, stackCount);
+		auto found = meshes.find(key);
+		if (found != meshes.end())
+			return found->second;
+
+		Sphere sphere(1.0f, sectorCount, stackCount);
+		std::vector<PackedSphereVertex> vertices = MeshOptimizer::packSphere(sphere, 1.0f);
+
+		MeshHandle handle = add(SpherePool, vertices.data(), vertices.size(), sphere.indices.data(), sphere.indices.size(), sphere.vertices.size() * sizeof(float));
+		meshes[key] = handle;
+		return handle;
+	}
+
+	// Torus with a centerline of radius 1. The tube radius isn't part of the mesh, the SunOrbits
+	// vertex shader takes it as the "tubeRadius" uniform relative to the centerline radius
+	MeshHandle torus(int numSides, int numRings)
+	{
+		if (numSides == 64 && numRings == 64)
+			return torus<64, 64>();
+
+		stats.requests++;
+
+		MeshKey key(TorusPool, numSides, numRings);
+		auto found = meshes.find(key);
+		if (found != meshes.end())
+			return found->second;
+
+		// Any tube radius works here, only the direction from the centerline is kept
+		Torus torus(1.0f, 0.25f, numSides, numRings);
+		std::vector<PackedTorusVertex> vertices = MeshOptimizer::packTorus(torus);
+
+		MeshHandle handle = add(TorusPool, vertices.data(), vertices.size(), torus.indices.data(), torus.indices.size(), torus.vertices.size() * sizeof(float));
+		meshes[key] = handle;
+		return handle;
+	}
+
+	// Unit cube of quad patches for the tessellated bodies, see CubeSpherePatches
+	MeshHandle cubeSphere(int patchesPerEdge)
+	{
+		stats.requests++;
+
+		MeshKey key(PatchPool, patchesPerEdge, 0);
+		auto found = meshes.find(key);
+		if (found != meshes.end())
+			return found->second;
+
+		CubeSpherePatches patches(patchesPerEdge);
+		MeshHandle handle = add(PatchPool, patches.vertices.data(), patches.vertices.size() / 3, patches.indices.data(), patches.indices.size(), patches.vertices.size() * sizeof(float));
+		meshes[key] = handle;
+		return handle;
+	}
+
+	// Sphere evaluated at compile time, uploaded straight from its read-only tables
+	template<int Sectors, int Stacks>
+	MeshHandle sphere()
+	{
+		static constexpr StaticSphere<Sectors, Stacks> mesh{};
+
+		stats.requests++;
+
+		MeshKey key(SpherePool, Sectors, Stacks);
+		auto found = meshes.find(key);
+		if (found != meshes.end())
+			return found->second;
+
+		MeshHandle handle = addStatic(SpherePool, mesh.vertices.data(), mesh.vertexCount, mesh.indices.data(), mesh.indexCount);
+		meshes[key] = handle;
+		return handle;
+	}
+
+	template<int Sides, int Rings>
+	MeshHandle torus()
+	{
+		static constexpr StaticTorus<Sides, Rings> mesh{};
+
+		stats.requests++;
+
+		MeshKey key(TorusPool, Sides, Rings);
+		auto found = meshes.find(key);
+		if (found != meshes.end())
+			return found->second;
+
+		MeshHandle handle = addStatic(TorusPool, mesh.vertices.data(), mesh.vertexCount, mesh.indices.data(), mesh.indexCount);
+		meshes[key] = handle;
+		return handle;
+	}
+
+	// Triangles, or 4-vertex patches for a cubeSphere
+	void draw(const MeshHandle& handle)
+	{
+		Pool& pool = pools[handle.pool];
+		if (!pool.stagedVertices.empty())
+			upload(pool);
+
+		GLenum mode = GL_TRIANGLES;
+		if (pool.type == PatchPool)
+		{
+			glPatchParameteri(GL_PATCH_VERTICES, 4);
+			mode = GL_PATCHES;
+		}
+
+		glBindVertexArray(pool.VAO);
+		glDrawElementsBaseVertex(mode, handle.indexCount, handle.indexType, (void*)handle.indexOffset, handle.baseVertex);
+		glBindVertexArray(0);
+	}
+
+	// Moves every mesh built so far to the GPU and drops the CPU copies
+	void upload()
+	{
+		for (Pool& pool : pools)
+			if (!pool.stagedVertices.empty())
+				upload(pool);
+	}
+
+	const MeshLibraryStats& getStats() const
+	{
+		return stats;
+	}
+
+	~MeshLibrary()
+	{
+		for (Pool& pool : pools)
+		{
+			glDeleteVertexArrays(1, &pool.VAO);
+			glDeleteBuffers(1, &pool.VBO);
+			glDeleteBuffers(1, &pool.EBO);
+		}
+	}
+
+private:
+	enum PoolType { SpherePool = 0, TorusPool = 1, PatchPool = 2, PoolCount = 3 };
+
+	typedef std::tuple<int, int, int> MeshKey;
+
+	struct Pool
+	{
+		PoolType type;
+		size_t stride;
+		size_t indexSize;			// 2 or 4 bytes
+		unsigned int VAO = 0, VBO = 0, EBO = 0;
+
+		// Sizes of what's already on the GPU
+		size_t vertexCount = 0, indexCount = 0;
+
+		// Meshes added since the last upload, pointing into compile-time tables or into copies
+		// kept until then
+		struct Piece
+		{
+			const void* data;
+			size_t bytes;
+		};
+		std::vector<Piece> stagedVertices, stagedIndices;
+		size_t stagedVertexBytes = 0, stagedIndexBytes = 0;
+		std::vector<std::vector<uint8_t>> stagedCopies;
+
+		void stage(std::vector<Piece>& pieces, size_t& total, const void* data, size_t bytes)
+		{
+			pieces.push_back({ data, bytes });
+			total += bytes;
+		}
+
+		void stageCopy(std::vector<Piece>& pieces, size_t& total, std::vector<uint8_t>&& bytes)
+		{
+			stagedCopies.push_back(std::move(bytes));
+			stage(pieces, total, stagedCopies.back().data(), stagedCopies.back().size());
+		}
+	};
+
+	// 16-bit pools by type, then 32-bit ones
+	Pool pools[2 * PoolCount];
+	std::map<MeshKey, MeshHandle> meshes;
+	MeshLibraryStats stats;
+
+	MeshLibrary()
+	{
+		const size_t strides[PoolCount] = { sizeof(PackedSphereVertex), sizeof(PackedTorusVertex), 3 * sizeof(float) };
+		for (int i = 0; i < 2 * PoolCount; i++)
+		{
+			pools[i].type = (PoolType)(i % PoolCount);
+			pools[i].stride = strides[i % PoolCount];
+			pools[i].indexSize = i < PoolCount ? sizeof(unsigned short) : sizeof(unsigned int);
+		}
+	}
+
+	template<typename Index>
+	MeshHandle add(PoolType type, const void* vertices, size_t vertexCount, const Index* sourceIndices, size_t sourceIndexCount, size_t originalVertexBytes)
+	{
+		// Indices are relative to the mesh's base vertex, so each mesh only has to fit 16 bits on its own
+		bool wide = vertexCount > 65536;
+		int poolIndex = wide ? PoolCount + type : type;
+		Pool& pool = pools[poolIndex];
+
+		std::vector<unsigned int> indices(sourceIndices, sourceIndices + sourceIndexCount);
+
+		// Patches are already in order and aren't triangles for the optimiser
+		if (type != PatchPool)
+		{
+			MeshStatistics& meshStats = MeshOptimizer::statistics();
+			meshStats.meshes++;
+			meshStats.triangles += indices.size() / 3;
+			meshStats.transformsBefore += MeshOptimizer::computeACMR(indices, vertexCount) * (indices.size() / 3);
+
+			MeshOptimizer::optimizeVertexCache(indices, vertexCount);
+
+			meshStats.transformsAfter += MeshOptimizer::computeACMR(indices, vertexCount) * (indices.size() / 3);
+			meshStats.originalBytes += originalVertexBytes + indices.size() * sizeof(unsigned int);
+			meshStats.packedBytes += vertexCount * pool.stride + indices.size() * pool.indexSize;
+		}
+
+		MeshHandle handle;
+		handle.pool = poolIndex;
+		handle.indexCount = (GLsizei)indices.size();
+		handle.indexOffset = pool.indexCount * pool.indexSize + pool.stagedIndexBytes;
+		handle.baseVertex = (GLint)(pool.vertexCount + pool.stagedVertexBytes / pool.stride);
+		handle.indexType = wide ? GL_UNSIGNED_INT : GL_UNSIGNED_SHORT;
+
+		const uint8_t* bytes = (const uint8_t*)vertices;
+		pool.stageCopy(pool.stagedVertices, pool.stagedVertexBytes, std::vector<uint8_t>(bytes, bytes + vertexCount * pool.stride));
+
+		std::vector<uint8_t> indexBytes(indices.size() * pool.indexSize);
+		if (wide)
+			std::copy(indices.begin(), indices.end(), (unsigned int*)indexBytes.data());
+		else
+			std::copy(indices.begin(), indices.end(), (unsigned short*)indexBytes.data());
+		pool.stageCopy(pool.stagedIndices, pool.stagedIndexBytes, std::move(indexBytes));
+
+		stats.meshes++;
+		stats.vertexBytes += vertexCount * pool.stride;
+		stats.indexBytes += indices.size() * pool.indexSize;
+
+		return handle;
+	}
+
+	// Compile-time meshes, already packed and in cache order, so they are only referenced until the
+	// upload. Both arrays have static storage.
+	MeshHandle addStatic(PoolType type, const void* vertices, size_t vertexCount, const uint16_t* indices, size_t indexCount)
+	{
+		Pool& pool = pools[type];
+
+		MeshHandle handle;
+		handle.pool = type;
+		handle.indexCount = (GLsizei)indexCount;
+		handle.indexOffset = pool.indexCount * pool.indexSize + pool.stagedIndexBytes;
+		handle.baseVertex = (GLint)(pool.vertexCount + pool.stagedVertexBytes / pool.stride);
+
+		pool.stage(pool.stagedVertices, pool.stagedVertexBytes, vertices, vertexCount * pool.stride);
+		pool.stage(pool.stagedIndices, pool.stagedIndexBytes, indices, indexCount * sizeof(uint16_t));
+
+		stats.meshes++;
+		stats.vertexBytes += vertexCount * pool.stride;
+		stats.indexBytes += indexCount * sizeof(uint16_t);
+
+		return handle;
+	}
+
+	// Grows the pool's buffers, keeping what's already uploaded, and appends the staged meshes
+	void upload(Pool& pool)
+	{
+		size_t newVertexCount = pool.vertexCount + pool.stagedVertexBytes / pool.stride;
+		size_t newIndexCount = pool.indexCount + pool.stagedIndexBytes / pool.indexSize;
+
+		unsigned int VBO, EBO;
+		glGenBuffers(1, &VBO);
+		glGenBuffers(1, &EBO);
+
+		glBindBuffer(GL_COPY_WRITE_BUFFER, VBO);
+		glBufferData(GL_COPY_WRITE_BUFFER, newVertexCount * pool.stride, NULL, GL_STATIC_DRAW);
+		if (pool.vertexCount > 0)
+		{
+			glBindBuffer(GL_COPY_READ_BUFFER, pool.VBO);
+			glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, pool.vertexCount * pool.stride);
+		}
+		size_t offset = pool.vertexCount * pool.stride;
+		for (const Pool::Piece& piece : pool.stagedVertices)
+		{
+			glBufferSubData(GL_COPY_WRITE_BUFFER, offset, piece.bytes, piece.data);
+			offset += piece.bytes;
+		}
+
+		glBindBuffer(GL_COPY_WRITE_BUFFER, EBO);
+		glBufferData(GL_COPY_WRITE_BUFFER, newIndexCount * pool.indexSize, NULL, GL_STATIC_DRAW);
+		if (pool.indexCount > 0)
+		{
+			glBindBuffer(GL_COPY_READ_BUFFER, pool.EBO);
+			glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, pool.indexCount * pool.indexSize);
+		}
+		offset = pool.indexCount * pool.indexSize;
+		for (const Pool::Piece& piece : pool.stagedIndices)
+		{
+			glBufferSubData(GL_COPY_WRITE_BUFFER, offset, piece.bytes, piece.data);
+			offset += piece.bytes;
+		}
+
+		glBindBuffer(GL_COPY_READ_BUFFER, 0);
+		glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+		if (pool.VAO != 0)
+		{
+			glDeleteVertexArrays(1, &pool.VAO);
+			glDeleteBuffers(1, &pool.VBO);
+			glDeleteBuffers(1, &pool.EBO);
+		}
+
+		pool.VBO = VBO;
+		pool.EBO = EBO;
+		pool.vertexCount = newVertexCount;
+		pool.indexCount = newIndexCount;
+
+		glGenVertexArrays(1, &pool.VAO);
+		glBindVertexArray(pool.VAO);
+		glBindBuffer(GL_ARRAY_BUFFER, pool.VBO);
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, pool.EBO);
+
+		if (pool.type == SpherePool)
+		{
+			// Position, octahedral normal, texture coordinates
+			glVertexAttribPointer(0, 3, GL_SHORT, GL_TRUE, sizeof(PackedSphereVertex), (void*)offsetof(PackedSphereVertex, position));
+			glEnableVertexAttribArray(0);
+			glVertexAttribPointer(1, 2, GL_SHORT, GL_TRUE, sizeof(PackedSphereVertex), (void*)offsetof(PackedSphereVertex, normal));
+			glEnableVertexAttribArray(1);
+			glVertexAttribPointer(2, 2, GL_UNSIGNED_SHORT, GL_TRUE, sizeof(PackedSphereVertex), (void*)offsetof(PackedSphereVertex, texCoord));
+			glEnableVertexAttribArray(2);
+		}
+		else if (pool.type == TorusPool)
+		{
+			// Centerline position, octahedral tube direction
+			glVertexAttribPointer(0, 3, GL_SHORT, GL_TRUE, sizeof(PackedTorusVertex), (void*)offsetof(PackedTorusVertex, position));
+			glEnableVertexAttribArray(0);
+			glVertexAttribPointer(1, 2, GL_SHORT, GL_TRUE, sizeof(PackedTorusVertex), (void*)offsetof(PackedTorusVertex, tube));
+			glEnableVertexAttribArray(1);
+		}
+		else
+		{
+			// Control points on the unit cube
+			glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, (GLsizei)pool.stride, (void*)0);
+			glEnableVertexAttribArray(0);
+		}
+
+		glBindVertexArray(0);
+
+		// Release the CPU copies
+		pool.stagedVertices.clear();
+		pool.stagedIndices.clear();
+		pool.stagedVertexBytes = pool.stagedIndexBytes = 0;
+		std::vector<std::vector<uint8_t>>().swap(pool.stagedCopies);
+	}
+};
+
+#endif
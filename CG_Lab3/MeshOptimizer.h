@@ -0,0 +1,290 @@
+#ifndef MESH_OPTIMIZER_H
+#define MESH_OPTIMIZER_H
+
+#include <vector>
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstddef>
+
+#include "Figures.h"
+
+// Vertex layouts uploaded to the GPU, decoded in ShaderData/Planets and ShaderData/SunOrbits vertex shaders
+struct PackedSphereVertex
+{
+	int16_t position[4];	// snorm16 of position / scale, w unused
+	int16_t normal[2];		// octahedral snorm16
+	uint16_t texCoord[2];	// unorm16
+};
+
+struct PackedTorusVertex
+{
+	int16_t position[4];	// snorm16 of the point on the tube centerline / scale, w unused
+	int16_t tube[2];		// octahedral snorm16 of the direction from the centerline to the surface
+};
+
+// Totals over every packed mesh, printed with the other statistics
+struct MeshStatistics
+{
+	int meshes = 0;
+	size_t originalBytes = 0;
+	size_t packedBytes = 0;
+	size_t triangles = 0;
+	double transformsBefore = 0.0;	// simulated vertex shader invocations
+	double transformsAfter = 0.0;
+};
+
+class MeshOptimizer
+{
+public:
+	static MeshStatistics& statistics()
+	{
+		static MeshStatistics stats;
+		return stats;
+	}
+
+	static int16_t snorm16(float value)
+	{
+		value = std::max(-1.0f, std::min(1.0f, value));
+		return (int16_t)std::lround(value * 32767.0f);
+	}
+
+	static uint16_t unorm16(float value)
+	{
+		value = std::max(0.0f, std::min(1.0f, value));
+		return (uint16_t)std::lround(value * 65535.0f);
+	}
+
+	// Octahedral mapping of a unit vector onto [-1, 1]^2
+	static void octEncode(float x, float y, float z, int16_t out[2])
+	{
+		float invL1 = 1.0f / (fabsf(x) + fabsf(y) + fabsf(z));
+		float u = x * invL1, v = y * invL1;
+
+		if (z < 0.0f)
+		{
+			float foldedU = (1.0f - fabsf(v)) * (u >= 0.0f ? 1.0f : -1.0f);
+			float foldedV = (1.0f - fabsf(u)) * (v >= 0.0f ? 1.0f : -1.0f);
+			u = foldedU;
+			v = foldedV;
+		}
+
+		out[0] = snorm16(u);
+		out[1] = snorm16(v);
+	}
+
+	// Average post-transform cache miss ratio (vertices transformed per triangle) with a FIFO cache
+	static double computeACMR(const std::vector<unsigned int>& indices, size_t vertexCount, int cacheSize = 16)
+	{
+		if (indices.empty())
+			return 0.0;
+
+		std::vector<long long> cachedAt(vertexCount, -1);
+		long long misses = 0;
+
+		for (unsigned int index : indices)
+		{
+			// A vertex is still cached if fewer than cacheSize misses happened since it was loaded
+			if (cachedAt[index] < 0 || misses - cachedAt[index] >= cacheSize)
+			{
+				cachedAt[index] = misses;
+				misses++;
+			}
+		}
+
+		return (double)misses / (indices.size() / 3);
+	}
+
+	// Forsyth's linear-speed vertex cache optimisation, reorders triangles in place
+	static void optimizeVertexCache(std::vector<unsigned int>& indices, size_t vertexCount)
+	{
+		const int cacheSize = 32;
+		size_t triangleCount = indices.size() / 3;
+		if (triangleCount == 0)
+			return;
+
+		// Triangles using each vertex
+		std::vector<unsigned int> useCount(vertexCount, 0), firstUse(vertexCount + 1, 0), triangleList(indices.size());
+		for (unsigned int index : indices)
+			useCount[index]++;
+		for (size_t v = 0; v < vertexCount; v++)
+			firstUse[v + 1] = firstUse[v] + useCount[v];
+
+		std::vector<unsigned int> fill(firstUse.begin(), firstUse.end() - 1);
+		for (size_t t = 0; t < triangleCount; t++)
+			for (int k = 0; k < 3; k++)
+				triangleList[fill[indices[t * 3 + k]]++] = (unsigned int)t;
+
+		std::vector<unsigned int> remaining(useCount);
+		std::vector<int> cachePosition(vertexCount, -1);
+		std::vector<float> vertexScore(vertexCount), triangleScore(triangleCount, 0.0f);
+		std::vector<bool> emitted(triangleCount, false);
+
+		for (size_t v = 0; v < vertexCount; v++)
+			vertexScore[v] = forsythScore(-1, remaining[v], cacheSize);
+		for (size_t t = 0; t < triangleCount; t++)
+			for (int k = 0; k < 3; k++)
+				triangleScore[t] += vertexScore[indices[t * 3 + k]];
+
+		std::vector<unsigned int> cache, nextCache, output;
+		output.reserve(indices.size());
+
+		size_t scanStart = 0;
+		long long best = -1;
+
+		for (size_t emittedCount = 0; emittedCount < triangleCount; emittedCount++)
+		{
+			// Nothing useful in the cache, take the best remaining triangle
+			if (best < 0)
+			{
+				float bestScore = -1.0f;
+				while (scanStart < triangleCount && emitted[scanStart])
+					scanStart++;
+				for (size_t t = scanStart; t < triangleCount; t++)
+				{
+					if (!emitted[t] && triangleScore[t] > bestScore)
+					{
+						bestScore = triangleScore[t];
+						best = (long long)t;
+					}
+				}
+			}
+
+			size_t t = (size_t)best;
+			emitted[t] = true;
+
+			// Emit the triangle and move its vertices to the front of the cache
+			nextCache.clear();
+			for (int k = 0; k < 3; k++)
+			{
+				unsigned int v = indices[t * 3 + k];
+				output.push_back(v);
+				nextCache.push_back(v);
+
+				// Drop the triangle from the vertex's remaining list
+				unsigned int* begin = &triangleList[firstUse[v]];
+				unsigned int* end = begin + remaining[v];
+				unsigned int* found = std::find(begin, end, (unsigned int)t);
+				if (found != end)
+				{
+					*found = *(end - 1);
+					remaining[v]--;
+				}
+			}
+			for (unsigned int v : cache)
+				if (std::find(nextCache.begin(), nextCache.end(), v) == nextCache.end())
+					nextCache.push_back(v);
+
+			// Vertices pushed out of the cache are rescored along with the cached ones
+			for (size_t i = 0; i < nextCache.size(); i++)
+				cachePosition[nextCache[i]] = i < (size_t)cacheSize ? (int)i : -1;
+
+			best = -1;
+			float bestScore = -1.0f;
+			for (unsigned int v : nextCache)
+			{
+				float delta = forsythScore(cachePosition[v], remaining[v], cacheSize) - vertexScore[v];
+				vertexScore[v] += delta;
+
+				for (unsigned int i = 0; i < remaining[v]; i++)
+				{
+					unsigned int other = triangleList[firstUse[v] + i];
+					triangleScore[other] += delta;
+				}
+			}
+
+			if (nextCache.size() > (size_t)cacheSize)
+				nextCache.resize(cacheSize);
+			cache.swap(nextCache);
+
+			for (unsigned int v : cache)
+			{
+				for (unsigned int i = 0; i < remaining[v]; i++)
+				{
+					unsigned int other = triangleList[firstUse[v] + i];
+					if (triangleScore[other] > bestScore)
+					{
+						bestScore = triangleScore[other];
+						best = other;
+					}
+				}
+			}
+		}
+
+		indices.swap(output);
+	}
+
+	static std::vector<PackedSphereVertex> packSphere(const Sphere& sphere, float radius)
+	{
+		size_t count = sphere.vertices.size() / 8;
+		std::vector<PackedSphereVertex> packed(count);
+
+		for (size_t i = 0; i < count; i++)
+		{
+			const float* v = &sphere.vertices[i * 8];
+			PackedSphereVertex& out = packed[i];
+
+			out.position[0] = snorm16(v[0] / radius);
+			out.position[1] = snorm16(v[1] / radius);
+			out.position[2] = snorm16(v[2] / radius);
+			out.position[3] = 0;
+
+			float length = sqrtf(v[3] * v[3] + v[4] * v[4] + v[5] * v[5]);
+			octEncode(v[3] / length, v[4] / length, v[5] / length, out.normal);
+
+			out.texCoord[0] = unorm16(v[6]);
+			out.texCoord[1] = unorm16(v[7]);
+		}
+
+		return packed;
+	}
+
+	// Splits every torus point into centerline + innerRadius * tube direction so thin tubes keep full precision
+	static std::vector<PackedTorusVertex> packTorus(const Torus& torus)
+	{
+		size_t count = torus.vertices.size() / 6;
+		std::vector<PackedTorusVertex> packed(count);
+
+		for (size_t i = 0; i < count; i++)
+		{
+			const float* v = &torus.vertices[i * 6];
+			PackedTorusVertex& out = packed[i];
+
+			float planar = sqrtf(v[0] * v[0] + v[1] * v[1]);
+			float cx = v[0] / planar * torus.outerRadius, cy = v[1] / planar * torus.outerRadius;
+
+			out.position[0] = snorm16(cx / torus.outerRadius);
+			out.position[1] = snorm16(cy / torus.outerRadius);
+			out.position[2] = 0;
+			out.position[3] = 0;
+
+			float tx = v[0] - cx, ty = v[1] - cy, tz = v[2];
+			float length = sqrtf(tx * tx + ty * ty + tz * tz);
+			octEncode(tx / length, ty / length, tz / length, out.tube);
+		}
+
+		return packed;
+	}
+
+private:
+	static float forsythScore(int cachePosition, unsigned int remaining, int cacheSize)
+	{
+		if (remaining == 0)
+			return -1.0f;
+
+		float score = 0.0f;
+		if (cachePosition >= 0)
+		{
+			// The last triangle's vertices get a fixed score so the next one doesn't just reuse its edge
+			if (cachePosition < 3)
+				score = 0.75f;
+			else
+				score = powf(1.0f - (float)(cachePosition - 3) / (cacheSize - 3), 1.5f);
+		}
+
+		// Prefer vertices with few triangles left so they leave the mesh early
+		return score + 2.0f * powf((float)remaining, -0.5f);
+	}
+};
+
+#endif
@@ -0,0 +1,180 @@
+#ifndef MODEL_MATRICES_H
+#define MODEL_MATRICES_H
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <vector>
+#include <chrono>
+#include <random>
+#include <cmath>
+#include <cstdint>
+#include <cstddef>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+#include "SimdMath.h"
+#include "JobSystem.h"
+#include "InstanceBuffer.h"
+
+struct ModelMatrixStats
+{
+	size_t bodies = 0;
+	double perObjectMs = 0.0;		// glm rotate/translate/scale chain per body
+	double batchedMs = 0.0;			// closed form into memory
+	double mappedMs = 0.0;			// closed form into a mapped instance buffer, map and unmap included
+	double maxError = 0.0;			// largest element difference between the two
+};
+
+// Model matrices of bodies on circular orbits in the ecliptic, spinning about their own axes:
+// rotate(ecliptic) * translate(r cos a, r sin a, 0) * rotate(spin, z) * scale(s). Multiplied out
+// only six elements aren't constant, so a body costs two sincos and a few multiplies instead of
+// four matrix products. Angles, radii and scales come in separate arrays, 8 bodies per AVX2 step.
+class ModelMatrices
+{
+public:
+	// 16 floats per body, column major like glm::mat4, into out. Meant for mapped instance
+	// buffers, so out is only written, with streaming stores when it's 16 byte aligned.
+	static void build(const float* orbitAngles, const float* orbitRadii, const float* spinAngles, const float* scales, size_t count, float* out)
+	{
+		JobSystem::instance().parallelFor(count, [&](size_t first, size_t last)
+			{
+				buildRange(orbitAngles, orbitRadii, spinAngles, scales, first, last, out);
+			});
+	}
+
+	// The same matrix as the glm calls, one body at a time
+	static glm::mat4 perObject(float orbitAngle, float orbitRadius, float spinAngle, float scale)
+	{
+		glm::mat4 model = glm::rotate(glm::mat4(1.0f), glm::radians(-90.0f), glm::vec3(1.0f, 0.0f, 0.0f));
+		model = glm::translate(model, glm::vec3(orbitRadius * cosf(orbitAngle), orbitRadius * sinf(orbitAngle), 0.0f));
+		model = glm::rotate(model, spinAngle, glm::vec3(0.0f, 0.0f, 1.0f));
+		return glm::scale(model, glm::vec3(scale));
+	}
+
+	// Both paths over count bodies on random orbits, and the batched one into instances as well when
+	// there's a GL context to map it in
+	static ModelMatrixStats measure(size_t count, InstanceBuffer* instances = nullptr)
+	{
+		std::mt19937 random(42);
+		std::uniform_real_distribution<float> angle(-100.0f, 100.0f), radius(3.0f, 45.0f), scale(0.05f, 3.0f);
+
+		std::vector<float> orbitAngles(count), orbitRadii(count), spinAngles(count), scales(count);
+		for (size_t i = 0; i < count; i++)
+		{
+			orbitAngles[i] = angle(random);
+			orbitRadii[i] = radius(random);
+			spinAngles[i] = angle(random);
+			scales[i] = scale(random);
+		}
+
+		std::vector<glm::mat4> perObjectMatrices(count), batchedMatrices(count);
+		int runs = count < 10000 ? 1000 : 10;
+
+		ModelMatrixStats stats;
+		stats.bodies = count;
+
+		// Once untimed, so the first run doesn't pay for starting workers
+		build(orbitAngles.data(), orbitRadii.data(), spinAngles.data(), scales.data(), count, &batchedMatrices[0][0][0]);
+
+		auto begin = std::chrono::high_resolution_clock::now();
+		for (int run = 0; run < runs; run++)
+		{
+			for (size_t i = 0; i < count; i++)
+				perObjectMatrices[i] = perObject(orbitAngles[i], orbitRadii[i], spinAngles[i], scales[i]);
+		}
+		stats.perObjectMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - begin).count() / runs;
+
+		begin = std::chrono::high_resolution_clock::now();
+		for (int run = 0; run < runs; run++)
+			build(orbitAngles.data(), orbitRadii.data(), spinAngles.data(), scales.data(), count, &batchedMatrices[0][0][0]);
+		stats.batchedMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - begin).count() / runs;
+
+		if (instances)
+		{
+			begin = std::chrono::high_resolution_clock::now();
+			for (int run = 0; run < runs; run++)
+			{
+				build(orbitAngles.data(), orbitRadii.data(), spinAngles.data(), scales.data(), count, instances->map(count));
+				instances->unmap();
+			}
+			stats.mappedMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - begin).count() / runs;
+		}
+
+		for (size_t i = 0; i < count; i++)
+			for (int c = 0; c < 4; c++)
+				for (int r = 0; r < 4; r++)
+					stats.maxError = fmax(stats.maxError, fabs((double)perObjectMatrices[i][c][r] - batchedMatrices[i][c][r]));
+
+		return stats;
+	}
+
+private:
+	static void buildRange(const float* orbitAngles, const float* orbitRadii, const float* spinAngles, const float* scales, size_t first, size_t last, float* out)
+	{
+		size_t i = first;
+
+#if defined(__AVX2__)
+		bool aligned = ((uintptr_t)out & 15) == 0;
+
+		for (; i + 8 <= last; i += 8)
+		{
+			__m256 orbitSin, orbitCos, spinSin, spinCos;
+			SimdMath::sincos8(_mm256_loadu_ps(orbitAngles + i), orbitSin, orbitCos);
+			SimdMath::sincos8(_mm256_loadu_ps(spinAngles + i), spinSin, spinCos);
+
+			__m256 radius = _mm256_loadu_ps(orbitRadii + i), scale = _mm256_loadu_ps(scales + i);
+
+			// The non-constant elements of all 8 matrices, then each matrix written column by column
+			alignas(32) float scaledCos[8], scaledSin[8], x[8], z[8], s[8];
+			_mm256_store_ps(scaledCos, _mm256_mul_ps(scale, spinCos));
+			_mm256_store_ps(scaledSin, _mm256_mul_ps(scale, spinSin));
+			_mm256_store_ps(x, _mm256_mul_ps(radius, orbitCos));
+			_mm256_store_ps(z, _mm256_mul_ps(radius, orbitSin));
+			_mm256_store_ps(s, scale);
+
+			for (int lane = 0; lane < 8; lane++)
+			{
+				float* matrix = out + 16 * (i + lane);
+				__m128 columns[4] = {
+					_mm_setr_ps(scaledCos[lane], 0.0f, -scaledSin[lane], 0.0f),
+					_mm_setr_ps(-scaledSin[lane], 0.0f, -scaledCos[lane], 0.0f),
+					_mm_setr_ps(0.0f, s[lane], 0.0f, 0.0f),
+					_mm_setr_ps(x[lane], 0.0f, -z[lane], 1.0f) };
+
+				for (int c = 0; c < 4; c++)
+				{
+					if (aligned)
+						_mm_stream_ps(matrix + 4 * c, columns[c]);
+					else
+						_mm_storeu_ps(matrix + 4 * c, columns[c]);
+				}
+			}
+		}
+
+		if (aligned)
+			_mm_sfence();
+#endif
+
+		for (; i < last; i++)
+		{
+			float orbitSin, orbitCos, spinSin, spinCos;
+			SimdMath::sincos(orbitAngles[i], orbitSin, orbitCos);
+			SimdMath::sincos(spinAngles[i], spinSin, spinCos);
+
+			float scale = scales[i], x = orbitRadii[i] * orbitCos, z = orbitRadii[i] * orbitSin;
+			const float matrix[16] = {
+				scale * spinCos, 0.0f, -scale * spinSin, 0.0f,
+				-scale * spinSin, 0.0f, -scale * spinCos, 0.0f,
+				0.0f, scale, 0.0f, 0.0f,
+				x, 0.0f, -z, 1.0f };
+
+			for (int e = 0; e < 16; e++)
+				out[16 * i + e] = matrix[e];
+		}
+	}
+};
+
+#endif
@@ -0,0 +1,364 @@
+#ifndef NBODY_H
+#define NBODY_H
+
+#include <glm/glm.hpp>
+
+#include <vector>
+#include <cmath>
+#include <chrono>
+#include <random>
+#include <algorithm>
+#include <cstddef>
+#include <memory>
+
+#include "BarnesHut.h"
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+// Conserved quantities and kernel throughput, printed with the other statistics
+struct NBodyStats
+{
+	long long steps = 0;
+	double simulatedTime = 0.0;
+	double relativeEnergyDrift = 0.0;		// |E - E0| / |E0|
+	double momentumDrift = 0.0;				// |P - P0|
+	double angularMomentumDrift = 0.0;		// |L - L0| / |L0|
+	double pairInteractions = 0.0;			// evaluated since the start
+	double kernelSeconds = 0.0;
+};
+
+// Direct-summation gravity in double precision. Bodies are stored as structure-of-arrays so the
+// all-pairs kernel loads 4 bodies per AVX2 register, and integrated with kick-drift-kick leapfrog
+// (velocity Verlet), which keeps the energy error bounded instead of letting it grow.
+// Units are the caller's as long as they agree, masses as G * m; SolarSystem runs it in AU and days
+// with G * m in AU^3/day^2.
+class NBodySystem
+{
+public:
+	NBodySystem(double softening = 0.0) : softening2(softening * softening)
+	{
+	}
+
+	size_t addBody(double gm, glm::dvec3 position, glm::dvec3 velocity)
+	{
+		mass.push_back(gm);
+		x.push_back(position.x); y.push_back(position.y); z.push_back(position.z);
+		vx.push_back(velocity.x); vy.push_back(velocity.y); vz.push_back(velocity.z);
+		ax.push_back(0.0); ay.push_back(0.0); az.push_back(0.0);
+
+		started = false;
+		return mass.size() - 1;
+	}
+
+	size_t size() const
+	{
+		return mass.size();
+	}
+
+	glm::dvec3 getPosition(size_t i) const
+	{
+		return glm::dvec3(x[i], y[i], z[i]);
+	}
+
+	glm::dvec3 getVelocity(size_t i) const
+	{
+		return glm::dvec3(vx[i], vy[i], vz[i]);
+	}
+
+	double getMass(size_t i) const
+	{
+		return mass[i];
+	}
+
+	double getTime() const
+	{
+		return time;
+	}
+
+	// Replaces direct summation by a Barnes-Hut tree, for large particle counts
+	void useTree(double openingAngle, bool quadrupole = true)
+	{
+		tree = std::make_unique<BarnesHut>(openingAngle, quadrupole, std::sqrt(softening2));
+	}
+
+	const BarnesHutStats* getTreeStats() const
+	{
+		return tree ? &tree->getStats() : nullptr;
+	}
+
+	// Starts again from new states at the given time, one per body in the order they were added
+	void reset(double newTime, const glm::dvec3* positions, const glm::dvec3* velocities)
+	{
+		for (size_t i = 0; i < size(); i++)
+		{
+			x[i] = positions[i].x; y[i] = positions[i].y; z[i] = positions[i].z;
+			vx[i] = velocities[i].x; vy[i] = velocities[i].y; vz[i] = velocities[i].z;
+		}
+
+		time = newTime;
+		started = false;
+	}
+
+	// Shifts every velocity so the total momentum is zero and the system doesn't drift away
+	void moveToBarycentre()
+	{
+		glm::dvec3 momentum = totalMomentum(), position(0.0);
+		double total = 0.0;
+		for (size_t i = 0; i < size(); i++)
+		{
+			position += mass[i] * getPosition(i);
+			total += mass[i];
+		}
+
+		glm::dvec3 velocity = momentum / total;
+		position /= total;
+		for (size_t i = 0; i < size(); i++)
+		{
+			x[i] -= position.x; y[i] -= position.y; z[i] -= position.z;
+			vx[i] -= velocity.x; vy[i] -= velocity.y; vz[i] -= velocity.z;
+		}
+
+		started = false;
+	}
+
+	// One kick-drift-kick step
+	void step(double dt)
+	{
+		if (!started)
+			start();
+
+		size_t n = size();
+		double halfDt = 0.5 * dt;
+
+		for (size_t i = 0; i < n; i++)
+		{
+			vx[i] += ax[i] * halfDt; vy[i] += ay[i] * halfDt; vz[i] += az[i] * halfDt;
+			x[i] += vx[i] * dt; y[i] += vy[i] * dt; z[i] += vz[i] * dt;
+		}
+
+		computeAccelerations();
+
+		for (size_t i = 0; i < n; i++)
+		{
+			vx[i] += ax[i] * halfDt; vy[i] += ay[i] * halfDt; vz[i] += az[i] * halfDt;
+		}
+
+		time += dt;
+		stats.steps++;
+		stats.simulatedTime = time;
+	}
+
+	// Fixed steps of at most maxStep until targetTime is reached, backwards too since leapfrog
+	// is time reversible
+	void advanceTo(double targetTime, double maxStep)
+	{
+		double remaining = targetTime - time;
+		if (remaining == 0.0)
+			return;
+
+		int steps = (int)std::ceil(std::abs(remaining) / maxStep);
+		double dt = remaining / steps;
+		for (int i = 0; i < steps; i++)
+			step(dt);
+	}
+
+	double totalEnergy() const
+	{
+		size_t n = size();
+		double kinetic = 0.0, potential = 0.0;
+
+		for (size_t i = 0; i < n; i++)
+		{
+			kinetic += 0.5 * mass[i] * (vx[i] * vx[i] + vy[i] * vy[i] + vz[i] * vz[i]);
+
+			for (size_t j = i + 1; j < n; j++)
+			{
+				double dx = x[j] - x[i], dy = y[j] - y[i], dz = z[j] - z[i];
+				potential -= mass[i] * mass[j] / std::sqrt(dx * dx + dy * dy + dz * dz + softening2);
+			}
+		}
+
+		// Masses are G * m, so kinetic energy and potential are both G times the physical values
+		return kinetic + potential;
+	}
+
+	glm::dvec3 totalMomentum() const
+	{
+		glm::dvec3 momentum(0.0);
+		for (size_t i = 0; i < size(); i++)
+			momentum += mass[i] * getVelocity(i);
+		return momentum;
+	}
+
+	glm::dvec3 totalAngularMomentum() const
+	{
+		glm::dvec3 angular(0.0);
+		for (size_t i = 0; i < size(); i++)
+			angular += mass[i] * glm::cross(getPosition(i), getVelocity(i));
+		return angular;
+	}
+
+	const NBodyStats& getStats()
+	{
+		if (started)
+		{
+			double energy = totalEnergy();
+			stats.relativeEnergyDrift = std::fabs((energy - initialEnergy) / initialEnergy);
+			stats.momentumDrift = glm::length(totalMomentum() - initialMomentum);
+
+			double angularLength = glm::length(initialAngularMomentum);
+			stats.angularMomentumDrift = angularLength > 0.0 ? glm::length(totalAngularMomentum() - initialAngularMomentum) / angularLength : 0.0;
+		}
+		return stats;
+	}
+
+	// Pair interactions per second of the force kernel on a random cluster of bodyCount bodies
+	static double measureThroughput(size_t bodyCount)
+	{
+		NBodySystem system(0.01);
+		system.addRandomCluster(bodyCount);
+
+		// Enough repetitions for small systems to be measurable
+		double pairsPerRun = (double)bodyCount * (bodyCount - 1);
+		int runs = (int)std::max(1.0, 2e7 / pairsPerRun);
+
+		auto begin = std::chrono::high_resolution_clock::now();
+		for (int i = 0; i < runs; i++)
+			system.computeAccelerations();
+		double seconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - begin).count();
+
+		return pairsPerRun * runs / seconds;
+	}
+
+	// Build and force times of the tree on the same kind of cluster, and its error on a sample of bodies
+	static BarnesHutStats measureTree(size_t bodyCount, double openingAngle, bool quadrupole)
+	{
+		NBodySystem system(0.01);
+		system.addRandomCluster(bodyCount);
+		system.useTree(openingAngle, quadrupole);
+		system.computeAccelerations();
+
+		system.tree->measureAccuracy(system.x.data(), system.y.data(), system.z.data(), system.mass.data(), bodyCount,
+			system.ax.data(), system.ay.data(), system.az.data(), 256);
+		return system.tree->getStats();
+	}
+
+private:
+	std::vector<double> x, y, z;
+	std::vector<double> vx, vy, vz;
+	std::vector<double> ax, ay, az;
+	std::vector<double> mass;
+
+	double softening2;
+	double time = 0.0;
+
+	bool started = false;
+	double initialEnergy = 0.0;
+	glm::dvec3 initialMomentum, initialAngularMomentum;
+
+	NBodyStats stats;
+	std::unique_ptr<BarnesHut> tree;
+
+	// Bodies of equal mass spread uniformly in a cube, at rest
+	void addRandomCluster(size_t bodyCount)
+	{
+		std::mt19937 random(1234);
+		std::uniform_real_distribution<double> uniform(-1.0, 1.0);
+
+		for (size_t i = 0; i < bodyCount; i++)
+			addBody(1.0 / bodyCount, glm::dvec3(uniform(random), uniform(random), uniform(random)), glm::dvec3(0.0));
+	}
+
+	// Reference values for the drift report and the accelerations for the first half kick
+	void start()
+	{
+		computeAccelerations();
+
+		initialEnergy = totalEnergy();
+		initialMomentum = totalMomentum();
+		initialAngularMomentum = totalAngularMomentum();
+		started = true;
+	}
+
+	void computeAccelerations()
+	{
+		auto begin = std::chrono::high_resolution_clock::now();
+
+		size_t n = size();
+		if (tree)
+		{
+			tree->computeAccelerations(x.data(), y.data(), z.data(), mass.data(), n, ax.data(), ay.data(), az.data());
+
+			stats.pairInteractions += tree->getStats().interactionsPerParticle * n;
+			stats.kernelSeconds += std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - begin).count();
+			return;
+		}
+
+		// Rows of the force matrix are independent, large systems split them over the job system
+		JobSystem::instance().parallelFor(n, [&](size_t first, size_t last)
+			{
+				for (size_t i = first; i < last; i++)
+				{
+					double sumX = 0.0, sumY = 0.0, sumZ = 0.0;
+					size_t j = 0;
+
+#if defined(__AVX2__)
+					__m256d xi = _mm256_set1_pd(x[i]), yi = _mm256_set1_pd(y[i]), zi = _mm256_set1_pd(z[i]);
+					__m256d eps2 = _mm256_set1_pd(softening2), zero = _mm256_setzero_pd(), one = _mm256_set1_pd(1.0);
+					__m256d accX = zero, accY = zero, accZ = zero;
+
+					for (; j + 4 <= n; j += 4)
+					{
+						__m256d dx = _mm256_sub_pd(_mm256_loadu_pd(&x[j]), xi);
+						__m256d dy = _mm256_sub_pd(_mm256_loadu_pd(&y[j]), yi);
+						__m256d dz = _mm256_sub_pd(_mm256_loadu_pd(&z[j]), zi);
+
+						__m256d r2 = _mm256_add_pd(_mm256_add_pd(_mm256_mul_pd(dx, dx), _mm256_mul_pd(dy, dy)), _mm256_add_pd(_mm256_mul_pd(dz, dz), eps2));
+
+						// m / r^3, zero for the body itself
+						__m256d invR = _mm256_div_pd(one, _mm256_sqrt_pd(r2));
+						__m256d scale = _mm256_mul_pd(_mm256_mul_pd(invR, invR), _mm256_mul_pd(invR, _mm256_loadu_pd(&mass[j])));
+						scale = _mm256_and_pd(scale, _mm256_cmp_pd(r2, zero, _CMP_GT_OQ));
+
+						accX = _mm256_add_pd(accX, _mm256_mul_pd(dx, scale));
+						accY = _mm256_add_pd(accY, _mm256_mul_pd(dy, scale));
+						accZ = _mm256_add_pd(accZ, _mm256_mul_pd(dz, scale));
+					}
+
+					sumX = horizontalSum(accX);
+					sumY = horizontalSum(accY);
+					sumZ = horizontalSum(accZ);
+#endif
+
+					for (; j < n; j++)
+					{
+						double dx = x[j] - x[i], dy = y[j] - y[i], dz = z[j] - z[i];
+						double r2 = dx * dx + dy * dy + dz * dz + softening2;
+						if (r2 <= 0.0)
+							continue;
+
+						double invR = 1.0 / std::sqrt(r2);
+						double scale = mass[j] * invR * invR * invR;
+						sumX += dx * scale; sumY += dy * scale; sumZ += dz * scale;
+					}
+
+					ax[i] = sumX; ay[i] = sumY; az[i] = sumZ;
+				}
+			});
+
+		stats.pairInteractions += (double)n * (n > 0 ? n - 1 : 0);
+		stats.kernelSeconds += std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - begin).count();
+	}
+
+#if defined(__AVX2__)
+	static double horizontalSum(__m256d v)
+	{
+		__m128d sum = _mm_add_pd(_mm256_castpd256_pd128(v), _mm256_extractf128_pd(v, 1));
+		return _mm_cvtsd_f64(_mm_add_sd(sum, _mm_unpackhi_pd(sum, sum)));
+	}
+#endif
+};
+
+#endif
@@ -0,0 +1,529 @@
+#ifndef ORBIT_TRAILS_H
+#define ORBIT_TRAILS_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <vector>
+#include <chrono>
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstddef>
+
+#include "Shader.h"
+#include "InstanceBuffer.h"
+
+struct TrailStats
+{
+	size_t trails = 0;
+	size_t classes = 0;
+	size_t chunks = 0;
+	size_t allocatedSamples = 0;
+	size_t capacitySamples = 0;
+	size_t appends = 0;					// one per class each time its trails take a sample
+	size_t uploadBytes = 0;				// by the newest append
+	double appendMs = 0.0;
+};
+
+// Synthetic trails of one class filled and drawn from one view
+struct TrailBenchmark
+{
+	size_t trails = 0;
+	size_t samples = 0;					// per trail
+	double appendMs = 0.0;				// one sample for every trail
+	size_t uploadsPerAppend = 0;
+	double gpuMs = 0.0;
+	double submitMs = 0.0;
+};
+
+// Where things have been, kept on the GPU. Every trail is a ring of its newest samples in one big
+// buffer the vertex shader reads as a texture buffer, and all of them are drawn by one instanced
+// strip whose vertices look their samples up, so nothing is rebuilt on the CPU.
+// Trails with the same length and sampling interval form a class and take their samples together.
+// Intervals are rounded down to a power of two days, so trails asking for similar ones share a class
+// and fill its chunks instead of each taking a class and a mostly empty chunk of its own.
+// A class owns chunks of chunkColumns trails sub-allocated from the buffer, sample-major, so one
+// append writes one contiguous row per chunk.
+class OrbitTrails
+{
+public:
+	using TrailId = size_t;
+	static constexpr TrailId noTrail = SIZE_MAX;
+
+	static constexpr size_t chunkColumns = 64;
+	static constexpr int maxClasses = 32;
+
+	// Capacity in samples, at most what a texture buffer can address and a float can count to
+	OrbitTrails(size_t capacity, const char* vertexShaderPath, const char* fragmentShaderPath)
+		: shader(vertexShaderPath, fragmentShaderPath), descriptors(floatsPerTrail)
+	{
+		GLint limit = 0;
+		glGetIntegerv(GL_MAX_TEXTURE_BUFFER_SIZE, &limit);
+		capacity = std::min(capacity, maxCapacity);
+		if (limit > 0)
+			capacity = std::min(capacity, (size_t)limit);
+
+		glGenBuffers(1, &sampleBuffer);
+		glBindBuffer(GL_TEXTURE_BUFFER, sampleBuffer);
+		glBufferData(GL_TEXTURE_BUFFER, (GLsizeiptr)(capacity * sizeof(glm::vec4)), nullptr, GL_DYNAMIC_DRAW);
+
+		glGenTextures(1, &sampleTexture);
+		glBindTexture(GL_TEXTURE_BUFFER, sampleTexture);
+		glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, sampleBuffer);
+		glBindTexture(GL_TEXTURE_BUFFER, 0);
+		glBindBuffer(GL_TEXTURE_BUFFER, 0);
+
+		glGenVertexArrays(1, &vao);
+
+		freeRanges.push_back({ 0, capacity });
+		stats.capacitySamples = capacity;
+	}
+
+	OrbitTrails(const OrbitTrails&) = delete;
+	OrbitTrails& operator=(const OrbitTrails&) = delete;
+
+	~OrbitTrails()
+	{
+		glDeleteVertexArrays(1, &vao);
+		glDeleteTextures(1, &sampleTexture);
+		glDeleteBuffers(1, &sampleBuffer);
+	}
+
+	// Ids are handed out from 0 and reused after remove. noTrail when the buffer or the classes
+	// have run out. The trail covers between half and all of length * intervalDays.
+	TrailId add(size_t length, double intervalDays, const glm::vec4& color)
+	{
+		length = std::max<size_t>(length, 2);
+		if (intervalDays > 0.0)
+			intervalDays = std::exp2(std::floor(std::log2(intervalDays)));
+
+		int classIndex = findClass(length, intervalDays);
+		if (classIndex < 0)
+			return noTrail;
+		TrailClass& trailClass = classes[classIndex];
+
+		// A column in the class's first chunk with room, or a new chunk
+		size_t chunkIndex = noTrail;
+		for (size_t candidate : trailClass.chunks)
+			if (chunks[candidate].used < chunkColumns)
+			{
+				chunkIndex = candidate;
+				break;
+			}
+
+		if (chunkIndex == noTrail)
+		{
+			size_t base = allocate(length * chunkColumns);
+			if (base == noTrail)
+			{
+				if (trailClass.chunks.empty())
+				{
+					trailClass.length = 0;
+					stats.classes--;
+				}
+				return noTrail;
+			}
+
+			chunkIndex = std::find_if(chunks.begin(), chunks.end(), [](const Chunk& chunk) { return chunk.trailClass < 0; }) - chunks.begin();
+			if (chunkIndex == chunks.size())
+				chunks.emplace_back();
+
+			Chunk& chunk = chunks[chunkIndex];
+			chunk.base = base;
+			chunk.samples = length * chunkColumns;
+			chunk.trailClass = classIndex;
+			chunk.used = 0;
+			std::fill(chunk.columns, chunk.columns + chunkColumns, noTrail);
+			trailClass.chunks.push_back(chunkIndex);
+		}
+
+		Chunk& chunk = chunks[chunkIndex];
+		size_t column = std::find(chunk.columns, chunk.columns + chunkColumns, noTrail) - chunk.columns;
+
+		TrailId id = std::find_if(trails.begin(), trails.end(), [](const Trail& trail) { return trail.chunk == noTrail; }) - trails.begin();
+		if (id == trails.size())
+			trails.emplace_back();
+
+		// Samples from before it joined are someone else's, it only shows the ones after
+		Trail& trail = trails[id];
+		trail.chunk = chunkIndex;
+		trail.column = column;
+		trail.born = trailClass.appends;
+		trail.color = color;
+
+		chunk.columns[column] = id;
+		chunk.used++;
+		stats.trails++;
+		descriptorsChanged = true;
+		return id;
+	}
+
+	void remove(TrailId id)
+	{
+		if (id >= trails.size() || trails[id].chunk == noTrail)
+			return;
+
+		Trail& trail = trails[id];
+		Chunk& chunk = chunks[trail.chunk];
+		chunk.columns[trail.column] = noTrail;
+		trail.chunk = noTrail;
+		stats.trails--;
+		descriptorsChanged = true;
+
+		if (--chunk.used > 0)
+			return;
+
+		// Empty chunks go back to the buffer, and an empty class frees its slot
+		TrailClass& trailClass = classes[chunk.trailClass];
+		trailClass.chunks.erase(std::find(trailClass.chunks.begin(), trailClass.chunks.end(), (size_t)(&chunk - chunks.data())));
+		if (trailClass.chunks.empty())
+		{
+			trailClass.length = 0;
+			stats.classes--;
+		}
+
+		release(chunk.base, chunk.samples);
+		chunk.trailClass = -1;
+	}
+
+	size_t size() const
+	{
+		return stats.trails;
+	}
+
+	// positions[id] for every id handed out so far, removed ones are skipped. Each class takes one
+	// sample when its interval has passed, however far the day has moved; going back in time
+	// starts the class over.
+	void append(double day, const glm::vec3* positions)
+	{
+		auto begin = std::chrono::high_resolution_clock::now();
+		stats.uploadBytes = 0;
+
+		glBindBuffer(GL_TEXTURE_BUFFER, sampleBuffer);
+		for (size_t classIndex = 0; classIndex < classes.size(); classIndex++)
+		{
+			TrailClass& trailClass = classes[classIndex];
+			if (trailClass.chunks.empty())
+				continue;
+
+			if (day < trailClass.lastDay)
+				restart(classIndex);
+			if (!std::isnan(trailClass.lastDay) && day - trailClass.lastDay < trailClass.interval)
+				continue;
+
+			// On the class's grid of days, so a long trail doesn't drift from its interval
+			trailClass.lastDay = std::isnan(trailClass.lastDay) ? day
+				: trailClass.lastDay + trailClass.interval * std::floor((day - trailClass.lastDay) / trailClass.interval);
+			trailClass.head = (trailClass.head + 1) % trailClass.length;
+			if (++trailClass.appends >= rebaseAppends)
+				rebase(classIndex);
+
+			for (size_t chunkIndex : trailClass.chunks)
+			{
+				const Chunk& chunk = chunks[chunkIndex];
+				glm::vec4 row[chunkColumns];
+				for (size_t column = 0; column < chunkColumns; column++)
+					row[column] = chunk.columns[column] == noTrail ? glm::vec4(0.0f) : glm::vec4(positions[chunk.columns[column]], 1.0f);
+
+				glBufferSubData(GL_TEXTURE_BUFFER, (GLintptr)((chunk.base + trailClass.head * chunkColumns) * sizeof(glm::vec4)), sizeof(row), row);
+				stats.uploadBytes += sizeof(row);
+			}
+			stats.appends++;
+		}
+		glBindBuffer(GL_TEXTURE_BUFFER, 0);
+
+		stats.appendMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - begin).count();
+	}
+
+	// Every trail starts empty again, e.g. when the positions come from somewhere else
+	void clear()
+	{
+		for (size_t classIndex = 0; classIndex < classes.size(); classIndex++)
+			if (!classes[classIndex].chunks.empty())
+				restart(classIndex);
+	}
+
+	// After the skybox, added on like the sprites without writing depth. Width in pixels, fading
+	// from the newest sample to nothing at the oldest.
+	void render(const glm::mat4& view, const glm::mat4& projection, const glm::vec2& viewport, float width)
+	{
+		if (stats.trails == 0)
+			return;
+
+		if (descriptorsChanged)
+			writeDescriptors();
+
+		size_t longest = 0;
+		std::vector<glm::vec2> classStates(classes.size());
+		for (size_t classIndex = 0; classIndex < classes.size(); classIndex++)
+		{
+			classStates[classIndex] = glm::vec2((float)classes[classIndex].head, (float)classes[classIndex].appends);
+			longest = std::max(longest, classes[classIndex].length);
+		}
+
+		shader.use();
+		shader.setUniformMat4("view", view);
+		shader.setUniformMat4("projection", projection);
+		shader.setUniformVec2("viewport", viewport);
+		shader.setUniformF("width", width);
+		shader.setUniformI("columns", (int)chunkColumns);
+		shader.setUniformI("samples", 0);
+		glUniform2fv(glGetUniformLocation(shader.programID, "classes"), (GLsizei)classStates.size(), &classStates[0][0]);
+
+		glActiveTexture(GL_TEXTURE0);
+		glBindTexture(GL_TEXTURE_BUFFER, sampleTexture);
+		glEnable(GL_BLEND);
+		glBlendFunc(GL_SRC_ALPHA, GL_ONE);
+		glDepthMask(GL_FALSE);
+
+		glBindVertexArray(vao);
+		glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, (GLsizei)(2 * longest), (GLsizei)descriptors.size());
+		glBindVertexArray(0);
+
+		glDepthMask(GL_TRUE);
+		glDisable(GL_BLEND);
+		glBindTexture(GL_TEXTURE_BUFFER, 0);
+	}
+
+	const TrailStats& getStats() const
+	{
+		return stats;
+	}
+
+	// count trails of samples each going round circles in the scene's plane, appended until full
+	// and then drawn from the given view into whatever is bound. Waits for the GPU, needs a GL context.
+	static std::vector<TrailBenchmark> measure(const char* vertexShaderPath, const char* fragmentShaderPath, const glm::mat4& view,
+		const glm::mat4& projection, const glm::vec2& viewport, size_t samples = 256, int runs = 10)
+	{
+		std::vector<TrailBenchmark> results;
+		GLuint timer;
+		glGenQueries(1, &timer);
+
+		for (size_t count : { 100, 1000, 10000 })
+		{
+			OrbitTrails trails(count * samples, vertexShaderPath, fragmentShaderPath);
+			for (size_t i = 0; i < count; i++)
+				trails.add(samples, 1.0, glm::vec4(0.7f, 0.85f, 1.0f, 0.5f));
+
+			TrailBenchmark benchmark;
+			benchmark.trails = trails.size();
+			benchmark.samples = samples;
+
+			std::vector<glm::vec3> positions(count);
+			for (size_t step = 0; step < samples; step++)
+			{
+				for (size_t i = 0; i < count; i++)
+				{
+					float radius = 5.0f + 30.0f * i / count, angle = 6.2831853f * (step / (float)samples + i / (float)count);
+					positions[i] = glm::vec3(radius * std::cos(angle), 0.0f, -radius * std::sin(angle));
+				}
+
+				trails.append((double)step, positions.data());
+				benchmark.appendMs += trails.getStats().appendMs / samples;
+			}
+			benchmark.uploadsPerAppend = trails.getStats().chunks;
+
+			glFinish();
+			for (int run = 0; run < runs; run++)
+			{
+				auto begin = std::chrono::high_resolution_clock::now();
+				glBeginQuery(GL_TIME_ELAPSED, timer);
+				trails.render(view, projection, viewport, 2.0f);
+				glEndQuery(GL_TIME_ELAPSED);
+				benchmark.submitMs += std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - begin).count() / runs;
+
+				GLuint64 nanoseconds = 0;
+				glGetQueryObjectui64v(timer, GL_QUERY_RESULT, &nanoseconds);
+				benchmark.gpuMs += nanoseconds * 1e-6 / runs;
+			}
+			results.push_back(benchmark);
+		}
+
+		glDeleteQueries(1, &timer);
+		return results;
+	}
+
+private:
+	// First sample, samples kept, class, class appends when it started, then the colour
+	static constexpr size_t floatsPerTrail = 8;
+
+	// Sample indices and append counts go to the shader as floats
+	static constexpr size_t maxCapacity = (size_t)1 << 24;
+	static constexpr size_t rebaseAppends = (size_t)1 << 22;
+
+	struct TrailClass
+	{
+		size_t length = 0;				// 0 when the slot is free
+		double interval = 0.0;
+		double lastDay = NAN;
+		size_t head = 0;				// row of the newest sample
+		size_t appends = 0;
+		std::vector<size_t> chunks;
+	};
+
+	struct Chunk
+	{
+		size_t base = 0, samples = 0;
+		int trailClass = -1;			// -1 when free
+		size_t used = 0;
+		TrailId columns[chunkColumns];
+	};
+
+	struct Trail
+	{
+		size_t chunk = noTrail;			// noTrail when removed
+		size_t column = 0;
+		size_t born = 0;
+		glm::vec4 color = glm::vec4(1.0f);
+	};
+
+	struct Range
+	{
+		size_t offset, size;
+	};
+
+	Shader shader;
+	InstanceBuffer descriptors;
+	GLuint sampleBuffer = 0, sampleTexture = 0, vao = 0;
+
+	std::vector<TrailClass> classes;
+	std::vector<Chunk> chunks;
+	std::vector<Trail> trails;
+	bool descriptorsChanged = false;
+
+	// Unused samples in order of offset, neighbours merged
+	std::vector<Range> freeRanges;
+
+	TrailStats stats;
+
+	int findClass(size_t length, double interval)
+	{
+		int freeSlot = -1;
+		for (size_t i = 0; i < classes.size(); i++)
+		{
+			if (classes[i].length == length && classes[i].interval == interval)
+				return (int)i;
+			if (classes[i].length == 0 && freeSlot < 0)
+				freeSlot = (int)i;
+		}
+
+		if (freeSlot < 0)
+		{
+			if (classes.size() == maxClasses)
+				return -1;
+			classes.emplace_back();
+			freeSlot = (int)classes.size() - 1;
+		}
+
+		TrailClass& trailClass = classes[freeSlot];
+		trailClass = TrailClass();
+		trailClass.length = length;
+		trailClass.interval = interval;
+		trailClass.head = length - 1;
+		stats.classes++;
+		return freeSlot;
+	}
+
+	// First fit, noTrail when no range is big enough
+	size_t allocate(size_t samples)
+	{
+		for (size_t i = 0; i < freeRanges.size(); i++)
+		{
+			Range& range = freeRanges[i];
+			if (range.size < samples)
+				continue;
+
+			size_t offset = range.offset;
+			range.offset += samples;
+			range.size -= samples;
+			if (range.size == 0)
+				freeRanges.erase(freeRanges.begin() + i);
+
+			stats.chunks++;
+			stats.allocatedSamples += samples;
+			return offset;
+		}
+
+		return noTrail;
+	}
+
+	void release(size_t offset, size_t samples)
+	{
+		auto next = std::lower_bound(freeRanges.begin(), freeRanges.end(), offset, [](const Range& range, size_t value) { return range.offset < value; });
+		next = freeRanges.insert(next, { offset, samples });
+
+		if (next + 1 != freeRanges.end() && next->offset + next->size == (next + 1)->offset)
+		{
+			next->size += (next + 1)->size;
+			freeRanges.erase(next + 1);
+		}
+		if (next != freeRanges.begin() && (next - 1)->offset + (next - 1)->size == next->offset)
+		{
+			(next - 1)->size += next->size;
+			freeRanges.erase(next);
+		}
+
+		stats.chunks--;
+		stats.allocatedSamples -= samples;
+	}
+
+	void restart(size_t classIndex)
+	{
+		TrailClass& trailClass = classes[classIndex];
+		trailClass.lastDay = NAN;
+		trailClass.head = trailClass.length - 1;
+		trailClass.appends = 0;
+
+		forEachTrail(classIndex, [](Trail& trail) { trail.born = 0; });
+	}
+
+	// Keeps the counts small enough for floats; trails that are full stay full
+	void rebase(size_t classIndex)
+	{
+		TrailClass& trailClass = classes[classIndex];
+		size_t shift = trailClass.appends - trailClass.length;
+		trailClass.appends = trailClass.length;
+
+		forEachTrail(classIndex, [shift](Trail& trail) { trail.born = trail.born > shift ? trail.born - shift : 0; });
+	}
+
+	template <typename Body>
+	void forEachTrail(size_t classIndex, Body body)
+	{
+		for (size_t chunkIndex : classes[classIndex].chunks)
+			for (TrailId id : chunks[chunkIndex].columns)
+				if (id != noTrail)
+					body(trails[id]);
+		descriptorsChanged = true;
+	}
+
+	// One per id handed out, removed ones keep nothing so the shader clips them
+	void writeDescriptors()
+	{
+		std::vector<float> data(trails.size() * floatsPerTrail, 0.0f);
+		for (size_t id = 0; id < trails.size(); id++)
+		{
+			const Trail& trail = trails[id];
+			if (trail.chunk == noTrail)
+				continue;
+
+			const Chunk& chunk = chunks[trail.chunk];
+			float* descriptor = &data[id * floatsPerTrail];
+			descriptor[0] = (float)(chunk.base + trail.column);
+			descriptor[1] = (float)classes[chunk.trailClass].length;
+			descriptor[2] = (float)chunk.trailClass;
+			descriptor[3] = (float)trail.born;
+			descriptor[4] = trail.color.x; descriptor[5] = trail.color.y; descriptor[6] = trail.color.z; descriptor[7] = trail.color.w;
+		}
+
+		descriptors.upload(data.data(), trails.size());
+		glBindVertexArray(vao);
+		descriptors.attribute(0, 4, 0);
+		descriptors.attribute(1, 4, 4);
+		glBindVertexArray(0);
+		descriptorsChanged = false;
+	}
+};
+
+#endif
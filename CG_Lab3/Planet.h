@@ -4,25 +4,32 @@
 #include <glad/glad.h>
 #include <glm/glm.hpp>
 #include <cmath>
+#include <memory>
+#include <string>
 
 #include "Figures.h"
 #include "Shader.h"
 #include "Texture.h"
+#include "Terrain.h"
+#include "AdaptiveSphere.h"
+#include "MeshLibrary.h"
 
 class Planet {
 public:
 
-	Planet(float radius, int sectorCount, int stackCount, float sunDistance, float sunRotationSpeed, float selfRotationSpeed, 
+	Planet(float radius, int sectorCount, int stackCount, float sunDistance, float selfRotationSpeed, 
 		const char* vertexShaderPath, const char* fragmentShaderPath, 
 		const char* texturePath, const char* cloudTexturePath = nullptr, 
 		const char* orbitTexturePath = nullptr, int orbitDencity = 0,
 		bool isLightSource = false)
-		: body(radius, sectorCount, stackCount),
-		shaderProgram(vertexShaderPath, fragmentShaderPath),
-		sunOrbit(sunDistance, 0.02f, 64, 64),
+		: shaderProgram(vertexShaderPath, fragmentShaderPath),
 		sunOrbitShaderProgram("ShaderData/SunOrbits/vertex_shader.txt", "ShaderData/SunOrbits/fragment_shader.txt")
 	{
-		setupBody(texturePath);
+		bodyRadius = radius;
+		distanceFromSun = sunDistance;
+		orbitShape = glm::scale(glm::mat4(1.0f), glm::vec3(distanceFromSun));
+
+		setupBody(texturePath, sectorCount, stackCount);
 
 		if (orbitTexturePath != nullptr) 
 			setupOrbit(orbitTexturePath, 0.05f, radius + 1.0f, 64, 64, orbitDencity);
@@ -37,77 +44,185 @@ public:
 
 		setupSunOrbit();
 
+		// Adaptive body mesh, GPU tessellation where available and static levels otherwise
+		if (TessellatedSphere::isSupported())
+		{
+			tessBody = std::make_unique<TessellatedSphere>();
+			tessShaderProgram = std::make_unique<Shader>("ShaderData/Planets/tess_vertex_shader.txt", "ShaderData/Planets/tess_control_shader.txt",
+				"ShaderData/Planets/tess_evaluation_shader.txt", fragmentShaderPath);
+		}
+		else
+		{
+			lodBody = std::make_unique<SphereLODSet>();
+		}
+
 		isLight = isLightSource;
 
-		distanceFromSun = sunDistance;
-		rotationAroundSunSpeed = sunRotationSpeed;
+		bodyTexturePath = texturePath;
+		bodyFragmentShaderPath = fragmentShaderPath;
+
 		rotationAroundSelfSpeed = selfRotationSpeed;
 	}
 
-	void updatePos(float deltaTime, float parentDistance = -1)
+	// Radians per second of render time about the body's axis
+	float getRotationSpeed() const
+	{
+		return rotationAroundSelfSpeed;
+	}
+
+	// World matrices from the scene hierarchy, the spinning body and its rings, which don't spin
+	void setTransforms(const glm::mat4& body, const glm::mat4& rings)
+	{
+		modelMatrix = body;
+		ringMatrix = rings;
+	}
+
+	// Switches to quadtree terrain displaced by the surface texture when the camera gets close
+	void enableTerrain(float heightScale)
 	{
-		modelMatrix = glm::mat4(1.0f);
+		terrain = std::make_unique<Terrain>(bodyRadius, bodyTexturePath.c_str(), heightScale);
+		terrainShaderProgram = std::make_unique<Shader>("ShaderData/Planets/terrain_vertex_shader.txt", bodyFragmentShaderPath.c_str());
+		surfaceHeightScale = heightScale;
+	}
 
-		modelMatrix = glm::rotate(modelMatrix, glm::radians(-90.0f), glm::vec3(1.0f, 0.0f, 0.0f));
-		modelMatrix = glm::rotate(modelMatrix, rotationAroundSunSpeed * deltaTime, glm::vec3(0.0f, 0.0f, 1.0f));
+	void setAdaptiveMesh(bool enabled)
+	{
+		adaptiveMesh = enabled;
+	}
 
-		glm::vec3 moonPos;
+	// Picks the level of detail of the body for the current camera
+	void updateDetail(glm::vec3 cameraPos, float viewportHeight, float fovY)
+	{
+		this->viewportHeight = viewportHeight;
 
-		if (parentDistance == -1)
-		{
-			moonPos = glm::vec3(distanceFromSun, 0.0f, 0.0f);
-		}
-		else
+		if (lodBody)
 		{
-			glm::vec3 parentPos = glm::vec3(parentDistance, 0.0f, 0.0f);
-			moonPos = parentPos + glm::vec3(1.0f * cos(0.5f * deltaTime), 1.0f * sin(0.5f * deltaTime), 0.0f);
+			float distance = fmaxf(glm::length(cameraPos - glm::vec3(modelMatrix[3])), bodyRadius * 1.001f);
+			lodBody->select(bodyRadius / distance * viewportHeight / (2.0f * tanf(fovY * 0.5f)));
 		}
 
-		modelMatrix = glm::translate(modelMatrix, moonPos);
+		drawTerrain = false;
+		if (!terrain)
+			return;
+
+		glm::vec3 cameraLocal = glm::vec3(glm::inverse(modelMatrix) * glm::vec4(cameraPos, 1.0f));
+		if (glm::length(cameraLocal) > bodyRadius * terrainRange)
+			return;
 
-		modelMatrix = glm::rotate(modelMatrix, rotationAroundSelfSpeed * deltaTime, glm::vec3(0.0f, 0.0f, 1.0f));
+		terrain->update(cameraLocal, viewportHeight, fovY);
+		drawTerrain = terrain->isReady();
+	}
+
+	const TerrainStats* getTerrainStats()
+	{
+		return terrain ? &terrain->getStats() : nullptr;
+	}
+
+	// Inner and outer edge of the rings, zero without any
+	glm::vec2 getRingSpan() const
+	{
+		if (ringRadii.empty())
+			return glm::vec2(0.0f);
+
+		return glm::vec2(ringRadii.front().x - ringRadii.front().y, ringRadii.back().x + ringRadii.back().y);
+	}
+
+	// Simulated rings take the place of the tori
+	void setRingsVisible(bool visible)
+	{
+		ringsVisible = visible;
+	}
+
+	// Radius of a sphere around the body, its terrain and its rings
+	float getBoundingRadius() const
+	{
+		float radius = bodyRadius * (1.0f + surfaceHeightScale);
+		if (!ringRadii.empty())
+			radius = fmaxf(radius, ringRadii.back().x + ringRadii.back().y);
+
+		return radius;
+	}
+
+	// Outside the view frustum only the sun orbit is drawn
+	void setVisible(bool isVisible)
+	{
+		visible = isVisible;
 	}
 
 	void render(glm::mat4 view, glm::mat4 projection, glm::vec3 lightPos, glm::vec3 lightColor, glm::vec3 viewPos, bool visibleOrbits)
 	{
+		if (!visible)
+		{
+			if (visibleOrbits)
+				renderSunOrbit(view, projection, lightPos, lightColor, viewPos);
+			return;
+		}
+
 		// Planet
-		shaderProgram.use();
-		shaderProgram.setUniformMat4("model", modelMatrix);
-		shaderProgram.setUniformMat4("view", view);
-		shaderProgram.setUniformMat4("projection", projection);
+		bool tessellate = adaptiveMesh && tessBody && !drawTerrain;
+		Shader& bodyShader = drawTerrain ? *terrainShaderProgram : (tessellate ? *tessShaderProgram : shaderProgram);
+
+		// The shared sphere mesh has radius 1, terrain and tessellation apply the radius themselves
+		bool unitMesh = !drawTerrain && !tessellate;
 
-		shaderProgram.setUniformVec3("lightPos", lightPos);
-		shaderProgram.setUniformVec3("lightColor", lightColor);
-		shaderProgram.setUniformVec3("viewPos", viewPos);
-		shaderProgram.setUniformB("isLightSource", isLight);
+		bodyShader.use();
+		bodyShader.setUniformMat4("model", unitMesh ? glm::scale(modelMatrix, glm::vec3(bodyRadius)) : modelMatrix);
+		bodyShader.setUniformMat4("view", view);
+		bodyShader.setUniformMat4("projection", projection);
 
-		shaderProgram.setUniformB("hasClouds", hasClouds);
+		bodyShader.setUniformVec3("lightPos", lightPos);
+		bodyShader.setUniformVec3("lightColor", lightColor);
+		bodyShader.setUniformVec3("viewPos", viewPos);
+		bodyShader.setUniformB("isLightSource", isLight);
+
+		bodyShader.setUniformB("hasClouds", hasClouds);
+
+		if (tessellate)
+		{
+			bodyShader.setUniformF("radius", bodyRadius);
+			bodyShader.setUniformF("heightScale", surfaceHeightScale);
+			bodyShader.setUniformF("maxPixelError", 0.5f);
+			bodyShader.setUniformVec2("viewportSize", glm::vec2(viewportHeight * projection[1][1] / projection[0][0], viewportHeight));
+		}
 
 		glActiveTexture(GL_TEXTURE0);
 		glBindTexture(GL_TEXTURE_2D, textureID);
-		shaderProgram.setUniformI("textureToSet", 0);
+		bodyShader.setUniformI("textureToSet", 0);
 
 		if (hasClouds) 
 		{
 			glActiveTexture(GL_TEXTURE1);
 			glBindTexture(GL_TEXTURE_2D, cloudTextureID);
-			shaderProgram.setUniformI("cloudTexture", 1);
+			bodyShader.setUniformI("cloudTexture", 1);
 		}
 
 		glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
-		glBindVertexArray(sphereVAO);
-		glDrawElements(GL_TRIANGLES, body.indices.size(), GL_UNSIGNED_INT, 0);
-		glBindVertexArray(0);
+		if (drawTerrain)
+		{
+			terrain->render();
+		}
+		else if (tessellate)
+		{
+			tessBody->render();
+		}
+		else if (adaptiveMesh && lodBody)
+		{
+			lodBody->render();
+		}
+		else
+		{
+			MeshLibrary::instance().draw(bodyMesh);
+		}
 
 		// Orbit, if the planet has one
-		if (orbitVAO.size() != 0)
+		if (ringRadii.size() != 0 && ringsVisible)
 		{
 			Shader orbitShader("ShaderData/SunOrbits/vertex_shader.txt", "ShaderData/SunOrbits/fragment_shader.txt");
 			orbitShader.use();
 
-			for (int i = 0; i < orbitVAO.size(); i++)
+			for (int i = 0; i < ringRadii.size(); i++)
 			{
-				orbitShader.setUniformMat4("model", modelMatrix);
+				orbitShader.setUniformMat4("model", glm::scale(ringMatrix, glm::vec3(ringRadii[i].x)));
 				orbitShader.setUniformMat4("view", view);
 				orbitShader.setUniformMat4("projection", projection);
 
@@ -117,118 +232,73 @@ public:
 				orbitShader.setUniformVec3("viewPos", viewPos);
 				orbitShader.setUniformB("ignoreLights", false);
 
-				glBindVertexArray(orbitVAO[i]);
-				glDrawElements(GL_TRIANGLES, orbitIndices[i].size(), GL_UNSIGNED_INT, 0);
-				glBindVertexArray(0);
+				orbitShader.setUniformF("tubeRadius", ringRadii[i].y / ringRadii[i].x);
+
+				MeshLibrary::instance().draw(ringMesh);
 			}
 		}
 
 		// Sun orbits
 		if (visibleOrbits)
-		{
-			glm::mat4 torusModel = glm::mat4(1.0f);
-			torusModel = glm::rotate(torusModel, glm::radians(90.0f), glm::vec3(1.0f, 0.0f, 0.0f));
-			torusModel = glm::translate(torusModel, glm::vec3(0.0f, 0.0f, 0.0f));
-
-			sunOrbitShaderProgram.use();
-			sunOrbitShaderProgram.setUniformMat4("model", torusModel);
-			sunOrbitShaderProgram.setUniformMat4("view", view);
-			sunOrbitShaderProgram.setUniformMat4("projection", projection);
-
-			sunOrbitShaderProgram.setUniformVec4("colorToSet", glm::vec4(1.0f));
-			sunOrbitShaderProgram.setUniformVec3("lightPos", lightPos);
-			sunOrbitShaderProgram.setUniformVec3("lightColor", lightColor);
-			sunOrbitShaderProgram.setUniformVec3("viewPos", viewPos);
-			sunOrbitShaderProgram.setUniformB("ignoreLights", true);
-
-			glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
-			glBindVertexArray(sunOrbitVAO);
-			glDrawElements(GL_TRIANGLES, sunOrbit.indices.size(), GL_UNSIGNED_INT, 0);
-			glBindVertexArray(0);
-		}
+			renderSunOrbit(view, projection, lightPos, lightColor, viewPos);
 	}
 
-	float getDistanceFromSun()
+	// Orbit drawn with the sun orbit torus, maps the unit circle of the orbital plane onto it
+	void setOrbitShape(const glm::mat4& shape)
 	{
-		return distanceFromSun;
+		orbitShape = shape;
 	}
 
-	~Planet() 
+	float getDistanceFromSun()
 	{
-		glDeleteVertexArrays(1, &sphereVAO);
-		glDeleteBuffers(1, &sphereVBO);
-		glDeleteBuffers(1, &sphereEBO);
-
-		if (orbitVAO.size() != 0) {
-			for (int i = 0; i < orbitVAO.size(); i++)
-			{
-				glDeleteVertexArrays(1, &orbitVAO[i]);
-				glDeleteBuffers(1, &orbitVBO[i]);
-				glDeleteBuffers(1, &orbitEBO[i]);
-			}
-		}
-
-		glDeleteVertexArrays(1, &sunOrbitVAO);
-		glDeleteBuffers(1, &sunOrbitVBO);
-		glDeleteBuffers(1, &sunOrbitEBO);
+		return distanceFromSun;
 	}
 
 
 private:
-	Sphere body;
-	Torus sunOrbit;
-
 	Shader shaderProgram;
 	Shader sunOrbitShaderProgram;
 
-	unsigned int sphereVBO, sphereVAO, sphereEBO;
-	std::vector<unsigned int> orbitVBO, orbitVAO, orbitEBO;
-	unsigned int sunOrbitVBO, sunOrbitVAO, sunOrbitEBO;
+	// Unit meshes shared through MeshLibrary
+	MeshHandle bodyMesh, ringMesh, sunOrbitMesh;
+	std::vector<glm::vec2> ringRadii;	// centerline and tube radius of every ring
+	bool ringsVisible = true;
+	const float sunOrbitThickness = 0.02f;
+	glm::mat4 orbitShape;
 
 	unsigned int textureID, orbitTextureID = 0, cloudTextureID = 0;
 
-	std::vector<std::vector<unsigned int>> orbitIndices;
-
 	bool isLight, hasClouds;
 
-	glm::mat4 modelMatrix;
+	glm::mat4 modelMatrix, ringMatrix;
+	bool visible = true;
 
 	float distanceFromSun;
-	float rotationAroundSunSpeed;
 	float rotationAroundSelfSpeed;
 
 	std::vector<glm::vec4> orbitColors;
 
+	float bodyRadius;
+	std::string bodyTexturePath;
+	std::string bodyFragmentShaderPath;
 
-	void setupBody(const char* texturePath)
-	{
-		glGenVertexArrays(1, &sphereVAO);
-		glGenBuffers(1, &sphereVBO);
-		glGenBuffers(1, &sphereEBO);
-
-		glBindVertexArray(sphereVAO);
-
-		// Vertex buffer
-		glBindBuffer(GL_ARRAY_BUFFER, sphereVBO);
-		glBufferData(GL_ARRAY_BUFFER, body.vertices.size() * sizeof(float), &body.vertices[0], GL_STATIC_DRAW);
-
-		// Element buffer
-		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, sphereEBO);
-		glBufferData(GL_ELEMENT_ARRAY_BUFFER, body.indices.size() * sizeof(unsigned int), &body.indices[0], GL_STATIC_DRAW);
+	// Terrain is only used within terrainRange body radii of the planet center
+	std::unique_ptr<Terrain> terrain;
+	std::unique_ptr<Shader> terrainShaderProgram;
+	bool drawTerrain = false;
+	const float terrainRange = 8.0f;
+	float surfaceHeightScale = 0.0f;
 
-		// Position attribute
-		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)0);
-		glEnableVertexAttribArray(0);
+	std::unique_ptr<TessellatedSphere> tessBody;
+	std::unique_ptr<Shader> tessShaderProgram;
+	std::unique_ptr<SphereLODSet> lodBody;
+	bool adaptiveMesh = true;
+	float viewportHeight = 600.0f;
 
-		// Normal attribute
-		glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)(3 * sizeof(float)));
-		glEnableVertexAttribArray(1);
 
-		// Texture coordinate attribute
-		glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)(6 * sizeof(float)));
-		glEnableVertexAttribArray(2);
-
-		glBindVertexArray(0);
+	void setupBody(const char* texturePath, int sectorCount, int stackCount)
+	{
+		bodyMesh = MeshLibrary::instance().sphere(sectorCount, stackCount);
 
 		Texture::loadTexture(texturePath, textureID);
 	}
@@ -240,37 +310,11 @@ private:
 
 	void setupOrbit(const char* orbitTexturePath, float innerRadius, float outerRadius, int numSides, int numRings, int ringsCount)
 	{
+		ringMesh = MeshLibrary::instance().torus(numSides, numRings);
+
 		for (int i = 0; i < ringsCount; i++)
 		{
-			Torus ring(outerRadius, innerRadius, numSides, numRings);
-
-			unsigned int VAO, VBO, EBO;
-
-			glGenVertexArrays(1, &VAO);
-			glGenBuffers(1, &VBO);
-			glGenBuffers(1, &EBO);
-
-			glBindVertexArray(VAO);
-
-			glBindBuffer(GL_ARRAY_BUFFER, VBO);
-			glBufferData(GL_ARRAY_BUFFER, ring.vertices.size() * sizeof(float), &ring.vertices[0], GL_STATIC_DRAW);
-
-			glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
-			glBufferData(GL_ELEMENT_ARRAY_BUFFER, ring.indices.size() * sizeof(unsigned int), &ring.indices[0], GL_STATIC_DRAW);
-
-			glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(float), (void*)0);
-			glEnableVertexAttribArray(0);
-
-			glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(float), (void*)(3 * sizeof(float)));
-			glEnableVertexAttribArray(1);
-
-			glBindVertexArray(0);
-
-			orbitVAO.push_back(VAO);
-			orbitVBO.push_back(VBO);
-			orbitEBO.push_back(EBO);
-
-			orbitIndices.push_back(ring.indices);
+			ringRadii.push_back(glm::vec2(outerRadius, innerRadius));
 
 			outerRadius += innerRadius + 0.05f;
 		}
@@ -280,25 +324,31 @@ private:
 
 	void setupSunOrbit() 
 	{
-		glGenVertexArrays(1, &sunOrbitVAO);
-		glGenBuffers(1, &sunOrbitVBO);
-		glGenBuffers(1, &sunOrbitEBO);
-
-		glBindVertexArray(sunOrbitVAO);
+		sunOrbitMesh = MeshLibrary::instance().torus(64, 64);
+	}
 
-		glBindBuffer(GL_ARRAY_BUFFER, sunOrbitVBO);
-		glBufferData(GL_ARRAY_BUFFER, sunOrbit.vertices.size() * sizeof(float), &sunOrbit.vertices[0], GL_STATIC_DRAW);
+	void renderSunOrbit(const glm::mat4& view, const glm::mat4& projection, const glm::vec3& lightPos, const glm::vec3& lightColor, const glm::vec3& viewPos)
+	{
+		// Same orbital plane rotation as the body
+		glm::mat4 torusModel = glm::mat4(1.0f);
+		torusModel = glm::rotate(torusModel, glm::radians(-90.0f), glm::vec3(1.0f, 0.0f, 0.0f));
+		torusModel = torusModel * orbitShape;
 
-		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, sunOrbitEBO);
-		glBufferData(GL_ELEMENT_ARRAY_BUFFER, sunOrbit.indices.size() * sizeof(unsigned int), &sunOrbit.indices[0], GL_STATIC_DRAW);
+		sunOrbitShaderProgram.use();
+		sunOrbitShaderProgram.setUniformMat4("model", torusModel);
+		sunOrbitShaderProgram.setUniformMat4("view", view);
+		sunOrbitShaderProgram.setUniformMat4("projection", projection);
 
-		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(float), (void*)0);
-		glEnableVertexAttribArray(0);
+		sunOrbitShaderProgram.setUniformVec4("colorToSet", glm::vec4(1.0f));
+		sunOrbitShaderProgram.setUniformVec3("lightPos", lightPos);
+		sunOrbitShaderProgram.setUniformVec3("lightColor", lightColor);
+		sunOrbitShaderProgram.setUniformVec3("viewPos", viewPos);
+		sunOrbitShaderProgram.setUniformB("ignoreLights", true);
 
-		glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(float), (void*)(3 * sizeof(float)));
-		glEnableVertexAttribArray(1);
+		sunOrbitShaderProgram.setUniformF("tubeRadius", sunOrbitThickness / distanceFromSun);
 
-		glBindVertexArray(0);
+		glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
+		MeshLibrary::instance().draw(sunOrbitMesh);
 	}
 };
 
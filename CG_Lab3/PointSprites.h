@@ -0,0 +1,79 @@
+#ifndef POINT_SPRITES_H
+#define POINT_SPRITES_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <cstddef>
+
+#include "Shader.h"
+#include "InstanceBuffer.h"
+
+// Any number of round, additively blended points in one draw. Each point is an instance of a single
+// vertex with its position as the per-instance attribute, so the positions go straight from the
+// CPU into a mapped instance buffer.
+class PointSprites
+{
+public:
+	PointSprites(const char* vertexShaderPath, const char* fragmentShaderPath)
+		: shader(vertexShaderPath, fragmentShaderPath), positions(3)
+	{
+		glGenVertexArrays(1, &vao);
+	}
+
+	~PointSprites()
+	{
+		glDeleteVertexArrays(1, &vao);
+	}
+
+	// 3 floats per point, write-only, until unmap
+	float* map(size_t count)
+	{
+		return positions.map(count);
+	}
+
+	void unmap()
+	{
+		positions.unmap();
+	}
+
+	size_t size() const
+	{
+		return positions.size();
+	}
+
+	// After the skybox: the points don't write depth, so it would cover them
+	void render(const glm::mat4& model, const glm::mat4& view, const glm::mat4& projection, const glm::vec4& color, float pointScale)
+	{
+		if (positions.size() == 0)
+			return;
+
+		shader.use();
+		shader.setUniformMat4("model", model);
+		shader.setUniformMat4("view", view);
+		shader.setUniformMat4("projection", projection);
+		shader.setUniformVec4("colorToSet", color);
+		shader.setUniformF("pointScale", pointScale);
+
+		glEnable(GL_PROGRAM_POINT_SIZE);
+		glEnable(GL_BLEND);
+		glBlendFunc(GL_SRC_ALPHA, GL_ONE);
+		glDepthMask(GL_FALSE);
+
+		glBindVertexArray(vao);
+		positions.attribute(0, 3, 0);
+		glDrawArraysInstanced(GL_POINTS, 0, 1, (GLsizei)positions.size());
+		glBindVertexArray(0);
+
+		glDepthMask(GL_TRUE);
+		glDisable(GL_BLEND);
+		glDisable(GL_PROGRAM_POINT_SIZE);
+	}
+
+private:
+	Shader shader;
+	InstanceBuffer positions;
+	GLuint vao = 0;
+};
+
+#endif
@@ -0,0 +1,366 @@
+#ifndef RING_PARTICLES_H
+#define RING_PARTICLES_H
+
+#include <vector>
+#include <memory>
+#include <atomic>
+#include <chrono>
+#include <random>
+#include <cmath>
+#include <algorithm>
+#include <cstdint>
+#include <cstddef>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+#include "SimdMath.h"
+#include "JobSystem.h"
+
+struct RingStats
+{
+	size_t particles = 0;
+	long long steps = 0;
+
+	// Per step, averaged
+	double hashMs = 0.0;				// cell keys, counting sort and reordering the particles
+	double collisionMs = 0.0;
+	double integrateMs = 0.0;
+	double collisionsPerStep = 0.0;
+};
+
+// A planetary ring as particles on Kepler orbits around the planet at the origin of the ring plane
+// (xy), bouncing off each other inelastically. Time is scaled so the inner edge goes round in a
+// given number of seconds instead of hours.
+// Every step the particles are sorted by a uniform spatial hash of their xy cell, a parallel
+// counting sort into a table of about two buckets per particle. The hash is the cell's row-major
+// index wrapped to the table, so cells next to each other in a row are consecutive buckets and
+// the sort keeps neighbours close in memory. Cells are a particle diameter wide, so a particle
+// only meets others from the 3 x 3 cells around its own, three runs of three buckets. Each
+// particle sums the impulses of all its contacts into a new velocity, so no two threads write
+// the same one.
+class RingParticles
+{
+public:
+	// Fraction of the normal approach speed a collision keeps
+	static constexpr float restitution = 0.5f;
+
+	// count particles between the radii, sized so their discs cover coverage of the ring's area
+	RingParticles(size_t count, float innerRadius, float outerRadius, float innerPeriod, float coverage = 0.3f)
+	{
+		const float twoPi = 6.2831853f;
+		float area = twoPi * 0.5f * (outerRadius * outerRadius - innerRadius * innerRadius);
+		particleRadius = sqrtf(coverage * area / (twoPi * 0.5f * count));
+		cellSize = 2.0f * particleRadius;
+		gm = powf(twoPi / innerPeriod, 2.0f) * innerRadius * innerRadius * innerRadius;
+
+		tableSize = 1;
+		while (tableSize < 2 * count)
+			tableSize *= 2;
+		rowCells = (uint32_t)ceilf(2.2f * outerRadius / cellSize);
+
+		for (std::vector<float>* array : { &x, &y, &z, &vx, &vy, &vz, &sortedX, &sortedY, &sortedZ, &sortedVx, &sortedVy, &sortedVz })
+			array->resize(count);
+		keys.resize(count);
+		order.resize(count);
+		cellStart.resize(tableSize + 1);
+		counters.reset(new std::atomic<uint32_t>[tableSize]);
+
+		// Uniform over the area, a few diameters thick, stirred at about the same speed
+		std::mt19937 random(5);
+		std::uniform_real_distribution<float> uniform(0.0f, 1.0f);
+		std::normal_distribution<float> gaussian;
+
+		for (size_t i = 0; i < count; i++)
+		{
+			float r = sqrtf(innerRadius * innerRadius + uniform(random) * (outerRadius * outerRadius - innerRadius * innerRadius));
+			float angle = twoPi * uniform(random), speed = sqrtf(gm / r);
+			float stir = 2.0f * particleRadius * speed / r;
+
+			x[i] = r * cosf(angle);
+			y[i] = r * sinf(angle);
+			z[i] = 2.0f * particleRadius * gaussian(random);
+			vx[i] = -speed * sinf(angle) + stir * gaussian(random);
+			vy[i] = speed * cosf(angle) + stir * gaussian(random);
+			vz[i] = stir * gaussian(random);
+		}
+	}
+
+	size_t size() const
+	{
+		return x.size();
+	}
+
+	float getParticleRadius() const
+	{
+		return particleRadius;
+	}
+
+	void step(float dt)
+	{
+		auto begin = std::chrono::high_resolution_clock::now();
+		integrate(dt);
+		auto integrated = std::chrono::high_resolution_clock::now();
+		sort();
+		auto sorted = std::chrono::high_resolution_clock::now();
+		collide();
+		auto collided = std::chrono::high_resolution_clock::now();
+
+		integrateSeconds += std::chrono::duration<double>(integrated - begin).count();
+		hashSeconds += std::chrono::duration<double>(sorted - integrated).count();
+		collisionSeconds += std::chrono::duration<double>(collided - sorted).count();
+		steps++;
+	}
+
+	// 3 floats per particle in the ring plane, only written, so out can be a mapped buffer
+	void writePositions(float* out) const
+	{
+		JobSystem::instance().parallelFor(size(), [&](size_t first, size_t last)
+			{
+				for (size_t i = first; i < last; i++)
+				{
+					out[3 * i] = x[i];
+					out[3 * i + 1] = y[i];
+					out[3 * i + 2] = z[i];
+				}
+			});
+	}
+
+	const RingStats& getStats()
+	{
+		double perStep = steps > 0 ? 1000.0 / steps : 0.0;
+		stats.particles = size();
+		stats.steps = steps;
+		stats.hashMs = hashSeconds * perStep;
+		stats.collisionMs = collisionSeconds * perStep;
+		stats.integrateMs = integrateSeconds * perStep;
+		stats.collisionsPerStep = steps > 0 ? (double)collisions / steps : 0.0;
+		return stats;
+	}
+
+	// count particles in a ring 3.5 to 5.5 units across going round in 30 s at the inner edge,
+	// steps of 1/60 s after one untimed
+	static RingStats measure(size_t count, int stepCount)
+	{
+		RingParticles ring(count, 3.5f, 5.5f, 30.0f);
+		ring.step(1.0f / 60.0f);
+		ring.steps = ring.collisions = 0;
+		ring.hashSeconds = ring.collisionSeconds = ring.integrateSeconds = 0.0;
+
+		for (int i = 0; i < stepCount; i++)
+			ring.step(1.0f / 60.0f);
+
+		return ring.getStats();
+	}
+
+private:
+	float particleRadius, cellSize, gm;
+
+	std::vector<float> x, y, z, vx, vy, vz;
+
+	// Reordered copies, swapped with the above every step
+	std::vector<float> sortedX, sortedY, sortedZ, sortedVx, sortedVy, sortedVz;
+
+	// Bucket of each particle, particles by bucket, and where each bucket starts among them
+	size_t tableSize;
+	uint32_t rowCells;
+	std::vector<uint32_t> keys, order, cellStart;
+	std::unique_ptr<std::atomic<uint32_t>[]> counters;
+
+	long long steps = 0, collisions = 0;
+	double hashSeconds = 0.0, collisionSeconds = 0.0, integrateSeconds = 0.0;
+	RingStats stats;
+
+	uint32_t bucketOf(float px, float py) const
+	{
+		return bucketOf((int32_t)floorf(px / cellSize), (int32_t)floorf(py / cellSize));
+	}
+
+	uint32_t bucketOf(int32_t cellX, int32_t cellY) const
+	{
+		return ((uint32_t)cellY * rowCells + (uint32_t)cellX) & (uint32_t)(tableSize - 1);
+	}
+
+	// Drift-kick-drift leapfrog around the planet
+	void integrate(float dt)
+	{
+		JobSystem::instance().parallelFor(size(), [&](size_t first, size_t last)
+			{
+				float halfDt = 0.5f * dt;
+				size_t i = first;
+
+#if defined(__AVX2__)
+				const __m256 hh = _mm256_set1_ps(halfDt), kick = _mm256_set1_ps(-gm * dt);
+
+				for (; i + 8 <= last; i += 8)
+				{
+					__m256 px = _mm256_loadu_ps(&x[i]), py = _mm256_loadu_ps(&y[i]), pz = _mm256_loadu_ps(&z[i]);
+					__m256 qx = _mm256_loadu_ps(&vx[i]), qy = _mm256_loadu_ps(&vy[i]), qz = _mm256_loadu_ps(&vz[i]);
+
+					px = SimdMath::fmadd8(qx, hh, px); py = SimdMath::fmadd8(qy, hh, py); pz = SimdMath::fmadd8(qz, hh, pz);
+
+					__m256 r2 = SimdMath::fmadd8(px, px, SimdMath::fmadd8(py, py, _mm256_mul_ps(pz, pz)));
+					__m256 pull = _mm256_mul_ps(kick, SimdMath::inverseCube8(r2));
+					qx = SimdMath::fmadd8(px, pull, qx); qy = SimdMath::fmadd8(py, pull, qy); qz = SimdMath::fmadd8(pz, pull, qz);
+
+					px = SimdMath::fmadd8(qx, hh, px); py = SimdMath::fmadd8(qy, hh, py); pz = SimdMath::fmadd8(qz, hh, pz);
+
+					_mm256_storeu_ps(&x[i], px); _mm256_storeu_ps(&y[i], py); _mm256_storeu_ps(&z[i], pz);
+					_mm256_storeu_ps(&vx[i], qx); _mm256_storeu_ps(&vy[i], qy); _mm256_storeu_ps(&vz[i], qz);
+				}
+#endif
+
+				for (; i < last; i++)
+				{
+					x[i] += vx[i] * halfDt; y[i] += vy[i] * halfDt; z[i] += vz[i] * halfDt;
+
+					float r2 = x[i] * x[i] + y[i] * y[i] + z[i] * z[i];
+					float pull = -gm * dt / (r2 * sqrtf(r2));
+					vx[i] += x[i] * pull; vy[i] += y[i] * pull; vz[i] += z[i] * pull;
+
+					x[i] += vx[i] * halfDt; y[i] += vy[i] * halfDt; z[i] += vz[i] * halfDt;
+				}
+			});
+	}
+
+	// Counting sort by bucket: count, scan, scatter, then the particles reordered to match
+	void sort()
+	{
+		JobSystem& jobs = JobSystem::instance();
+		size_t count = size();
+
+		jobs.parallelFor(tableSize, [&](size_t first, size_t last)
+			{
+				for (size_t b = first; b < last; b++)
+					counters[b].store(0, std::memory_order_relaxed);
+			});
+
+		jobs.parallelFor(count, [&](size_t first, size_t last)
+			{
+				for (size_t i = first; i < last; i++)
+				{
+					keys[i] = bucketOf(x[i], y[i]);
+					counters[keys[i]].fetch_add(1, std::memory_order_relaxed);
+				}
+			});
+
+		// Exclusive scan in chunks: chunk totals, their offsets, then every bucket. The counters
+		// become scatter cursors starting at each bucket's first slot.
+		const size_t chunks = 64, chunkSize = (tableSize + chunks - 1) / chunks;
+		uint32_t chunkOffsets[chunks + 1] = {};
+		jobs.parallelFor(chunks, 1, [&](size_t first, size_t last)
+			{
+				for (size_t c = first; c < last; c++)
+				{
+					uint32_t total = 0;
+					for (size_t b = c * chunkSize; b < std::min((c + 1) * chunkSize, tableSize); b++)
+						total += counters[b].load(std::memory_order_relaxed);
+					chunkOffsets[c + 1] = total;
+				}
+			});
+		for (size_t c = 0; c < chunks; c++)
+			chunkOffsets[c + 1] += chunkOffsets[c];
+
+		jobs.parallelFor(chunks, 1, [&](size_t first, size_t last)
+			{
+				for (size_t c = first; c < last; c++)
+				{
+					uint32_t offset = chunkOffsets[c];
+					for (size_t b = c * chunkSize; b < std::min((c + 1) * chunkSize, tableSize); b++)
+					{
+						cellStart[b] = offset;
+						offset += counters[b].load(std::memory_order_relaxed);
+						counters[b].store(cellStart[b], std::memory_order_relaxed);
+					}
+				}
+			});
+		cellStart[tableSize] = (uint32_t)count;
+
+		jobs.parallelFor(count, [&](size_t first, size_t last)
+			{
+				for (size_t i = first; i < last; i++)
+					order[counters[keys[i]].fetch_add(1, std::memory_order_relaxed)] = (uint32_t)i;
+			});
+
+		jobs.parallelFor(count, [&](size_t first, size_t last)
+			{
+				for (size_t slot = first; slot < last; slot++)
+				{
+					uint32_t i = order[slot];
+					sortedX[slot] = x[i]; sortedY[slot] = y[i]; sortedZ[slot] = z[i];
+					sortedVx[slot] = vx[i]; sortedVy[slot] = vy[i]; sortedVz[slot] = vz[i];
+				}
+			});
+
+		x.swap(sortedX); y.swap(sortedY); z.swap(sortedZ);
+		vx.swap(sortedVx); vy.swap(sortedVy); vz.swap(sortedVz);
+	}
+
+	// Approaching pairs closer than a diameter exchange momentum along the line between them,
+	// half of (1 + restitution) times the approach speed each. New velocities go to the sorted
+	// copies, which become the current ones.
+	void collide()
+	{
+		float contact2 = 4.0f * particleRadius * particleRadius, share = 0.5f * (1.0f + restitution);
+		std::atomic<long long> contacts(0);
+
+		JobSystem::instance().parallelFor(size(), [&](size_t first, size_t last)
+			{
+				long long found = 0;
+				for (size_t p = first; p < last; p++)
+				{
+					float px = x[p], py = y[p], pz = z[p];
+					float dvx = 0.0f, dvy = 0.0f, dvz = 0.0f;
+					int32_t cellX = (int32_t)floorf(px / cellSize), cellY = (int32_t)floorf(py / cellSize);
+
+					auto touch = [&](uint32_t begin, uint32_t end)
+						{
+							for (uint32_t q = begin; q < end; q++)
+							{
+								float dx = x[q] - px, dy = y[q] - py, dz = z[q] - pz;
+								float d2 = dx * dx + dy * dy + dz * dz;
+								if (d2 >= contact2 || q == p)
+									continue;
+
+								float approach = dx * (vx[q] - vx[p]) + dy * (vy[q] - vy[p]) + dz * (vz[q] - vz[p]);
+								if (approach >= 0.0f)
+									continue;
+
+								float impulse = share * approach / fmaxf(d2, 1e-20f);
+								dvx += dx * impulse; dvy += dy * impulse; dvz += dz * impulse;
+								found++;
+							}
+						};
+
+					// A row of three cells is one run of particles unless it wraps around the table
+					for (int offsetY = -1; offsetY <= 1; offsetY++)
+					{
+						uint32_t bucket = bucketOf(cellX - 1, cellY + offsetY);
+						if (bucket + 3 <= tableSize)
+							touch(cellStart[bucket], cellStart[bucket + 3]);
+						else
+						{
+							for (uint32_t b = 0; b < 3; b++)
+							{
+								uint32_t wrapped = (bucket + b) & (uint32_t)(tableSize - 1);
+								touch(cellStart[wrapped], cellStart[wrapped + 1]);
+							}
+						}
+					}
+
+					sortedVx[p] = vx[p] + dvx;
+					sortedVy[p] = vy[p] + dvy;
+					sortedVz[p] = vz[p] + dvz;
+				}
+				contacts.fetch_add(found, std::memory_order_relaxed);
+			});
+
+		vx.swap(sortedVx); vy.swap(sortedVy); vz.swap(sortedVz);
+
+		// Both particles of a pair count it
+		collisions += contacts.load() / 2;
+	}
+};
+
+#endif
@@ -0,0 +1,109 @@
+#ifndef SCENE_SCALE_H
+#define SCENE_SCALE_H
+
+#include <glm/glm.hpp>
+
+#include <vector>
+#include <cmath>
+#include <algorithm>
+#include <cstddef>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+#include "SimdMath.h"
+
+// The scene isn't to scale: distances from the Sun map through (AU, scene) pairs in increasing
+// order, linearly in between and past the last along the last segment. Directions are kept and
+// the ecliptic is rotated into the scene like the bodies.
+class SceneScale
+{
+public:
+	void setRadii(const std::vector<glm::dvec2>& auToScene)
+	{
+		hinges.clear();
+		slopeChanges.clear();
+
+		double lastAu = 0.0, lastScene = 0.0, lastSlope = 0.0;
+		for (const glm::dvec2& point : auToScene)
+		{
+			double slope = (point.y - lastScene) / (point.x - lastAu);
+			hinges.push_back((float)lastAu);
+			slopeChanges.push_back((float)(slope - lastSlope));
+
+			lastAu = point.x;
+			lastScene = point.y;
+			lastSlope = slope;
+		}
+	}
+
+	// Heliocentric ecliptic positions first to last into scene positions, 3 floats each at out + 3 * i
+	void apply(const float* x, const float* y, const float* z, size_t first, size_t last, float* out) const
+	{
+		size_t i = first;
+
+#if defined(__AVX2__)
+		for (; i + 8 <= last; i += 8)
+		{
+			__m256 px = _mm256_loadu_ps(&x[i]), py = _mm256_loadu_ps(&y[i]), pz = _mm256_loadu_ps(&z[i]);
+			__m256 scale = factor8(px, py, pz);
+
+			// Ecliptic xyz to the scene's x, z, -y
+			alignas(32) float sx[8], sy[8], sz[8];
+			_mm256_store_ps(sx, _mm256_mul_ps(px, scale));
+			_mm256_store_ps(sy, _mm256_mul_ps(pz, scale));
+			_mm256_store_ps(sz, _mm256_mul_ps(py, scale));
+
+			for (int lane = 0; lane < 8; lane++)
+			{
+				float* point = out + 3 * (i + lane);
+				point[0] = sx[lane];
+				point[1] = sy[lane];
+				point[2] = -sz[lane];
+			}
+		}
+#endif
+
+		for (; i < last; i++)
+		{
+			float scale = factor(x[i], y[i], z[i]);
+			float* point = out + 3 * i;
+			point[0] = x[i] * scale;
+			point[1] = z[i] * scale;
+			point[2] = -y[i] * scale;
+		}
+	}
+
+	// Scene distance over distance from the Sun
+	float factor(float x, float y, float z) const
+	{
+		float r = std::sqrt(x * x + y * y + z * z), scene = 0.0f;
+		for (size_t k = 0; k < hinges.size(); k++)
+			scene += std::max(r - hinges[k], 0.0f) * slopeChanges[k];
+
+		return scene / std::max(r, 1e-12f);
+	}
+
+#if defined(__AVX2__)
+	__m256 factor8(__m256 x, __m256 y, __m256 z) const
+	{
+		__m256 r = _mm256_sqrt_ps(SimdMath::fmadd8(x, x, SimdMath::fmadd8(y, y, _mm256_mul_ps(z, z))));
+
+		__m256 scene = _mm256_setzero_ps();
+		for (size_t k = 0; k < hinges.size(); k++)
+		{
+			__m256 beyond = _mm256_max_ps(_mm256_sub_ps(r, _mm256_set1_ps(hinges[k])), _mm256_setzero_ps());
+			scene = SimdMath::fmadd8(beyond, _mm256_set1_ps(slopeChanges[k]), scene);
+		}
+
+		return _mm256_div_ps(scene, _mm256_max_ps(r, _mm256_set1_ps(1e-12f)));
+	}
+#endif
+
+private:
+	// Scene distance as the sum of slopeChanges[k] * max(r - hinges[k], 0)
+	std::vector<float> hinges, slopeChanges;
+};
+
+#endif
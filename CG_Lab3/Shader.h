@@ -16,64 +16,69 @@ public:
 
 	Shader(const char* vertexShaderPath, const char* fragmentShaderPath)
 	{
-		std::string vertexStr;
-		std::string fragmentStr;
+		std::string vertexStr = readFile(vertexShaderPath);
+		std::string fragmentStr = readFile(fragmentShaderPath);
 
-		std::ifstream vShaderFile;
-		std::ifstream fShaderFile;
-
-		vShaderFile.exceptions(std::ifstream::failbit | std::ifstream::badbit);
-		fShaderFile.exceptions(std::ifstream::failbit | std::ifstream::badbit);
+		// compiling shaders
+		unsigned int vertexShader = compile(GL_VERTEX_SHADER, vertexStr, "VERTEX");
+		unsigned int fragmentShader = compile(GL_FRAGMENT_SHADER, fragmentStr, "FRAGMENT");
 
-		try
-		{
-			// reading files
-			vShaderFile.open(vertexShaderPath);
-			fShaderFile.open(fragmentShaderPath);
+		// creating a shader program
+		programID = glCreateProgram();
+		glAttachShader(programID, vertexShader);
+		glAttachShader(programID, fragmentShader);
+		glLinkProgram(programID);
+		checkErrors(programID, "SHADER_PROGRAM");
 
-			std::stringstream vShaderStream, fShaderStream;
-			vShaderStream << vShaderFile.rdbuf();
-			fShaderStream << fShaderFile.rdbuf();
+		// deleting shaders
+		glDeleteShader(vertexShader);
+		glDeleteShader(fragmentShader);
+	}
 
-			vShaderFile.close();
-			fShaderFile.close();
+	// Program with tessellation stages, needs a GL 4.0+ context
+	Shader(const char* vertexShaderPath, const char* tessControlShaderPath, const char* tessEvaluationShaderPath, const char* fragmentShaderPath)
+	{
+		unsigned int vertexShader = compile(GL_VERTEX_SHADER, readFile(vertexShaderPath), "VERTEX");
+		unsigned int tessControlShader = compile(GL_TESS_CONTROL_SHADER, readFile(tessControlShaderPath), "TESS_CONTROL");
+		unsigned int tessEvaluationShader = compile(GL_TESS_EVALUATION_SHADER, readFile(tessEvaluationShaderPath), "TESS_EVALUATION");
+		unsigned int fragmentShader = compile(GL_FRAGMENT_SHADER, readFile(fragmentShaderPath), "FRAGMENT");
 
-			// converting streams into strings
-			vertexStr = vShaderStream.str();
-			fragmentStr = fShaderStream.str();
-		}
-		catch (std::ifstream::failure& e)
-		{
-			std::cout << "ERROR::SHADER::FILE_NOT_SUCCESSFULLY_READ: " << e.what() << std::endl;
-		}
+		programID = glCreateProgram();
+		glAttachShader(programID, vertexShader);
+		glAttachShader(programID, tessControlShader);
+		glAttachShader(programID, tessEvaluationShader);
+		glAttachShader(programID, fragmentShader);
+		glLinkProgram(programID);
+		checkErrors(programID, "SHADER_PROGRAM");
 
-		const char* vertexCode = vertexStr.c_str();
-		const char* fragmentCode = fragmentStr.c_str();
+		glDeleteShader(vertexShader);
+		glDeleteShader(tessControlShader);
+		glDeleteShader(tessEvaluationShader);
+		glDeleteShader(fragmentShader);
+	}
 
-		// compiling shaders
-		unsigned int vertexShader;
-		vertexShader = glCreateShader(GL_VERTEX_SHADER);
-		glShaderSource(vertexShader, 1, &vertexCode, NULL);
-		glCompileShader(vertexShader);
-		checkErrors(vertexShader, "VERTEX");
-		
-
-		unsigned int fragmentShader;
-		fragmentShader = glCreateShader(GL_FRAGMENT_SHADER);
-		glShaderSource(fragmentShader, 1, &fragmentCode, NULL);
-		glCompileShader(fragmentShader);
-		checkErrors(vertexShader, "FRAGMENT");
+	// Program that only captures one output into a transform feedback buffer, with an optional
+	// geometry shader to drop or add vertices. Draw it with GL_RASTERIZER_DISCARD enabled.
+	Shader(const char* vertexShaderPath, const char* geometryShaderPath, const char* feedbackVarying)
+	{
+		unsigned int vertexShader = compile(GL_VERTEX_SHADER, readFile(vertexShaderPath), "VERTEX");
+		unsigned int geometryShader = 0;
+		if (geometryShaderPath)
+			geometryShader = compile(GL_GEOMETRY_SHADER, readFile(geometryShaderPath), "GEOMETRY");
 
-		// creating a shader program
 		programID = glCreateProgram();
 		glAttachShader(programID, vertexShader);
-		glAttachShader(programID, fragmentShader);
+		if (geometryShader)
+			glAttachShader(programID, geometryShader);
+
+		// Outputs to capture have to be named before linking
+		glTransformFeedbackVaryings(programID, 1, &feedbackVarying, GL_INTERLEAVED_ATTRIBS);
 		glLinkProgram(programID);
 		checkErrors(programID, "SHADER_PROGRAM");
 
-		// deleting shaders
 		glDeleteShader(vertexShader);
-		glDeleteShader(fragmentShader);
+		if (geometryShader)
+			glDeleteShader(geometryShader);
 	}
 
 	void use()
@@ -93,6 +98,10 @@ public:
 	{
 		glUniform1i(glGetUniformLocation(programID, name.c_str()), (int)value);
 	}
+	void setUniformVec2(const std::string& name, const glm::vec2& value) const
+	{
+		glUniform2fv(glGetUniformLocation(programID, name.c_str()), 1, &value[0]);
+	}
 	void setUniformVec3(const std::string& name, const glm::vec3& value) const
 	{
 		glUniform3fv(glGetUniformLocation(programID, name.c_str()), 1, &value[0]);
@@ -107,6 +116,42 @@ public:
 	}
 
 private:
+	std::string readFile(const char* path)
+	{
+		std::ifstream shaderFile;
+		shaderFile.exceptions(std::ifstream::failbit | std::ifstream::badbit);
+
+		try
+		{
+			shaderFile.open(path);
+
+			std::stringstream shaderStream;
+			shaderStream << shaderFile.rdbuf();
+
+			shaderFile.close();
+
+			return shaderStream.str();
+		}
+		catch (std::ifstream::failure& e)
+		{
+			std::cout << "ERROR::SHADER::FILE_NOT_SUCCESSFULLY_READ: " << e.what() << std::endl;
+		}
+
+		return std::string();
+	}
+
+	unsigned int compile(GLenum type, const std::string& source, const std::string& name)
+	{
+		const char* code = source.c_str();
+
+		unsigned int shader = glCreateShader(type);
+		glShaderSource(shader, 1, &code, NULL);
+		glCompileShader(shader);
+		checkErrors(shader, name);
+
+		return shader;
+	}
+
 	void checkErrors(GLuint shader, std::string type)
 	{
 		int success;
@@ -0,0 +1,246 @@
+#ifndef SIMD_MATH_H
+#define SIMD_MATH_H
+
+#include <vector>
+#include <chrono>
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+// Angles evenly over [-range, range], sines and cosines of all of them per millisecond, and the
+// largest difference from double precision
+struct SinCosStats
+{
+	size_t angles = 0;
+	float range = 0.0f;
+	double vectorPerMs = 0.0;			// sincos over arrays, 8 lanes at a time with AVX2
+	double scalarPerMs = 0.0;			// the same polynomials one angle at a time
+	double standardPerMs = 0.0;			// std::sin and std::cos
+	double vectorMaxError = 0.0;
+	double scalarMaxError = 0.0;
+};
+
+// Cephes-style single precision sine/cosine: reduction to [-pi/4, pi/4] and minimax polynomials,
+// evaluated 8 lanes at a time with AVX2 and with the same arithmetic on scalars otherwise
+class SimdMath
+{
+public:
+	static void sincos(float x, float& sine, float& cosine)
+	{
+		float ax = fabsf(x);
+
+		// Octant, rounded up to an even number so the remainder lies in [-pi/4, pi/4]
+		int j = (int)(ax * FourOverPi);
+		j = (j + 1) & ~1;
+		float y = (float)j;
+
+		float r = ((ax - y * DP1) - y * DP2) - y * DP3;
+		float z = r * r;
+
+		float polyCos = ((CosC0 * z + CosC1) * z + CosC2) * z * z - 0.5f * z + 1.0f;
+		float polySin = ((SinC0 * z + SinC1) * z + SinC2) * z * r + r;
+
+		bool swap = (j & 2) != 0;
+		float s = swap ? polyCos : polySin;
+		float c = swap ? polySin : polyCos;
+
+		if (((j & 4) != 0) != (x < 0.0f))
+			s = -s;
+		if (((j - 2) & 4) == 0)
+			c = -c;
+
+		sine = s;
+		cosine = c;
+	}
+
+	// Fills sines/cosines for count angles, 8 at a time
+	static void sincos(const float* angles, float* sines, float* cosines, size_t count)
+	{
+		size_t i = 0;
+
+#if defined(__AVX2__)
+		for (; i + 8 <= count; i += 8)
+		{
+			__m256 s, c;
+			sincos8(_mm256_loadu_ps(angles + i), s, c);
+			_mm256_storeu_ps(sines + i, s);
+			_mm256_storeu_ps(cosines + i, c);
+		}
+#endif
+
+		for (; i < count; i++)
+			sincos(angles[i], sines[i], cosines[i]);
+	}
+
+	// sin/cos of start + i * step for i in [0, count)
+	static void sincosRange(float start, float step, float* sines, float* cosines, size_t count)
+	{
+		float angles[8];
+		size_t i = 0;
+
+		for (; i < count; i += 8)
+		{
+			size_t lanes = count - i < 8 ? count - i : 8;
+			for (size_t k = 0; k < lanes; k++)
+				angles[k] = start + (float)(i + k) * step;
+
+			sincos(angles, sines + i, cosines + i, lanes);
+		}
+	}
+
+#if defined(__AVX2__)
+	static void sincos8(__m256 x, __m256& sine, __m256& cosine)
+	{
+		const __m256 signMask = _mm256_castsi256_ps(_mm256_set1_epi32((int)0x80000000));
+
+		__m256 signSin = _mm256_and_ps(x, signMask);
+		x = _mm256_andnot_ps(signMask, x);
+
+		__m256i j = _mm256_cvttps_epi32(_mm256_mul_ps(x, _mm256_set1_ps(FourOverPi)));
+		j = _mm256_and_si256(_mm256_add_epi32(j, _mm256_set1_epi32(1)), _mm256_set1_epi32(~1));
+		__m256 y = _mm256_cvtepi32_ps(j);
+
+		// Sign flips and polynomial selection per lane
+		__m256 swapSignSin = _mm256_castsi256_ps(_mm256_slli_epi32(_mm256_and_si256(j, _mm256_set1_epi32(4)), 29));
+		__m256 signCos = _mm256_castsi256_ps(_mm256_slli_epi32(_mm256_andnot_si256(_mm256_sub_epi32(j, _mm256_set1_epi32(2)), _mm256_set1_epi32(4)), 29));
+		__m256 swap = _mm256_castsi256_ps(_mm256_cmpeq_epi32(_mm256_and_si256(j, _mm256_set1_epi32(2)), _mm256_set1_epi32(2)));
+		signSin = _mm256_xor_ps(signSin, swapSignSin);
+
+		x = _mm256_sub_ps(x, _mm256_mul_ps(y, _mm256_set1_ps(DP1)));
+		x = _mm256_sub_ps(x, _mm256_mul_ps(y, _mm256_set1_ps(DP2)));
+		x = _mm256_sub_ps(x, _mm256_mul_ps(y, _mm256_set1_ps(DP3)));
+		__m256 z = _mm256_mul_ps(x, x);
+
+		__m256 polyCos = _mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(CosC0), z), _mm256_set1_ps(CosC1));
+		polyCos = _mm256_add_ps(_mm256_mul_ps(polyCos, z), _mm256_set1_ps(CosC2));
+		polyCos = _mm256_mul_ps(_mm256_mul_ps(polyCos, z), z);
+		polyCos = _mm256_sub_ps(polyCos, _mm256_mul_ps(z, _mm256_set1_ps(0.5f)));
+		polyCos = _mm256_add_ps(polyCos, _mm256_set1_ps(1.0f));
+
+		__m256 polySin = _mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(SinC0), z), _mm256_set1_ps(SinC1));
+		polySin = _mm256_add_ps(_mm256_mul_ps(polySin, z), _mm256_set1_ps(SinC2));
+		polySin = _mm256_add_ps(_mm256_mul_ps(_mm256_mul_ps(polySin, z), x), x);
+
+		sine = _mm256_xor_ps(_mm256_blendv_ps(polySin, polyCos, swap), signSin);
+		cosine = _mm256_xor_ps(_mm256_blendv_ps(polyCos, polySin, swap), signCos);
+	}
+
+#endif
+
+	static SinCosStats measure(size_t count, float range = 100.0f, int runs = 10)
+	{
+		SinCosStats stats;
+		stats.angles = count;
+		stats.range = range;
+
+		std::vector<float> angles(count), sines(count), cosines(count);
+		for (size_t i = 0; i < count; i++)
+			angles[i] = -range + 2.0f * range * (float)i / (float)std::max<size_t>(count - 1, 1);
+
+		// The fastest of the runs, each result kept so the loops aren't optimised away
+		auto time = [&](auto body)
+		{
+			double best = INFINITY;
+			for (int run = 0; run < runs; run++)
+			{
+				auto begin = std::chrono::high_resolution_clock::now();
+				body();
+				best = std::min(best, std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - begin).count());
+
+				volatile float sink = sines[count / 2] + cosines[count / 3];
+				(void)sink;
+			}
+			return count / best;
+		};
+
+		stats.standardPerMs = time([&]()
+			{
+				for (size_t i = 0; i < count; i++)
+				{
+					sines[i] = std::sin(angles[i]);
+					cosines[i] = std::cos(angles[i]);
+				}
+			});
+
+		stats.scalarPerMs = time([&]()
+			{
+				for (size_t i = 0; i < count; i++)
+					sincos(angles[i], sines[i], cosines[i]);
+			});
+		for (size_t i = 0; i < count; i++)
+			stats.scalarMaxError = std::max(stats.scalarMaxError, maxError(angles[i], sines[i], cosines[i]));
+
+		stats.vectorPerMs = time([&]() { sincos(angles.data(), sines.data(), cosines.data(), count); });
+		for (size_t i = 0; i < count; i++)
+			stats.vectorMaxError = std::max(stats.vectorMaxError, maxError(angles[i], sines[i], cosines[i]));
+
+		return stats;
+	}
+
+#if defined(__AVX2__)
+	// a * b + c and c - a * b. FMA is a separate extension: MSVC's /arch:AVX2 implies it, but
+	// GCC and Clang only define __FMA__ with -mfma or -march, so plain -mavx2 gets mul and add.
+	static __m256 fmadd8(__m256 a, __m256 b, __m256 c)
+	{
+#if defined(__FMA__) || defined(_MSC_VER)
+		return _mm256_fmadd_ps(a, b, c);
+#else
+		return _mm256_add_ps(_mm256_mul_ps(a, b), c);
+#endif
+	}
+
+	static __m256 fnmadd8(__m256 a, __m256 b, __m256 c)
+	{
+#if defined(__FMA__) || defined(_MSC_VER)
+		return _mm256_fnmadd_ps(a, b, c);
+#else
+		return _mm256_sub_ps(c, _mm256_mul_ps(a, b));
+#endif
+	}
+
+	static __m128 fmadd4(__m128 a, __m128 b, __m128 c)
+	{
+#if defined(__FMA__) || defined(_MSC_VER)
+		return _mm_fmadd_ps(a, b, c);
+#else
+		return _mm_add_ps(_mm_mul_ps(a, b), c);
+#endif
+	}
+
+	// 1 / r^3 from r^2 for gravity, the rsqrt estimate refined once by Newton's method
+	static __m256 inverseCube8(__m256 r2)
+	{
+		__m256 y = _mm256_rsqrt_ps(r2);
+		y = _mm256_mul_ps(y, fnmadd8(_mm256_mul_ps(_mm256_set1_ps(0.5f), r2), _mm256_mul_ps(y, y), _mm256_set1_ps(1.5f)));
+		return _mm256_mul_ps(y, _mm256_mul_ps(y, y));
+	}
+#endif
+
+private:
+	static double maxError(float angle, float sine, float cosine)
+	{
+		return std::max(std::fabs(sine - std::sin((double)angle)), std::fabs(cosine - std::cos((double)angle)));
+	}
+
+	static constexpr float FourOverPi = 1.27323954473516f;
+
+	// pi/4 split in three parts for an exact reduction
+	static constexpr float DP1 = 0.78515625f;
+	static constexpr float DP2 = 2.4187564849853515625e-4f;
+	static constexpr float DP3 = 3.77489497744594108e-8f;
+
+	static constexpr float SinC0 = -1.9515295891e-4f;
+	static constexpr float SinC1 = 8.3321608736e-3f;
+	static constexpr float SinC2 = -1.6666654611e-1f;
+
+	static constexpr float CosC0 = 2.443315711809948e-5f;
+	static constexpr float CosC1 = -1.388731625493765e-3f;
+	static constexpr float CosC2 = 4.166664568298827e-2f;
+};
+
+#endif
@@ -0,0 +1,137 @@
+#ifndef SIMULATION_CLOCK_H
+#define SIMULATION_CLOCK_H
+
+#include <functional>
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+
+struct ClockStats
+{
+	int stepsLastFrame = 0;
+	double requestedWarp = 1.0;
+
+	// Scene seconds per wall second actually simulated, smoothed over frames
+	double achievedWarp = 1.0;
+
+	// Scene time given up to the per-frame budget instead of falling further behind
+	double droppedSeconds = 0.0;
+	double stepMs = 0.0;
+};
+
+// Fixed-step simulation time on integer ticks. Wall time times the warp fills an accumulator that
+// is drained in whole steps, so the state after n steps is the same whatever the frame times were.
+// High warps just mean more steps per frame, up to a CPU budget, after which the rest of the frame's
+// time is dropped rather than carried into the next one. What's left over in the accumulator is
+// how far to interpolate between the last two states.
+class SimulationClock
+{
+public:
+	// Scene microseconds, one scene second per wall second at 1x
+	static constexpr int64_t ticksPerSecond = 1000000;
+	static constexpr int64_t stepTicks = 8000;
+	static constexpr double maxWarp = 1e7;
+
+	static double seconds(int64_t ticks)
+	{
+		return (double)ticks / ticksPerSecond;
+	}
+
+	void setWarp(double newWarp)
+	{
+		warp = std::min(std::max(newWarp, 1.0), maxWarp);
+		stats.requestedWarp = warp;
+	}
+
+	double getWarp() const
+	{
+		return warp;
+	}
+
+	void setPaused(bool isPaused)
+	{
+		paused = isPaused;
+	}
+
+	void setFrameBudget(double milliseconds)
+	{
+		budgetMs = milliseconds;
+	}
+
+	// Runs the steps due after frameSeconds of wall time, step(ticks) brings the state to that time.
+	// Sources that need every step (integrations) get them all; ones that can jump to any time only
+	// get the last two, enough to interpolate between.
+	int tick(double frameSeconds, bool everyStep, const std::function<void(int64_t)>& step)
+	{
+		stats.stepsLastFrame = 0;
+		if (paused || frameSeconds <= 0.0)
+			return 0;
+
+		// A stall (a breakpoint, dragging the window) counts as one slow frame
+		frameSeconds = std::min(frameSeconds, 0.25);
+
+		pending += frameSeconds * warp * ticksPerSecond;
+		int64_t due = (int64_t)(pending / stepTicks);
+		pending -= (double)(due * stepTicks);
+
+		int64_t startTicks = ticks;
+		if (!everyStep && due > 2)
+		{
+			ticks += (due - 2) * stepTicks;
+			due = 2;
+		}
+
+		auto begin = std::chrono::high_resolution_clock::now();
+		int64_t steps = 0;
+		while (steps < due)
+		{
+			ticks += stepTicks;
+			step(ticks);
+			steps++;
+
+			double ms = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - begin).count();
+			if (ms > budgetMs && steps < due)
+			{
+				stats.droppedSeconds += seconds((due - steps) * stepTicks);
+				break;
+			}
+		}
+
+		stats.stepsLastFrame = (int)steps;
+		stats.stepMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - begin).count();
+		stats.achievedWarp += 0.05 * (seconds(ticks - startTicks) / frameSeconds - stats.achievedWarp);
+		return (int)steps;
+	}
+
+	int64_t getTicks() const
+	{
+		return ticks;
+	}
+
+	// Fraction of a step between the previous state and the current one
+	float alpha() const
+	{
+		return (float)(pending / stepTicks);
+	}
+
+	// The time shown when interpolating, a step behind the newest state
+	double renderSeconds() const
+	{
+		return seconds(ticks - stepTicks) + pending / ticksPerSecond;
+	}
+
+	const ClockStats& getStats() const
+	{
+		return stats;
+	}
+
+private:
+	int64_t ticks = 0;
+	double pending = 0.0;
+	double warp = 1.0;
+	double budgetMs = 8.0;
+	bool paused = false;
+	ClockStats stats;
+};
+
+#endif
@@ -0,0 +1,281 @@
+#ifndef SIMULATION_THREAD_H
+#define SIMULATION_THREAD_H
+
+#include <glm/glm.hpp>
+
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <algorithm>
+#include <cstdint>
+
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <sched.h>
+#endif
+
+#include "SolarSystem.h"
+#include "SimulationClock.h"
+#include "TripleBuffer.h"
+#include "SpscQueue.h"
+
+// Busy time of a thread over the last second, and the core it last ran on
+struct ThreadTiming
+{
+	double busyMsPerSecond = 0.0;
+	int core = -1;
+};
+
+// Everything the render thread needs from one simulation step
+struct SimulationState
+{
+	glm::dvec3 previous[SolarSystem::BodyCount];
+	glm::dvec3 current[SolarSystem::BodyCount];
+
+	// Clock at publication, to carry on interpolating until the next state arrives
+	int64_t ticks = 0;
+	float alpha = 0.0f;
+	double warp = 1.0;
+	bool paused = false;
+	std::chrono::steady_clock::time_point published;
+
+	SolarSystem::Source source = SolarSystem::Simulation;
+	double day = 0.0;
+
+	NBodyStats gravity;
+	EphemerisStats ephemeris;
+	size_t ephemerisBytes = 0;
+	ClockStats clock;
+	size_t theoryTerms = 0;
+	ThreadTiming timing;
+
+	// Interpolation fraction at the given wall time, past the published one
+	float alphaAt(std::chrono::steady_clock::time_point now) const
+	{
+		if (paused)
+			return alpha;
+
+		double elapsed = std::chrono::duration<double>(now - published).count();
+		double steps = alpha + elapsed * warp * SimulationClock::ticksPerSecond / SimulationClock::stepTicks;
+		return (float)std::min(steps, 1.0);
+	}
+
+	double renderSeconds(float atAlpha) const
+	{
+		return SimulationClock::seconds(ticks - SimulationClock::stepTicks) + SimulationClock::seconds(SimulationClock::stepTicks) * atAlpha;
+	}
+
+	glm::vec3 scenePosition(SolarSystem::Body body, float sceneDistance, float atAlpha) const
+	{
+		return SolarSystem::toScene(body, previous[body] + (current[body] - previous[body]) * (double)atAlpha, sceneDistance);
+	}
+};
+
+// Runs the solar system and its clock on a thread of its own. Settings come in through a queue the
+// render thread fills, states go out through a triple buffer the render thread reads, so neither
+// side ever waits for the other.
+class SimulationThread
+{
+public:
+	// Owns the system from here on, the render thread only sees published states
+	SimulationThread(SolarSystem& system) : solarSystem(system)
+	{
+		publish(std::chrono::steady_clock::now());
+		states.update();
+		worker = std::thread([this]() { run(); });
+	}
+
+	~SimulationThread()
+	{
+		running.store(false, std::memory_order_release);
+		worker.join();
+	}
+
+	// Render thread: settings are only sent when they change, and again later if the queue was full
+	void setWarp(double warp)
+	{
+		if (warp != sent.warp && commands.push({ Command::Warp, warp }))
+			sent.warp = warp;
+	}
+
+	void setPaused(bool paused)
+	{
+		if (paused != sent.paused && commands.push({ Command::Pause, paused ? 1.0 : 0.0 }))
+			sent.paused = paused;
+	}
+
+	void setSource(SolarSystem::Source source)
+	{
+		if (source != sent.source && commands.push({ Command::Source, (double)source }))
+			sent.source = source;
+	}
+
+	// -1, 0 or 1 decade per second through the ephemeris or the series
+	void setScrub(int direction)
+	{
+		if (direction != sent.scrub && commands.push({ Command::Scrub, (double)direction }))
+			sent.scrub = direction;
+	}
+
+	// Render thread: the newest state
+	const SimulationState& latest()
+	{
+		states.update();
+		return states.front();
+	}
+
+	// Simulation busy time so far, for measuring how much of it overlaps other threads
+	std::chrono::nanoseconds busyTime() const
+	{
+		return std::chrono::nanoseconds(busyNanoseconds.load(std::memory_order_acquire));
+	}
+
+	static int currentCore()
+	{
+#ifdef _WIN32
+		return (int)GetCurrentProcessorNumber();
+#else
+		return sched_getcpu();
+#endif
+	}
+
+private:
+	struct Command
+	{
+		enum Type { Warp, Pause, Source, Scrub } type;
+		double value;
+	};
+
+	struct Settings
+	{
+		double warp = 1.0;
+		bool paused = false;
+		SolarSystem::Source source = SolarSystem::Simulation;
+		int scrub = 0;
+	};
+
+	SolarSystem& solarSystem;
+	SimulationClock clock;
+
+	// Days ahead of the clock, kept when the simulation takes over so it carries on from the day shown
+	double scrubDays = 0.0;
+
+	Settings sent, applied;
+	SpscQueue<Command, 64> commands;
+	TripleBuffer<SimulationState> states;
+
+	std::atomic<bool> running{ true };
+	std::atomic<int64_t> busyNanoseconds{ 0 };
+	ThreadTiming timing;
+	std::thread worker;
+
+	void run()
+	{
+		auto last = std::chrono::steady_clock::now(), second = last;
+		double busySecond = 0.0;
+
+		while (running.load(std::memory_order_acquire))
+		{
+			auto begin = std::chrono::steady_clock::now();
+			double frameSeconds = std::chrono::duration<double>(begin - last).count();
+			last = begin;
+
+			bool changed = applyCommands();
+
+			double startDay, endDay;
+			bool jumps = solarSystem.scrubRange(startDay, endDay);
+			if (jumps && !applied.paused)
+			{
+				double day = SimulationClock::seconds(clock.getTicks()) * SolarSystem::daysPerSecond;
+				scrubDays += applied.scrub * frameSeconds * 3652.5;
+				scrubDays = std::min(std::max(day + scrubDays, startDay), endDay) - day;
+			}
+
+			int steps = clock.tick(frameSeconds, !jumps, [this](int64_t ticks)
+				{
+					solarSystem.update(SimulationClock::seconds(ticks) * SolarSystem::daysPerSecond + scrubDays);
+				});
+
+			if (steps > 0 || changed)
+				publish(std::chrono::steady_clock::now());
+
+			auto end = std::chrono::steady_clock::now();
+			busyNanoseconds.fetch_add(std::chrono::duration_cast<std::chrono::nanoseconds>(end - begin).count(), std::memory_order_acq_rel);
+			busySecond += std::chrono::duration<double, std::milli>(end - begin).count();
+			timing.core = currentCore();
+
+			if (end - second >= std::chrono::seconds(1))
+			{
+				timing.busyMsPerSecond = busySecond / std::chrono::duration<double>(end - second).count();
+				busySecond = 0.0;
+				second = end;
+			}
+
+			// Until about the next step, but often enough to pick up settings
+			double untilStep = (1.0 - clock.alpha()) * SimulationClock::stepTicks / (clock.getWarp() * SimulationClock::ticksPerSecond);
+			std::this_thread::sleep_for(std::chrono::duration<double>(std::min(std::max(untilStep, 0.0005), 0.004)));
+		}
+	}
+
+	bool applyCommands()
+	{
+		bool changed = false;
+		Command command;
+		while (commands.pop(command))
+		{
+			changed = true;
+			switch (command.type)
+			{
+			case Command::Warp:
+				applied.warp = command.value;
+				clock.setWarp(command.value);
+				break;
+			case Command::Pause:
+				applied.paused = command.value != 0.0;
+				clock.setPaused(applied.paused);
+				break;
+			case Command::Source:
+				applied.source = (SolarSystem::Source)(int)command.value;
+				solarSystem.setSource(applied.source);
+				break;
+			case Command::Scrub:
+				applied.scrub = (int)command.value;
+				break;
+			}
+		}
+
+		return changed;
+	}
+
+	void publish(std::chrono::steady_clock::time_point now)
+	{
+		SimulationState& state = states.back();
+		solarSystem.getPositions(state.previous, state.current);
+
+		state.ticks = clock.getTicks();
+		state.alpha = clock.alpha();
+		state.warp = clock.getWarp();
+		state.paused = applied.paused;
+		state.published = now;
+
+		state.source = solarSystem.getSource();
+		state.day = solarSystem.getDay();
+		state.gravity = solarSystem.getStats();
+		state.ephemeris = solarSystem.getEphemerisStats();
+		state.ephemerisBytes = solarSystem.getEphemeris().isOpen() ? solarSystem.getEphemeris().fileBytes() : 0;
+		state.clock = clock.getStats();
+		state.theoryTerms = solarSystem.getTheory().termCount();
+		state.timing = timing;
+
+		states.publish();
+	}
+};
+
+#endif
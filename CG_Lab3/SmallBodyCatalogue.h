@@ -0,0 +1,463 @@
+#ifndef SMALL_BODY_CATALOGUE_H
+#define SMALL_BODY_CATALOGUE_H
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <vector>
+#include <string>
+#include <fstream>
+#include <chrono>
+#include <random>
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cstdint>
+#include <cstddef>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+#include "MappedFile.h"
+#include "Kepler.h"
+#include "SceneScale.h"
+#include "Frustum.h"
+#include "JobSystem.h"
+
+struct CatalogueStats
+{
+	size_t objects = 0;
+	size_t fileBytes = 0;
+	double openMs = 0.0;
+
+	// Newest propagation and visibility pass
+	long long propagations = 0;
+	double propagateMs = 0.0;
+	double cullMs = 0.0;
+	size_t visible = 0;
+};
+
+struct CatalogueBenchmark
+{
+	size_t objects = 0;
+	size_t textBytes = 0;
+	size_t fileBytes = 0;
+	double importMs = 0.0;
+	double openMs = 0.0;
+	double firstPropagateMs = 0.0;			// touches every page of the mapping
+	double propagateMs = 0.0;
+	double positionsPerMs = 0.0;
+	double cullMs = 0.0;					// scene positions and culling, copying the visible ones out
+};
+
+// Asteroids and comets on Kepler orbits around the Sun, from a binary file that is the
+// propagator's own structure of arrays: opening it maps the file and points a KeplerArrays into
+// it, nothing is parsed or copied. The file is made once from the Minor Planet Center's text
+// catalogue (MPCORB.DAT) by import.
+// Days from J2000, positions heliocentric in the ecliptic (AU).
+class SmallBodyCatalogue
+{
+public:
+	static constexpr const char* file = "SmallBodies.cat";
+
+	// Fixed-width MPCORB lines to the binary file, sorted by eccentricity for the propagator.
+	// Header lines, unbound orbits and lines that don't parse are skipped. Returns the objects
+	// written, 0 when there were none or the file couldn't be written.
+	static size_t import(const char* textPath, const char* binaryPath, double gm)
+	{
+		std::ifstream in(textPath);
+		if (!in)
+			return 0;
+
+		KeplerPropagator propagator(gm);
+		std::string line;
+		OrbitalElements elements;
+		while (std::getline(in, line))
+		{
+			if (parseLine(line, elements))
+				propagator.add(elements);
+		}
+
+		if (propagator.size() == 0)
+			return 0;
+
+		KeplerArrays orbits = propagator.getArrays();
+		size_t padded = (orbits.count + 7) / 8 * 8;
+
+		// Line order of each object, in the file's order
+		std::vector<uint32_t> ids(padded, 0);
+		for (size_t i = 0; i < orbits.count; i++)
+			ids[i] = (uint32_t)propagator.getId(i);
+
+		Header header;
+		std::memcpy(header.magic, fileMagic, sizeof(header.magic));
+		header.version = fileVersion;
+		header.count = orbits.count;
+		header.gm = gm;
+
+		const void* arrays[arrayCount] = { orbits.meanMotion, orbits.phase, orbits.eccentricity, orbits.semiMajor, orbits.semiMinor,
+			orbits.px, orbits.py, orbits.pz, orbits.qx, orbits.qy, orbits.qz, orbits.blockIterations, ids.data() };
+
+		std::ofstream out(binaryPath, std::ios::binary);
+		if (!out)
+			return 0;
+
+		out.write((const char*)&header, sizeof(Header));
+		uint64_t written = sizeof(Header), offsets[arrayCount + 1];
+		layout(orbits.count, offsets);
+		const char zeros[arrayAlignment] = {};
+		for (int array = 0; array < arrayCount; array++)
+		{
+			out.write(zeros, offsets[array] - written);
+			out.write((const char*)arrays[array], arrayBytes(array, orbits.count));
+			written = offsets[array] + arrayBytes(array, orbits.count);
+		}
+
+		return out ? orbits.count : 0;
+	}
+
+	bool open(const char* path)
+	{
+		close();
+		auto begin = std::chrono::high_resolution_clock::now();
+
+		// Every frame reads it all from start to end
+		if (!mapped.open(path, true) || mapped.size() < sizeof(Header))
+		{
+			close();
+			return false;
+		}
+
+		Header header;
+		std::memcpy(&header, mapped.data(), sizeof(Header));
+		uint64_t offsets[arrayCount + 1];
+		layout(header.count, offsets);
+		if (std::memcmp(header.magic, fileMagic, sizeof(header.magic)) != 0 || header.version != fileVersion ||
+			header.count == 0 || mapped.size() < offsets[arrayCount])
+		{
+			close();
+			return false;
+		}
+
+		const unsigned char* base = mapped.data();
+		orbits.count = (size_t)header.count;
+		orbits.meanMotion = (const double*)(base + offsets[MeanMotion]);
+		orbits.phase = (const double*)(base + offsets[Phase]);
+		orbits.eccentricity = (const float*)(base + offsets[Eccentricity]);
+		orbits.semiMajor = (const float*)(base + offsets[SemiMajor]);
+		orbits.semiMinor = (const float*)(base + offsets[SemiMinor]);
+		orbits.px = (const float*)(base + offsets[Px]);
+		orbits.py = (const float*)(base + offsets[Py]);
+		orbits.pz = (const float*)(base + offsets[Pz]);
+		orbits.qx = (const float*)(base + offsets[Qx]);
+		orbits.qy = (const float*)(base + offsets[Qy]);
+		orbits.qz = (const float*)(base + offsets[Qz]);
+		orbits.blockIterations = (const int32_t*)(base + offsets[BlockIterations]);
+		ids = (const uint32_t*)(base + offsets[Ids]);
+
+		x.assign(orbits.count, 0.0f);
+		y.assign(orbits.count, 0.0f);
+		z.assign(orbits.count, 0.0f);
+		scene.assign(3 * orbits.count, 0.0f);
+
+		stats = CatalogueStats();
+		stats.objects = orbits.count;
+		stats.fileBytes = mapped.size();
+		stats.openMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - begin).count();
+		return true;
+	}
+
+	void close()
+	{
+		mapped.close();
+		orbits = KeplerArrays();
+		ids = nullptr;
+		x.clear(); y.clear(); z.clear(); scene.clear();
+		visibleCounts.assign(chunks, 0);
+	}
+
+	bool isOpen() const
+	{
+		return mapped.isOpen();
+	}
+
+	size_t size() const
+	{
+		return orbits.count;
+	}
+
+	// Line of the text catalogue the object at index i came from
+	size_t getId(size_t i) const
+	{
+		return ids[i];
+	}
+
+	// Every object's position at day, on the job system
+	void propagate(double day)
+	{
+		auto begin = std::chrono::high_resolution_clock::now();
+		KeplerPropagator::propagate(orbits, day, x.data(), y.data(), z.data());
+
+		stats.propagations++;
+		stats.propagateMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - begin).count();
+	}
+
+	// Scene positions of the propagated objects inside the frustum, kept until writeVisible.
+	// Returns how many there are.
+	size_t gatherVisible(const SceneScale& scale, const Frustum& frustum)
+	{
+		auto begin = std::chrono::high_resolution_clock::now();
+		size_t count = size();
+
+		// Fixed chunks compacted in place, so the order doesn't depend on the threads
+		visibleCounts.assign(chunks, 0);
+		JobSystem::instance().parallelFor(chunks, 1, [&](size_t firstChunk, size_t lastChunk)
+			{
+				for (size_t chunk = firstChunk; chunk < lastChunk; chunk++)
+				{
+					size_t first = count * chunk / chunks, last = count * (chunk + 1) / chunks;
+					float* kept = scene.data() + 3 * first;
+					size_t i = first;
+
+#if defined(__AVX2__)
+					for (; i + 8 <= last; i += 8)
+					{
+						__m256 px = _mm256_loadu_ps(&x[i]), py = _mm256_loadu_ps(&y[i]), pz = _mm256_loadu_ps(&z[i]);
+						__m256 factor = scale.factor8(px, py, pz);
+
+						// Ecliptic xyz to the scene's x, z, -y
+						alignas(32) float sx[8], sy[8], sz[8];
+						__m256 sceneX = _mm256_mul_ps(px, factor), sceneY = _mm256_mul_ps(pz, factor);
+						__m256 sceneZ = _mm256_sub_ps(_mm256_setzero_ps(), _mm256_mul_ps(py, factor));
+						int inside = _mm256_movemask_ps(frustum.containsPoints(sceneX, sceneY, sceneZ));
+						if (inside == 0)
+							continue;
+
+						_mm256_store_ps(sx, sceneX);
+						_mm256_store_ps(sy, sceneY);
+						_mm256_store_ps(sz, sceneZ);
+						for (int lane = 0; lane < 8; lane++)
+						{
+							kept[0] = sx[lane]; kept[1] = sy[lane]; kept[2] = sz[lane];
+							kept += 3 * ((inside >> lane) & 1);
+						}
+					}
+#endif
+
+					for (; i < last; i++)
+					{
+						float factor = scale.factor(x[i], y[i], z[i]);
+						glm::vec3 point(x[i] * factor, z[i] * factor, -y[i] * factor);
+						if (!frustum.intersects(point, 0.0f))
+							continue;
+
+						kept[0] = point.x; kept[1] = point.y; kept[2] = point.z;
+						kept += 3;
+					}
+					visibleCounts[chunk] = (size_t)(kept - (scene.data() + 3 * first)) / 3;
+				}
+			});
+
+		stats.visible = 0;
+		for (size_t chunk = 0; chunk < chunks; chunk++)
+			stats.visible += visibleCounts[chunk];
+
+		stats.cullMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - begin).count();
+		return stats.visible;
+	}
+
+	// The gathered positions, 3 floats each. Only written, so out can be a mapped buffer.
+	void writeVisible(float* out) const
+	{
+		size_t count = size();
+		for (size_t chunk = 0; chunk < visibleCounts.size(); chunk++)
+		{
+			size_t floats = 3 * visibleCounts[chunk];
+			std::memcpy(out, scene.data() + 3 * (count * chunk / chunks), floats * sizeof(float));
+			out += floats;
+		}
+	}
+
+	const CatalogueStats& getStats() const
+	{
+		return stats;
+	}
+
+	// count made-up objects written as MPCORB text, imported, mapped, propagated and culled from
+	// the default camera. The files are deleted afterwards; the text was just written, so the
+	// mapping is read from the page cache, not the disk.
+	static CatalogueBenchmark measure(size_t count, double gm)
+	{
+		const char* textPath = "CatalogueBenchmark.txt";
+		const char* binaryPath = "CatalogueBenchmark.cat";
+
+		CatalogueBenchmark result;
+		std::mt19937 random(11);
+		std::uniform_real_distribution<double> uniform(0.0, 1.0);
+		{
+			std::ofstream text(textPath);
+			text << "Made-up orbits in MPCORB.DAT's format\n" << std::string(160, '-') << "\n";
+
+			const char packed[] = "123456789ABCDEFGHIJKLMNOPQRSTUV";
+			char line[256];
+			for (size_t i = 0; i < count; i++)
+			{
+				char epoch[6] = { 'K', '2', (char)('0' + random() % 6), packed[random() % 12], packed[random() % 28], 0 };
+				double a = 1.8 + 3.5 * uniform(random) * uniform(random) + 0.5 * uniform(random);
+				std::snprintf(line, sizeof(line), "%07zu %5.2f %5.2f %5s %9.5f  %9.5f  %9.5f  %9.5f  %9.7f %11.8f %11.7f  0 MPO000000  1234  20 1993-2025 0.52 M-v 3Ek MPCLINUX   0000",
+					i % 10000000, 10.0 + 10.0 * uniform(random), 0.15, epoch, 360.0 * uniform(random), 360.0 * uniform(random), 360.0 * uniform(random),
+					30.0 * uniform(random) * uniform(random), 0.4 * uniform(random) * uniform(random), 0.9856076686 / std::pow(a, 1.5), a);
+				text << line << "\n";
+			}
+			result.textBytes = (size_t)text.tellp();
+		}
+
+		auto begin = std::chrono::high_resolution_clock::now();
+		result.objects = import(textPath, binaryPath, gm);
+		result.importMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - begin).count();
+
+		SmallBodyCatalogue catalogue;
+		if (result.objects > 0 && catalogue.open(binaryPath))
+		{
+			result.fileBytes = catalogue.getStats().fileBytes;
+			result.openMs = catalogue.getStats().openMs;
+
+			catalogue.propagate(9000.0);
+			result.firstPropagateMs = catalogue.getStats().propagateMs;
+
+			const int runs = 10;
+			for (int run = 0; run < runs; run++)
+			{
+				catalogue.propagate(9000.0 + run);
+				result.propagateMs += catalogue.getStats().propagateMs / runs;
+			}
+			result.positionsPerMs = result.objects / result.propagateMs;
+
+			SceneScale scale;
+			scale.setRadii({ { 1.0, 12.0 }, { 5.2, 19.5 } });
+			glm::mat4 projection = glm::perspective(glm::radians(45.0f), 800.0f / 600.0f, 0.1f, 100.0f);
+			Frustum frustum(projection * glm::lookAt(glm::vec3(0.0f, 7.0f, 0.0f), glm::vec3(0.0f, 7.0f, -1.0f), glm::vec3(0.0f, 1.0f, 0.0f)));
+			for (int run = 0; run < runs; run++)
+			{
+				catalogue.gatherVisible(scale, frustum);
+				result.cullMs += catalogue.getStats().cullMs / runs;
+			}
+		}
+
+		catalogue.close();
+		std::remove(textPath);
+		std::remove(binaryPath);
+		return result;
+	}
+
+private:
+	static constexpr char fileMagic[8] = { 'S', 'M', 'B', 'O', 'D', 'Y', 0, 0 };
+	static constexpr uint32_t fileVersion = 1;
+	static constexpr size_t arrayAlignment = 64;
+	static constexpr size_t chunks = 64;
+
+	struct Header
+	{
+		char magic[8] = {};
+		uint32_t version = 0;
+		uint32_t reserved = 0;
+		uint64_t count = 0;
+		double gm = 0.0;
+	};
+
+	// The arrays in file order, each padded to whole blocks of 8 and starting on a cache line
+	enum Array { MeanMotion, Phase, Eccentricity, SemiMajor, SemiMinor, Px, Py, Pz, Qx, Qy, Qz, BlockIterations, Ids, arrayCount };
+
+	MappedFile mapped;
+	KeplerArrays orbits;
+	const uint32_t* ids = nullptr;
+
+	// Newest positions, heliocentric then in the scene, and how many each chunk kept
+	std::vector<float> x, y, z, scene;
+	std::vector<size_t> visibleCounts;
+
+	CatalogueStats stats;
+
+	static uint64_t arrayBytes(int array, uint64_t count)
+	{
+		uint64_t padded = (count + 7) / 8 * 8;
+		if (array == MeanMotion || array == Phase)
+			return padded * sizeof(double);
+		if (array == BlockIterations)
+			return padded / 8 * sizeof(int32_t);
+		return padded * 4;
+	}
+
+	// Where each array starts, and the file's size as the last entry
+	static void layout(uint64_t count, uint64_t* offsets)
+	{
+		uint64_t offset = sizeof(Header);
+		for (int array = 0; array < arrayCount; array++)
+		{
+			offset = (offset + arrayAlignment - 1) / arrayAlignment * arrayAlignment;
+			offsets[array] = offset;
+			offset += arrayBytes(array, count);
+		}
+		offsets[arrayCount] = offset;
+	}
+
+	// Columns 27-103 of an MPCORB line: M, argument of perihelion, node and inclination in degrees
+	// for the J2000 ecliptic, e, n and a, with the packed epoch in 21-25
+	static bool parseLine(const std::string& line, OrbitalElements& elements)
+	{
+		if (line.size() < 103)
+			return false;
+
+		double day;
+		if (!packedEpoch(line.c_str() + 20, day))
+			return false;
+
+		const int columns[6][2] = { { 26, 9 }, { 37, 9 }, { 48, 9 }, { 59, 9 }, { 70, 9 }, { 92, 11 } };
+		double values[6];
+		for (int field = 0; field < 6; field++)
+		{
+			char text[16] = {};
+			std::memcpy(text, line.c_str() + columns[field][0], columns[field][1]);
+			char* end;
+			values[field] = std::strtod(text, &end);
+			if (end == text)
+				return false;
+		}
+
+		const double degrees = 3.14159265358979323846 / 180.0;
+		elements.meanAnomaly = values[0] * degrees;
+		elements.argumentOfPeriapsis = values[1] * degrees;
+		elements.ascendingNode = values[2] * degrees;
+		elements.inclination = values[3] * degrees;
+		elements.eccentricity = values[4];
+		elements.semiMajorAxis = values[5];
+		elements.epoch = day;
+
+		return elements.semiMajorAxis > 0.0 && elements.eccentricity >= 0.0 && elements.eccentricity < 1.0;
+	}
+
+	// MPC packed dates, K2555 is 2025 May 5.0 TT, as days from J2000
+	static bool packedEpoch(const char* packed, double& day)
+	{
+		auto digit = [](char c) { return c >= '1' && c <= '9' ? c - '0' : c >= 'A' && c <= 'V' ? c - 'A' + 10 : -1; };
+
+		int century = packed[0] == 'I' ? 18 : packed[0] == 'J' ? 19 : packed[0] == 'K' ? 20 : -1;
+		int month = digit(packed[3]), dayOfMonth = digit(packed[4]);
+		if (century < 0 || packed[1] < '0' || packed[1] > '9' || packed[2] < '0' || packed[2] > '9' || month < 1 || month > 12 || dayOfMonth < 1)
+			return false;
+
+		// Days from 1 March of year 0 of the proleptic Gregorian calendar
+		long long year = century * 100 + (packed[1] - '0') * 10 + (packed[2] - '0') - (month <= 2 ? 1 : 0);
+		long long shiftedMonth = (month + 9) % 12;
+		long long days = 365 * year + year / 4 - year / 100 + year / 400 + (153 * shiftedMonth + 2) / 5 + dayOfMonth - 1;
+
+		// 2000 January 1.5 is day 730425.5 of that count
+		day = (double)days - 730425.5;
+		return true;
+	}
+};
+
+#endif
@@ -0,0 +1,572 @@
+#ifndef SOLAR_SYSTEM_H
+#define SOLAR_SYSTEM_H
+
+#include <glm/glm.hpp>
+
+#include <vector>
+#include <algorithm>
+#include <chrono>
+#include <random>
+#include <cmath>
+
+#include "NBody.h"
+#include "Hermite.h"
+#include "WisdomHolman.h"
+#include "Kepler.h"
+#include "Ephemeris.h"
+#include "AnalyticalTheory.h"
+
+// The simulation's leapfrog against block-step Hermite through a comet's perihelion passages
+struct EncounterStats
+{
+	double years = 0.0;
+	double leapfrogMs = 0.0, hermiteMs = 0.0;
+	long long leapfrogSteps = 0;
+	double leapfrogEnergyDrift = 0.0, hermiteEnergyDrift = 0.0;
+	double leapfrogCometError = 0.0, hermiteCometError = 0.0;		// AU
+	HermiteStats hermite;
+};
+
+// Wisdom-Holman over a long run, with the simulation's leapfrog extrapolated from a short one
+struct LongRunStats
+{
+	double years = 0.0, stepDays = 0.0;
+	long long steps = 0;
+	double wisdomHolmanSeconds = 0.0;
+	double maxEnergyError = 0.0;			// relative, sampled every century
+	double leapfrogSeconds = 0.0;			// estimated for the same span
+};
+
+// The Sun, the planets and the Moon integrated with real masses and distances (AU, days), starting
+// from their J2000 mean orbital elements.
+// The scene isn't to scale, so positions are mapped onto it afterwards: every orbit is stretched
+// to the body's scene distance, keeping its direction and eccentricity.
+// Positions come from the integration, from a Chebyshev ephemeris fitted to it or from periodic
+// series of the drifting mean orbits. The last two can jump to any date.
+class SolarSystem
+{
+public:
+	enum Body { Sun, Mercury, Venus, Earth, Moon, Mars, Jupiter, Saturn, Uranus, Neptune, Pluto, BodyCount };
+	enum Source { Simulation, Tabulated, Analytical, SourceCount };
+
+	// Simulated days per scene second, one year takes as long as Earth's old 0.2 rad/s circle
+	static constexpr double daysPerSecond = 365.25 * 0.2 / 6.283185307179586;
+
+	static constexpr const char* ephemerisFile = "SolarSystem.eph";
+
+	// G * M of the Sun in AU^3 / day^2
+	static constexpr double gmSun = 2.9591220828559115e-4;
+
+	SolarSystem()
+	{
+		addBodies(simulation);
+		simulation.moveToBarycentre();
+		readSimulation();
+		std::copy(relative, relative + BodyCount, previous);
+
+		buildTheory(theory);
+		theory.truncate(theoryArcseconds);
+	}
+
+	// Positions at the given day after J2000
+	void update(double day)
+	{
+		currentDay = day;
+		std::copy(relative, relative + BodyCount, previous);
+
+		if (source != Simulation)
+		{
+			evaluate(source, day, relative);
+			return;
+		}
+
+		simulation.advanceTo(day, maxStepDays);
+		readSimulation();
+	}
+
+	bool openEphemeris(const char* path)
+	{
+		if (!ephemeris.open(path) || ephemeris.bodyCount() != BodyCount)
+		{
+			ephemeris.close();
+			source = Simulation;
+			return false;
+		}
+
+		return true;
+	}
+
+	const Ephemeris& getEphemeris() const
+	{
+		return ephemeris;
+	}
+
+	// Tabulated only works with an ephemeris open. The integration starts again from where the
+	// source being left has the bodies, rather than integrating over the days it was idle.
+	void setSource(Source newSource)
+	{
+		if (newSource == Tabulated && !ephemeris.isOpen())
+			newSource = Simulation;
+
+		if (newSource == Simulation && source != Simulation)
+			restartSimulation();
+		source = newSource;
+	}
+
+	Source getSource() const
+	{
+		return source;
+	}
+
+	double getDay() const
+	{
+		return currentDay;
+	}
+
+	// Days the current source can jump within, the simulation has to be integrated instead
+	bool scrubRange(double& startDay, double& endDay) const
+	{
+		if (source == Tabulated)
+		{
+			startDay = ephemeris.startDay();
+			endDay = ephemeris.endDay();
+			return true;
+		}
+
+		if (source == Analytical)
+		{
+			// Where the element rates were fitted
+			startDay = -200.0 * 365.25;
+			endDay = 50.0 * 365.25;
+			return true;
+		}
+
+		return false;
+	}
+
+	const AnalyticalTheory& getTheory() const
+	{
+		return theory;
+	}
+
+	// Full series of every body but the Sun, in Body order from Mercury
+	static void buildTheory(AnalyticalTheory& series)
+	{
+		for (int i = Mercury; i < BodyCount; i++)
+			series.addBody(getElements((Body)i), getRates((Body)i));
+	}
+
+	// Evaluations of all bodies per millisecond with the series truncated at the given accuracy,
+	// and how far from the full series they land, in arcseconds
+	static double measureTheory(double arcseconds, size_t count, size_t& terms, double& maxErrorArcseconds)
+	{
+		AnalyticalTheory full, truncated;
+		buildTheory(full);
+		buildTheory(truncated);
+		truncated.truncate(arcseconds);
+		terms = truncated.termCount();
+
+		std::mt19937 random(3);
+		std::uniform_real_distribution<double> uniform(-200.0 * 365.25, 50.0 * 365.25);
+		std::vector<double> days(count);
+		for (double& day : days)
+			day = uniform(random);
+
+		glm::dvec3 sum(0.0);
+		auto begin = std::chrono::high_resolution_clock::now();
+		for (double day : days)
+			for (size_t i = 0; i < truncated.size(); i++)
+				sum += truncated.position(i, day);
+		double ms = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - begin).count();
+
+		// Keeps the loop from being optimised away
+		volatile double sink = sum.x + sum.y + sum.z;
+		(void)sink;
+
+		maxErrorArcseconds = 0.0;
+		for (size_t d = 0; d < std::min<size_t>(count, 1000); d++)
+		{
+			for (size_t i = 0; i < truncated.size(); i++)
+			{
+				double error = glm::length(truncated.position(i, days[d]) - full.position(i, days[d]));
+				double scale = bodies[i + Mercury].semiMajorAxis * 3.14159265358979323846 / (180.0 * 3600.0);
+				maxErrorArcseconds = std::max(maxErrorArcseconds, error / scale);
+			}
+		}
+
+		return count / ms;
+	}
+
+	// Every body on its J2000 orbit around its parent, in Body order, into any integrator with
+	// addBody(gm, position, velocity) and getPosition/getVelocity
+	template<typename Integrator>
+	static void addBodies(Integrator& integrator)
+	{
+		std::vector<glm::dvec3> positions(BodyCount), velocities(BodyCount);
+		for (int i = 0; i < BodyCount; i++)
+		{
+			const Description& body = bodies[i];
+			double gm = gmSun / body.sunMassRatio;
+
+			glm::dvec3 position(0.0), velocity(0.0);
+			if (i != Sun)
+			{
+				// Elliptic orbit around the parent at J2000
+				double parentGm = gmSun / bodies[body.parent].sunMassRatio;
+				KeplerPropagator::stateVector(getElements((Body)i), parentGm + gm, 0.0, position, velocity);
+
+				position += positions[body.parent];
+				velocity += velocities[body.parent];
+			}
+
+			positions[i] = position;
+			velocities[i] = velocity;
+			integrator.addBody(gm, position, velocity);
+		}
+	}
+
+	// The bodies plus a massless comet with perihelion at 0.05 AU and a 5 year period, over years
+	// from aphelion: leapfrog with the simulation's fixed step against Hermite with block steps
+	// from a 1 day maximum. Errors are the comet's final distance from a Hermite run at a tenth
+	// of the accuracy parameter.
+	static EncounterStats measureEncounters(double years)
+	{
+		OrbitalElements comet = { 2.92, 0.983, 0.3, 1.0, 2.0, 3.14159265358979323846 };
+		double days = years * 365.25;
+
+		EncounterStats stats;
+		stats.years = years;
+
+		NBodySystem leapfrog;
+		addBodies(leapfrog);
+		size_t leapfrogComet = addComet(leapfrog, comet);
+
+		HermiteIntegrator hermite(1.0), reference(1.0, 0.002);
+		addBodies(hermite);
+		addBodies(reference);
+		size_t hermiteComet = addComet(hermite, comet);
+		addComet(reference, comet);
+
+		double leapfrogEnergy = leapfrog.totalEnergy();
+		auto begin = std::chrono::high_resolution_clock::now();
+		leapfrog.advanceTo(days, maxStepDays);
+		stats.leapfrogMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - begin).count();
+		stats.leapfrogSteps = leapfrog.getStats().steps;
+		stats.leapfrogEnergyDrift = std::fabs((leapfrog.totalEnergy() - leapfrogEnergy) / leapfrogEnergy);
+
+		hermite.advanceTo(0.0);
+		double hermiteEnergy = hermite.totalEnergy();
+		begin = std::chrono::high_resolution_clock::now();
+		hermite.advanceTo(days);
+		stats.hermiteMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - begin).count();
+		stats.hermiteEnergyDrift = std::fabs((hermite.totalEnergy() - hermiteEnergy) / hermiteEnergy);
+		stats.hermite = hermite.getStats();
+
+		reference.advanceTo(days);
+		glm::dvec3 truth = reference.getPosition(hermiteComet) - reference.getPosition(Sun);
+		stats.leapfrogCometError = glm::length(leapfrog.getPosition(leapfrogComet) - leapfrog.getPosition(Sun) - truth);
+		stats.hermiteCometError = glm::length(hermite.getPosition(hermiteComet) - hermite.getPosition(Sun) - truth);
+		return stats;
+	}
+
+	// The Sun and the planets with the Earth and the Moon as their barycentre, which the mapping
+	// needs since the Moon's orbit is far shorter than any step, over years
+	static LongRunStats measureLongRun(double years, double stepDays)
+	{
+		struct Bodies
+		{
+			double gm[BodyCount];
+			glm::dvec3 positions[BodyCount], velocities[BodyCount];
+			size_t count = 0;
+
+			size_t addBody(double bodyGm, glm::dvec3 position, glm::dvec3 velocity)
+			{
+				gm[count] = bodyGm;
+				positions[count] = position;
+				velocities[count] = velocity;
+				return count++;
+			}
+		} bodyList;
+		addBodies(bodyList);
+
+		WisdomHolmanIntegrator integrator;
+		for (int i = 0; i < BodyCount; i++)
+		{
+			if (i == Moon)
+				continue;
+
+			double gm = bodyList.gm[i];
+			glm::dvec3 position = bodyList.positions[i], velocity = bodyList.velocities[i];
+			if (i == Earth)
+			{
+				gm += bodyList.gm[Moon];
+				position = (bodyList.gm[Earth] * position + bodyList.gm[Moon] * bodyList.positions[Moon]) / gm;
+				velocity = (bodyList.gm[Earth] * velocity + bodyList.gm[Moon] * bodyList.velocities[Moon]) / gm;
+			}
+			integrator.addBody(gm, position, velocity);
+		}
+
+		LongRunStats stats;
+		stats.years = years;
+		stats.stepDays = stepDays;
+
+		double initialEnergy = integrator.totalEnergy();
+		auto begin = std::chrono::high_resolution_clock::now();
+		for (double century = 100.0; century <= years; century += 100.0)
+		{
+			integrator.advanceTo(century * 365.25, stepDays);
+			stats.maxEnergyError = std::max(stats.maxEnergyError, std::fabs((integrator.totalEnergy() - initialEnergy) / initialEnergy));
+		}
+		integrator.advanceTo(years * 365.25, stepDays);
+		stats.wisdomHolmanSeconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - begin).count();
+		stats.steps = (long long)std::ceil(years * 365.25 / stepDays);
+
+		SolarSystem leapfrog;
+		begin = std::chrono::high_resolution_clock::now();
+		leapfrog.simulation.advanceTo(10.0 * 365.25, maxStepDays);
+		stats.leapfrogSeconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - begin).count() * years / 10.0;
+		return stats;
+	}
+
+	// Integrates from J2000 back to startDay, then forward to endDay, and writes the fit
+	static bool writeEphemeris(const char* path, double startDay, double endDay)
+	{
+		std::vector<EphemerisLayout> layout(BodyCount);
+		for (int i = 0; i < BodyCount; i++)
+		{
+			// The Sun is kept relative to the barycentre
+			layout[i] = { i == Sun ? -1 : (int)bodies[i].parent, bodies[i].segmentDays, bodies[i].coefficientCount };
+		}
+
+		SolarSystem integration;
+		integration.simulation.advanceTo(startDay, integration.maxStepDays);
+
+		return Ephemeris::write(path, startDay, endDay, layout, [&integration](double day, glm::dvec3* positions)
+			{
+				integration.update(day);
+				for (int i = 0; i < BodyCount; i++)
+					positions[i] = integration.relative[i];
+			});
+	}
+
+	// Position in the scene's ecliptic relative to the parent body (the Sun for planets),
+	// with the semi-major axis mapped to sceneDistance. alpha goes from the previous update to the last.
+	glm::vec3 scenePosition(Body body, float sceneDistance, float alpha = 1.0f) const
+	{
+		return toScene(body, previous[body] + (relative[body] - previous[body]) * (double)alpha, sceneDistance);
+	}
+
+	// G * M in AU^3 / day^2
+	static double gmOf(Body body)
+	{
+		return gmSun / bodies[body].sunMassRatio;
+	}
+
+	static Body parentOf(Body body)
+	{
+		return bodies[body].parent;
+	}
+
+	// Maps a position relative to the parent (AU) onto the scene
+	static glm::vec3 toScene(Body body, const glm::dvec3& relative, float sceneDistance)
+	{
+		if (body == Sun)
+			return glm::vec3(0.0f);
+
+		return glm::vec3(relative * (sceneDistance / bodies[body].semiMajorAxis));
+	}
+
+	// The last two positions relative to the parents, in AU
+	void getPositions(glm::dvec3* previousPositions, glm::dvec3* positions) const
+	{
+		std::copy(previous, previous + BodyCount, previousPositions);
+		std::copy(relative, relative + BodyCount, positions);
+	}
+
+	const NBodyStats& getStats()
+	{
+		return simulation.getStats();
+	}
+
+	const EphemerisStats& getEphemerisStats() const
+	{
+		return ephemeris.getStats();
+	}
+
+	// Maps the unit circle of the xy plane onto the body's J2000 orbit in the scene, for drawing it
+	static glm::mat4 orbitEllipse(Body body, float sceneDistance)
+	{
+		OrbitalElements elements = getElements(body);
+		glm::dvec3 p, q;
+		KeplerPropagator::perifocalAxes(elements, p, q);
+
+		double e = elements.eccentricity;
+		glm::dvec3 major = p * (double)sceneDistance, minor = q * (sceneDistance * std::sqrt(1.0 - e * e));
+		glm::dvec3 normal = glm::cross(p, q) * (double)sceneDistance;
+
+		// The Sun sits at a focus
+		glm::dvec3 center = -e * major;
+
+		return glm::mat4(glm::vec4(glm::vec3(major), 0.0f), glm::vec4(glm::vec3(minor), 0.0f),
+			glm::vec4(glm::vec3(normal), 0.0f), glm::vec4(glm::vec3(center), 1.0f));
+	}
+
+	// Drift of the mean elements per Julian century, in the ecliptic frame
+	static OrbitalElements getRates(Body body)
+	{
+		const double degrees = 3.14159265358979323846 / 180.0;
+		const Rates& d = rates[body];
+
+		OrbitalElements elements;
+		elements.semiMajorAxis = d.semiMajorAxis;
+		elements.eccentricity = d.eccentricity;
+		elements.inclination = d.inclination * degrees;
+		elements.ascendingNode = d.ascendingNode * degrees;
+		elements.argumentOfPeriapsis = (d.longitudeOfPerihelion - d.ascendingNode) * degrees;
+		elements.meanAnomaly = (d.meanLongitude - d.longitudeOfPerihelion) * degrees;
+		return elements;
+	}
+
+	// Mean elements at J2000 relative to the parent, in the ecliptic frame
+	static OrbitalElements getElements(Body body)
+	{
+		const double degrees = 3.14159265358979323846 / 180.0;
+		const Description& d = bodies[body];
+
+		OrbitalElements elements;
+		elements.semiMajorAxis = d.semiMajorAxis;
+		elements.eccentricity = d.eccentricity;
+		elements.inclination = d.inclination * degrees;
+		elements.ascendingNode = d.ascendingNode * degrees;
+		elements.argumentOfPeriapsis = (d.longitudeOfPerihelion - d.ascendingNode) * degrees;
+		elements.meanAnomaly = (d.meanLongitude - d.longitudeOfPerihelion) * degrees;
+		return elements;
+	}
+
+private:
+	struct Description
+	{
+		double sunMassRatio;	// M_sun / M
+		Body parent;
+
+		// AU around the parent, and degrees
+		double semiMajorAxis, eccentricity, inclination;
+		double meanLongitude, longitudeOfPerihelion, ascendingNode;
+
+		// Chebyshev segments, shorter and with more terms for faster curving orbits
+		double segmentDays;
+		unsigned int coefficientCount;
+	};
+
+	struct Rates
+	{
+		// AU and degrees per Julian century
+		double semiMajorAxis, eccentricity, inclination;
+		double meanLongitude, longitudeOfPerihelion, ascendingNode;
+	};
+
+	// The Moon takes about 550 steps per orbit
+	static constexpr double maxStepDays = 0.05;
+
+	// Planets from Standish's J2000 mean elements (Earth uses the Earth-Moon barycentre),
+	// the Moon's are geocentric mean elements at J2000
+	static constexpr Description bodies[BodyCount] = {
+		{ 1.0, Sun, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 32.0, 10 },
+		{ 6023600.0, Sun, 0.38709927, 0.20563593, 7.00497902, 252.25032350, 77.45779628, 48.33076593, 8.0, 12 },
+		{ 408523.71, Sun, 0.72333566, 0.00677672, 3.39467605, 181.97909950, 131.60246718, 76.67984255, 16.0, 10 },
+		{ 332946.05, Sun, 1.00000261, 0.01671123, -0.00001531, 100.46457166, 102.93768193, 0.0, 16.0, 12 },
+		{ 332946.05 * 81.3006, Earth, 0.00256955, 0.0549, 5.145, 218.32, 83.35, 125.08, 4.0, 12 },
+		{ 3098708.0, Sun, 1.52371034, 0.09339410, 1.84969142, -4.55343205, -23.94362959, 49.55953891, 32.0, 10 },
+		{ 1047.3486, Sun, 5.20288700, 0.04838624, 1.30439695, 34.39644051, 14.72847983, 100.47390909, 64.0, 8 },
+		{ 3497.898, Sun, 9.53667594, 0.05386179, 2.48599187, 49.95424423, 92.59887831, 113.66242448, 64.0, 8 },
+		{ 22902.98, Sun, 19.18916464, 0.04725744, 0.77263783, 313.23810451, 170.95427630, 74.01692503, 64.0, 6 },
+		{ 19412.24, Sun, 30.06992276, 0.00859048, 1.77004347, -55.12002969, 44.96476227, 131.78422574, 64.0, 6 },
+		{ 1.352e8, Sun, 39.48211675, 0.24882730, 17.14001206, 238.92903833, 224.06891629, 110.30393684, 64.0, 6 } };
+
+	// Standish's rates for 1800-2050, the Moon's perigee and node turn in 8.85 and 18.6 years
+	static constexpr Rates rates[BodyCount] = {
+		{ 0.0, 0.0, 0.0, 0.0, 0.0, 0.0 },
+		{ 0.00000037, 0.00001906, -0.00594749, 149472.67411175, 0.16047689, -0.12534081 },
+		{ 0.00000390, -0.00004107, -0.00078890, 58517.81538729, 0.00268329, -0.27769418 },
+		{ 0.00000562, -0.00004392, -0.01294668, 35999.37244981, 0.32327364, 0.0 },
+		{ 0.0, 0.0, 0.0, 481267.88123, 4069.0137, -1934.136 },
+		{ 0.00001847, 0.00007882, -0.00813131, 19140.30268499, 0.44441088, -0.29257343 },
+		{ -0.00011607, -0.00013253, -0.00183714, 3034.74612775, 0.21252668, 0.20469106 },
+		{ -0.00125060, -0.00050991, 0.00193609, 1222.49362201, -0.41897216, -0.28867794 },
+		{ -0.00196176, -0.00004397, -0.00242939, 428.48202785, 0.40805281, 0.04240589 },
+		{ 0.00026291, 0.00005105, 0.00035372, 218.45945325, -0.32241464, -0.00508664 },
+		{ -0.00031596, 0.00005170, 0.00004818, 145.20780515, -0.04062942, -0.01183482 } };
+
+	// Accuracy the series are truncated to
+	const double theoryArcseconds = 1.0;
+
+	NBodySystem simulation;
+	Ephemeris ephemeris;
+	AnalyticalTheory theory;
+	Source source = Simulation;
+	double currentDay = 0.0;
+
+	// Last two positions relative to the parents (the barycentre for the Sun), in AU
+	glm::dvec3 relative[BodyCount];
+	glm::dvec3 previous[BodyCount];
+
+	// A massless body around the Sun, returns its index
+	template<typename Integrator>
+	static size_t addComet(Integrator& integrator, const OrbitalElements& elements)
+	{
+		glm::dvec3 position, velocity;
+		KeplerPropagator::stateVector(elements, gmSun, 0.0, position, velocity);
+		return integrator.addBody(0.0, position + integrator.getPosition(Sun), velocity + integrator.getVelocity(Sun));
+	}
+
+	// Positions relative to the parents from the ephemeris or the series
+	void evaluate(Source from, double day, glm::dvec3* positions)
+	{
+		if (from == Tabulated)
+		{
+			for (int i = 0; i < BodyCount; i++)
+				ephemeris.evaluate(i, day, positions[i]);
+			return;
+		}
+
+		positions[Sun] = glm::dvec3(0.0);
+		for (int i = Mercury; i < BodyCount; i++)
+			positions[i] = theory.position(i - Mercury, day);
+	}
+
+	// States at the current day from the current source, velocities by central differences
+	void restartSimulation()
+	{
+		const double h = 0.01;
+		glm::dvec3 positions[BodyCount], before[BodyCount], after[BodyCount], velocities[BodyCount];
+		evaluate(source, currentDay, positions);
+		evaluate(source, currentDay - h, before);
+		evaluate(source, currentDay + h, after);
+
+		for (int i = 0; i < BodyCount; i++)
+		{
+			velocities[i] = (after[i] - before[i]) / (2.0 * h);
+			if (i != Sun)
+			{
+				positions[i] += positions[bodies[i].parent];
+				velocities[i] += velocities[bodies[i].parent];
+			}
+		}
+
+		simulation.reset(currentDay, positions, velocities);
+		simulation.moveToBarycentre();
+		readSimulation();
+	}
+
+	void readSimulation()
+	{
+		for (int i = 0; i < BodyCount; i++)
+		{
+			relative[i] = simulation.getPosition(i);
+			if (i != Sun)
+				relative[i] -= simulation.getPosition(bodies[i].parent);
+		}
+	}
+};
+
+#endif
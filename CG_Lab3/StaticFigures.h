@@ -0,0 +1,230 @@
+#ifndef STATIC_FIGURES_H
+#define STATIC_FIGURES_H
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+#include "Figures.h"
+#include "MeshOptimizer.h"
+
+// Trigonometry and quantization usable in constant expressions
+class ConstexprMath
+{
+public:
+	static constexpr double wrap(double x)
+	{
+		while (x > PI) x -= 2.0 * PI;
+		while (x < -PI) x += 2.0 * PI;
+		return x;
+	}
+
+	// Taylor series on [-pi, pi], the first dropped term is below 1e-9
+	static constexpr double sin(double x)
+	{
+		x = wrap(x);
+		double term = x, sum = x;
+		for (int n = 1; n < 12; n++)
+		{
+			term *= -x * x / ((2.0 * n) * (2.0 * n + 1.0));
+			sum += term;
+		}
+		return sum;
+	}
+
+	static constexpr double cos(double x)
+	{
+		x = wrap(x);
+		double term = 1.0, sum = 1.0;
+		for (int n = 1; n < 12; n++)
+		{
+			term *= -x * x / ((2.0 * n - 1.0) * (2.0 * n));
+			sum += term;
+		}
+		return sum;
+	}
+
+	static constexpr double abs(double x)
+	{
+		return x < 0.0 ? -x : x;
+	}
+
+	static constexpr int16_t snorm16(double value)
+	{
+		value = value < -1.0 ? -1.0 : (value > 1.0 ? 1.0 : value);
+		return (int16_t)(value * 32767.0 + (value >= 0.0 ? 0.5 : -0.5));
+	}
+
+	static constexpr uint16_t unorm16(double value)
+	{
+		value = value < 0.0 ? 0.0 : (value > 1.0 ? 1.0 : value);
+		return (uint16_t)(value * 65535.0 + 0.5);
+	}
+
+	// Same mapping as MeshOptimizer::octEncode
+	static constexpr void octEncode(double x, double y, double z, int16_t* out)
+	{
+		double invL1 = 1.0 / (abs(x) + abs(y) + abs(z));
+		double u = x * invL1, v = y * invL1;
+
+		if (z < 0.0)
+		{
+			double foldedU = (1.0 - abs(v)) * (u >= 0.0 ? 1.0 : -1.0);
+			double foldedV = (1.0 - abs(u)) * (v >= 0.0 ? 1.0 : -1.0);
+			u = foldedU;
+			v = foldedV;
+		}
+
+		out[0] = snorm16(u);
+		out[1] = snorm16(v);
+	}
+};
+
+// Triangles are emitted in bands this many quads wide, row by row down each band: the two rows of
+// vertices a band touches fit the 16-entry FIFO MeshOptimizer::computeACMR models, so every vertex
+// is transformed about once per band edge without running the optimiser at startup
+constexpr int staticCacheBand = 7;
+
+// Unit Sphere with a resolution known at compile time, already in the packed vertex format.
+// Same vertices as Sphere(1.0f, Sectors, Stacks) and the same triangles in cache order
+template<int Sectors, int Stacks>
+struct StaticSphere
+{
+	static constexpr size_t vertexCount = (size_t)(Sectors + 1) * (Stacks + 1);
+	static constexpr size_t indexCount = Stacks > 1 ? (size_t)Sectors * (2 * Stacks - 2) * 3 : 0;
+
+	static_assert(vertexCount <= 65536, "StaticSphere needs to fit 16-bit indices");
+
+	std::array<PackedSphereVertex, vertexCount> vertices;
+	std::array<uint16_t, indexCount> indices;
+
+	constexpr StaticSphere() : vertices(), indices()
+	{
+		std::array<double, Sectors + 1> sectorSin{}, sectorCos{};
+		for (int j = 0; j <= Sectors; j++)
+		{
+			double sectorAngle = j * 2.0 * PI / Sectors;
+			sectorSin[j] = ConstexprMath::sin(sectorAngle);
+			sectorCos[j] = ConstexprMath::cos(sectorAngle);
+		}
+
+		size_t v = 0;
+		for (int i = 0; i <= Stacks; i++)
+		{
+			double stackAngle = PI / 2.0 - i * PI / Stacks; // starting from pi/2 to -pi/2
+			double nxy = ConstexprMath::cos(stackAngle);
+			double nz = ConstexprMath::sin(stackAngle);
+
+			for (int j = 0; j <= Sectors; j++, v++)
+			{
+				double nx = nxy * sectorCos[j];
+				double ny = nxy * sectorSin[j];
+
+				PackedSphereVertex& out = vertices[v];
+				out.position[0] = ConstexprMath::snorm16(nx);
+				out.position[1] = ConstexprMath::snorm16(ny);
+				out.position[2] = ConstexprMath::snorm16(nz);
+				out.position[3] = 0;
+
+				ConstexprMath::octEncode(nx, ny, nz, out.normal);
+
+				out.texCoord[0] = ConstexprMath::unorm16((double)j / Sectors);
+				out.texCoord[1] = ConstexprMath::unorm16((double)i / Stacks);
+			}
+		}
+
+		size_t k = 0;
+		for (int band = 0; band < Sectors; band += staticCacheBand)
+		{
+			for (int i = 0; i < Stacks; i++)
+			{
+				for (int j = band; j < Sectors && j < band + staticCacheBand; j++)
+				{
+					int k1 = i * (Sectors + 1) + j;
+					int k2 = k1 + Sectors + 1;
+
+					if (i != 0)
+					{
+						indices[k++] = (uint16_t)k1;
+						indices[k++] = (uint16_t)k2;
+						indices[k++] = (uint16_t)(k1 + 1);
+					}
+
+					if (i != Stacks - 1)
+					{
+						indices[k++] = (uint16_t)(k1 + 1);
+						indices[k++] = (uint16_t)k2;
+						indices[k++] = (uint16_t)(k2 + 1);
+					}
+				}
+			}
+		}
+	}
+};
+
+// Unit-centerline Torus in the packed vertex format, same vertices as Torus(1.0f, r, Sides, Rings)
+// and the same triangles in cache order
+template<int Sides, int Rings>
+struct StaticTorus
+{
+	static constexpr size_t vertexCount = (size_t)(Rings + 1) * (Sides + 1);
+	static constexpr size_t indexCount = (size_t)Rings * Sides * 6;
+
+	static_assert(vertexCount <= 65536, "StaticTorus needs to fit 16-bit indices");
+
+	std::array<PackedTorusVertex, vertexCount> vertices;
+	std::array<uint16_t, indexCount> indices;
+
+	constexpr StaticTorus() : vertices(), indices()
+	{
+		std::array<double, Sides + 1> sideSin{}, sideCos{};
+		for (int side = 0; side <= Sides; side++)
+		{
+			double v = side * 2.0 * PI / Sides;
+			sideSin[side] = ConstexprMath::sin(v);
+			sideCos[side] = ConstexprMath::cos(v);
+		}
+
+		size_t n = 0;
+		for (int ring = 0; ring <= Rings; ring++)
+		{
+			double u = ring * 2.0 * PI / Rings;
+			double cosU = ConstexprMath::cos(u);
+			double sinU = ConstexprMath::sin(u);
+
+			for (int side = 0; side <= Sides; side++, n++)
+			{
+				PackedTorusVertex& out = vertices[n];
+				out.position[0] = ConstexprMath::snorm16(cosU);
+				out.position[1] = ConstexprMath::snorm16(sinU);
+				out.position[2] = 0;
+				out.position[3] = 0;
+
+				ConstexprMath::octEncode(sideCos[side] * cosU, sideCos[side] * sinU, sideSin[side], out.tube);
+			}
+		}
+
+		size_t k = 0;
+		for (int band = 0; band < Sides; band += staticCacheBand)
+		{
+			for (int ring = 0; ring < Rings; ring++)
+			{
+				int ringStart = ring * (Sides + 1);
+				int nextRingStart = (ring + 1) * (Sides + 1);
+
+				for (int side = band; side < Sides && side < band + staticCacheBand; side++)
+				{
+					indices[k++] = (uint16_t)(ringStart + side);
+					indices[k++] = (uint16_t)(nextRingStart + side);
+					indices[k++] = (uint16_t)(ringStart + side + 1);
+
+					indices[k++] = (uint16_t)(ringStart + side + 1);
+					indices[k++] = (uint16_t)(nextRingStart + side);
+					indices[k++] = (uint16_t)(nextRingStart + side + 1);
+				}
+			}
+		}
+	}
+};
+
+#endif
@@ -0,0 +1,542 @@
+#ifndef TERRAIN_H
+#define TERRAIN_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <vector>
+#include <algorithm>
+#include <memory>
+#include <functional>
+#include <unordered_map>
+#include <mutex>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <iostream>
+
+#include "Texture.h"
+#include "JobSystem.h"
+
+#define PI 3.14159265358979323846
+
+// Greyscale height source sampled by longitude/latitude, same mapping as the Sphere texture coordinates
+class Heightmap
+{
+public:
+	Heightmap(const char* path)
+	{
+		int channels;
+		unsigned char* data = stbi_load(path, &width, &height, &channels, 1);
+		if (data)
+		{
+			pixels.assign(data, data + width * height);
+		}
+		else
+		{
+			std::cerr << "Failed to load heightmap at path: " << path << std::endl;
+			width = height = 0;
+		}
+		stbi_image_free(data);
+	}
+
+	// Returns height in [0, 1] for a unit direction (z is the pole axis)
+	float sample(const glm::vec3& dir) const
+	{
+		if (pixels.empty())
+			return 0.5f;
+
+		float s = atan2f(dir.y, dir.x) / (2.0f * PI);
+		if (s < 0.0f) s += 1.0f;
+		float t = acosf(fmaxf(-1.0f, fminf(1.0f, dir.z))) / PI;
+
+		float x = s * width - 0.5f;
+		float y = t * (height - 1);
+
+		int x0 = (int)floorf(x), y0 = (int)floorf(y);
+		float fx = x - x0, fy = y - y0;
+
+		float h00 = texel(x0, y0), h10 = texel(x0 + 1, y0);
+		float h01 = texel(x0, y0 + 1), h11 = texel(x0 + 1, y0 + 1);
+
+		return ((h00 * (1 - fx) + h10 * fx) * (1 - fy) + (h01 * (1 - fx) + h11 * fx) * fy) / 255.0f;
+	}
+
+private:
+	int width, height;
+	std::vector<unsigned char> pixels;
+
+	float texel(int x, int y) const
+	{
+		x = ((x % width) + width) % width;		// wrap around longitude
+		y = y < 0 ? 0 : (y >= height ? height - 1 : y);	// clamp at the poles
+		return pixels[y * width + x];
+	}
+};
+
+struct TerrainStats
+{
+	int visibleChunks = 0;
+	int loadedChunks = 0;
+	int pendingChunks = 0;
+	int uploadsLastFrame = 0;
+	double avgGenerationMs = 0.0;	// time spent building one chunk on a worker
+	double avgLatencyMs = 0.0;		// time from request until the chunk is drawable
+	double maxLatencyMs = 0.0;
+};
+
+// Cube-sphere quadtree terrain. Every face of a cube is recursively split into chunks
+// until the projected vertex spacing drops below pixelError, chunks are displaced by a heightmap
+// and get skirts along their edges so neighbours at different levels don't show cracks
+class Terrain
+{
+public:
+	Terrain(float radius, const char* heightmapPath, float heightScale, int chunkResolution = 17, int maxDepth = 12)
+		: radius(radius), heightScale(heightScale), resolution(chunkResolution), maxDepth(maxDepth),
+		shared(std::make_shared<SharedState>(heightmapPath))
+	{
+		setupIndices();
+
+		for (int face = 0; face < 6; face++)
+			requestChunk(nodeKey(face, 0, 0, 0), getNode(face, 0, 0, 0));
+	}
+
+	// cameraLocal is the camera position in the planet's model space
+	void update(const glm::vec3& cameraLocal, float viewportHeight, float fovY)
+	{
+		frame++;
+		pixelsPerRadian = viewportHeight / (2.0f * tanf(fovY * 0.5f));
+
+		uploadFinishedChunks();
+
+		visible.clear();
+		for (int face = 0; face < 6; face++)
+			visit(nodeKey(face, 0, 0, 0), cameraLocal);
+
+		pruneUnused();
+
+		stats.visibleChunks = (int)visible.size();
+		stats.pendingChunks = pendingCount;
+	}
+
+	// True once every root chunk has been generated, until then the planet draws its regular sphere
+	bool isReady() const
+	{
+		return readyRoots == 6;
+	}
+
+	void render()
+	{
+		for (const Node* node : visible)
+		{
+			glBindVertexArray(node->VAO);
+			glDrawElements(GL_TRIANGLES, (GLsizei)indexCount, GL_UNSIGNED_SHORT, 0);
+		}
+		glBindVertexArray(0);
+	}
+
+	const TerrainStats& getStats() const
+	{
+		return stats;
+	}
+
+	// Milliseconds to build count level 4 chunks spread over the faces, on the job system like
+	// the background builds but waited for
+	static double measureGeneration(const char* heightmapPath, int count, int chunkResolution = 17)
+	{
+		Heightmap heightmap(heightmapPath);
+
+		auto begin = std::chrono::high_resolution_clock::now();
+		JobSystem::instance().parallelFor((size_t)count, 1, [&](size_t first, size_t last)
+			{
+				std::vector<float> vertices;
+				for (size_t i = first; i < last; i++)
+					buildChunk(heightmap, 1.0f, 0.02f, chunkResolution, (int)(i % 6), 4, (int)(i / 6 % 16), (int)(i / 96 % 16), vertices);
+			});
+		return std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - begin).count();
+	}
+
+	~Terrain()
+	{
+		for (auto& entry : nodes)
+			releaseChunk(entry.second);
+
+		glDeleteBuffers(1, &EBO);
+	}
+
+private:
+	enum class ChunkState { Empty, Pending, Ready };
+
+	struct Node
+	{
+		int face, level, x, y;
+		ChunkState state = ChunkState::Empty;
+		unsigned int VAO = 0, VBO = 0;
+		unsigned long long lastUsedFrame = 0;
+		std::chrono::steady_clock::time_point requestTime;
+
+		glm::vec3 center;	// center on the undisplaced sphere
+		float boundRadius;
+		float angularSize;
+	};
+
+	struct ChunkData
+	{
+		uint64_t key;
+		std::vector<float> vertices;
+		double generationMs;
+	};
+
+	// Everything the workers touch lives here so that chunks still in flight outlive the terrain
+	struct SharedState
+	{
+		Heightmap heightmap;
+		std::mutex mutex;
+		std::vector<ChunkData> finished;
+
+		SharedState(const char* path) : heightmap(path) {}
+	};
+
+	const int maxPendingChunks = 64;
+	const int maxUploadsPerFrame = 8;
+	const float pixelError = 6.0f;
+
+	float radius, heightScale;
+	int resolution, maxDepth;
+	std::shared_ptr<SharedState> shared;
+
+	std::unordered_map<uint64_t, Node> nodes;
+	std::vector<const Node*> visible;
+
+	unsigned int EBO = 0;
+	size_t indexCount = 0;
+
+	unsigned long long frame = 0;
+	float pixelsPerRadian = 1.0f;
+	int pendingCount = 0, readyRoots = 0;
+	long long completedChunks = 0;
+
+	TerrainStats stats;
+
+	static uint64_t nodeKey(int face, int level, int x, int y)
+	{
+		return ((uint64_t)face << 61) | ((uint64_t)level << 56) | ((uint64_t)x << 28) | (uint64_t)y;
+	}
+
+	// Cube face point (a, b in [0, 1]) mapped onto the unit sphere with an area-preserving-ish warp
+	static glm::vec3 cubeToSphere(int face, float a, float b)
+	{
+		static const glm::vec3 normals[6] = { {1, 0, 0}, {-1, 0, 0}, {0, 1, 0}, {0, -1, 0}, {0, 0, 1}, {0, 0, -1} };
+		static const glm::vec3 uAxes[6] = { {0, 1, 0}, {0, -1, 0}, {-1, 0, 0}, {1, 0, 0}, {1, 0, 0}, {-1, 0, 0} };
+		static const glm::vec3 vAxes[6] = { {0, 0, 1}, {0, 0, 1}, {0, 0, 1}, {0, 0, 1}, {0, 1, 0}, {0, 1, 0} };
+
+		glm::vec3 p = normals[face] + (2.0f * a - 1.0f) * uAxes[face] + (2.0f * b - 1.0f) * vAxes[face];
+
+		float x2 = p.x * p.x, y2 = p.y * p.y, z2 = p.z * p.z;
+		return glm::vec3(
+			p.x * sqrtf(1.0f - y2 / 2.0f - z2 / 2.0f + y2 * z2 / 3.0f),
+			p.y * sqrtf(1.0f - z2 / 2.0f - x2 / 2.0f + z2 * x2 / 3.0f),
+			p.z * sqrtf(1.0f - x2 / 2.0f - y2 / 2.0f + x2 * y2 / 3.0f));
+	}
+
+	Node& getNode(int face, int level, int x, int y)
+	{
+		uint64_t key = nodeKey(face, level, x, y);
+		auto found = nodes.find(key);
+		if (found != nodes.end())
+			return found->second;
+
+		Node& node = nodes[key];
+		node.face = face;
+		node.level = level;
+		node.x = x;
+		node.y = y;
+
+		float size = 1.0f / (1 << level);
+		node.center = radius * cubeToSphere(face, (x + 0.5f) * size, (y + 0.5f) * size);
+		node.angularSize = (float)(PI / 2.0) * size;
+		node.boundRadius = radius * (node.angularSize * 0.75f + heightScale);
+
+		return node;
+	}
+
+	void visit(uint64_t key, const glm::vec3& cameraLocal)
+	{
+		Node& node = nodes[key];
+		node.lastUsedFrame = frame;
+
+		if (isBelowHorizon(node, cameraLocal))
+			return;
+
+		if (node.state == ChunkState::Empty)
+			requestChunk(key, node);
+
+		float distance = fmaxf(glm::length(cameraLocal - node.center) - node.boundRadius, radius * 1e-4f);
+		float spacing = radius * node.angularSize / (resolution - 1);
+		float screenError = spacing / distance * pixelsPerRadian;
+
+		if (node.level < maxDepth && screenError > pixelError)
+		{
+			uint64_t children[4];
+			bool childrenReady = true;
+			for (int i = 0; i < 4; i++)
+			{
+				Node& child = getNode(node.face, node.level + 1, node.x * 2 + (i & 1), node.y * 2 + (i >> 1));
+				child.lastUsedFrame = frame;
+				children[i] = nodeKey(child.face, child.level, child.x, child.y);
+
+				if (child.state == ChunkState::Empty)
+					requestChunk(children[i], child);
+				childrenReady = childrenReady && child.state == ChunkState::Ready;
+			}
+
+			// Draw this chunk until all four children are uploaded
+			if (childrenReady)
+			{
+				for (uint64_t child : children)
+					visit(child, cameraLocal);
+				return;
+			}
+		}
+
+		if (node.state == ChunkState::Ready)
+			visible.push_back(&node);
+	}
+
+	// Chunks completely behind the planet's horizon can't be seen
+	bool isBelowHorizon(const Node& node, const glm::vec3& cameraLocal) const
+	{
+		float cameraDistance = glm::length(cameraLocal);
+		if (cameraDistance <= radius)
+			return false;
+
+		float horizonAngle = acosf(radius / cameraDistance);
+		float chunkAngle = acosf(fmaxf(-1.0f, fminf(1.0f, glm::dot(cameraLocal / cameraDistance, node.center / radius))));
+
+		return chunkAngle > horizonAngle + node.angularSize + heightScale;
+	}
+
+	void requestChunk(uint64_t key, Node& node)
+	{
+		if (pendingCount >= maxPendingChunks)
+			return;
+
+		node.state = ChunkState::Pending;
+		node.requestTime = std::chrono::steady_clock::now();
+		pendingCount++;
+
+		std::shared_ptr<SharedState> state = shared;
+		float r = radius, hs = heightScale;
+		int res = resolution, face = node.face, level = node.level, x = node.x, y = node.y;
+
+		JobSystem::instance().submit([state, key, r, hs, res, face, level, x, y]()
+			{
+				auto start = std::chrono::steady_clock::now();
+
+				ChunkData chunk;
+				chunk.key = key;
+				buildChunk(state->heightmap, r, hs, res, face, level, x, y, chunk.vertices);
+				chunk.generationMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+				std::lock_guard<std::mutex> lock(state->mutex);
+				state->finished.push_back(std::move(chunk));
+			});
+	}
+
+	// Runs on a worker. Writes res*res grid vertices followed by 4*res skirt vertices (pos, normal, uv)
+	static void buildChunk(const Heightmap& heightmap, float radius, float heightScale, int res,
+		int face, int level, int nodeX, int nodeY, std::vector<float>& vertices)
+	{
+		float size = 1.0f / (1 << level);
+		float step = size / (res - 1);
+		float a0 = nodeX * size, b0 = nodeY * size;
+
+		// Grid with a one-sample border so the normals on chunk edges match the neighbours
+		int border = res + 2;
+		std::vector<glm::vec3> dirs(border * border), points(border * border);
+		for (int j = 0; j < border; j++)
+		{
+			for (int i = 0; i < border; i++)
+			{
+				glm::vec3 dir = cubeToSphere(face, a0 + (i - 1) * step, b0 + (j - 1) * step);
+				float h = heightmap.sample(dir) - 0.5f;
+
+				dirs[j * border + i] = dir;
+				points[j * border + i] = dir * radius * (1.0f + heightScale * h);
+			}
+		}
+
+		glm::vec3 centerDir = cubeToSphere(face, a0 + size * 0.5f, b0 + size * 0.5f);
+		float centerS = atan2f(centerDir.y, centerDir.x) / (2.0f * PI);
+		if (centerS < 0.0f) centerS += 1.0f;
+
+		float skirtDepth = radius * (heightScale + (float)(PI / 2.0) * step);
+
+		vertices.resize((size_t)(res * res + 4 * res) * 8);
+		float* out = vertices.data();
+
+		auto emit = [&](int i, int j, float drop)
+			{
+				int index = (j + 1) * border + (i + 1);
+				const glm::vec3& dir = dirs[index];
+
+				glm::vec3 normal = glm::normalize(glm::cross(points[index + 1] - points[index - 1], points[index + border] - points[index - border]));
+				if (glm::dot(normal, dir) < 0.0f)
+					normal = -normal;
+
+				glm::vec3 pos = points[index] - dir * drop;
+
+				// Texture coordinates match Sphere, shifted so a chunk never straddles the longitude seam
+				float s = atan2f(dir.y, dir.x) / (2.0f * PI);
+				if (s < 0.0f) s += 1.0f;
+				if (s - centerS > 0.5f) s -= 1.0f;
+				if (s - centerS < -0.5f) s += 1.0f;
+				float t = acosf(fmaxf(-1.0f, fminf(1.0f, dir.z))) / PI;
+
+				*out++ = pos.x; *out++ = pos.y; *out++ = pos.z;
+				*out++ = normal.x; *out++ = normal.y; *out++ = normal.z;
+				*out++ = s; *out++ = t;
+			};
+
+		for (int j = 0; j < res; j++)
+			for (int i = 0; i < res; i++)
+				emit(i, j, 0.0f);
+
+		// Skirts: bottom, top, left, right edges pulled down towards the planet center
+		for (int i = 0; i < res; i++) emit(i, 0, skirtDepth);
+		for (int i = 0; i < res; i++) emit(i, res - 1, skirtDepth);
+		for (int j = 0; j < res; j++) emit(0, j, skirtDepth);
+		for (int j = 0; j < res; j++) emit(res - 1, j, skirtDepth);
+	}
+
+	// Every chunk has the same topology, so all of them share one element buffer
+	void setupIndices()
+	{
+		std::vector<unsigned short> indices;
+		int res = resolution;
+
+		for (int j = 0; j < res - 1; j++)
+		{
+			for (int i = 0; i < res - 1; i++)
+			{
+				unsigned short k1 = j * res + i;
+				unsigned short k2 = k1 + res;
+
+				indices.insert(indices.end(), { k1, k2, (unsigned short)(k1 + 1) });
+				indices.insert(indices.end(), { (unsigned short)(k1 + 1), k2, (unsigned short)(k2 + 1) });
+			}
+		}
+
+		// Skirt strips, each edge vertex connected to its lowered copy
+		auto addSkirt = [&](int edgeStart, int edgeStride, int skirtStart)
+			{
+				for (int i = 0; i < res - 1; i++)
+				{
+					unsigned short e0 = edgeStart + i * edgeStride, e1 = edgeStart + (i + 1) * edgeStride;
+					unsigned short s0 = skirtStart + i, s1 = skirtStart + i + 1;
+
+					indices.insert(indices.end(), { e0, s0, e1 });
+					indices.insert(indices.end(), { e1, s0, s1 });
+				}
+			};
+
+		int skirts = res * res;
+		addSkirt(0, 1, skirts);
+		addSkirt((res - 1) * res, 1, skirts + res);
+		addSkirt(0, res, skirts + 2 * res);
+		addSkirt(res - 1, res, skirts + 3 * res);
+
+		indexCount = indices.size();
+
+		glGenBuffers(1, &EBO);
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+		glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned short), &indices[0], GL_STATIC_DRAW);
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+	}
+
+	// Uploads a bounded number of finished chunks per frame so generation bursts don't stall rendering
+	void uploadFinishedChunks()
+	{
+		std::vector<ChunkData> ready;
+		{
+			std::lock_guard<std::mutex> lock(shared->mutex);
+			size_t count = std::min(shared->finished.size(), (size_t)maxUploadsPerFrame);
+			ready.assign(std::make_move_iterator(shared->finished.begin()), std::make_move_iterator(shared->finished.begin() + count));
+			shared->finished.erase(shared->finished.begin(), shared->finished.begin() + count);
+		}
+
+		stats.uploadsLastFrame = (int)ready.size();
+		auto now = std::chrono::steady_clock::now();
+
+		for (ChunkData& chunk : ready)
+		{
+			pendingCount--;
+
+			// The node may have been pruned while the chunk was being built
+			auto found = nodes.find(chunk.key);
+			if (found == nodes.end() || found->second.state != ChunkState::Pending)
+				continue;
+
+			Node& node = found->second;
+
+			glGenVertexArrays(1, &node.VAO);
+			glGenBuffers(1, &node.VBO);
+
+			glBindVertexArray(node.VAO);
+
+			glBindBuffer(GL_ARRAY_BUFFER, node.VBO);
+			glBufferData(GL_ARRAY_BUFFER, chunk.vertices.size() * sizeof(float), &chunk.vertices[0], GL_STATIC_DRAW);
+
+			glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+
+			glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)0);
+			glEnableVertexAttribArray(0);
+			glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)(3 * sizeof(float)));
+			glEnableVertexAttribArray(1);
+			glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)(6 * sizeof(float)));
+			glEnableVertexAttribArray(2);
+
+			glBindVertexArray(0);
+
+			node.state = ChunkState::Ready;
+			if (node.level == 0)
+				readyRoots++;
+
+			// Running averages over every chunk built so far
+			double latency = std::chrono::duration<double, std::milli>(now - node.requestTime).count();
+			completedChunks++;
+			stats.avgGenerationMs += (chunk.generationMs - stats.avgGenerationMs) / completedChunks;
+			stats.avgLatencyMs += (latency - stats.avgLatencyMs) / completedChunks;
+			stats.maxLatencyMs = fmax(stats.maxLatencyMs, latency);
+			stats.loadedChunks++;
+		}
+	}
+
+	// Frees chunks that weren't reached by the last traversal, roots always stay resident
+	void pruneUnused()
+	{
+		for (auto it = nodes.begin(); it != nodes.end();)
+		{
+			if (it->second.level > 0 && it->second.lastUsedFrame + 30 < frame)
+			{
+				releaseChunk(it->second);
+				it = nodes.erase(it);
+			}
+			else
+				++it;
+		}
+	}
+
+	void releaseChunk(Node& node)
+	{
+		if (node.state == ChunkState::Ready)
+		{
+			glDeleteVertexArrays(1, &node.VAO);
+			glDeleteBuffers(1, &node.VBO);
+			stats.loadedChunks--;
+		}
+		node.state = ChunkState::Empty;
+	}
+};
+
+#endif
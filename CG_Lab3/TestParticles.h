@@ -0,0 +1,334 @@
+#ifndef TEST_PARTICLES_H
+#define TEST_PARTICLES_H
+
+#include <glm/glm.hpp>
+
+#include <vector>
+#include <chrono>
+#include <random>
+#include <cmath>
+#include <algorithm>
+#include <cstddef>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+#include "SimdMath.h"
+#include "JobSystem.h"
+#include "SolarSystem.h"
+#include "SceneScale.h"
+
+struct ParticleStats
+{
+	size_t particles = 0;
+	long long steps = 0;
+	double lastAdvanceMs = 0.0;				// all substeps of the newest advance
+	double lastSubsteps = 0.0;
+	double lagDays = 0.0;					// asked for but past the step budget in the newest advance
+
+	// From measure
+	double stepMs = 0.0;					// one step of every particle
+	double particleStepsPerSecond = 0.0;
+	double sceneMs = 0.0;					// writeScene
+	double maxOrbitError = 0.0;				// AU after a year around the Sun alone, against Kepler
+};
+
+// Massless particles in the restricted problem: they feel the Sun and a few sources (the planets)
+// whose positions come from outside, and pull on nothing. Heliocentric positions (AU) and
+// velocities (AU / day) in separate float arrays, stepped by kick-drift-kick leapfrog 8 particles
+// per AVX2 instruction, with the frame's acceleration towards the sources as the indirect term.
+// A block of particles stays in registers through all substeps of an advance, so memory is read
+// and written once per frame however many substeps it takes.
+class TestParticles
+{
+public:
+	// Steps are at most this long, under a 170th of Mercury's period
+	static constexpr double maxStepDays = 0.5;
+
+	// Particle steps one advance may take, a few milliseconds on a desktop's cores. When warp or
+	// scrubbing asks for more, the swarm moves as far as that many steps take it and the caller
+	// asks for the rest again later, so probes fall behind rather than take longer steps.
+	static constexpr double maxParticleSteps = 8388608.0;
+
+	// Softening keeps particles that pass through a planet from being flung away
+	explicit TestParticles(double centralGm, double softening = 1e-4)
+		: centralGm(centralGm), softening2(softening * softening)
+	{
+	}
+
+	size_t addSource(double gm)
+	{
+		sourceGm.push_back(gm);
+		return sourceGm.size() - 1;
+	}
+
+	void add(const glm::dvec3& position, const glm::dvec3& velocity)
+	{
+		// The first half kick feels only the Sun
+		glm::dvec3 acceleration = -position * (centralGm / std::pow(glm::dot(position, position), 1.5));
+
+		x.push_back((float)position.x); y.push_back((float)position.y); z.push_back((float)position.z);
+		vx.push_back((float)velocity.x); vy.push_back((float)velocity.y); vz.push_back((float)velocity.z);
+		ax.push_back((float)acceleration.x); ay.push_back((float)acceleration.y); az.push_back((float)acceleration.z);
+	}
+
+	void clear()
+	{
+		for (std::vector<float>* array : { &x, &y, &z, &vx, &vy, &vz, &ax, &ay, &az })
+			array->clear();
+	}
+
+	size_t size() const
+	{
+		return x.size();
+	}
+
+	glm::dvec3 getPosition(size_t i) const
+	{
+		return glm::dvec3(x[i], y[i], z[i]);
+	}
+
+	// Moves every particle days on, backwards when negative, while the sources move linearly from
+	// sourcesFrom to sourcesTo (heliocentric, one per addSource). Returns the days moved, fewer
+	// than asked when the steps would run over maxParticleSteps; the sources then only go as far
+	// along as the particles do.
+	double advance(double days, const glm::dvec3* sourcesFrom, const glm::dvec3* sourcesTo)
+	{
+		if (days == 0.0)
+			return 0.0;
+
+		auto begin = std::chrono::high_resolution_clock::now();
+
+		double budget = std::max(std::floor(maxParticleSteps / std::max<size_t>(size(), 1)), 1.0);
+		int substeps = (int)std::min(std::ceil(std::fabs(days) / maxStepDays), budget);
+		double moved = std::copysign(std::min(std::fabs(days), substeps * maxStepDays), days);
+		prepareSources(substeps, moved / days, sourcesFrom, sourcesTo);
+
+		float dt = (float)(moved / substeps);
+		size_t count = size();
+		size_t groups = (count + 7) / 8;
+
+		JobSystem::instance().parallelFor(groups, [&](size_t first, size_t last)
+			{
+				stepRange(8 * first, std::min(8 * last, count), substeps, dt);
+			});
+
+		stats.steps += substeps;
+		stats.lastSubsteps = substeps;
+		stats.lagDays = std::fabs(days - moved);
+		stats.lastAdvanceMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - begin).count();
+		return moved;
+	}
+
+	// Distances from the Sun for writeScene, see SceneScale
+	void setSceneRadii(const std::vector<glm::dvec2>& auToScene)
+	{
+		sceneScale.setRadii(auToScene);
+	}
+
+	// Scene positions, 3 floats per particle, rotated from the ecliptic like the bodies. Only
+	// written, so out can be a mapped buffer.
+	void writeScene(float* out) const
+	{
+		size_t count = size();
+		JobSystem::instance().parallelFor((count + 7) / 8, [&](size_t first, size_t last)
+			{
+				sceneScale.apply(x.data(), y.data(), z.data(), 8 * first, std::min(8 * last, count), out);
+			});
+	}
+
+	const ParticleStats& getStats()
+	{
+		stats.particles = size();
+		return stats;
+	}
+
+	// count particles on random orbits between Mercury and Jupiter among 10 fixed sources, one
+	// step each, then the error of 8 lone particles after a year of the longest steps
+	static ParticleStats measure(size_t count)
+	{
+		const double gmSun = SolarSystem::gmSun;
+		std::mt19937 random(3);
+		std::uniform_real_distribution<double> uniform(0.0, 1.0);
+
+		TestParticles particles(gmSun);
+		std::vector<glm::dvec3> sources;
+		for (int i = 0; i < 10; i++)
+		{
+			double r = 0.4 * std::pow(1.6, i), angle = 6.283185307179586 * uniform(random);
+			particles.addSource(gmSun * 1e-6 * (1 + i));
+			sources.push_back(glm::dvec3(r * std::cos(angle), r * std::sin(angle), 0.0));
+		}
+
+		for (size_t i = 0; i < count; i++)
+		{
+			double r = 0.4 + 4.8 * uniform(random), angle = 6.283185307179586 * uniform(random);
+			double speed = std::sqrt(gmSun / r);
+			particles.add(glm::dvec3(r * std::cos(angle), r * std::sin(angle), 0.01 * (uniform(random) - 0.5)),
+				glm::dvec3(-speed * std::sin(angle), speed * std::cos(angle), 0.0));
+		}
+
+		ParticleStats stats;
+		stats.particles = count;
+
+		// Once untimed, so the first run doesn't pay for starting workers
+		particles.advance(maxStepDays, sources.data(), sources.data());
+
+		const int runs = count < 100000 ? 100 : 10;
+		auto begin = std::chrono::high_resolution_clock::now();
+		for (int run = 0; run < runs; run++)
+			particles.advance(maxStepDays, sources.data(), sources.data());
+		stats.stepMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - begin).count() / runs;
+		stats.particleStepsPerSecond = count / (stats.stepMs * 1e-3);
+
+		particles.setSceneRadii({ { 1.0, 12.0 }, { 5.2, 19.5 } });
+		std::vector<float> scene(3 * count);
+		begin = std::chrono::high_resolution_clock::now();
+		for (int run = 0; run < runs; run++)
+			particles.writeScene(scene.data());
+		stats.sceneMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - begin).count() / runs;
+
+		TestParticles lone(gmSun);
+		std::vector<OrbitalElements> orbits;
+		for (int i = 0; i < 8; i++)
+		{
+			OrbitalElements elements = { 0.4 + 0.6 * i, 0.02 * i, 0.05 * i, 0.3 * i, 0.5 * i, 0.7 * i };
+			glm::dvec3 position, velocity;
+			KeplerPropagator::stateVector(elements, gmSun, 0.0, position, velocity);
+			lone.add(position, velocity);
+			orbits.push_back(elements);
+		}
+		for (int step = 0; step < 730; step++)
+			lone.advance(maxStepDays, nullptr, nullptr);
+
+		for (int i = 0; i < 8; i++)
+		{
+			glm::dvec3 position, velocity;
+			KeplerPropagator::stateVector(orbits[i], gmSun, 365.0, position, velocity);
+			stats.maxOrbitError = std::max(stats.maxOrbitError, glm::length(lone.getPosition(i) - position));
+		}
+
+		return stats;
+	}
+
+private:
+	double centralGm, softening2;
+	std::vector<double> sourceGm;
+
+	// Particle state, structure of arrays
+	std::vector<float> x, y, z, vx, vy, vz, ax, ay, az;
+
+	// Per substep, the sources at its end (x, y, z, gm) and the indirect acceleration
+	std::vector<float> substepSources;
+	std::vector<glm::vec3> indirect;
+
+	SceneScale sceneScale;
+
+	ParticleStats stats;
+
+	// Sources at the end of every substep, the last reach of the way from from to to
+	void prepareSources(int substeps, double reach, const glm::dvec3* from, const glm::dvec3* to)
+	{
+		size_t sources = sourceGm.size();
+		substepSources.resize(substeps * sources * 4);
+		indirect.resize(substeps);
+
+		for (int s = 0; s < substeps; s++)
+		{
+			double f = reach * (s + 1.0) / substeps;
+			glm::dvec3 frame(0.0);
+
+			for (size_t k = 0; k < sources; k++)
+			{
+				glm::dvec3 position = from[k] + (to[k] - from[k]) * f;
+				frame -= position * (sourceGm[k] / std::pow(glm::dot(position, position), 1.5));
+
+				float* source = &substepSources[(s * sources + k) * 4];
+				source[0] = (float)position.x;
+				source[1] = (float)position.y;
+				source[2] = (float)position.z;
+				source[3] = (float)sourceGm[k];
+			}
+			indirect[s] = glm::vec3(frame);
+		}
+	}
+
+	void stepRange(size_t first, size_t last, int substeps, float dt)
+	{
+		size_t sources = sourceGm.size();
+		float halfDt = 0.5f * dt;
+		size_t i = first;
+
+#if defined(__AVX2__)
+		const __m256 central = _mm256_set1_ps((float)centralGm), soft = _mm256_set1_ps((float)softening2);
+		const __m256 h = _mm256_set1_ps(dt), hh = _mm256_set1_ps(halfDt);
+
+		for (; i + 8 <= last; i += 8)
+		{
+			__m256 px = _mm256_loadu_ps(&x[i]), py = _mm256_loadu_ps(&y[i]), pz = _mm256_loadu_ps(&z[i]);
+			__m256 qx = _mm256_loadu_ps(&vx[i]), qy = _mm256_loadu_ps(&vy[i]), qz = _mm256_loadu_ps(&vz[i]);
+			__m256 gx = _mm256_loadu_ps(&ax[i]), gy = _mm256_loadu_ps(&ay[i]), gz = _mm256_loadu_ps(&az[i]);
+
+			for (int s = 0; s < substeps; s++)
+			{
+				qx = SimdMath::fmadd8(gx, hh, qx); qy = SimdMath::fmadd8(gy, hh, qy); qz = SimdMath::fmadd8(gz, hh, qz);
+				px = SimdMath::fmadd8(qx, h, px); py = SimdMath::fmadd8(qy, h, py); pz = SimdMath::fmadd8(qz, h, pz);
+
+				__m256 r2 = SimdMath::fmadd8(px, px, SimdMath::fmadd8(py, py, _mm256_mul_ps(pz, pz)));
+				__m256 pull = _mm256_mul_ps(central, SimdMath::inverseCube8(r2));
+				gx = SimdMath::fnmadd8(px, pull, _mm256_set1_ps(indirect[s].x));
+				gy = SimdMath::fnmadd8(py, pull, _mm256_set1_ps(indirect[s].y));
+				gz = SimdMath::fnmadd8(pz, pull, _mm256_set1_ps(indirect[s].z));
+
+				const float* source = substepSources.data() + s * sources * 4;
+				for (size_t k = 0; k < sources; k++, source += 4)
+				{
+					__m256 dx = _mm256_sub_ps(_mm256_set1_ps(source[0]), px);
+					__m256 dy = _mm256_sub_ps(_mm256_set1_ps(source[1]), py);
+					__m256 dz = _mm256_sub_ps(_mm256_set1_ps(source[2]), pz);
+					__m256 d2 = SimdMath::fmadd8(dx, dx, SimdMath::fmadd8(dy, dy, SimdMath::fmadd8(dz, dz, soft)));
+					__m256 gm = _mm256_mul_ps(_mm256_set1_ps(source[3]), SimdMath::inverseCube8(d2));
+					gx = SimdMath::fmadd8(dx, gm, gx); gy = SimdMath::fmadd8(dy, gm, gy); gz = SimdMath::fmadd8(dz, gm, gz);
+				}
+
+				qx = SimdMath::fmadd8(gx, hh, qx); qy = SimdMath::fmadd8(gy, hh, qy); qz = SimdMath::fmadd8(gz, hh, qz);
+			}
+
+			_mm256_storeu_ps(&x[i], px); _mm256_storeu_ps(&y[i], py); _mm256_storeu_ps(&z[i], pz);
+			_mm256_storeu_ps(&vx[i], qx); _mm256_storeu_ps(&vy[i], qy); _mm256_storeu_ps(&vz[i], qz);
+			_mm256_storeu_ps(&ax[i], gx); _mm256_storeu_ps(&ay[i], gy); _mm256_storeu_ps(&az[i], gz);
+		}
+#endif
+
+		for (; i < last; i++)
+		{
+			glm::vec3 p(x[i], y[i], z[i]), v(vx[i], vy[i], vz[i]), a(ax[i], ay[i], az[i]);
+
+			for (int s = 0; s < substeps; s++)
+			{
+				v += a * halfDt;
+				p += v * dt;
+
+				float r2 = glm::dot(p, p);
+				a = indirect[s] - p * (float)(centralGm / (r2 * std::sqrt(r2)));
+
+				const float* source = substepSources.data() + s * sources * 4;
+				for (size_t k = 0; k < sources; k++, source += 4)
+				{
+					glm::vec3 d = glm::vec3(source[0], source[1], source[2]) - p;
+					float d2 = glm::dot(d, d) + (float)softening2;
+					a += d * (source[3] / (d2 * std::sqrt(d2)));
+				}
+
+				v += a * halfDt;
+			}
+
+			x[i] = p.x; y[i] = p.y; z[i] = p.z;
+			vx[i] = v.x; vy[i] = v.y; vz[i] = v.z;
+			ax[i] = a.x; ay[i] = a.y; az[i] = a.z;
+		}
+	}
+};
+
+#endif
@@ -3,11 +3,78 @@
 
 #include <glad/glad.h>
 #include <iostream>
+#include <vector>
+#include <string>
+#include <map>
+#include <memory>
+#include <chrono>
+#include <stdexcept>
 #define STB_IMAGE_IMPLEMENTATION
 #include "stb_image.h"
 
+#include "JobSystem.h"
+
 class Texture {
 public:
+	// Decoded pixels, freed with the image
+	struct Image
+	{
+		unsigned char* data = nullptr;
+		int width = 0, height = 0, channels = 0;
+
+		~Image()
+		{
+			stbi_image_free(data);
+		}
+	};
+
+	// Starts decoding the images on the job system, the loads below then only wait for the ones
+	// still in flight instead of decoding everything one after another. Main thread only.
+	static void prefetch(const std::vector<std::string>& paths)
+	{
+		for (const std::string& path : paths)
+		{
+			if (decodes().count(path) != 0)
+				continue;
+
+			std::shared_ptr<Image> image = std::make_shared<Image>();
+			JobHandle job = JobSystem::instance().run([image, path]()
+				{
+					image->data = stbi_load(path.c_str(), &image->width, &image->height, &image->channels, 0);
+				});
+			decodes()[path] = { job, image };
+		}
+	}
+
+	// The prefetched image if there is one, helping with other jobs until it's decoded, otherwise
+	// decoded right here
+	static std::shared_ptr<Image> decode(const char* path)
+	{
+		auto found = decodes().find(path);
+		if (found != decodes().end())
+		{
+			PendingImage pending = found->second;
+			decodes().erase(found);
+
+			JobSystem::instance().wait(pending.job);
+			return pending.image;
+		}
+
+		std::shared_ptr<Image> image = std::make_shared<Image>();
+		image->data = stbi_load(path, &image->width, &image->height, &image->channels, 0);
+		return image;
+	}
+
+	// Milliseconds to decode the images as separate jobs, for measuring how it scales
+	static double measureDecode(const std::vector<std::string>& paths)
+	{
+		auto begin = std::chrono::high_resolution_clock::now();
+		prefetch(paths);
+		for (const std::string& path : paths)
+			decode(path.c_str());
+		return std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - begin).count();
+	}
+
 	static void loadTexture(const char* path, unsigned int &textureID)
 	{
 		glGenTextures(1, &textureID);
@@ -20,22 +87,20 @@ public:
 		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
 
 		// Load image using stb_image
-		int width, height, nrChannels;
-		unsigned char* data = stbi_load(path, &width, &height, &nrChannels, 0);
-		if (data)
+		std::shared_ptr<Image> image = decode(path);
+		if (image->data)
 		{
 			// Determine image format
-			GLenum format = (nrChannels == 3) ? GL_RGB : GL_RGBA;
+			GLenum format = (image->channels == 3) ? GL_RGB : GL_RGBA;
 
 			// Load texture data into OpenGL
-			glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, data);
+			glTexImage2D(GL_TEXTURE_2D, 0, format, image->width, image->height, 0, format, GL_UNSIGNED_BYTE, image->data);
 			glGenerateMipmap(GL_TEXTURE_2D);
 		}
 		else
 		{
 			std::cerr << "Failed to load texture at path: " << path << std::endl;
 		}
-		stbi_image_free(data);
 	}
 
 	static unsigned int loadCubemap(std::vector<std::string> faces)
@@ -44,22 +109,19 @@ public:
 		glGenTextures(1, &textureID);
 		glBindTexture(GL_TEXTURE_CUBE_MAP, textureID);
 
-		int width, height, nrChannels;
+		prefetch(faces);
 		for (unsigned int i = 0; i < faces.size(); i++)
 		{
-			unsigned char* data = stbi_load(faces[i].c_str(), &width, &height,
-				&nrChannels, 0);
-			if (data)
+			std::shared_ptr<Image> image = decode(faces[i].c_str());
+			if (image->data)
 			{
 				glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, 0, GL_RGB,
-					width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, data);
-				stbi_image_free(data);
+					image->width, image->height, 0, GL_RGB, GL_UNSIGNED_BYTE, image->data);
 			}
 			else
 			{
 				std::cout << "Cubemap failed to load at path: " << faces[i]
 					<< std::endl;
-				stbi_image_free(data);
 			}
 		}
 		glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
@@ -76,13 +138,15 @@ public:
 
 	static std::vector<glm::vec4> sampleTextureColors(const char* texturePath, int numSegments)
 	{
-		int width, height, channels;
-		unsigned char* data = stbi_load(texturePath, &width, &height, &channels, 0);
-		if (!data)
+		std::shared_ptr<Image> image = decode(texturePath);
+		if (!image->data)
 		{
 			throw std::runtime_error("Failed to load texture.");
 		}
 
+		const unsigned char* data = image->data;
+		int width = image->width, channels = image->channels;
+
 		std::vector<glm::vec4> colors(numSegments);
 		for (int i = 0; i < numSegments; ++i)
 		{
@@ -100,14 +164,25 @@ public:
 			colors[i] = glm::vec4(r, g, b, a);
 		}
 
-		stbi_image_free(data);
-
 		/*for (const auto& color : colors) {
 			std::cout << "Color: " << color.r << ", " << color.g << ", " << color.b << ", " << color.a << "\n";
 		}*/
 
 		return colors;
 	}
+
+private:
+	struct PendingImage
+	{
+		JobHandle job;
+		std::shared_ptr<Image> image;
+	};
+
+	static std::map<std::string, PendingImage>& decodes()
+	{
+		static std::map<std::string, PendingImage> pending;
+		return pending;
+	}
 };
 
 #endif
\ No newline at end of file
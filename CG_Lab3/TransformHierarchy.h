@@ -0,0 +1,292 @@
+#ifndef TRANSFORM_HIERARCHY_H
+#define TRANSFORM_HIERARCHY_H
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <vector>
+#include <chrono>
+#include <cstring>
+#include <cstdint>
+#include <cstddef>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+#include "SimdMath.h"
+#include "JobSystem.h"
+
+struct HierarchyStats
+{
+	size_t nodes = 0;
+	double allDirtyMs = 0.0;		// every local transform changed
+	double oneSubtreeMs = 0.0;		// one planet in a hundred moved, with everything below it
+	double cleanMs = 0.0;			// nothing changed
+};
+
+// Parent-relative transforms of scene nodes (bodies, their spin, rings, moons of moons, spacecraft)
+// in flat arrays sorted depth first. Every parent comes before its children and a subtree is the
+// range [index, index + subtreeSize), so world matrices are one forward pass that recomputes the
+// subtrees of dirty nodes and jumps over everything else. Transforms are stored as the three rows
+// of an affine matrix, which is all a scene node needs and a quarter less memory to stream through.
+class TransformHierarchy
+{
+public:
+	// Ids stay valid when nodes are inserted or removed before them, indices don't
+	typedef uint32_t NodeId;
+	static constexpr NodeId none = UINT32_MAX;
+
+	// Inserted at the end of the parent's subtree, which is the end of the arrays when a scene is
+	// built depth first. Other insertions shift the nodes after it.
+	NodeId add(NodeId parentNode, const glm::mat4& local = glm::mat4(1.0f))
+	{
+		size_t position = parentNode == none ? size() : indexOf[parentNode] + subtreeSize[indexOf[parentNode]];
+
+		NodeId id = (NodeId)indexOf.size();
+		indexOf.push_back((uint32_t)position);
+
+		// Nodes after the insertion move up one, and so do references to them
+		for (size_t i = position; i < size(); i++)
+			indexOf[idOf[i]]++;
+		for (size_t i = position; i < size(); i++)
+			if (parent[i] >= (int32_t)position)
+				parent[i]++;
+
+		parent.insert(parent.begin() + position, parentNode == none ? -1 : (int32_t)indexOf[parentNode]);
+		subtreeSize.insert(subtreeSize.begin() + position, 1);
+		dirty.insert(dirty.begin() + position, 1);
+		localMatrices.insert(localMatrices.begin() + position, Affine(local));
+		worldMatrices.insert(worldMatrices.begin() + position, Affine(local));
+		idOf.insert(idOf.begin() + position, id);
+
+		for (int32_t ancestor = parent[position]; ancestor >= 0; ancestor = parent[ancestor])
+			subtreeSize[ancestor]++;
+
+		return id;
+	}
+
+	// Removes the node and everything below it, a spacecraft leaving the scene
+	void remove(NodeId node)
+	{
+		size_t first = indexOf[node], count = subtreeSize[first];
+
+		for (int32_t ancestor = parent[first]; ancestor >= 0; ancestor = parent[ancestor])
+			subtreeSize[ancestor] -= (uint32_t)count;
+
+		for (size_t i = first; i < first + count; i++)
+			indexOf[idOf[i]] = UINT32_MAX;
+		for (size_t i = first + count; i < size(); i++)
+		{
+			indexOf[idOf[i]] -= (uint32_t)count;
+			if (parent[i] >= (int32_t)(first + count))
+				parent[i] -= (int32_t)count;
+		}
+
+		parent.erase(parent.begin() + first, parent.begin() + first + count);
+		subtreeSize.erase(subtreeSize.begin() + first, subtreeSize.begin() + first + count);
+		dirty.erase(dirty.begin() + first, dirty.begin() + first + count);
+		localMatrices.erase(localMatrices.begin() + first, localMatrices.begin() + first + count);
+		worldMatrices.erase(worldMatrices.begin() + first, worldMatrices.begin() + first + count);
+		idOf.erase(idOf.begin() + first, idOf.begin() + first + count);
+	}
+
+	void setLocal(NodeId node, const glm::mat4& local)
+	{
+		size_t index = indexOf[node];
+		localMatrices[index] = Affine(local);
+		dirty[index] = 1;
+	}
+
+	glm::mat4 getLocal(NodeId node) const
+	{
+		return localMatrices[indexOf[node]].toMat4();
+	}
+
+	// As of the last update
+	glm::mat4 getWorld(NodeId node) const
+	{
+		return worldMatrices[indexOf[node]].toMat4();
+	}
+
+	size_t size() const
+	{
+		return parent.size();
+	}
+
+	// Brings the world matrices of dirty subtrees up to date, returns how many were recomputed
+	size_t update()
+	{
+		size_t n = size(), updated = 0, i = 0;
+		while (i < n)
+		{
+			const void* next = std::memchr(dirty.data() + i, 1, n - i);
+			if (next == nullptr)
+				break;
+
+			i = (const uint8_t*)next - dirty.data();
+			updateSubtree(i);
+
+			updated += subtreeSize[i];
+			i += subtreeSize[i];
+		}
+
+		return updated;
+	}
+
+	// Update times for about nodeCount nodes: 100 planets with a spin and a ring node each and 30
+	// moons, each of those with 10 moons of its own carrying a spacecraft
+	static HierarchyStats measureUpdate(size_t nodeCount)
+	{
+		TransformHierarchy scene;
+		std::vector<NodeId> planets;
+
+		NodeId root = scene.add(none, glm::rotate(glm::mat4(1.0f), glm::radians(-90.0f), glm::vec3(1.0f, 0.0f, 0.0f)));
+		while (scene.size() < nodeCount)
+		{
+			NodeId planet = scene.add(root, glm::translate(glm::mat4(1.0f), glm::vec3((float)planets.size(), 0.0f, 0.0f)));
+			planets.push_back(planet);
+			scene.add(planet, glm::rotate(glm::mat4(1.0f), 0.1f, glm::vec3(0.0f, 0.0f, 1.0f)));
+			scene.add(planet);
+
+			for (int m = 0; m < 30 && scene.size() < nodeCount; m++)
+			{
+				NodeId moon = scene.add(planet, glm::translate(glm::mat4(1.0f), glm::vec3(0.0f, 0.1f * m, 0.0f)));
+				scene.add(moon, glm::rotate(glm::mat4(1.0f), 0.2f, glm::vec3(0.0f, 0.0f, 1.0f)));
+
+				for (int s = 0; s < 10 && scene.size() < nodeCount; s++)
+				{
+					NodeId subMoon = scene.add(moon, glm::translate(glm::mat4(1.0f), glm::vec3(0.01f * s, 0.0f, 0.0f)));
+					scene.add(subMoon, glm::rotate(glm::mat4(1.0f), 0.3f, glm::vec3(0.0f, 0.0f, 1.0f)));
+					scene.add(subMoon, glm::translate(glm::mat4(1.0f), glm::vec3(0.0f, 0.0f, 0.001f)));
+				}
+			}
+		}
+
+		HierarchyStats stats;
+		stats.nodes = scene.size();
+		const int runs = 20;
+
+		auto timeUpdates = [&](auto&& change)
+			{
+				double total = 0.0;
+				for (int run = 0; run < runs; run++)
+				{
+					change();
+					auto begin = std::chrono::high_resolution_clock::now();
+					scene.update();
+					total += std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - begin).count();
+				}
+				return total / runs;
+			};
+
+		stats.allDirtyMs = timeUpdates([&]() { std::memset(scene.dirty.data(), 1, scene.size()); });
+		stats.oneSubtreeMs = timeUpdates([&]()
+			{
+				for (size_t p = 0; p < planets.size(); p += 100)
+					scene.setLocal(planets[p], scene.getLocal(planets[p]));
+			});
+		stats.cleanMs = timeUpdates([]() {});
+		return stats;
+	}
+
+private:
+	// Subtrees at least this large have their children's subtrees updated in parallel
+	static constexpr size_t parallelNodes = 4096;
+
+	// Top three rows of a matrix whose last row is (0, 0, 0, 1)
+	struct Affine
+	{
+		glm::vec4 rows[3];
+
+		Affine() = default;
+
+		explicit Affine(const glm::mat4& m)
+		{
+			for (int r = 0; r < 3; r++)
+				rows[r] = glm::vec4(m[0][r], m[1][r], m[2][r], m[3][r]);
+		}
+
+		glm::mat4 toMat4() const
+		{
+			glm::mat4 m(1.0f);
+			for (int r = 0; r < 3; r++)
+				for (int c = 0; c < 4; c++)
+					m[c][r] = rows[r][c];
+			return m;
+		}
+	};
+
+	// By index, in depth-first order
+	std::vector<int32_t> parent;
+	std::vector<uint32_t> subtreeSize;
+	std::vector<uint8_t> dirty;
+	std::vector<Affine> localMatrices, worldMatrices;
+	std::vector<NodeId> idOf;
+
+	// By id
+	std::vector<uint32_t> indexOf;
+
+	void updateNode(size_t index)
+	{
+		if (parent[index] < 0)
+			worldMatrices[index] = localMatrices[index];
+		else
+			multiply(worldMatrices[parent[index]], localMatrices[index], worldMatrices[index]);
+		dirty[index] = 0;
+	}
+
+	// The node, then its children's subtrees, which only read the node's world matrix
+	void updateSubtree(size_t first)
+	{
+		size_t end = first + subtreeSize[first];
+		updateNode(first);
+
+		if (end - first < parallelNodes)
+		{
+			for (size_t i = first + 1; i < end; i++)
+				updateNode(i);
+			return;
+		}
+
+		std::vector<size_t> children;
+		for (size_t child = first + 1; child < end; child += subtreeSize[child])
+			children.push_back(child);
+
+		JobSystem::instance().parallelFor(children.size(), 1, [&](size_t begin, size_t last)
+			{
+				for (size_t c = begin; c < last; c++)
+					updateSubtree(children[c]);
+			});
+	}
+
+	// out = a * b, each row of out is a's row weighting b's rows, plus a's translation
+	static void multiply(const Affine& a, const Affine& b, Affine& out)
+	{
+#if defined(__AVX2__)
+		const float* pa = &a.rows[0][0];
+		const float* pb = &b.rows[0][0];
+		float* po = &out.rows[0][0];
+
+		__m128 b0 = _mm_loadu_ps(pb), b1 = _mm_loadu_ps(pb + 4), b2 = _mm_loadu_ps(pb + 8);
+		__m128 translation = _mm_castsi128_ps(_mm_set_epi32(-1, 0, 0, 0));
+		for (int r = 0; r < 3; r++)
+		{
+			const float* row = pa + 4 * r;
+			__m128 result = _mm_and_ps(_mm_loadu_ps(row), translation);
+			result = SimdMath::fmadd4(_mm_set1_ps(row[0]), b0, result);
+			result = SimdMath::fmadd4(_mm_set1_ps(row[1]), b1, result);
+			result = SimdMath::fmadd4(_mm_set1_ps(row[2]), b2, result);
+			_mm_storeu_ps(po + 4 * r, result);
+		}
+#else
+		for (int r = 0; r < 3; r++)
+		{
+			const glm::vec4& row = a.rows[r];
+			out.rows[r] = b.rows[0] * row.x + b.rows[1] * row.y + b.rows[2] * row.z + glm::vec4(0.0f, 0.0f, 0.0f, row.w);
+		}
+#endif
+	}
+};
+
+#endif
@@ -0,0 +1,50 @@
+#ifndef TRIPLE_BUFFER_H
+#define TRIPLE_BUFFER_H
+
+#include <atomic>
+#include <cstdint>
+
+// One writer and one reader hand over whole values without locks or waiting. Each side owns a slot
+// and the third is swapped through an atomic, with a bit saying whether it holds something newer.
+// The writer never blocks the reader and the reader always gets the newest published value.
+template<typename T>
+class TripleBuffer
+{
+public:
+	// Writer: fill back() completely, then publish it
+	T& back()
+	{
+		return slots[backIndex];
+	}
+
+	void publish()
+	{
+		backIndex = shared.exchange((uint8_t)(backIndex | freshBit), std::memory_order_acq_rel) & indexMask;
+	}
+
+	// Reader: takes the newest published value if there is one, returns whether front() changed
+	bool update()
+	{
+		if ((shared.load(std::memory_order_relaxed) & freshBit) == 0)
+			return false;
+
+		frontIndex = shared.exchange(frontIndex, std::memory_order_acq_rel) & indexMask;
+		return true;
+	}
+
+	const T& front() const
+	{
+		return slots[frontIndex];
+	}
+
+private:
+	static constexpr uint8_t indexMask = 3;
+	static constexpr uint8_t freshBit = 4;
+
+	T slots[3];
+	std::atomic<uint8_t> shared{ 1 };
+	uint8_t backIndex = 0;
+	uint8_t frontIndex = 2;
+};
+
+#endif
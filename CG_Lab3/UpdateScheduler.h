@@ -0,0 +1,160 @@
+#ifndef UPDATE_SCHEDULER_H
+#define UPDATE_SCHEDULER_H
+
+#include <glm/glm.hpp>
+
+#include <vector>
+#include <chrono>
+#include <random>
+#include <cmath>
+#include <cstddef>
+
+// When a body's position was last evaluated, and the motion to carry it on with until the next time
+struct ScheduleComponent
+{
+	float lastTime = 0.0f, nextTime = 0.0f;
+	glm::vec3 position = glm::vec3(0.0f), velocity = glm::vec3(0.0f);
+
+	// A velocity needs a second evaluation after the first
+	bool sampled = false;
+	bool forced = true;
+};
+
+struct ScheduleStats
+{
+	size_t bodies = 0;
+	double everyFrameMs = 0.0;			// per frame, every body evaluated
+	double scheduledMs = 0.0;			// per frame, evaluated when due and extrapolated otherwise
+	double evaluationsPerFrame = 0.0;	// on average, when scheduled
+	double maxErrorPixels = 0.0;		// extrapolated against evaluated positions
+};
+
+// Temporal level of detail: a body is evaluated again once it could have moved maxPixels on screen,
+// from its speed and distance to the camera, and extrapolated linearly in between. Outer planets
+// seen from afar go seconds between evaluations, Mercury up close gets one every frame.
+// Intervals are in render time, so warp and pause need no special cases.
+class UpdateScheduler
+{
+public:
+	// Extrapolating over this much motion stays a fraction of a pixel off
+	static constexpr float maxPixels = 2.0f;
+
+	// Bounds the extrapolation along curved orbits of bodies that barely move on screen
+	static constexpr float maxInterval = 2.0f;
+
+	static bool due(const ScheduleComponent& schedule, float time)
+	{
+		return schedule.forced || time >= schedule.nextTime || time < schedule.lastTime;
+	}
+
+	// Records a freshly evaluated position, distance is from the camera and pixelsPerRadian the
+	// viewport height over the tangent of the field of view
+	static void sample(ScheduleComponent& schedule, const glm::vec3& position, float time, float distance, float pixelsPerRadian)
+	{
+		bool hadSample = schedule.sampled;
+		if (hadSample && time > schedule.lastTime)
+			schedule.velocity = (position - schedule.position) / (time - schedule.lastTime);
+
+		schedule.position = position;
+		schedule.lastTime = time;
+		schedule.sampled = true;
+		schedule.forced = false;
+
+		float pixelsPerSecond = glm::length(schedule.velocity) / fmaxf(distance, 1e-3f) * pixelsPerRadian;
+		float interval = pixelsPerSecond > maxPixels / maxInterval ? maxPixels / pixelsPerSecond : maxInterval;
+		schedule.nextTime = hadSample ? time + interval : time;
+	}
+
+	static glm::vec3 position(const ScheduleComponent& schedule, float time)
+	{
+		return schedule.position + schedule.velocity * (time - schedule.lastTime);
+	}
+
+	static float pixelsPerRadian(float viewportHeight, float fovY)
+	{
+		return viewportHeight / (2.0f * tanf(fovY * 0.5f));
+	}
+
+	// count bodies on Kepler orbits from 3 to 45 units at the scene's speeds, seen from 70 units
+	// away, over 10 seconds at 60 frames per second. Every evaluation solves Kepler's equation.
+	static ScheduleStats measure(size_t count)
+	{
+		std::mt19937 random(11);
+		std::uniform_real_distribution<float> uniform(0.0f, 1.0f);
+
+		std::vector<float> radii(count), eccentricities(count), rates(count), phases(count);
+		for (size_t i = 0; i < count; i++)
+		{
+			radii[i] = 3.0f + 42.0f * uniform(random);
+			eccentricities[i] = 0.2f * uniform(random);
+			rates[i] = 0.2f * powf(12.0f / radii[i], 1.5f);
+			phases[i] = 6.2831853f * uniform(random);
+		}
+
+		auto evaluate = [&](size_t i, float time)
+			{
+				float meanAnomaly = phases[i] + rates[i] * time, e = eccentricities[i], anomaly = meanAnomaly;
+				for (int iteration = 0; iteration < 6; iteration++)
+					anomaly -= (anomaly - e * sinf(anomaly) - meanAnomaly) / (1.0f - e * cosf(anomaly));
+
+				return glm::vec3(radii[i] * (cosf(anomaly) - e), 0.0f, -radii[i] * sqrtf(1.0f - e * e) * sinf(anomaly));
+			};
+
+		const glm::vec3 camera(0.0f, 0.0f, 70.0f);
+		const float perRadian = pixelsPerRadian(600.0f, glm::radians(45.0f));
+		const int frames = 600;
+
+		ScheduleStats stats;
+		stats.bodies = count;
+		std::vector<glm::vec3> positions(count);
+
+		auto begin = std::chrono::high_resolution_clock::now();
+		for (int frame = 0; frame < frames; frame++)
+		{
+			for (size_t i = 0; i < count; i++)
+				positions[i] = evaluate(i, frame / 60.0f);
+		}
+		stats.everyFrameMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - begin).count() / frames;
+
+		std::vector<ScheduleComponent> schedules(count);
+		size_t evaluations = 0;
+
+		begin = std::chrono::high_resolution_clock::now();
+		for (int frame = 0; frame < frames; frame++)
+		{
+			float time = frame / 60.0f;
+			for (size_t i = 0; i < count; i++)
+			{
+				if (due(schedules[i], time))
+				{
+					positions[i] = evaluate(i, time);
+					sample(schedules[i], positions[i], time, glm::length(positions[i] - camera), perRadian);
+					evaluations++;
+				}
+				else
+					positions[i] = position(schedules[i], time);
+			}
+		}
+		stats.scheduledMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - begin).count() / frames;
+		stats.evaluationsPerFrame = (double)evaluations / frames;
+
+		// Again untimed, extrapolations against the truth on every tenth frame
+		schedules.assign(count, ScheduleComponent());
+		for (int frame = 0; frame < frames; frame++)
+		{
+			float time = frame / 60.0f;
+			for (size_t i = 0; i < count; i++)
+			{
+				glm::vec3 exact = evaluate(i, time);
+				if (due(schedules[i], time))
+					sample(schedules[i], exact, time, glm::length(exact - camera), perRadian);
+				else if (frame % 10 == 0)
+					stats.maxErrorPixels = fmax(stats.maxErrorPixels, glm::length(position(schedules[i], time) - exact) / glm::length(exact - camera) * perRadian);
+			}
+		}
+
+		return stats;
+	}
+};
+
+#endif
@@ -0,0 +1,287 @@
+#ifndef WISDOM_HOLMAN_H
+#define WISDOM_HOLMAN_H
+
+#include <glm/glm.hpp>
+
+#include <vector>
+#include <cmath>
+#include <cstddef>
+
+#include "JobSystem.h"
+
+// Symplectic mapping for planetary systems (Wisdom & Holman 1991) in democratic heliocentric
+// coordinates (Duncan, Levison & Lee 1998): positions relative to the central body, barycentric
+// velocities. The Hamiltonian splits into Kepler motion around the central body, solved exactly
+// with universal variables, the planets' pull on each other as kicks, and the central body's
+// reflex motion as a drift, composed kick-jump-drift-jump-kick. The energy error stays bounded at
+// steps of days, a twentieth of the shortest period is enough.
+// The first body added is the central one. Units as NBodySystem's, masses as G * m.
+class WisdomHolmanIntegrator
+{
+public:
+	size_t addBody(double gm, glm::dvec3 position, glm::dvec3 velocity)
+	{
+		mass.push_back(gm);
+		inertialPositions.push_back(position);
+		inertialVelocities.push_back(velocity);
+
+		started = false;
+		return mass.size() - 1;
+	}
+
+	size_t size() const
+	{
+		return mass.size();
+	}
+
+	double getTime() const
+	{
+		return time;
+	}
+
+	glm::dvec3 getPosition(size_t i)
+	{
+		toInertial();
+		return inertialPositions[i];
+	}
+
+	glm::dvec3 getVelocity(size_t i)
+	{
+		toInertial();
+		return inertialVelocities[i];
+	}
+
+	void step(double dt)
+	{
+		if (!started)
+			start();
+
+		kick(0.5 * dt);
+		jump(0.5 * dt);
+		drift(dt);
+		jump(0.5 * dt);
+		kick(0.5 * dt);
+
+		time += dt;
+		inertialCurrent = false;
+	}
+
+	// Steps of at most maxStep, the last one shortened to land on targetTime
+	void advanceTo(double targetTime, double maxStep)
+	{
+		double remaining = targetTime - time;
+		if (remaining <= 0.0)
+			return;
+
+		long long steps = (long long)std::ceil(remaining / maxStep);
+		double dt = remaining / steps;
+		for (long long i = 0; i < steps; i++)
+			step(dt);
+	}
+
+	double totalEnergy()
+	{
+		toInertial();
+
+		size_t n = size();
+		double kinetic = 0.0, potential = 0.0;
+		for (size_t i = 0; i < n; i++)
+		{
+			kinetic += 0.5 * mass[i] * glm::dot(inertialVelocities[i], inertialVelocities[i]);
+			for (size_t j = i + 1; j < n; j++)
+				potential -= mass[i] * mass[j] / glm::length(inertialPositions[j] - inertialPositions[i]);
+		}
+
+		return kinetic + potential;
+	}
+
+	// Position and velocity after dt on the Kepler orbit around gm, any eccentricity
+	static void keplerDrift(double gm, double dt, glm::dvec3& position, glm::dvec3& velocity)
+	{
+		double r0 = glm::length(position);
+		double eta = glm::dot(position, velocity);
+		double beta = 2.0 * gm / r0 - glm::dot(velocity, velocity);
+
+		// Whole revolutions of bound orbits change nothing
+		if (beta > 0.0)
+			dt = std::remainder(dt, 6.283185307179586 * gm / (beta * std::sqrt(beta)));
+
+		// Universal anomaly s from r0 G1 + eta G2 + gm G3 = dt, by Halley's method
+		double s = dt / r0, g1 = 0.0, g2 = 0.0, g3 = 0.0, r = r0;
+		for (int iteration = 0; iteration < 30; iteration++)
+		{
+			double c2, c3;
+			stumpff(beta * s * s, c2, c3);
+
+			g1 = s * (1.0 - beta * s * s * c3);
+			g2 = s * s * c2;
+			g3 = s * s * s * c3;
+			double g0 = 1.0 - beta * g2;
+
+			double f = r0 * g1 + eta * g2 + gm * g3 - dt;
+			r = r0 * g0 + eta * g1 + gm * g2;
+			double rPrime = eta * g0 + (gm - beta * r0) * g1;
+
+			double ds = f / r;
+			ds = f / (r - 0.5 * ds * rPrime);
+			s -= ds;
+
+			if (std::fabs(ds) <= 1e-15 * std::fabs(s))
+				break;
+		}
+
+		double c2, c3;
+		stumpff(beta * s * s, c2, c3);
+		g1 = s * (1.0 - beta * s * s * c3);
+		g2 = s * s * c2;
+		g3 = s * s * s * c3;
+		r = r0 * (1.0 - beta * g2) + eta * g1 + gm * g2;
+
+		double f = 1.0 - gm * g2 / r0, g = dt - gm * g3;
+		double fDot = -gm * g1 / (r * r0), gDot = 1.0 - gm * g2 / r;
+
+		glm::dvec3 p = position;
+		position = p * f + velocity * g;
+		velocity = p * fDot + velocity * gDot;
+	}
+
+private:
+	std::vector<double> mass;
+
+	// As added and on demand
+	std::vector<glm::dvec3> inertialPositions, inertialVelocities;
+	bool inertialCurrent = true;
+
+	// Heliocentric positions and barycentric velocities of every body but the central one (index 0 unused)
+	std::vector<glm::dvec3> positions, velocities;
+	glm::dvec3 centreOfMass, centreVelocity;
+	double totalMass = 0.0;
+
+	double time = 0.0;
+	bool started = false;
+
+	// c2(x) and c3(x) by their series near zero, closed forms elsewhere
+	static void stumpff(double x, double& c2, double& c3)
+	{
+		if (std::fabs(x) < 0.1)
+		{
+			c2 = 0.5; c3 = 1.0 / 6.0;
+			double term2 = 0.5, term3 = 1.0 / 6.0;
+			for (int k = 1; k < 8; k++)
+			{
+				term2 *= -x / ((2 * k + 1) * (2 * k + 2));
+				term3 *= -x / ((2 * k + 2) * (2 * k + 3));
+				c2 += term2;
+				c3 += term3;
+			}
+			return;
+		}
+
+		if (x > 0.0)
+		{
+			double root = std::sqrt(x);
+			c2 = (1.0 - std::cos(root)) / x;
+			c3 = (root - std::sin(root)) / (x * root);
+		}
+		else
+		{
+			double root = std::sqrt(-x);
+			c2 = (std::cosh(root) - 1.0) / -x;
+			c3 = (std::sinh(root) - root) / (-x * root);
+		}
+	}
+
+	void start()
+	{
+		size_t n = size();
+		totalMass = 0.0;
+		centreOfMass = centreVelocity = glm::dvec3(0.0);
+		for (size_t i = 0; i < n; i++)
+		{
+			totalMass += mass[i];
+			centreOfMass += mass[i] * inertialPositions[i];
+			centreVelocity += mass[i] * inertialVelocities[i];
+		}
+		centreOfMass /= totalMass;
+		centreVelocity /= totalMass;
+
+		positions.assign(n, glm::dvec3(0.0));
+		velocities.assign(n, glm::dvec3(0.0));
+		for (size_t i = 1; i < n; i++)
+		{
+			positions[i] = inertialPositions[i] - inertialPositions[0];
+			velocities[i] = inertialVelocities[i] - centreVelocity;
+		}
+
+		inertialCurrent = true;
+		started = true;
+	}
+
+	void toInertial()
+	{
+		if (inertialCurrent || !started)
+			return;
+
+		// The centre of mass moves on uniformly
+		size_t n = size();
+		glm::dvec3 weighted(0.0), momentum(0.0);
+		for (size_t i = 1; i < n; i++)
+		{
+			weighted += mass[i] * positions[i];
+			momentum += mass[i] * velocities[i];
+		}
+
+		glm::dvec3 centre = centreOfMass + centreVelocity * time - weighted / totalMass;
+		inertialPositions[0] = centre;
+		inertialVelocities[0] = centreVelocity - momentum / mass[0];
+		for (size_t i = 1; i < n; i++)
+		{
+			inertialPositions[i] = positions[i] + centre;
+			inertialVelocities[i] = velocities[i] + centreVelocity;
+		}
+
+		inertialCurrent = true;
+	}
+
+	// The planets' pull on each other
+	void kick(double dt)
+	{
+		size_t n = size();
+		for (size_t i = 1; i < n; i++)
+		{
+			for (size_t j = i + 1; j < n; j++)
+			{
+				glm::dvec3 d = positions[j] - positions[i];
+				double r2 = glm::dot(d, d);
+				d *= dt / (r2 * std::sqrt(r2));
+
+				velocities[i] += mass[j] * d;
+				velocities[j] -= mass[i] * d;
+			}
+		}
+	}
+
+	// The central body's motion, shared by all heliocentric positions
+	void jump(double dt)
+	{
+		size_t n = size();
+		glm::dvec3 momentum(0.0);
+		for (size_t i = 1; i < n; i++)
+			momentum += mass[i] * velocities[i];
+
+		glm::dvec3 shift = momentum * (dt / mass[0]);
+		for (size_t i = 1; i < n; i++)
+			positions[i] += shift;
+	}
+
+	void drift(double dt)
+	{
+		JobSystem::instance().parallelFor(size() - 1, [&](size_t first, size_t last)
+			{
+				for (size_t i = first + 1; i < last + 1; i++)
+					keplerDrift(mass[0], dt, positions[i], velocities[i]);
+			});
+	}
+};
+
+#endif